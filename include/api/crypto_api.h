@@ -0,0 +1,19 @@
+#ifndef API_CRYPTO_API_H
+#define API_CRYPTO_API_H
+
+#include <JavaScriptCore/JavaScript.h>
+
+struct Hasher;
+
+JSValueRef crypto_create_hash(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str);
+
+JSValueRef fs_hash_file(JSContextRef ctx, JSObjectRef js_fn,
+                        JSObjectRef this_obj, size_t argc,
+                        const JSValueRef args[], JSValueRef *js_err_str);
+
+// native hasher behind a crypto.createHash() object, NULL for other values
+struct Hasher *to_hasher(JSContextRef ctx, JSValueRef value);
+
+#endif
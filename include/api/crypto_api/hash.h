@@ -0,0 +1,63 @@
+#ifndef CRYPTO_API_HASH_H
+#define CRYPTO_API_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_MAX_DIGEST_SIZE 32
+
+typedef enum { HASH_SHA256, HASH_CRC32C, HASH_XXH64 } hash_algorithm;
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t length; // bytes hashed so far
+  uint8_t block[64];
+  size_t block_length;
+} Sha256Context;
+
+// only for protocols that still call for it, e.g. the WebSocket handshake
+typedef struct {
+  uint32_t state[5];
+  uint64_t length;
+  uint8_t block[64];
+  size_t block_length;
+} Sha1Context;
+
+typedef struct {
+  uint64_t acc[4];
+  uint64_t length;
+  uint8_t block[32];
+  size_t block_length;
+} Xxh64Context;
+
+typedef struct Hasher {
+  hash_algorithm algorithm;
+  union {
+    Sha256Context sha256;
+    uint32_t crc32c;
+    Xxh64Context xxh64;
+  } ctx;
+} Hasher;
+
+// accepts "sha256", "crc32c" and "xxh64", false if unknown
+bool hasher_init(Hasher *hasher, const char *algorithm_name);
+void hasher_update(Hasher *hasher, const void *data, size_t length);
+// writes the digest to `out` and returns its length in bytes
+size_t hasher_digest(const Hasher *hasher, uint8_t *out);
+
+void sha256_init(Sha256Context *ctx);
+void sha256_update(Sha256Context *ctx, const uint8_t *data, size_t length);
+void sha256_final(const Sha256Context *ctx, uint8_t out[32]);
+
+void sha1_init(Sha1Context *ctx);
+void sha1_update(Sha1Context *ctx, const uint8_t *data, size_t length);
+void sha1_final(const Sha1Context *ctx, uint8_t out[20]);
+
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t length);
+
+void xxh64_init(Xxh64Context *ctx);
+void xxh64_update(Xxh64Context *ctx, const uint8_t *data, size_t length);
+uint64_t xxh64_digest(const Xxh64Context *ctx);
+
+#endif
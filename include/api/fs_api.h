@@ -21,4 +21,7 @@ JSValueRef fs_read_file_async(JSContextRef ctx, JSObjectRef js_fn,
 
 char *read_file(const char *filename);
 
+// maps node-style flags ("r", "w", "a+", ...) to open(2) flags, -1 if unknown
+int to_open_flags(const char *flags);
+
 #endif
@@ -1,6 +1,8 @@
 #ifndef API_HTTP_API_H
 #define API_HTTP_API_H
 
+#include "api/net_api.h"
+
 #include <JavaScriptCore/JavaScript.h>
 
 JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
@@ -15,4 +17,13 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef js_fn,
                               JSObjectRef this_obj, size_t argc,
                               const JSValueRef args[], JSValueRef *js_err_str);
 
+JSValueRef http_serve_static(JSContextRef ctx, JSObjectRef js_fn,
+                             JSObjectRef this_obj, size_t argc,
+                             const JSValueRef args[], JSValueRef *js_err_str);
+
+// net.broadcast() to a WebSocket or to a response streaming chunks (e.g.
+// server-sent events), BROADCAST_UNKNOWN for other values
+BroadcastResult http_broadcast_to(JSContextRef ctx, JSValueRef target,
+                                  Broadcast *broadcast);
+
 #endif
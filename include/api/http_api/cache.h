@@ -0,0 +1,65 @@
+#ifndef API_HTTP_API_CACHE_H
+#define API_HTTP_API_CACHE_H
+
+#include "api/streams_api/queue.h"
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// one cached response: the status line and headers without the Connection
+// header or the blank line, which depend on the request, then the body.
+// Writes still queued on a socket hold their own reference to the bytes
+typedef struct CacheEntry {
+  char *key;
+  size_t key_length;
+  uint32_t hash;
+  SharedBuffer *response;
+  size_t head_length;
+  uint64_t fresh_until; // loop time
+  uint64_t stale_until; // served while one request refreshes it
+  bool refreshing;
+  struct CacheEntry *bucket_next;
+  struct CacheEntry *newer; // LRU list, `newest` is the last one used
+  struct CacheEntry *older;
+} CacheEntry;
+
+typedef struct {
+  CacheEntry *buckets[HTTP_CACHE_BUCKETS];
+  CacheEntry *newest;
+  CacheEntry *oldest;
+  size_t bytes; // keys, responses and entries, kept under max_bytes
+  size_t max_bytes;
+  uint64_t ttl_ms;
+  uint64_t stale_ms;
+  char *vary[HTTP_CACHE_MAX_VARY]; // request headers that are part of the key
+  size_t vary_count;
+} ResponseCache;
+
+ResponseCache *response_cache_create(size_t max_bytes, uint64_t ttl_ms,
+                                     uint64_t stale_ms);
+void response_cache_free(ResponseCache *cache);
+bool response_cache_add_vary(ResponseCache *cache, const char *name);
+
+// the entry as it is, even if expired
+CacheEntry *response_cache_find(ResponseCache *cache, const char *key,
+                                size_t key_length);
+
+// a fresh or stale entry, marked as the most recently used; entries past
+// their stale window are dropped and NULL is returned
+CacheEntry *response_cache_get(ResponseCache *cache, const char *key,
+                               size_t key_length, uint64_t now);
+
+// takes over the caller's reference to `response`, releasing it when the
+// response doesn't fit the budget. Older entries are evicted to make room
+bool response_cache_put(ResponseCache *cache, const char *key,
+                        size_t key_length, SharedBuffer *response,
+                        size_t head_length, uint64_t now);
+
+// whether a response's "Name: value\r\n" header lines allow sharing it:
+// no Set-Cookie, no private/no-store/no-cache, and a Vary within the key
+bool response_cache_storable(const ResponseCache *cache, const char *headers,
+                             size_t length);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef API_HTTP_API_MULTIPART_H
+#define API_HTTP_API_MULTIPART_H
+
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// one part's Content-Disposition and Content-Type, only valid in on_part
+typedef struct {
+  const char *name;         // the form field, "" when missing
+  const char *filename;     // NULL for a plain field
+  const char *content_type; // NULL when not given
+} MultipartPart;
+
+typedef struct {
+  void (*on_part)(void *user_data, const MultipartPart *part);
+  void (*on_data)(void *user_data, const char *data, size_t length);
+  void (*on_part_end)(void *user_data);
+} MultipartCallbacks;
+
+typedef enum {
+  MULTIPART_INCOMPLETE, // needs more of the body
+  MULTIPART_DONE,       // past the closing delimiter, the rest is ignored
+  MULTIPART_ERROR,
+} MultipartResult;
+
+// a multipart/form-data decoder fed the body as it arrives. Part bodies are
+// scanned for "\r\n--boundary" with Horspool's skip table, so a large file
+// is mostly stepped over a delimiter's length at a time
+typedef struct {
+  char delimiter[4 + MULTIPART_MAX_BOUNDARY];
+  size_t delimiter_length;
+  unsigned char shift[256];
+
+  // the end of the last input that might start a delimiter
+  char carry[4 + MULTIPART_MAX_BOUNDARY];
+  size_t carry_length;
+
+  int state;
+  bool in_part;
+  char headers[MULTIPART_MAX_HEADER_SIZE + 1];
+  size_t headers_length;
+} MultipartParser;
+
+// false when `boundary` is empty or too long
+bool multipart_parser_init(MultipartParser *parser, const char *boundary,
+                           size_t length);
+
+MultipartResult multipart_parser_execute(MultipartParser *parser,
+                                         const char *data, size_t length,
+                                         const MultipartCallbacks *callbacks,
+                                         void *user_data);
+
+// whether the closing delimiter has been seen
+bool multipart_parser_done(const MultipartParser *parser);
+
+// the boundary parameter of a multipart/form-data Content-Type, false when
+// it is some other type or has none
+bool multipart_boundary(const char *content_type, size_t length,
+                        const char **boundary_out, size_t *boundary_length_out);
+
+#endif
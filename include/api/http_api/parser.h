@@ -0,0 +1,76 @@
+#ifndef API_HTTP_API_PARSER_H
+#define API_HTTP_API_PARSER_H
+
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a run of bytes in the connection buffer, kept as an offset so the buffer
+// can grow while the rest of the request is still arriving. Requests are
+// capped well below 4 GiB, and 32 bits halve every parked connection's
+// header table
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+} HttpSpan;
+
+typedef struct {
+  HttpSpan name;
+  HttpSpan value;
+} HttpHeader;
+
+typedef enum {
+  HTTP_PARSE_INCOMPLETE, // needs more bytes, call again once they arrive
+  HTTP_PARSE_DONE,       // the request's head, or its whole body
+  HTTP_PARSE_ERROR,      // answer with `error_status` and close
+} HttpParseResult;
+
+typedef struct {
+  int state;
+  size_t position; // next byte to scan
+  size_t mark;     // start of the token being scanned
+
+  HttpSpan method;
+  HttpSpan url;
+  int version_minor; // HTTP/1.x
+  HttpHeader headers[HTTP_MAX_HEADERS];
+  size_t header_count;
+
+  size_t content_length;
+  bool has_content_length;
+  bool chunked;
+  bool keep_alive;
+  size_t body_remaining; // of the body, or of the current chunk
+  int chunk_size_digits;
+
+  int error_status;
+} HttpParser;
+
+void http_parser_init(HttpParser *parser);
+
+// resumes scanning at `position`; `data` holds the request from its first
+// byte and `length` is how much of it has been read so far. DONE once the
+// headers are in, `position` is then where the body starts
+HttpParseResult http_parser_execute(HttpParser *parser, const char *data,
+                                    size_t length);
+
+// decodes the Content-Length or chunked body from `position`, handing each
+// run of payload bytes to `on_data`. Everything before `position` has been
+// used afterwards, so the caller may drop it and move `position` back
+HttpParseResult http_parser_execute_body(
+    HttpParser *parser, const char *data, size_t length,
+    void (*on_data)(void *user_data, const char *data, size_t length),
+    void *user_data);
+
+// whether the headers are complete and body bytes are still to come
+bool http_parser_in_body(const HttpParser *parser);
+
+// case-insensitive header lookup, NULL when the request doesn't have it
+const HttpHeader *http_parser_find_header(const HttpParser *parser,
+                                          const char *data, const char *name);
+
+bool http_span_equals(const char *data, HttpSpan span, const char *literal);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef API_HTTP_API_ROUTER_H
+#define API_HTTP_API_ROUTER_H
+
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// compressed radix tree over route patterns. Static runs are shared between
+// routes, ":name" matches one path segment and a trailing "*" the rest
+typedef struct RouteHandler {
+  char *method; // "*" for any method
+  void *data;
+  struct RouteHandler *next;
+} RouteHandler;
+
+typedef struct RouteNode {
+  char *prefix; // static text, empty for the root and param/wildcard nodes
+  size_t prefix_length;
+  struct RouteNode **children; // static children, distinct first bytes
+  size_t child_count;
+  struct RouteNode *param_child;
+  char *param_name;
+  struct RouteNode *wildcard_child;
+  RouteHandler *handlers;
+} RouteNode;
+
+typedef struct {
+  RouteNode *root;
+  size_t route_count;
+} Router;
+
+typedef struct {
+  const char *name; // owned by the router
+  size_t offset;    // into the matched path, no copy is made
+  size_t length;
+} RouteParam;
+
+typedef enum {
+  ROUTE_FOUND,
+  ROUTE_NOT_FOUND,
+  ROUTE_METHOD_NOT_ALLOWED, // paths matched, none of them took the method
+} RouteResult;
+
+typedef struct {
+  void *data;
+  RouteParam params[HTTP_MAX_ROUTE_PARAMS];
+  size_t param_count;
+  // handlers of each route the path matched, for a 405's Allow header
+  const RouteHandler *allowed[HTTP_MAX_ROUTE_CANDIDATES];
+  size_t allowed_count;
+} RouteMatch;
+
+void router_init(Router *router);
+
+// false for malformed patterns and param name conflicts; a route added
+// twice replaces the earlier handler, whose data goes to `replaced`
+bool router_add(Router *router, const char *method, const char *pattern,
+                void *data, void **replaced);
+
+RouteResult router_match(const Router *router, const char *method,
+                         size_t method_length, const char *path,
+                         size_t path_length, RouteMatch *match);
+
+void router_free(Router *router, void (*release)(void *data, void *context),
+                 void *context);
+
+#endif
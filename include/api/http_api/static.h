@@ -0,0 +1,67 @@
+#ifndef API_HTTP_API_STATIC_H
+#define API_HTTP_API_STATIC_H
+
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+// what a response needs from stat(), copied out of the cache per request
+typedef struct {
+  uint64_t size;
+  bool is_directory;
+  char etag[HTTP_STATIC_VALIDATOR_SIZE];
+  char last_modified[HTTP_STATIC_VALIDATOR_SIZE];
+} StaticStat;
+
+typedef struct {
+  char *path; // NULL for an empty slot
+  StaticStat stat;
+  uint64_t checked_at; // loop time of the stat
+} StaticCacheEntry;
+
+// one http.serveStatic() root. Its stat cache is direct-mapped, so it stays
+// bounded, and is cleared whenever the watcher sees the tree change
+typedef struct {
+  char *root;
+  double max_age; // seconds, for Cache-Control
+  StaticCacheEntry cache[HTTP_STATIC_CACHE_SIZE];
+  uv_fs_event_t *watcher;
+} StaticRoot;
+
+typedef enum {
+  STATIC_RANGE_NONE,          // serve the whole file
+  STATIC_RANGE_SATISFIABLE,   // 206 for [start, end]
+  STATIC_RANGE_UNSATISFIABLE, // 416
+} StaticRangeResult;
+
+StaticRoot *static_root_create(uv_loop_t *loop, const char *root,
+                               double max_age);
+void static_root_free(StaticRoot *root);
+
+// joins the percent-decoded url path onto the root; false for paths that
+// would leave it or don't fit `out`
+bool static_resolve_path(const StaticRoot *root, const char *url_path,
+                         size_t length, char *out, size_t out_size);
+
+// NULL when missing or older than HTTP_STATIC_STAT_TTL_MS
+const StaticStat *static_cache_get(StaticRoot *root, const char *path,
+                                   uint64_t now);
+void static_cache_put(StaticRoot *root, const char *path,
+                      const uv_stat_t *stat, uint64_t now, StaticStat *out);
+
+const char *static_mime_type(const char *path);
+
+// If-None-Match wins over If-Modified-Since; NULL for an absent header
+bool static_is_not_modified(const StaticStat *stat, const char *if_none_match,
+                            size_t if_none_match_length,
+                            const char *if_modified_since,
+                            size_t if_modified_since_length);
+
+StaticRangeResult static_parse_range(const char *value, size_t length,
+                                     uint64_t size, uint64_t *start,
+                                     uint64_t *end);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef API_HTTP_API_WEBSOCKET_H
+#define API_HTTP_API_WEBSOCKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+  WEBSOCKET_CONTINUATION = 0x0,
+  WEBSOCKET_TEXT = 0x1,
+  WEBSOCKET_BINARY = 0x2,
+  WEBSOCKET_CLOSE = 0x8,
+  WEBSOCKET_PING = 0x9,
+  WEBSOCKET_PONG = 0xa,
+};
+
+enum {
+  WEBSOCKET_CLOSE_NORMAL = 1000,
+  WEBSOCKET_CLOSE_PROTOCOL_ERROR = 1002,
+  WEBSOCKET_CLOSE_NO_STATUS = 1005, // reported, never sent
+  WEBSOCKET_CLOSE_ABNORMAL = 1006,  // the connection dropped without one
+  WEBSOCKET_CLOSE_INVALID_DATA = 1007,
+  WEBSOCKET_CLOSE_TOO_BIG = 1009,
+};
+
+#define WEBSOCKET_MAX_HEADER_SIZE 14
+#define WEBSOCKET_MAX_CONTROL_PAYLOAD 125
+#define WEBSOCKET_ACCEPT_KEY_SIZE 29 // 28 base64 characters and a NUL
+
+typedef struct {
+  bool fin;
+  int opcode;
+  bool masked;
+  uint8_t mask[4];
+  uint64_t payload_length;
+} WebSocketFrame;
+
+// parses the frame header at `data`. Returns its length, 0 until all of it
+// has arrived, or -1 when it breaks the protocol: reserved bits or opcodes,
+// or a control frame that is fragmented or too long
+int websocket_parse_header(const char *data, size_t length,
+                           WebSocketFrame *frame);
+
+// writes the header of an unmasked, unfragmented server frame to `out`,
+// which has room for WEBSOCKET_MAX_HEADER_SIZE bytes, and returns its length
+size_t websocket_frame_header(uint8_t *out, int opcode, uint64_t length);
+
+// copies payload bytes to `dest` unmasking them, `offset` is how far into
+// the payload `src` starts so a frame can arrive in pieces. `dest` may be
+// `src`
+void websocket_unmask(char *dest, const char *src, size_t length,
+                      const uint8_t mask[4], uint64_t offset);
+
+bool websocket_valid_utf8(const char *data, size_t length);
+
+// decodes text that passed websocket_valid_utf8, NULs included, into `dest`
+// with room for `length` units. Returns how many UTF-16 units it wrote
+size_t websocket_utf8_to_utf16(uint16_t *dest, const char *data,
+                               size_t length);
+
+// Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+void websocket_accept_key(const char *key, size_t key_length,
+                          char out[WEBSOCKET_ACCEPT_KEY_SIZE]);
+
+#endif
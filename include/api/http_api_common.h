@@ -5,6 +5,7 @@
 #include <uv.h>
 
 void http_write_complete(uv_write_t *req, int status);
+const char *http_status_text(int status);
 void http_alloc_buffer(uv_handle_t *handle, size_t suggested_size,
                        uv_buf_t *buf);
 
@@ -1,16 +1,46 @@
 #ifndef API_NET_API_H
 #define API_NET_API_H
 
+#include "api/streams_api/queue.h"
+
 #include <JavaScriptCore/JavaScript.h>
+#include <stdbool.h>
 
 JSValueRef net_create_server(JSContextRef ctx, JSObjectRef js_fn,
                              JSObjectRef this_obj, size_t argc,
                              const JSValueRef args[], JSValueRef *js_err_str);
 
+JSValueRef net_connect(JSContextRef ctx, JSObjectRef js_fn,
+                       JSObjectRef this_obj, size_t argc,
+                       const JSValueRef args[], JSValueRef *js_err_str);
+
 JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef js_fn,
                              JSObjectRef this_obj, size_t argc,
                              const JSValueRef args[], JSValueRef *js_err_str);
 
+// one net.broadcast() call. The payload is serialized at most once for each
+// framing its subscribers need, and every socket's write shares that copy
+typedef struct {
+  SharedBuffer *raw;             // as given, for net sockets
+  SharedBuffer *websocket_frame; // one message, made on first use
+  SharedBuffer *http_chunk;      // one chunk of a streaming response
+  bool binary; // bytes rather than a string, for the WebSocket opcode
+  size_t high_watermark; // queued bytes that make a subscriber slow
+  bool drop_slow;        // close slow subscribers rather than skip them
+} Broadcast;
+
+typedef enum {
+  BROADCAST_SENT,
+  BROADCAST_SKIPPED, // slow, this payload isn't queued for it
+  BROADCAST_DROPPED, // slow, and closed
+  BROADCAST_CLOSED,  // already gone, or not something that can be sent to
+  BROADCAST_UNKNOWN, // not a socket the module asked knows about
+} BroadcastResult;
+
+JSValueRef net_broadcast(JSContextRef ctx, JSObjectRef js_fn,
+                         JSObjectRef this_obj, size_t argc,
+                         const JSValueRef args[], JSValueRef *js_err_str);
+
 JSValueRef client_write(JSContextRef ctx, JSObjectRef js_fn,
                         JSObjectRef this_obj, size_t argc,
                         const JSValueRef args[], JSValueRef *js_err_str);
@@ -10,6 +10,13 @@
 
 // Queue structure is defined in api/streams_api/queue.h
 struct StreamQueue;
+// Line splitter is defined in api/streams_api/lines.h
+struct LineSplitter;
+// Hasher is defined in api/crypto_api/hash.h
+struct Hasher;
+// Shared buffer is defined in api/streams_api/queue.h
+struct SharedBuffer;
+struct WritableStreamState;
 
 typedef struct {
   uv_fs_t fs_req;
@@ -23,17 +30,37 @@ typedef struct {
   struct StreamQueue *queue;
   size_t high_watermark;
   size_t chunk_size;
+  struct LineSplitter *line_splitter; // emits arrays of lines when set
+  size_t batch_size;                  // max lines per array, 0 = per chunk
+  size_t lines_read;
+  bool parse_json;                    // emit parsed NDJSON records, not lines
+  bool binary;                        // emit Uint8Array chunks, not strings
+  struct Hasher *tap_hasher;          // sees every chunk read, see tap()
+  JSObjectRef tap_obj;
+  JSObjectRef next_resolve; // pending next() from async iteration
+  JSObjectRef next_reject;
+  struct WritableStreamState **pipe_dests; // native fan-out, see pipeMany()
+  size_t pipe_count;
+
+  // set for a stream fed by readable_stream_push() rather than a file, it is
+  // told whether the consumer wants more so the source can stop reading
+  void (*pull)(void *source, bool more);
+  void *source;
 
   bool flowing;
   bool ended;
+  bool end_emitted;
+  bool end_pending; // 'end' came before any listener, the first one gets it
   bool reading;
+  JSValueRef error; // set once opening or reading failed, rejects next()
   off_t file_position;
+  off_t end_position; // inclusive, -1 to read until EOF
   char *path; // for error messages
   
   uv_buf_t read_buffer; // for current read operation
 } ReadableStreamState;
 
-typedef struct {
+typedef struct WritableStreamState {
   uv_fs_t fs_req;
   uv_file fd;
   JSContextRef ctx;
@@ -45,19 +72,82 @@ typedef struct {
   struct StreamQueue *queue;
   size_t high_watermark;
 
+  // native upstream of pipeMany(), told when this stream drains
+  void (*on_drain)(void *data);
+  void *on_drain_data;
+
+  // native owner or pipeMany() upstream, told once everything is written and
+  // the file closed, or once the file couldn't be opened or written (`failed`)
+  void (*on_finish)(void *data);
+  void *on_finish_data;
+
   bool needs_drain;
   bool ended;
+  bool finished;
+  bool failed;
   bool writing;
   char *path; // for error messages
   
   uv_buf_t write_buffer; // for current write operation
 } WritableStreamState;
 
+// parses the "encoding" option ("utf8" or "buffer") shared by byte streams
+bool to_stream_encoding(JSContextRef ctx, JSValueRef options,
+                        bool default_binary, bool *binary_out,
+                        JSValueRef *js_err_str);
+
+// wires source 'data'/'end' to dest write()/end() with drain backpressure
+JSValueRef pipe_streams(JSContextRef ctx, JSObjectRef source, JSObjectRef dest,
+                        JSValueRef *js_err_str);
+
+// the state behind a fs.createWriteStream() object, NULL for other values
+WritableStreamState *to_writable_stream(JSContextRef ctx, JSValueRef value);
+
+// fs.createWriteStream() for native callers, the object starts out protected
+WritableStreamState *create_write_stream(JSContextRef ctx, const char *path,
+                                         int open_flags, size_t high_watermark);
+
+// queues a shared chunk without copying, false once past the high watermark
+bool writable_stream_write_shared(WritableStreamState *state,
+                                  struct SharedBuffer *buffer);
+
+// takes ownership of `data`, false once past the high watermark
+bool writable_stream_write_bytes(WritableStreamState *state, char *data,
+                                 size_t length);
+
+void writable_stream_finish(WritableStreamState *state);
+
+// a binary stream whose chunks come from native code, e.g. a request body,
+// with the same pause/resume/pipe behaviour as a file stream
+ReadableStreamState *create_pushed_stream(JSContextRef ctx,
+                                          void (*pull)(void *source, bool more),
+                                          void *source);
+
+// takes ownership of `data`, which must have a spare byte past `length`
+void readable_stream_push(ReadableStreamState *state, char *data,
+                          size_t length);
+
+void readable_stream_push_end(ReadableStreamState *state);
+
+// emits 'error' and stops the stream, nothing more is pushed after it
+void readable_stream_push_error(ReadableStreamState *state,
+                                const char *message);
+
 JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
                                   JSObjectRef this_obj, size_t argc,
                                   const JSValueRef args[],
                                   JSValueRef *js_err_str);
 
+JSValueRef fs_create_line_reader(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str);
+
+JSValueRef fs_create_ndjson_reader(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str);
+
 JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef js_fn,
                                    JSObjectRef this_obj, size_t argc,
                                    const JSValueRef args[],
@@ -77,11 +167,31 @@ JSValueRef readable_stream_resume(JSContextRef ctx, JSObjectRef js_fn,
                                    const JSValueRef args[],
                                    JSValueRef *js_err_str);
 
+JSValueRef readable_stream_next(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str);
+
+JSValueRef readable_stream_return(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str);
+
+JSValueRef readable_stream_tap(JSContextRef ctx, JSObjectRef js_fn,
+                                JSObjectRef this_obj, size_t argc,
+                                const JSValueRef args[],
+                                JSValueRef *js_err_str);
+
 JSValueRef readable_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
                                  JSObjectRef this_obj, size_t argc,
                                  const JSValueRef args[],
                                  JSValueRef *js_err_str);
 
+JSValueRef readable_stream_pipe_many(JSContextRef ctx, JSObjectRef js_fn,
+                                      JSObjectRef this_obj, size_t argc,
+                                      const JSValueRef args[],
+                                      JSValueRef *js_err_str);
+
 JSValueRef writable_stream_write(JSContextRef ctx, JSObjectRef js_fn,
                                   JSObjectRef this_obj, size_t argc,
                                   const JSValueRef args[],
@@ -0,0 +1,26 @@
+#ifndef STREAMS_API_LINES_H
+#define STREAMS_API_LINES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// called once per complete line, `line` is NUL-terminated without its newline
+typedef void (*line_handler)(char *line, size_t length, void *user_data);
+
+typedef struct LineSplitter {
+  char *partial; // carried over from the previous chunk
+  size_t partial_length;
+  size_t partial_capacity;
+  size_t max_line_length; // bytes before the newline
+} LineSplitter;
+
+void line_splitter_init(LineSplitter *splitter, size_t max_line_length);
+// false once a line is longer than max_line_length or can't be buffered, the
+// lines before it have been handed out and the partial line is dropped
+bool line_splitter_feed(LineSplitter *splitter, char *data, size_t length,
+                        line_handler handler, void *user_data);
+void line_splitter_flush(LineSplitter *splitter, line_handler handler,
+                         void *user_data);
+void line_splitter_free(LineSplitter *splitter);
+
+#endif
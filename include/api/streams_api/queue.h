@@ -3,9 +3,17 @@
 
 #include <stddef.h>
 
+// one chunk queued on several streams at once, freed on the last release
+typedef struct SharedBuffer {
+  char *data;
+  size_t length;
+  unsigned refs;
+} SharedBuffer;
+
 typedef struct StreamChunk {
   char *data;
   size_t length;
+  SharedBuffer *shared; // set when `data` belongs to a shared buffer
   struct StreamChunk *next;
 } StreamChunk;
 
@@ -15,10 +23,23 @@ typedef struct StreamQueue {
   size_t total_size;
 } StreamQueue;
 
+// NULL when out of memory, `data` is then still the caller's
+SharedBuffer *shared_buffer_create(char *data, size_t length);
+void shared_buffer_retain(SharedBuffer *buffer);
+void shared_buffer_release(SharedBuffer *buffer);
+
 void stream_queue_init(StreamQueue *queue);
 void stream_queue_enqueue(StreamQueue *queue, char *data, size_t length);
+// queues `buffer` without copying it, holding a reference until dequeued
+void stream_queue_enqueue_shared(StreamQueue *queue, SharedBuffer *buffer);
 StreamChunk *stream_queue_dequeue(StreamQueue *queue);
+// empties the queue into one NUL-terminated buffer; a lone chunk is handed
+// over without copying, so chunks must have a spare byte past `length` and
+// must not be shared
+char *stream_queue_take_all(StreamQueue *queue, size_t *length_out);
 void stream_queue_free(StreamQueue *queue);
 int stream_queue_is_empty(StreamQueue *queue);
+// frees a dequeued chunk, releasing its shared buffer if it has one
+void stream_chunk_free(StreamChunk *chunk);
 
 #endif
\ No newline at end of file
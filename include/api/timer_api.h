@@ -1,10 +1,12 @@
 #ifndef API_TIMER_API_H
 #define API_TIMER_API_H
 
+#include "core/libuv.h"
+
 #include <JavaScriptCore/JavaScript.h>
 #include <stdint.h>
 
-extern uint32_t next_timer_id;
+extern THREAD_LOCAL uint32_t next_timer_id;
 
 JSValueRef js_set_timeout(JSContextRef ctx, JSObjectRef js_fn,
                           JSObjectRef this_obj, size_t argc,
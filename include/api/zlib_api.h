@@ -0,0 +1,24 @@
+#ifndef API_ZLIB_API_H
+#define API_ZLIB_API_H
+
+#include <JavaScriptCore/JavaScript.h>
+
+JSValueRef zlib_create_gzip(JSContextRef ctx, JSObjectRef js_fn,
+                            JSObjectRef this_obj, size_t argc,
+                            const JSValueRef args[], JSValueRef *js_err_str);
+
+JSValueRef zlib_create_gunzip(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str);
+
+JSValueRef zlib_create_deflate(JSContextRef ctx, JSObjectRef js_fn,
+                               JSObjectRef this_obj, size_t argc,
+                               const JSValueRef args[],
+                               JSValueRef *js_err_str);
+
+JSValueRef zlib_create_inflate(JSContextRef ctx, JSObjectRef js_fn,
+                               JSObjectRef this_obj, size_t argc,
+                               const JSValueRef args[],
+                               JSValueRef *js_err_str);
+
+#endif
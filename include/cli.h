@@ -13,6 +13,8 @@ typedef enum {
 typedef struct {
   command_type cmd;
   char *arg;
+  int cluster_workers; // --cluster=N, 0 to run in this process
+  const char *error;
 } parse_result;
 
 parse_result parse_args(int argc, char **argv);
@@ -7,20 +7,82 @@
 
 // Limits
 #define MAX_FILE_SIZE 1024    // bytes
-#define TCP_LISTEN_BACKLOG 10 // pending connections
+#define TCP_LISTEN_BACKLOG 511 // pending connections, servers can override
+#define SOCKET_KEEPALIVE_DELAY_MS 60000 // keepAlive without an initial delay
+#define SOCKET_FASTOPEN_QUEUE 256 // pending fast open requests for fastOpen: true
 #define MAX_TIMER_STATES 1024 // active timers
 #define MODULE_CACHE_SIZE 64  // hashtable buckets
 
 // Stream limits
 #define STREAM_CHUNK_SIZE 4096 // 4 KiB
 #define STREAM_HIGH_WATERMARK 16384 // 16 KiB
+#define STREAM_MAX_CHUNK_SIZE (64 * 1024 * 1024) // one read's buffer
+#define STREAM_MAX_OFFSET 9007199254740991.0 // 2^53 - 1, exact as a double
+#define LINE_READER_CHUNK_SIZE 65536 // 64 KiB
+#define LINE_READER_MAX_LINE_LENGTH (16 * 1024 * 1024) // 'error' past it
+#define ZLIB_OUTPUT_CHUNK_SIZE 16384 // 16 KiB, grows as needed
+#define HASH_FILE_CHUNK_SIZE 65536 // 64 KiB
 #define MAX_STREAM_QUEUE_SIZE 32
+#define STREAM_MAX_PIPE_DESTS 1024 // pipeMany() destinations
+
+// HTTP server limits
+#define HTTP_MAX_HEADERS 64
+#define HTTP_MAX_HEADER_SIZE 8192 // request line and headers
+#define HTTP_READ_BUFFER_SIZE 4096 // per connection, grows as needed
+#define HTTP_READ_BUFFER_POOL_SIZE 16 // idle read buffers kept for reuse
+#define HTTP_CLIENT_SLAB_SIZE 64 // connections or writes per slab
+#define HTTP_MAX_PIPELINE_SIZE 65536 // buffered ahead of the current response
+#define HTTP_KEEP_ALIVE_TIMEOUT_MS 5000 // idle time before closing
+#define HTTP_HEADER_TIMEOUT_MS 10000 // from a request's first byte to its headers
+#define HTTP_BODY_TIMEOUT_MS 30000 // longest pause while a body arrives
+#define HTTP_MAX_ROUTE_PARAMS 16 // :params and * in one route
+#define HTTP_MAX_ROUTE_CANDIDATES 8 // routes whose methods a 405's Allow lists
+#define HTTP_MAX_THREADS 256 // createServer threads option
+#define HTTP_RESPONSE_STACK_BUFS 16 // body parts sent without a heap iovec
+#define HTTP_RESPONSE_HIGH_WATERMARK 65536 // queued bytes before 'drain'
+#define HTTP_CHUNK_LINE_SIZE 20 // hex chunk size and CRLF
+#define HTTP_RETRY_AFTER_SECONDS "1" // sent with load shedding 503s
+
+// Connection timeouts
+#define TIMER_WHEEL_SLOTS 512 // a turn of the wheel is 51.2s
+#define TIMER_WHEEL_TICK_MS 100 // resolution of connection timeouts
+#define NET_IDLE_TIMEOUT_MS 120000 // net connections without reads or writes
+#define NET_READ_BUFFER_SIZE 4096
+#define NET_BROADCAST_HIGH_WATERMARK (1024 * 1024) // queued on a slow subscriber
+
+// Static files
+#define HTTP_STATIC_CACHE_SIZE 256 // stat cache slots per serveStatic root
+#define HTTP_STATIC_STAT_TTL_MS 2000 // re-stat even without a watch event
+#define HTTP_STATIC_VALIDATOR_SIZE 48 // ETag and Last-Modified values
+#define HTTP_STATIC_PATH_SIZE 1024
+#define HTTP_STATIC_CHUNK_SIZE 262144 // 256 KiB per sendfile call
+
+// Response cache
+#define HTTP_CACHE_BUCKETS 1024 // hash buckets per server, a power of two
+#define HTTP_CACHE_KEY_SIZE 2048 // longer method+url+vary keys aren't cached
+#define HTTP_CACHE_MAX_VARY 8
+#define HTTP_CACHE_DEFAULT_BYTES (16 * 1024 * 1024)
+#define HTTP_CACHE_DEFAULT_TTL_MS 1000
+
+// Multipart uploads
+#define MULTIPART_MAX_BOUNDARY 70 // RFC 2046
+#define MULTIPART_MAX_HEADER_SIZE 4096 // one part's headers
+#define MULTIPART_DEFAULT_FIELD_SIZE 65536 // a non-file field's value
+
+// WebSockets
+#define WEBSOCKET_MAX_MESSAGE_SIZE (16 * 1024 * 1024) // closed with 1009 past it
+#define WEBSOCKET_CLOSE_TIMEOUT_MS 5000 // for the peer to answer our close
+
+// Cluster mode
+#define CLUSTER_MAX_WORKERS 256
+#define CLUSTER_RESTART_DELAY_MS 1000 // before replacing a crashed worker
+#define CLUSTER_IPC_FD 3 // worker's end of the control pipe
+#define CLUSTER_MESSAGE_SIZE 256 // longest control message line
+#define CLUSTER_WORKER_ENV "RAGTIME_CLUSTER_WORKER" // worker id, set by master
 
 // Buffer sizes
 #define HTTP_REQUEST_BUFFER_SIZE 1024
 #define HTTP_RESPONSE_BUFFER_SIZE 512
-#define HTTP_METHOD_BUFFER_SIZE 16
-#define HTTP_URL_BUFFER_SIZE 256
 #define ERROR_MSG_BUFFER_SIZE 512
 
 // Network
@@ -39,7 +101,9 @@
 #define ERR_INVALID_STREAM_STATE "Invalid stream state"
 #define ERR_INVALID_SERVER_STATE "Invalid server state"
 #define ERR_INVALID_CLIENT_STATE "Invalid client state"
+#define ERR_HEADERS_SENT "Headers already sent"
 #define ERR_CALLBACK_REQUIRED "Callback must be a function"
 #define ERR_TOO_MANY_TIMERS "Too many active timers"
+#define ERR_UNKNOWN_HASH_ALGORITHM "Unknown hash algorithm (sha256, crc32c, xxh64)"
 
 #endif
@@ -0,0 +1,19 @@
+#ifndef CORE_CLUSTER_H
+#define CORE_CLUSTER_H
+
+#include <stdbool.h>
+
+// `ragtime --cluster=N app.js`: the master runs no JS, it forks N workers
+// running app.js, restarts the ones that crash and talks to them over a
+// newline-delimited control pipe
+int run_cluster_master(int workers, int argc, char **argv);
+
+// workers find their control pipe through CLUSTER_WORKER_ENV
+void init_cluster_worker(void);
+bool is_cluster_worker(void);
+int cluster_worker_id(void); // -1 outside cluster mode
+
+// sends one control message line to the master
+void cluster_send(const char *message);
+
+#endif
@@ -11,6 +11,22 @@ bool is_valid_argc(JSContextRef ctx, size_t argc, size_t expected_count,
 bool to_callback(JSContextRef ctx, JSValueRef js_callback,
                  JSObjectRef *callback_out, JSValueRef *js_err_str);
 char *to_c_str(JSContextRef ctx, JSValueRef js_value, JSValueRef *js_err_str);
+bool get_number_option(JSContextRef ctx, JSValueRef options, const char *name,
+                       double *value_out);
+char *get_string_option(JSContextRef ctx, JSValueRef options,
+                        const char *name);
+JSObjectRef make_byte_array(JSContextRef ctx, char *data, size_t length);
+// a string from `length` bytes of UTF-8, NULs included; malformed sequences
+// become U+FFFD instead of cutting it short
+JSValueRef make_utf8_string(JSContextRef ctx, const char *data, size_t length);
+// how many bytes at the end of `data` start a character that isn't complete,
+// to be carried over to the next chunk
+size_t incomplete_utf8_tail(const char *data, size_t length);
+bool get_byte_span(JSContextRef ctx, JSValueRef value, char **data_out,
+                   size_t *length_out);
+// copies a Uint8Array/ArrayBuffer, or a string as UTF-8, into a heap buffer
+char *to_bytes(JSContextRef ctx, JSValueRef js_value, size_t *length_out,
+               JSValueRef *js_err_str);
 void set_js_error(JSContextRef ctx, const char *message,
                   JSValueRef *js_err_str);
 
@@ -3,7 +3,11 @@
 
 #include <uv.h>
 
-extern uv_loop_t *loop;
+// each HTTP worker thread runs its own loop and JS context (see
+// core/workers.h), so globals tied to either are thread-local
+#define THREAD_LOCAL __thread
+
+extern THREAD_LOCAL uv_loop_t *loop;
 void init_event_loop();
 void run_event_loop();
 
@@ -0,0 +1,36 @@
+#ifndef CORE_SOCKET_OPTIONS_H
+#define CORE_SOCKET_OPTIONS_H
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdbool.h>
+#include <uv.h>
+
+// the tuning options listen() and http.get() take; unset ones leave the
+// system default alone
+typedef struct {
+  int no_delay;            // -1 unset, else 0 or 1
+  int keep_alive;          // -1 unset, 0 off, else the initial delay in s
+  int send_buffer_size;    // bytes, 0 unset
+  int receive_buffer_size; // bytes, 0 unset
+  int defer_accept;        // s, 0 unset, listening sockets on Linux only
+  int fast_open;           // listen queue length or 1 to connect, 0 unset
+} SocketOptions;
+
+void init_socket_options(SocketOptions *options);
+
+// { noDelay, keepAlive, keepAliveInitialDelay (ms), sendBufferSize,
+//   receiveBufferSize, deferAccept (s), fastOpen }, undefined for none
+bool get_socket_options(JSContextRef ctx, JSValueRef value,
+                        SocketOptions *options, JSValueRef *js_err_str);
+
+// a listening socket, between bind and listen. Buffer sizes set here are
+// inherited by accepted sockets
+int apply_listen_options(uv_tcp_t *socket, const SocketOptions *options);
+
+// an accepted socket; fastOpen only applies to the listening one
+int apply_socket_options(uv_tcp_t *socket, const SocketOptions *options);
+
+// a socket about to connect, created with uv_tcp_init_ex so it has an fd
+int apply_connect_options(uv_tcp_t *socket, const SocketOptions *options);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef CORE_TIMER_WHEEL_H
+#define CORE_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// connection timeouts share one uv_timer per loop instead of one each. A
+// timer sits in the slot of the tick it expires on, so starting, restarting
+// and stopping it are O(1), and every tick sweeps a single slot. Timeouts
+// longer than a turn of the wheel stay in their slot for the later rounds
+typedef struct WheelTimer {
+  struct WheelTimer *next; // NULL while stopped, so zeroed timers are valid
+  struct WheelTimer *prev;
+  uint64_t expires; // loop time
+  void (*on_expire)(struct WheelTimer *timer);
+} WheelTimer;
+
+// (re)starts the timer on the current thread's loop, with tick resolution
+void wheel_timer_start(WheelTimer *timer, uint64_t timeout_ms,
+                       void (*on_expire)(WheelTimer *timer));
+void wheel_timer_stop(WheelTimer *timer);
+
+// closes the loop's tick timer, before the loop itself is closed
+void close_timer_wheel(void);
+
+#endif
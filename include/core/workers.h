@@ -0,0 +1,18 @@
+#ifndef CORE_WORKERS_H
+#define CORE_WORKERS_H
+
+#include <stdbool.h>
+
+// the script the process was started with, which worker threads run again
+void set_worker_script(const char *path, const char *source);
+
+bool is_worker_thread(void);
+
+// starts `count` threads that each run the script on their own loop and JS
+// context, sharing no JS state. Only the main thread's first call starts any
+void start_workers(int count);
+
+// waits for the worker threads once the main loop has nothing left to do
+void join_workers(void);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// fixed-size objects carved out of larger slabs and recycled through a free
+// list, so short-lived per-connection structs skip malloc/free
+typedef struct PoolSlab {
+  struct PoolSlab *next;
+} PoolSlab;
+
+typedef struct {
+  size_t object_size;
+  size_t objects_per_slab;
+  void *free_list;
+  PoolSlab *slabs;
+} ObjectPool;
+
+void pool_init(ObjectPool *pool, size_t object_size, size_t objects_per_slab);
+void *pool_alloc(ObjectPool *pool); // zeroed, NULL when out of memory
+void pool_free(ObjectPool *pool, void *object);
+
+// same-sized buffers, keeping up to `max_idle` released ones warm for reuse
+typedef struct {
+  size_t buffer_size;
+  size_t max_idle;
+  size_t idle_count;
+  void **idle;
+} BufferPool;
+
+void buffer_pool_init(BufferPool *pool, size_t buffer_size, size_t max_idle);
+void *buffer_pool_acquire(BufferPool *pool);
+void buffer_pool_release(BufferPool *pool, void *buffer);
+
+#endif
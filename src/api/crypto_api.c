@@ -0,0 +1,286 @@
+#include "api/crypto_api.h"
+
+#include "api/crypto_api/hash.h"
+#include "constants.h"
+#include "core/jsc_interop.h"
+#include "core/libuv.h"
+
+#include <JavaScriptCore/JavaScript.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h>
+
+static THREAD_LOCAL JSClassRef hash_class = NULL;
+
+typedef struct {
+  uv_work_t work_req;
+  JSContextRef ctx;
+  JSObjectRef callback;
+  char *path;
+  Hasher hasher;
+  int result; // 0 or a libuv error code
+} HashFileState;
+
+static void hash_finalize(JSObjectRef object) {
+  Hasher *hasher = JSObjectGetPrivate(object);
+  free(hasher);
+}
+
+static JSValueRef make_hex_string(JSContextRef ctx, const uint8_t *digest,
+                                  size_t length) {
+  static const char hex_digits[] = "0123456789abcdef";
+  char hex[HASH_MAX_DIGEST_SIZE * 2 + 1];
+
+  for (size_t i = 0; i < length; i++) {
+    hex[i * 2] = hex_digits[digest[i] >> 4];
+    hex[i * 2 + 1] = hex_digits[digest[i] & 0x0f];
+  }
+  hex[length * 2] = '\0';
+
+  JSStringRef hex_str = JSStringCreateWithUTF8CString(hex);
+  JSValueRef value = JSValueMakeString(ctx, hex_str);
+  JSStringRelease(hex_str);
+  return value;
+}
+
+Hasher *to_hasher(JSContextRef ctx, JSValueRef value) {
+  if (!hash_class || !JSValueIsObjectOfClass(ctx, value, hash_class)) {
+    return NULL;
+  }
+  return JSObjectGetPrivate((JSObjectRef)value);
+}
+
+static JSValueRef hash_update(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "hash.update", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  Hasher *hasher = to_hasher(ctx, this_obj);
+  if (!hasher) {
+    set_js_error(ctx, "Invalid hash state", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  // bytes are hashed in place, only strings need a UTF-8 copy
+  char *bytes;
+  size_t length;
+  if (get_byte_span(ctx, args[0], &bytes, &length)) {
+    hasher_update(hasher, bytes, length);
+    return this_obj;
+  }
+
+  char *data = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+  hasher_update(hasher, data, strlen(data));
+  free(data);
+
+  return this_obj;
+}
+
+static JSValueRef hash_digest(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str) {
+  Hasher *hasher = to_hasher(ctx, this_obj);
+  if (!hasher) {
+    set_js_error(ctx, "Invalid hash state", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  uint8_t digest[HASH_MAX_DIGEST_SIZE];
+  size_t length = hasher_digest(hasher, digest);
+
+  if (argc > 0 && JSValueIsString(ctx, args[0])) {
+    char *encoding = to_c_str(ctx, args[0], js_err_str);
+    if (*js_err_str) {
+      return JSValueMakeUndefined(ctx);
+    }
+
+    bool as_buffer = strcmp(encoding, "buffer") == 0;
+    bool known = as_buffer || strcmp(encoding, "hex") == 0;
+    free(encoding);
+
+    if (!known) {
+      set_js_error(ctx, "Unknown digest encoding", js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+
+    if (as_buffer) {
+      char *bytes = malloc(length);
+      if (!bytes) {
+        set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+        return JSValueMakeUndefined(ctx);
+      }
+      memcpy(bytes, digest, length);
+      return make_byte_array(ctx, bytes, length);
+    }
+  }
+
+  return make_hex_string(ctx, digest, length);
+}
+
+JSValueRef crypto_create_hash(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "crypto.createHash", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *algorithm = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  Hasher *hasher = malloc(sizeof(Hasher));
+  if (!hasher) {
+    free(algorithm);
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!hasher_init(hasher, algorithm)) {
+    free(algorithm);
+    free(hasher);
+    set_js_error(ctx, ERR_UNKNOWN_HASH_ALGORITHM, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  free(algorithm);
+
+  if (hash_class == NULL) {
+    JSClassDefinition class_def = kJSClassDefinitionEmpty;
+    class_def.finalize = hash_finalize;
+    hash_class = JSClassCreate(&class_def);
+  }
+
+  JSObjectRef hash_obj = JSObjectMake(ctx, hash_class, hasher);
+
+  JSStringRef update_name = JSStringCreateWithUTF8CString("update");
+  JSObjectRef update_fn =
+      JSObjectMakeFunctionWithCallback(ctx, update_name, hash_update);
+  JSObjectSetProperty(ctx, hash_obj, update_name, update_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(update_name);
+
+  JSStringRef digest_name = JSStringCreateWithUTF8CString("digest");
+  JSObjectRef digest_fn =
+      JSObjectMakeFunctionWithCallback(ctx, digest_name, hash_digest);
+  JSObjectSetProperty(ctx, hash_obj, digest_name, digest_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(digest_name);
+
+  return hash_obj;
+}
+
+// runs on the threadpool: the whole open/read/hash loop stays off the loop
+static void hash_file_work(uv_work_t *req) {
+  HashFileState *state = req->data;
+
+  int fd = open(state->path, O_RDONLY);
+  if (fd < 0) {
+    state->result = uv_translate_sys_error(errno);
+    return;
+  }
+
+  char *buffer = malloc(HASH_FILE_CHUNK_SIZE);
+  if (!buffer) {
+    state->result = UV_ENOMEM;
+    close(fd);
+    return;
+  }
+
+  ssize_t bytes_read;
+  while ((bytes_read = read(fd, buffer, HASH_FILE_CHUNK_SIZE)) != 0) {
+    if (bytes_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      state->result = uv_translate_sys_error(errno);
+      break;
+    }
+    hasher_update(&state->hasher, buffer, bytes_read);
+  }
+
+  free(buffer);
+  close(fd);
+}
+
+static void on_hash_file_done(uv_work_t *req, int uv_status) {
+  HashFileState *state = req->data;
+
+  if (state->result < 0) {
+    invoke_callback_with_err(state->ctx, state->callback, state->result,
+                             "fs.hashFile", true);
+  } else {
+    uint8_t digest[HASH_MAX_DIGEST_SIZE];
+    size_t length = hasher_digest(&state->hasher, digest);
+    JSValueRef args[] = {JSValueMakeNull(state->ctx),
+                         make_hex_string(state->ctx, digest, length)};
+    JSObjectCallAsFunction(state->ctx, state->callback, NULL, 2, args, NULL);
+  }
+
+  JSValueUnprotect(state->ctx, state->callback);
+  free(state->path);
+  free(state);
+}
+
+JSValueRef fs_hash_file(JSContextRef ctx, JSObjectRef js_fn,
+                        JSObjectRef this_obj, size_t argc,
+                        const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 3, "fs.hashFile", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *path = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *algorithm = to_c_str(ctx, args[1], js_err_str);
+  if (*js_err_str) {
+    free(path);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef callback;
+  if (!to_callback(ctx, args[2], &callback, js_err_str)) {
+    free(path);
+    free(algorithm);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  HashFileState *state = malloc(sizeof(HashFileState));
+  if (!state) {
+    free(path);
+    free(algorithm);
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!hasher_init(&state->hasher, algorithm)) {
+    free(path);
+    free(algorithm);
+    free(state);
+    set_js_error(ctx, ERR_UNKNOWN_HASH_ALGORITHM, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  free(algorithm);
+
+  state->ctx = ctx;
+  state->callback = callback;
+  JSValueProtect(ctx, state->callback);
+  state->path = path;
+  state->result = 0;
+  state->work_req.data = state; // back pointer for later access
+
+  uv_queue_work(loop, &state->work_req, hash_file_work,
+                on_hash_file_done);
+
+  return JSValueMakeUndefined(ctx);
+}
@@ -0,0 +1,96 @@
+#include "api/crypto_api/hash.h"
+#include <string.h>
+#include <uv.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAS_HW_CRC32C_PATH 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HAS_HW_CRC32C_PATH 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78 // Castagnoli, reflected
+
+// filled once by init_crc32c, hashes run on the threadpool and on every
+// {threads} loop
+static uint32_t table[256];
+static uv_once_t crc32c_once = UV_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *data, size_t length) {
+  while (length--) {
+    crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const uint8_t *data, size_t length) {
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    length -= 8;
+  }
+
+  crc = (uint32_t)crc64;
+  while (length--) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+static bool has_hw_crc32c(void) { return __builtin_cpu_supports("sse4.2"); }
+#elif defined(HAS_HW_CRC32C_PATH)
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *data, size_t length) {
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
+    data += 8;
+    length -= 8;
+  }
+
+  while (length--) {
+    crc = __crc32cb(crc, *data++);
+  }
+  return crc;
+}
+
+// compiled in only when the target guarantees the CRC extension
+static bool has_hw_crc32c(void) { return true; }
+#endif
+
+#ifdef HAS_HW_CRC32C_PATH
+static bool hw_support = false;
+#endif
+
+static void init_crc32c(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t entry = i;
+    for (int bit = 0; bit < 8; bit++) {
+      entry = (entry >> 1) ^ (CRC32C_POLY & (0 - (entry & 1)));
+    }
+    table[i] = entry;
+  }
+
+#ifdef HAS_HW_CRC32C_PATH
+  hw_support = has_hw_crc32c();
+#endif
+}
+
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t length) {
+  uv_once(&crc32c_once, init_crc32c);
+  crc = ~crc;
+
+#ifdef HAS_HW_CRC32C_PATH
+  if (hw_support) {
+    return ~crc32c_hw(crc, data, length);
+  }
+#endif
+
+  return ~crc32c_sw(crc, data, length);
+}
@@ -0,0 +1,54 @@
+#include "api/crypto_api/hash.h"
+#include <string.h>
+
+bool hasher_init(Hasher *hasher, const char *algorithm_name) {
+  if (strcmp(algorithm_name, "sha256") == 0) {
+    hasher->algorithm = HASH_SHA256;
+    sha256_init(&hasher->ctx.sha256);
+  } else if (strcmp(algorithm_name, "crc32c") == 0) {
+    hasher->algorithm = HASH_CRC32C;
+    hasher->ctx.crc32c = 0;
+  } else if (strcmp(algorithm_name, "xxh64") == 0) {
+    hasher->algorithm = HASH_XXH64;
+    xxh64_init(&hasher->ctx.xxh64);
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+void hasher_update(Hasher *hasher, const void *data, size_t length) {
+  switch (hasher->algorithm) {
+  case HASH_SHA256:
+    sha256_update(&hasher->ctx.sha256, data, length);
+    break;
+  case HASH_CRC32C:
+    hasher->ctx.crc32c = crc32c_update(hasher->ctx.crc32c, data, length);
+    break;
+  case HASH_XXH64:
+    xxh64_update(&hasher->ctx.xxh64, data, length);
+    break;
+  }
+}
+
+static size_t write_be(uint8_t *out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    out[i] = (uint8_t)(value >> (8 * (size - 1 - i)));
+  }
+  return size;
+}
+
+size_t hasher_digest(const Hasher *hasher, uint8_t *out) {
+  switch (hasher->algorithm) {
+  case HASH_SHA256:
+    sha256_final(&hasher->ctx.sha256, out);
+    return 32;
+  case HASH_CRC32C:
+    return write_be(out, hasher->ctx.crc32c, 4);
+  case HASH_XXH64:
+    return write_be(out, xxh64_digest(&hasher->ctx.xxh64), 8);
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include "api/crypto_api/hash.h"
+#include <string.h>
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_compress(uint32_t state[5], const uint8_t block[64]) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; i++) {
+    w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4];
+
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+
+    uint32_t t = ROTL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = ROTL(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+void sha1_init(Sha1Context *ctx) {
+  static const uint32_t initial_state[5] = {0x67452301, 0xefcdab89, 0x98badcfe,
+                                            0x10325476, 0xc3d2e1f0};
+  memcpy(ctx->state, initial_state, sizeof(initial_state));
+  ctx->length = 0;
+  ctx->block_length = 0;
+}
+
+void sha1_update(Sha1Context *ctx, const uint8_t *data, size_t length) {
+  ctx->length += length;
+
+  if (ctx->block_length > 0) {
+    size_t fill = 64 - ctx->block_length;
+    if (fill > length) {
+      fill = length;
+    }
+    memcpy(ctx->block + ctx->block_length, data, fill);
+    ctx->block_length += fill;
+    data += fill;
+    length -= fill;
+
+    if (ctx->block_length < 64) {
+      return;
+    }
+    sha1_compress(ctx->state, ctx->block);
+    ctx->block_length = 0;
+  }
+
+  while (length >= 64) {
+    sha1_compress(ctx->state, data);
+    data += 64;
+    length -= 64;
+  }
+
+  memcpy(ctx->block, data, length);
+  ctx->block_length = length;
+}
+
+void sha1_final(const Sha1Context *ctx, uint8_t out[20]) {
+  Sha1Context final = *ctx;
+  uint64_t bit_length = final.length * 8;
+
+  uint8_t padding[72] = {0x80};
+  size_t pad_length = (final.block_length < 56 ? 56 : 120) - final.block_length;
+  for (int i = 0; i < 8; i++) {
+    padding[pad_length + i] = (uint8_t)(bit_length >> (56 - 8 * i));
+  }
+  sha1_update(&final, padding, pad_length + 8);
+
+  for (int i = 0; i < 5; i++) {
+    out[i * 4] = (uint8_t)(final.state[i] >> 24);
+    out[i * 4 + 1] = (uint8_t)(final.state[i] >> 16);
+    out[i * 4 + 2] = (uint8_t)(final.state[i] >> 8);
+    out[i * 4 + 3] = (uint8_t)final.state[i];
+  }
+}
@@ -0,0 +1,122 @@
+#include "api/crypto_api/hash.h"
+#include <string.h>
+
+// XXH64 with seed 0, inputs are read little-endian (x86-64 and arm64 hosts)
+
+#define PRIME64_1 0x9e3779b185ebca87ULL
+#define PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define PRIME64_3 0x165667b19e3779f9ULL
+#define PRIME64_4 0x85ebca77c2b2ae63ULL
+#define PRIME64_5 0x27d4eb2f165667c5ULL
+
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static uint64_t read64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = ROTL64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t value) {
+  acc ^= xxh64_round(0, value);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static void xxh64_consume_stripe(Xxh64Context *ctx, const uint8_t *stripe) {
+  for (int i = 0; i < 4; i++) {
+    ctx->acc[i] = xxh64_round(ctx->acc[i], read64(stripe + i * 8));
+  }
+}
+
+void xxh64_init(Xxh64Context *ctx) {
+  ctx->acc[0] = PRIME64_1 + PRIME64_2;
+  ctx->acc[1] = PRIME64_2;
+  ctx->acc[2] = 0;
+  ctx->acc[3] = 0 - PRIME64_1;
+  ctx->length = 0;
+  ctx->block_length = 0;
+}
+
+void xxh64_update(Xxh64Context *ctx, const uint8_t *data, size_t length) {
+  ctx->length += length;
+
+  if (ctx->block_length > 0) {
+    size_t fill = 32 - ctx->block_length;
+    if (fill > length) {
+      fill = length;
+    }
+    memcpy(ctx->block + ctx->block_length, data, fill);
+    ctx->block_length += fill;
+    data += fill;
+    length -= fill;
+
+    if (ctx->block_length < 32) {
+      return;
+    }
+    xxh64_consume_stripe(ctx, ctx->block);
+    ctx->block_length = 0;
+  }
+
+  while (length >= 32) {
+    xxh64_consume_stripe(ctx, data);
+    data += 32;
+    length -= 32;
+  }
+
+  memcpy(ctx->block, data, length);
+  ctx->block_length = length;
+}
+
+uint64_t xxh64_digest(const Xxh64Context *ctx) {
+  uint64_t hash;
+  if (ctx->length >= 32) {
+    hash = ROTL64(ctx->acc[0], 1) + ROTL64(ctx->acc[1], 7) +
+           ROTL64(ctx->acc[2], 12) + ROTL64(ctx->acc[3], 18);
+    for (int i = 0; i < 4; i++) {
+      hash = xxh64_merge_round(hash, ctx->acc[i]);
+    }
+  } else {
+    hash = PRIME64_5;
+  }
+
+  hash += ctx->length;
+
+  const uint8_t *p = ctx->block;
+  size_t remaining = ctx->block_length;
+  while (remaining >= 8) {
+    hash ^= xxh64_round(0, read64(p));
+    hash = ROTL64(hash, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+    remaining -= 8;
+  }
+  if (remaining >= 4) {
+    hash ^= (uint64_t)read32(p) * PRIME64_1;
+    hash = ROTL64(hash, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+    remaining -= 4;
+  }
+  while (remaining > 0) {
+    hash ^= (*p++) * PRIME64_5;
+    hash = ROTL64(hash, 11) * PRIME64_1;
+    remaining--;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -3,6 +3,7 @@
 #include "core/jsc_errors.h"
 #include "core/jsc_interop.h"
 #include "core/jsc_promise.h"
+#include "core/libuv.h"
 
 #include <JavaScriptCore/JavaScript.h>
 #include <fcntl.h>
@@ -18,6 +19,29 @@ typedef struct {
   JSObjectRef callback;
 } FileOpState;
 
+int to_open_flags(const char *flags) {
+  static const struct {
+    const char *name;
+    int value;
+  } open_flags[] = {{"r", O_RDONLY},
+                    {"r+", O_RDWR},
+                    {"w", O_WRONLY | O_CREAT | O_TRUNC},
+                    {"wx", O_WRONLY | O_CREAT | O_TRUNC | O_EXCL},
+                    {"w+", O_RDWR | O_CREAT | O_TRUNC},
+                    {"a", O_WRONLY | O_CREAT | O_APPEND},
+                    {"ax", O_WRONLY | O_CREAT | O_APPEND | O_EXCL},
+                    {"a+", O_RDWR | O_CREAT | O_APPEND}};
+
+  const size_t flags_count = sizeof(open_flags) / sizeof(open_flags[0]);
+  for (size_t i = 0; i < flags_count; i++) {
+    if (strcmp(flags, open_flags[i].name) == 0) {
+      return open_flags[i].value;
+    }
+  }
+
+  return -1;
+}
+
 static void on_file_read(uv_fs_t *req) {
   FileOpState *state = (FileOpState *)req->data;
   uv_file fd = req->file;
@@ -31,7 +55,7 @@ static void on_file_read(uv_fs_t *req) {
     invoke_callback_with_err(state->ctx, state->callback, req->result,
                              "fs.readFile", true);
     uv_fs_req_cleanup(req);
-    uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+    uv_fs_close(loop, &state->req, fd, NULL);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->buffer.base);
     free(state);
@@ -46,7 +70,7 @@ static void on_file_read(uv_fs_t *req) {
     invoke_callback_with_custom_err(state->ctx, state->callback, ERR_FILE_IO,
                                     err_msg, true);
     uv_fs_req_cleanup(req);
-    uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+    uv_fs_close(loop, &state->req, fd, NULL);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->buffer.base);
     free(state);
@@ -61,7 +85,7 @@ static void on_file_read(uv_fs_t *req) {
   JSObjectCallAsFunction(state->ctx, state->callback, NULL, 2, args, NULL);
   JSStringRelease(file_content);
 
-  uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+  uv_fs_close(loop, &state->req, fd, NULL);
 
   JSValueUnprotect(state->ctx, state->callback);
   free(state->buffer.base);
@@ -91,13 +115,13 @@ static void on_file_open_for_read(uv_fs_t *req) {
   state->buffer = uv_buf_init((char *)malloc(MAX_FILE_SIZE), MAX_FILE_SIZE);
   if (!state->buffer.base) {
     fprintf(stderr, "Memory allocation failed\n");
-    uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+    uv_fs_close(loop, &state->req, fd, NULL);
     JSValueUnprotect(state->ctx, state->callback);
     free(state);
     return;
   }
 
-  uv_fs_read(uv_default_loop(), &state->req, fd, &state->buffer, 1, 0,
+  uv_fs_read(loop, &state->req, fd, &state->buffer, 1, 0,
              on_file_read);
 }
 
@@ -131,7 +155,7 @@ JSValueRef fs_read_file(JSContextRef ctx, JSObjectRef js_fn,
   JSValueProtect(ctx, state->callback);
   state->req.data = state; // back pointer for later access
 
-  uv_fs_open(uv_default_loop(), &state->req, path, O_RDONLY, 0,
+  uv_fs_open(loop, &state->req, path, O_RDONLY, 0,
              on_file_open_for_read);
   free(path);
 
@@ -151,7 +175,7 @@ void on_file_write(uv_fs_t *req) {
     invoke_callback_with_err(state->ctx, state->callback, req->result,
                              "fs.writeFile", false);
     uv_fs_req_cleanup(req);
-    uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+    uv_fs_close(loop, &state->req, fd, NULL);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->buffer.base);
     free(state);
@@ -162,7 +186,7 @@ void on_file_write(uv_fs_t *req) {
   JSValueRef args[] = {JSValueMakeNull(state->ctx)};
   JSObjectCallAsFunction(state->ctx, state->callback, NULL, 1, args, NULL);
 
-  uv_fs_close(uv_default_loop(), &state->req, fd, NULL);
+  uv_fs_close(loop, &state->req, fd, NULL);
   JSValueUnprotect(state->ctx, state->callback);
   free(state->buffer.base);
   free(state);
@@ -188,7 +212,7 @@ void on_file_open_for_write(uv_fs_t *req) {
   uv_file fd = req->result;
   uv_fs_req_cleanup(req);
 
-  uv_fs_write(uv_default_loop(), &state->req, fd, &state->buffer, 1, 0,
+  uv_fs_write(loop, &state->req, fd, &state->buffer, 1, 0,
               on_file_write);
 }
 
@@ -231,7 +255,7 @@ JSValueRef fs_write_file(JSContextRef ctx, JSObjectRef js_fn,
   state->buffer = uv_buf_init(content, strlen(content));
   state->req.data = state; // back pointer for later access
 
-  uv_fs_open(uv_default_loop(), &state->req, path, O_WRONLY | O_CREAT | O_TRUNC,
+  uv_fs_open(loop, &state->req, path, O_WRONLY | O_CREAT | O_TRUNC,
              FILE_DEFAULT_PERMISSIONS, on_file_open_for_write);
   free(path);
 
@@ -291,7 +315,7 @@ JSValueRef fs_exists(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
   JSValueProtect(ctx, state->callback);
   state->req.data = state; // back pointer for later access
 
-  uv_fs_stat(uv_default_loop(), &state->req, path, on_file_stat);
+  uv_fs_stat(loop, &state->req, path, on_file_stat);
   free(path);
 
   return JSValueMakeUndefined(ctx);
@@ -327,7 +351,7 @@ static void promise_read_callback(uv_fs_t *req) {
   }
 
   uv_fs_req_cleanup(req);
-  uv_fs_close(uv_default_loop(), &op->req, fd, NULL);
+  uv_fs_close(loop, &op->req, fd, NULL);
   JSValueUnprotect(op->ctx, op->resolve);
   JSValueUnprotect(op->ctx, op->reject);
   free(op->buffer);
@@ -361,7 +385,7 @@ static void promise_open_callback(uv_fs_t *req) {
     JSValueRef error = create_js_error(op->ctx, ERR_MEMORY, "fs.readFileAsync",
                                        ERR_MEMORY_ALLOCATION);
     promise_reject(op->ctx, op->reject, error);
-    uv_fs_close(uv_default_loop(), &op->req, fd, NULL);
+    uv_fs_close(loop, &op->req, fd, NULL);
     JSValueUnprotect(op->ctx, op->resolve);
     JSValueUnprotect(op->ctx, op->reject);
     free(op);
@@ -369,7 +393,7 @@ static void promise_open_callback(uv_fs_t *req) {
   }
 
   uv_buf_t buffer = uv_buf_init(op->buffer, MAX_FILE_SIZE - 1);
-  uv_fs_read(uv_default_loop(), &op->req, fd, &buffer, 1, 0,
+  uv_fs_read(loop, &op->req, fd, &buffer, 1, 0,
              promise_read_callback);
 }
 
@@ -408,7 +432,7 @@ JSValueRef fs_read_file_async(JSContextRef ctx, JSObjectRef js_fn,
   JSValueProtect(ctx, resolve);
   JSValueProtect(ctx, reject);
 
-  uv_fs_open(uv_default_loop(), &op->req, filepath, O_RDONLY, 0,
+  uv_fs_open(loop, &op->req, filepath, O_RDONLY, 0,
              promise_open_callback);
   free(filepath);
 
@@ -0,0 +1,260 @@
+#include "api/http_api/cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static uint32_t hash_key(const char *key, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static size_t entry_bytes(const CacheEntry *entry) {
+  return sizeof(CacheEntry) + entry->key_length + entry->response->length;
+}
+
+static void unlink_lru(ResponseCache *cache, CacheEntry *entry) {
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    cache->newest = entry->older;
+
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    cache->oldest = entry->newer;
+
+  entry->newer = NULL;
+  entry->older = NULL;
+}
+
+static void push_newest(ResponseCache *cache, CacheEntry *entry) {
+  entry->older = cache->newest;
+  entry->newer = NULL;
+  if (cache->newest)
+    cache->newest->newer = entry;
+  else
+    cache->oldest = entry;
+  cache->newest = entry;
+}
+
+static void remove_entry(ResponseCache *cache, CacheEntry *entry) {
+  CacheEntry **link = &cache->buckets[entry->hash & (HTTP_CACHE_BUCKETS - 1)];
+  while (*link != entry)
+    link = &(*link)->bucket_next;
+  *link = entry->bucket_next;
+
+  unlink_lru(cache, entry);
+  cache->bytes -= entry_bytes(entry);
+
+  shared_buffer_release(entry->response);
+  free(entry->key);
+  free(entry);
+}
+
+ResponseCache *response_cache_create(size_t max_bytes, uint64_t ttl_ms,
+                                     uint64_t stale_ms) {
+  ResponseCache *cache = calloc(1, sizeof(ResponseCache));
+  if (!cache)
+    return NULL;
+
+  cache->max_bytes = max_bytes;
+  cache->ttl_ms = ttl_ms;
+  cache->stale_ms = stale_ms;
+  return cache;
+}
+
+void response_cache_free(ResponseCache *cache) {
+  if (!cache)
+    return;
+
+  while (cache->oldest)
+    remove_entry(cache, cache->oldest);
+
+  for (size_t i = 0; i < cache->vary_count; i++)
+    free(cache->vary[i]);
+  free(cache);
+}
+
+bool response_cache_add_vary(ResponseCache *cache, const char *name) {
+  if (cache->vary_count == HTTP_CACHE_MAX_VARY || !*name)
+    return false;
+
+  char *copy = strdup(name);
+  if (!copy)
+    return false;
+
+  cache->vary[cache->vary_count++] = copy;
+  return true;
+}
+
+CacheEntry *response_cache_find(ResponseCache *cache, const char *key,
+                                size_t key_length) {
+  uint32_t hash = hash_key(key, key_length);
+  CacheEntry *entry = cache->buckets[hash & (HTTP_CACHE_BUCKETS - 1)];
+
+  for (; entry; entry = entry->bucket_next) {
+    if (entry->hash == hash && entry->key_length == key_length &&
+        memcmp(entry->key, key, key_length) == 0)
+      return entry;
+  }
+
+  return NULL;
+}
+
+CacheEntry *response_cache_get(ResponseCache *cache, const char *key,
+                               size_t key_length, uint64_t now) {
+  CacheEntry *entry = response_cache_find(cache, key, key_length);
+  if (!entry)
+    return NULL;
+
+  // a refresh in flight keeps the entry, the refreshing request replaces it
+  if (now >= entry->stale_until) {
+    if (!entry->refreshing)
+      remove_entry(cache, entry);
+    return NULL;
+  }
+
+  unlink_lru(cache, entry);
+  push_newest(cache, entry);
+  return entry;
+}
+
+bool response_cache_put(ResponseCache *cache, const char *key,
+                        size_t key_length, SharedBuffer *response,
+                        size_t head_length, uint64_t now) {
+  CacheEntry *existing = response_cache_find(cache, key, key_length);
+  if (existing)
+    remove_entry(cache, existing);
+
+  size_t bytes = sizeof(CacheEntry) + key_length + response->length;
+  if (bytes > cache->max_bytes) {
+    shared_buffer_release(response);
+    return false;
+  }
+
+  CacheEntry *entry = calloc(1, sizeof(CacheEntry));
+  char *key_copy = malloc(key_length);
+  if (!entry || !key_copy) {
+    free(entry);
+    free(key_copy);
+    shared_buffer_release(response);
+    return false;
+  }
+
+  while (cache->bytes + bytes > cache->max_bytes)
+    remove_entry(cache, cache->oldest);
+
+  memcpy(key_copy, key, key_length);
+  entry->key = key_copy;
+  entry->key_length = key_length;
+  entry->hash = hash_key(key, key_length);
+  entry->response = response;
+  entry->head_length = head_length;
+  entry->fresh_until = now + cache->ttl_ms;
+  entry->stale_until = entry->fresh_until + cache->stale_ms;
+
+  CacheEntry **bucket = &cache->buckets[entry->hash & (HTTP_CACHE_BUCKETS - 1)];
+  entry->bucket_next = *bucket;
+  *bucket = entry;
+  push_newest(cache, entry);
+  cache->bytes += bytes;
+  return true;
+}
+
+// whether the comma separated `value` lists `token`, ignoring "=..." args
+static bool has_directive(const char *value, size_t length, const char *token) {
+  size_t token_length = strlen(token);
+  const char *cursor = value;
+  const char *end = value + length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ','))
+      cursor++;
+
+    const char *start = cursor;
+    while (cursor < end && *cursor != ',' && *cursor != '=' && *cursor != ' ')
+      cursor++;
+
+    if ((size_t)(cursor - start) == token_length &&
+        strncasecmp(start, token, token_length) == 0)
+      return true;
+
+    while (cursor < end && *cursor != ',')
+      cursor++;
+  }
+
+  return false;
+}
+
+// a response's Vary must only name headers the key already holds
+static bool varies_within_key(const ResponseCache *cache, const char *value,
+                              size_t length) {
+  const char *cursor = value;
+  const char *end = value + length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ','))
+      cursor++;
+
+    const char *start = cursor;
+    while (cursor < end && *cursor != ',' && *cursor != ' ')
+      cursor++;
+
+    size_t name_length = cursor - start;
+    if (name_length == 0)
+      continue;
+
+    bool found = false;
+    for (size_t i = 0; i < cache->vary_count && !found; i++) {
+      found = strlen(cache->vary[i]) == name_length &&
+              strncasecmp(cache->vary[i], start, name_length) == 0;
+    }
+    if (!found)
+      return false; // includes "*"
+  }
+
+  return true;
+}
+
+bool response_cache_storable(const ResponseCache *cache, const char *headers,
+                             size_t length) {
+  const char *line = headers;
+  const char *end = headers + length;
+
+  while (line < end) {
+    const char *line_end = memchr(line, '\r', end - line);
+    if (!line_end)
+      line_end = end;
+
+    const char *colon = memchr(line, ':', line_end - line);
+    if (colon) {
+      size_t name_length = colon - line;
+      const char *value = colon + 1;
+      while (value < line_end && *value == ' ')
+        value++;
+
+      // per-user responses are never shared
+      if (name_length == 10 && strncasecmp(line, "set-cookie", 10) == 0)
+        return false;
+
+      if (name_length == 13 && strncasecmp(line, "cache-control", 13) == 0 &&
+          (has_directive(value, line_end - value, "no-store") ||
+           has_directive(value, line_end - value, "no-cache") ||
+           has_directive(value, line_end - value, "private")))
+        return false;
+
+      if (name_length == 4 && strncasecmp(line, "vary", 4) == 0 &&
+          !varies_within_key(cache, value, line_end - value))
+        return false;
+    }
+
+    line = line_end + 2;
+  }
+
+  return true;
+}
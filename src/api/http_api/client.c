@@ -3,6 +3,8 @@
 #include "api/http_api_common.h"
 #include "constants.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
+#include "core/socket_options.h"
 
 #include <JavaScriptCore/JavaScript.h>
 #include <stdio.h>
@@ -15,6 +17,7 @@ typedef struct {
   JSContextRef ctx;
   JSObjectRef callback;
   char *host;
+  char *port;
   char *path;
   char *response_data;
   size_t response_size;
@@ -22,6 +25,7 @@ typedef struct {
   char *response_headers;
   char *response_body;
   bool headers_parsed;
+  SocketOptions socket_options;
 } HttpRequestState;
 
 static void on_http_read(uv_stream_t *stream, ssize_t bytes_read,
@@ -54,6 +58,7 @@ static void on_http_read(uv_stream_t *stream, ssize_t bytes_read,
     uv_close((uv_handle_t *)&state->socket, on_socket_close);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state->response_data);
     free(state->response_headers);
@@ -71,6 +76,7 @@ static void on_http_read(uv_stream_t *stream, ssize_t bytes_read,
       uv_close((uv_handle_t *)&state->socket, on_socket_close);
       JSValueUnprotect(state->ctx, state->callback);
       free(state->host);
+      free(state->port);
       free(state->path);
       free(state->response_data);
       free(state->response_headers);
@@ -183,6 +189,7 @@ static void on_http_read(uv_stream_t *stream, ssize_t bytes_read,
   uv_close((uv_handle_t *)&state->socket, on_socket_close);
   JSValueUnprotect(state->ctx, state->callback);
   free(state->host);
+  free(state->port);
   free(state->path);
   free(state->response_data);
   free(state->response_headers);
@@ -207,6 +214,7 @@ static void on_http_connect(uv_connect_t *req, int uv_status) {
     uv_close((uv_handle_t *)&state->socket, on_socket_close);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state);
     free(req);
@@ -227,6 +235,7 @@ static void on_http_connect(uv_connect_t *req, int uv_status) {
     uv_close((uv_handle_t *)&state->socket, on_socket_close);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state);
     free(req);
@@ -239,6 +248,7 @@ static void on_http_connect(uv_connect_t *req, int uv_status) {
     uv_close((uv_handle_t *)&state->socket, on_socket_close);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state);
     free(req);
@@ -258,6 +268,7 @@ static void on_dns_resolved(uv_getaddrinfo_t *resolver, int uv_status,
     invoke_callback_with_error(state, uv_strerror(uv_status));
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state);
     free(resolver);
@@ -267,14 +278,23 @@ static void on_dns_resolved(uv_getaddrinfo_t *resolver, int uv_status,
     return;
   }
 
-  uv_tcp_init(uv_default_loop(), &state->socket);
+  // created up front, so the options are set before connecting
+  uv_tcp_init_ex(loop, &state->socket, res->ai_family);
   state->socket.data = state;
 
+  int options_result = apply_connect_options(&state->socket,
+                                             &state->socket_options);
+  if (options_result < 0) {
+    fprintf(stderr, "Client socket option error: %s\n",
+            uv_strerror(options_result));
+  }
+
   uv_connect_t *connect_req = malloc(sizeof(uv_connect_t));
   if (!connect_req) {
     invoke_callback_with_error(state, ERR_MEMORY_ALLOCATION);
     JSValueUnprotect(state->ctx, state->callback);
     free(state->host);
+    free(state->port);
     free(state->path);
     free(state);
     uv_freeaddrinfo(res);
@@ -309,8 +329,16 @@ JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
     return JSValueMakeUndefined(ctx);
   }
 
+  // http.get(url[, socketOptions], callback)
+  SocketOptions socket_options;
+  JSValueRef options = argc > 2 ? args[1] : JSValueMakeUndefined(ctx);
+  if (!get_socket_options(ctx, options, &socket_options, js_err_str)) {
+    free(url);
+    return JSValueMakeUndefined(ctx);
+  }
+
   JSObjectRef callback;
-  if (!to_callback(ctx, args[1], &callback, js_err_str)) {
+  if (!to_callback(ctx, args[argc > 2 ? 2 : 1], &callback, js_err_str)) {
     free(url);
     return JSValueMakeUndefined(ctx);
   }
@@ -333,10 +361,17 @@ JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
     return JSValueMakeUndefined(ctx);
   }
 
+  char *port_start = strchr(host, ':');
+  char *port = strdup(port_start ? port_start + 1 : HTTP_DEFAULT_PORT);
+  if (port_start) {
+    *port_start = '\0';
+  }
+
   HttpRequestState *http = malloc(sizeof(HttpRequestState));
   if (!http) {
     free(url);
     free(host);
+    free(port);
     free(path);
     set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
     return JSValueMakeUndefined(ctx);
@@ -346,6 +381,7 @@ JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
   http->callback = callback;
   JSValueProtect(ctx, callback);
   http->host = host;
+  http->port = port;
   http->path = path;
   http->response_data = NULL;
   http->response_size = 0;
@@ -353,6 +389,7 @@ JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
   http->response_headers = NULL;
   http->response_body = NULL;
   http->headers_parsed = false;
+  http->socket_options = socket_options;
 
   struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
   uv_getaddrinfo_t *resolver = malloc(sizeof(uv_getaddrinfo_t));
@@ -360,13 +397,14 @@ JSValueRef http_get(JSContextRef ctx, JSObjectRef js_fn, JSObjectRef this_obj,
     JSValueUnprotect(ctx, callback);
     free(url);
     free(host);
+    free(port);
     free(path);
     free(http);
     set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
   resolver->data = http;
-  uv_getaddrinfo(uv_default_loop(), resolver, on_dns_resolved, http->host, HTTP_DEFAULT_PORT,
+  uv_getaddrinfo(loop, resolver, on_dns_resolved, http->host, http->port,
                  &hints);
 
   free(url);
@@ -0,0 +1,340 @@
+#include "api/http_api/multipart.h"
+
+#include <string.h>
+#include <strings.h>
+
+enum {
+  STATE_BODY,            // a part's body, or the preamble before the first
+  STATE_DELIMITER_END,   // "--" for the last part, CRLF for another
+  STATE_DELIMITER_LF,
+  STATE_CLOSING_DASH,
+  STATE_HEADERS,
+  STATE_DONE,
+};
+
+bool multipart_parser_init(MultipartParser *parser, const char *boundary,
+                           size_t length) {
+  if (length == 0 || length > MULTIPART_MAX_BOUNDARY)
+    return false;
+
+  memset(parser, 0, sizeof(MultipartParser));
+  memcpy(parser->delimiter, "\r\n--", 4);
+  memcpy(parser->delimiter + 4, boundary, length);
+  parser->delimiter_length = length + 4;
+
+  size_t n = parser->delimiter_length;
+  memset(parser->shift, (int)n, sizeof(parser->shift));
+  for (size_t i = 0; i + 1 < n; i++)
+    parser->shift[(unsigned char)parser->delimiter[i]] = (unsigned char)(n - 1 - i);
+
+  // the first delimiter has no CRLF before it, so the body starts as if
+  // it followed one
+  memcpy(parser->carry, "\r\n", 2);
+  parser->carry_length = 2;
+  parser->state = STATE_BODY;
+  return true;
+}
+
+// the carried bytes followed by `data`, as one run
+static char window_at(const MultipartParser *parser, const char *data,
+                      size_t i) {
+  return i < parser->carry_length ? parser->carry[i]
+                                  : data[i - parser->carry_length];
+}
+
+// hands window bytes [0, end) to the current part, the preamble is dropped
+static void emit_window(MultipartParser *parser, const char *data, size_t end,
+                        const MultipartCallbacks *callbacks, void *user_data) {
+  if (!parser->in_part || end == 0)
+    return;
+
+  size_t from_carry = end < parser->carry_length ? end : parser->carry_length;
+  if (from_carry > 0)
+    callbacks->on_data(user_data, parser->carry, from_carry);
+  if (end > from_carry)
+    callbacks->on_data(user_data, data, end - from_carry);
+}
+
+// looks for the delimiter in the carried bytes plus `data`. Whatever can't
+// be part of one goes to on_data; a possible start of one at the very end is
+// carried over to the next call. `used_out` is how much of `data` was taken
+static bool find_delimiter(MultipartParser *parser, const char *data,
+                           size_t length, size_t *used_out,
+                           const MultipartCallbacks *callbacks,
+                           void *user_data) {
+  const char *delimiter = parser->delimiter;
+  size_t n = parser->delimiter_length;
+  size_t total = parser->carry_length + length;
+  size_t position = 0;
+
+  while (position + n <= total) {
+    size_t i = n - 1;
+    while (window_at(parser, data, position + i) == delimiter[i]) {
+      if (i == 0) {
+        emit_window(parser, data, position, callbacks, user_data);
+        *used_out = position + n - parser->carry_length;
+        parser->carry_length = 0;
+        return true;
+      }
+      i--;
+    }
+    position += parser->shift[(unsigned char)window_at(parser, data,
+                                                       position + n - 1)];
+  }
+
+  // positions the skips stepped over can't start even a partial match
+  size_t start = position;
+  for (; start < total; start++) {
+    size_t i = 0;
+    while (start + i < total &&
+           window_at(parser, data, start + i) == delimiter[i])
+      i++;
+    if (start + i == total)
+      break;
+  }
+
+  emit_window(parser, data, start, callbacks, user_data);
+
+  char carry[sizeof(parser->carry)];
+  size_t carry_length = total - start;
+  for (size_t i = 0; i < carry_length; i++)
+    carry[i] = window_at(parser, data, start + i);
+  memcpy(parser->carry, carry, carry_length);
+  parser->carry_length = carry_length;
+
+  *used_out = length;
+  return false;
+}
+
+static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+// a parameter value, a token or a quoted string unescaped in place, and
+// NUL-terminated. Returns where scanning continues
+static char *read_param_value(char *cursor, char *end, char **value_out) {
+  if (cursor < end && *cursor == '"') {
+    char *value = ++cursor;
+    char *out = value;
+    while (cursor < end && *cursor != '"') {
+      if (*cursor == '\\' && cursor + 1 < end)
+        cursor++;
+      *out++ = *cursor++;
+    }
+    if (cursor < end)
+      cursor++; // closing quote
+    *out = '\0';
+    *value_out = value;
+    return cursor;
+  }
+
+  char *value = cursor;
+  while (cursor < end && *cursor != ';' && !is_space(*cursor))
+    cursor++;
+  char *value_end = cursor;
+  if (cursor < end)
+    cursor++;
+  *value_end = '\0';
+  *value_out = value;
+  return cursor;
+}
+
+// pulls name and filename out of `form-data; name="a"; filename="b"`
+static void parse_disposition(char *value, char *end, MultipartPart *part) {
+  char *cursor = memchr(value, ';', end - value);
+
+  while (cursor && cursor < end) {
+    while (cursor < end && (*cursor == ';' || is_space(*cursor)))
+      cursor++;
+
+    char *key = cursor;
+    while (cursor < end && *cursor != '=' && *cursor != ';')
+      cursor++;
+    if (cursor >= end || *cursor != '=') {
+      continue; // a parameter without a value
+    }
+    size_t key_length = cursor - key;
+    cursor++;
+
+    char *param;
+    cursor = read_param_value(cursor, end, &param);
+
+    if (key_length == 4 && strncasecmp(key, "name", 4) == 0)
+      part->name = param;
+    else if (key_length == 8 && strncasecmp(key, "filename", 8) == 0)
+      part->filename = param;
+  }
+}
+
+// headers end in their blank line; each line's value is NUL-terminated in
+// place, which the blank line's CRLF leaves room for
+static bool parse_part_headers(MultipartParser *parser, MultipartPart *part) {
+  char *line = parser->headers;
+  char *end = parser->headers + parser->headers_length;
+
+  part->name = "";
+  part->filename = NULL;
+  part->content_type = NULL;
+
+  while (line < end) {
+    char *line_end = memchr(line, '\r', end - line);
+    if (!line_end || line_end == line)
+      break;
+
+    char *colon = memchr(line, ':', line_end - line);
+    if (!colon)
+      return false;
+
+    char *value = colon + 1;
+    while (value < line_end && is_space(*value))
+      value++;
+    char *value_end = line_end;
+    while (value_end > value && is_space(value_end[-1]))
+      value_end--;
+
+    size_t name_length = colon - line;
+    if (name_length == 19 &&
+        strncasecmp(line, "content-disposition", 19) == 0) {
+      parse_disposition(value, value_end, part);
+    } else if (name_length == 12 &&
+               strncasecmp(line, "content-type", 12) == 0) {
+      *value_end = '\0';
+      part->content_type = value;
+    }
+
+    line = line_end + 2;
+  }
+
+  return true;
+}
+
+MultipartResult multipart_parser_execute(MultipartParser *parser,
+                                         const char *data, size_t length,
+                                         const MultipartCallbacks *callbacks,
+                                         void *user_data) {
+  size_t position = 0;
+
+  while (position < length) {
+    char c = data[position];
+
+    switch (parser->state) {
+    case STATE_BODY: {
+      size_t used;
+      bool found = find_delimiter(parser, data + position, length - position,
+                                  &used, callbacks, user_data);
+      position += used;
+      if (!found)
+        return MULTIPART_INCOMPLETE;
+
+      if (parser->in_part) {
+        parser->in_part = false;
+        callbacks->on_part_end(user_data);
+      }
+      parser->state = STATE_DELIMITER_END;
+      continue;
+    }
+
+    case STATE_DELIMITER_END:
+      if (c == '-')
+        parser->state = STATE_CLOSING_DASH;
+      else if (c == '\r')
+        parser->state = STATE_DELIMITER_LF;
+      else if (!is_space(c)) // transport padding
+        return MULTIPART_ERROR;
+      break;
+
+    case STATE_DELIMITER_LF:
+      if (c != '\n')
+        return MULTIPART_ERROR;
+      parser->headers_length = 0;
+      parser->state = STATE_HEADERS;
+      break;
+
+    case STATE_CLOSING_DASH:
+      if (c != '-')
+        return MULTIPART_ERROR;
+      parser->state = STATE_DONE;
+      return MULTIPART_DONE;
+
+    case STATE_HEADERS: {
+      if (parser->headers_length == MULTIPART_MAX_HEADER_SIZE)
+        return MULTIPART_ERROR;
+      parser->headers[parser->headers_length++] = c;
+
+      size_t n = parser->headers_length;
+      bool blank_line = (n == 2 && memcmp(parser->headers, "\r\n", 2) == 0) ||
+                        (n >= 4 && memcmp(parser->headers + n - 4,
+                                          "\r\n\r\n", 4) == 0);
+      if (!blank_line)
+        break;
+
+      MultipartPart part;
+      if (!parse_part_headers(parser, &part))
+        return MULTIPART_ERROR;
+
+      parser->in_part = true;
+      parser->state = STATE_BODY;
+      callbacks->on_part(user_data, &part);
+      break;
+    }
+
+    case STATE_DONE:
+      return MULTIPART_DONE;
+    }
+
+    position++;
+  }
+
+  return parser->state == STATE_DONE ? MULTIPART_DONE : MULTIPART_INCOMPLETE;
+}
+
+bool multipart_parser_done(const MultipartParser *parser) {
+  return parser->state == STATE_DONE;
+}
+
+bool multipart_boundary(const char *content_type, size_t length,
+                        const char **boundary_out, size_t *boundary_length_out) {
+  static const char type[] = "multipart/form-data";
+  size_t type_length = sizeof(type) - 1;
+  if (length < type_length || strncasecmp(content_type, type, type_length) != 0)
+    return false;
+
+  const char *cursor = content_type + type_length;
+  const char *end = content_type + length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ';' || is_space(*cursor)))
+      cursor++;
+
+    const char *key = cursor;
+    while (cursor < end && *cursor != '=' && *cursor != ';')
+      cursor++;
+    if (cursor >= end || *cursor != '=')
+      continue;
+
+    bool is_boundary =
+        cursor - key == 8 && strncasecmp(key, "boundary", 8) == 0;
+    cursor++;
+
+    const char *value = cursor;
+    const char *value_end;
+    if (cursor < end && *cursor == '"') {
+      value = ++cursor;
+      while (cursor < end && *cursor != '"')
+        cursor++;
+      value_end = cursor;
+      if (cursor < end)
+        cursor++;
+    } else {
+      while (cursor < end && *cursor != ';' && !is_space(*cursor))
+        cursor++;
+      value_end = cursor;
+    }
+
+    if (is_boundary && value_end > value) {
+      *boundary_out = value;
+      *boundary_length_out = value_end - value;
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,427 @@
+#include "api/http_api/parser.h"
+
+#include <string.h>
+#include <strings.h>
+
+enum {
+  STATE_METHOD,
+  STATE_URL,
+  STATE_VERSION,
+  STATE_REQUEST_LINE_LF,
+  STATE_HEADER_START,
+  STATE_HEADER_NAME,
+  STATE_HEADER_VALUE_START,
+  STATE_HEADER_VALUE,
+  STATE_HEADER_LF,
+  STATE_HEADERS_END_LF,
+  STATE_BODY,
+  STATE_CHUNK_SIZE,
+  STATE_CHUNK_EXTENSION,
+  STATE_CHUNK_SIZE_LF,
+  STATE_CHUNK_DATA,
+  STATE_CHUNK_DATA_CR,
+  STATE_CHUNK_DATA_LF,
+  STATE_TRAILER_START,
+  STATE_TRAILER,
+  STATE_TRAILERS_END_LF,
+  STATE_DONE,
+};
+
+// a chunk size beyond 15 hex digits couldn't be a real upload
+#define MAX_CHUNK_SIZE_DIGITS 15
+
+static bool is_token_char(unsigned char c) {
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9'))
+    return true;
+  return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+static bool is_value_char(unsigned char c) {
+  return c == '\t' || (c >= 0x20 && c != 0x7f);
+}
+
+static HttpParseResult fail(HttpParser *parser, int status) {
+  parser->error_status = status;
+  return HTTP_PARSE_ERROR;
+}
+
+void http_parser_init(HttpParser *parser) {
+  memset(parser, 0, sizeof(HttpParser));
+  parser->state = STATE_METHOD;
+}
+
+bool http_parser_in_body(const HttpParser *parser) {
+  return parser->state >= STATE_BODY && parser->state < STATE_DONE;
+}
+
+bool http_span_equals(const char *data, HttpSpan span, const char *literal) {
+  return strlen(literal) == span.length &&
+         strncasecmp(data + span.offset, literal, span.length) == 0;
+}
+
+const HttpHeader *http_parser_find_header(const HttpParser *parser,
+                                          const char *data, const char *name) {
+  for (size_t i = 0; i < parser->header_count; i++) {
+    if (http_span_equals(data, parser->headers[i].name, name))
+      return &parser->headers[i];
+  }
+
+  return NULL;
+}
+
+// whether a comma separated header value lists `token`, e.g. "close"
+static bool span_has_token(const char *data, HttpSpan span, const char *token) {
+  size_t token_length = strlen(token);
+  const char *cursor = data + span.offset;
+  const char *end = cursor + span.length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ','))
+      cursor++;
+
+    const char *start = cursor;
+    while (cursor < end && *cursor != ',')
+      cursor++;
+
+    const char *last = cursor;
+    while (last > start && (last[-1] == ' ' || last[-1] == '\t'))
+      last--;
+
+    if ((size_t)(last - start) == token_length &&
+        strncasecmp(start, token, token_length) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+static bool parse_content_length(const char *data, HttpSpan span,
+                                 size_t *length_out) {
+  if (span.length == 0 || span.length > 15)
+    return false;
+
+  size_t length = 0;
+  for (size_t i = 0; i < span.length; i++) {
+    char c = data[span.offset + i];
+    if (c < '0' || c > '9')
+      return false;
+    length = length * 10 + (size_t)(c - '0');
+  }
+
+  *length_out = length;
+  return true;
+}
+
+static HttpParseResult on_header(HttpParser *parser, const char *data,
+                                 HttpHeader *header) {
+  if (http_span_equals(data, header->name, "content-length")) {
+    size_t length;
+    if (!parse_content_length(data, header->value, &length) ||
+        (parser->has_content_length && length != parser->content_length))
+      return fail(parser, 400);
+    parser->content_length = length;
+    parser->has_content_length = true;
+  } else if (http_span_equals(data, header->name, "transfer-encoding")) {
+    // only chunked is decoded, and it must be the one coding
+    if (!http_span_equals(data, header->value, "chunked"))
+      return fail(parser, 501);
+    parser->chunked = true;
+  }
+
+  return HTTP_PARSE_INCOMPLETE;
+}
+
+static HttpParseResult on_headers_complete(HttpParser *parser,
+                                           const char *data) {
+  parser->keep_alive = parser->version_minor >= 1;
+
+  const HttpHeader *connection =
+      http_parser_find_header(parser, data, "connection");
+  if (connection) {
+    if (span_has_token(data, connection->value, "close"))
+      parser->keep_alive = false;
+    else if (span_has_token(data, connection->value, "keep-alive"))
+      parser->keep_alive = true;
+  }
+
+  // both framings at once is how requests get smuggled past proxies
+  if (parser->chunked && parser->has_content_length)
+    return fail(parser, 400);
+
+  // the body is streamed from here, the request is dispatched without it
+  if (parser->chunked) {
+    parser->state = STATE_CHUNK_SIZE;
+  } else if (parser->content_length > 0) {
+    parser->body_remaining = parser->content_length;
+    parser->state = STATE_BODY;
+  } else {
+    parser->state = STATE_DONE;
+  }
+  return HTTP_PARSE_DONE;
+}
+
+HttpParseResult http_parser_execute(HttpParser *parser, const char *data,
+                                    size_t length) {
+  while (parser->position < length) {
+    unsigned char c = data[parser->position];
+
+    switch (parser->state) {
+    case STATE_METHOD:
+      if ((c == '\r' || c == '\n') && parser->position == parser->mark) {
+        parser->mark++; // stray CRLF between requests
+      } else if (c == ' ') {
+        if (parser->position == parser->mark)
+          return fail(parser, 400);
+        parser->method.offset = parser->mark;
+        parser->method.length = parser->position - parser->mark;
+        parser->mark = parser->position + 1;
+        parser->state = STATE_URL;
+      } else if (!is_token_char(c)) {
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_URL:
+      if (c == ' ') {
+        if (parser->position == parser->mark)
+          return fail(parser, 400);
+        parser->url.offset = parser->mark;
+        parser->url.length = parser->position - parser->mark;
+        parser->mark = parser->position + 1;
+        parser->state = STATE_VERSION;
+      } else if (c <= 0x20 || c == 0x7f) {
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_VERSION:
+      if (c == '\r' || c == '\n') {
+        const char *version = data + parser->mark;
+        if (parser->position - parser->mark != 8 ||
+            strncmp(version, "HTTP/1.", 7) != 0 ||
+            (version[7] != '0' && version[7] != '1'))
+          return fail(parser, 505);
+        parser->version_minor = version[7] - '0';
+        parser->state = c == '\r' ? STATE_REQUEST_LINE_LF : STATE_HEADER_START;
+      }
+      break;
+
+    case STATE_REQUEST_LINE_LF:
+    case STATE_HEADER_LF:
+      if (c != '\n')
+        return fail(parser, 400);
+      parser->state = STATE_HEADER_START;
+      break;
+
+    case STATE_HEADER_START:
+      if (c == '\r') {
+        parser->state = STATE_HEADERS_END_LF;
+      } else if (c == '\n') {
+        parser->position++;
+        return on_headers_complete(parser, data);
+      } else if (is_token_char(c)) {
+        if (parser->header_count == HTTP_MAX_HEADERS)
+          return fail(parser, 431);
+        parser->mark = parser->position;
+        parser->state = STATE_HEADER_NAME;
+      } else {
+        // includes obsolete line folding, which RFC 7230 lets us reject
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_HEADER_NAME:
+      if (c == ':') {
+        HttpHeader *header = &parser->headers[parser->header_count];
+        header->name.offset = parser->mark;
+        header->name.length = parser->position - parser->mark;
+        parser->state = STATE_HEADER_VALUE_START;
+      } else if (!is_token_char(c)) {
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_HEADER_VALUE_START:
+      if (c == ' ' || c == '\t')
+        break;
+      parser->mark = parser->position;
+      parser->state = STATE_HEADER_VALUE;
+      continue; // rescan as part of the value
+
+    case STATE_HEADER_VALUE:
+      if (c == '\r' || c == '\n') {
+        size_t end = parser->position;
+        while (end > parser->mark &&
+               (data[end - 1] == ' ' || data[end - 1] == '\t'))
+          end--;
+
+        HttpHeader *header = &parser->headers[parser->header_count++];
+        header->value.offset = parser->mark;
+        header->value.length = end - parser->mark;
+        if (on_header(parser, data, header) == HTTP_PARSE_ERROR)
+          return HTTP_PARSE_ERROR;
+
+        parser->state = c == '\r' ? STATE_HEADER_LF : STATE_HEADER_START;
+      } else if (!is_value_char(c)) {
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_HEADERS_END_LF:
+      if (c != '\n')
+        return fail(parser, 400);
+      parser->position++;
+      return on_headers_complete(parser, data);
+
+    default:
+      return HTTP_PARSE_DONE;
+    }
+
+    parser->position++;
+
+    if (parser->position > HTTP_MAX_HEADER_SIZE)
+      return fail(parser, 431);
+  }
+
+  return HTTP_PARSE_INCOMPLETE;
+}
+
+static int hex_digit(unsigned char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// the payload bytes of a Content-Length body or of one chunk that are here
+static void take_payload(HttpParser *parser, const char *data, size_t length,
+                         void (*on_data)(void *, const char *, size_t),
+                         void *user_data) {
+  size_t available = length - parser->position;
+  size_t run = available < parser->body_remaining ? available
+                                                  : parser->body_remaining;
+
+  on_data(user_data, data + parser->position, run);
+  parser->position += run;
+  parser->body_remaining -= run;
+}
+
+HttpParseResult http_parser_execute_body(
+    HttpParser *parser, const char *data, size_t length,
+    void (*on_data)(void *user_data, const char *data, size_t length),
+    void *user_data) {
+  while (parser->position < length) {
+    unsigned char c = data[parser->position];
+
+    switch (parser->state) {
+    case STATE_BODY:
+      take_payload(parser, data, length, on_data, user_data);
+      if (parser->body_remaining == 0) {
+        parser->state = STATE_DONE;
+        return HTTP_PARSE_DONE;
+      }
+      continue;
+
+    case STATE_CHUNK_SIZE: {
+      int digit = hex_digit(c);
+      if (digit >= 0) {
+        if (++parser->chunk_size_digits > MAX_CHUNK_SIZE_DIGITS)
+          return fail(parser, 413);
+        parser->body_remaining = parser->body_remaining * 16 + (size_t)digit;
+        break;
+      }
+      if (parser->chunk_size_digits == 0)
+        return fail(parser, 400);
+
+      if (c == ';' || c == ' ' || c == '\t') {
+        parser->state = STATE_CHUNK_EXTENSION; // ignored
+      } else if (c == '\r') {
+        parser->state = STATE_CHUNK_SIZE_LF;
+      } else if (c == '\n') {
+        parser->state = STATE_CHUNK_SIZE_LF;
+        continue; // rescan as the line's end
+      } else {
+        return fail(parser, 400);
+      }
+      break;
+    }
+
+    case STATE_CHUNK_EXTENSION:
+      if (c == '\r' || c == '\n') {
+        parser->state = STATE_CHUNK_SIZE_LF;
+        if (c == '\n')
+          continue;
+      } else if (!is_value_char(c)) {
+        return fail(parser, 400);
+      }
+      break;
+
+    case STATE_CHUNK_SIZE_LF:
+      if (c != '\n')
+        return fail(parser, 400);
+      parser->chunk_size_digits = 0;
+      parser->state =
+          parser->body_remaining > 0 ? STATE_CHUNK_DATA : STATE_TRAILER_START;
+      break;
+
+    case STATE_CHUNK_DATA:
+      take_payload(parser, data, length, on_data, user_data);
+      if (parser->body_remaining == 0)
+        parser->state = STATE_CHUNK_DATA_CR;
+      continue;
+
+    case STATE_CHUNK_DATA_CR:
+      if (c == '\r')
+        parser->state = STATE_CHUNK_DATA_LF;
+      else if (c == '\n')
+        parser->state = STATE_CHUNK_SIZE;
+      else
+        return fail(parser, 400);
+      break;
+
+    case STATE_CHUNK_DATA_LF:
+      if (c != '\n')
+        return fail(parser, 400);
+      parser->state = STATE_CHUNK_SIZE;
+      break;
+
+    // trailer fields are read past, nothing looks at them
+    case STATE_TRAILER_START:
+      if (c == '\r') {
+        parser->state = STATE_TRAILERS_END_LF;
+      } else if (c == '\n') {
+        parser->position++;
+        parser->state = STATE_DONE;
+        return HTTP_PARSE_DONE;
+      } else {
+        parser->state = STATE_TRAILER;
+      }
+      break;
+
+    case STATE_TRAILER:
+      if (c == '\n')
+        parser->state = STATE_TRAILER_START;
+      else if (c != '\r' && !is_value_char(c))
+        return fail(parser, 400);
+      break;
+
+    case STATE_TRAILERS_END_LF:
+      if (c != '\n')
+        return fail(parser, 400);
+      parser->position++;
+      parser->state = STATE_DONE;
+      return HTTP_PARSE_DONE;
+
+    default:
+      return HTTP_PARSE_DONE;
+    }
+
+    parser->position++;
+  }
+
+  return parser->state == STATE_DONE ? HTTP_PARSE_DONE : HTTP_PARSE_INCOMPLETE;
+}
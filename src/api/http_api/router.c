@@ -0,0 +1,332 @@
+#include "api/http_api/router.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static RouteNode *create_node(const char *prefix, size_t prefix_length) {
+  RouteNode *node = calloc(1, sizeof(RouteNode));
+  if (!node)
+    return NULL;
+
+  node->prefix = malloc(prefix_length + 1);
+  if (!node->prefix) {
+    free(node);
+    return NULL;
+  }
+  memcpy(node->prefix, prefix, prefix_length);
+  node->prefix[prefix_length] = '\0';
+  node->prefix_length = prefix_length;
+  return node;
+}
+
+static bool add_child(RouteNode *node, RouteNode *child) {
+  RouteNode **children =
+      realloc(node->children, (node->child_count + 1) * sizeof(RouteNode *));
+  if (!children)
+    return false;
+
+  node->children = children;
+  node->children[node->child_count++] = child;
+  return true;
+}
+
+static RouteNode *find_child(const RouteNode *node, char first) {
+  for (size_t i = 0; i < node->child_count; i++) {
+    if (node->children[i]->prefix[0] == first)
+      return node->children[i];
+  }
+
+  return NULL;
+}
+
+// turns `child` ("users") into "us" -> "ers" so a new route can branch off
+static RouteNode *split_node(RouteNode *parent, RouteNode *child,
+                             size_t common) {
+  RouteNode *head = create_node(child->prefix, common);
+  if (!head)
+    return NULL;
+
+  char *rest = malloc(child->prefix_length - common + 1);
+  if (!rest || !add_child(head, child)) {
+    free(rest);
+    free(head->prefix);
+    free(head->children);
+    free(head);
+    return NULL;
+  }
+  memcpy(rest, child->prefix + common, child->prefix_length - common + 1);
+  free(child->prefix);
+  child->prefix = rest;
+  child->prefix_length -= common;
+
+  for (size_t i = 0; i < parent->child_count; i++) {
+    if (parent->children[i] == child)
+      parent->children[i] = head;
+  }
+
+  return head;
+}
+
+static RouteNode *insert_static(RouteNode *node, const char *text,
+                                size_t length) {
+  while (length > 0) {
+    RouteNode *child = find_child(node, text[0]);
+    if (!child) {
+      child = create_node(text, length);
+      if (!child || !add_child(node, child)) {
+        if (child) {
+          free(child->prefix);
+          free(child);
+        }
+        return NULL;
+      }
+      return child;
+    }
+
+    size_t common = 0;
+    while (common < length && common < child->prefix_length &&
+           text[common] == child->prefix[common])
+      common++;
+
+    if (common < child->prefix_length) {
+      child = split_node(node, child, common);
+      if (!child)
+        return NULL;
+    }
+
+    node = child;
+    text += common;
+    length -= common;
+  }
+
+  return node;
+}
+
+void router_init(Router *router) {
+  router->root = create_node("", 0);
+  router->route_count = 0;
+}
+
+bool router_add(Router *router, const char *method, const char *pattern,
+                void *data, void **replaced) {
+  *replaced = NULL;
+  if (!router->root || pattern[0] != '/')
+    return false;
+
+  RouteNode *node = router->root;
+  const char *cursor = pattern;
+
+  while (*cursor) {
+    if (*cursor == ':') {
+      const char *name = cursor + 1;
+      size_t name_length = strcspn(name, "/");
+      if (name_length == 0 || cursor[-1] != '/')
+        return false;
+
+      if (!node->param_child) {
+        node->param_child = create_node("", 0);
+        if (!node->param_child)
+          return false;
+        node->param_child->param_name = strndup(name, name_length);
+      } else if (strlen(node->param_child->param_name) != name_length ||
+                 strncmp(node->param_child->param_name, name, name_length)) {
+        return false; // "/users/:id" and "/users/:name" can't both exist
+      }
+
+      node = node->param_child;
+      cursor = name + name_length;
+    } else if (*cursor == '*') {
+      if (cursor[1] != '\0' || cursor[-1] != '/')
+        return false;
+
+      if (!node->wildcard_child) {
+        node->wildcard_child = create_node("", 0);
+        if (!node->wildcard_child)
+          return false;
+        node->wildcard_child->param_name = strdup("*");
+      }
+
+      node = node->wildcard_child;
+      cursor++;
+    } else {
+      size_t length = strcspn(cursor, ":*");
+      node = insert_static(node, cursor, length);
+      if (!node)
+        return false;
+      cursor += length;
+    }
+  }
+
+  for (RouteHandler *handler = node->handlers; handler;
+       handler = handler->next) {
+    if (strcmp(handler->method, method) == 0) {
+      *replaced = handler->data;
+      handler->data = data;
+      return true;
+    }
+  }
+
+  RouteHandler *handler = malloc(sizeof(RouteHandler));
+  if (!handler)
+    return false;
+  handler->method = strdup(method);
+  handler->data = data;
+  handler->next = node->handlers;
+  node->handlers = handler;
+  router->route_count++;
+  return true;
+}
+
+static bool method_equals(const char *name, const char *method,
+                          size_t method_length) {
+  return strlen(name) == method_length &&
+         strncmp(name, method, method_length) == 0;
+}
+
+static const RouteHandler *find_handler(const RouteNode *node,
+                                        const char *method,
+                                        size_t method_length) {
+  for (const RouteHandler *handler = node->handlers; handler;
+       handler = handler->next) {
+    if (method_equals(handler->method, method, method_length))
+      return handler;
+  }
+
+  // HEAD falls back to GET, then any method routes
+  const char *fallbacks[] = {"GET", "*"};
+  bool is_head = method_equals("HEAD", method, method_length);
+
+  for (size_t i = is_head ? 0 : 1; i < 2; i++) {
+    for (const RouteHandler *handler = node->handlers; handler;
+         handler = handler->next) {
+      if (strcmp(handler->method, fallbacks[i]) == 0)
+        return handler;
+    }
+  }
+
+  return NULL;
+}
+
+// a route whose path fits but which doesn't take the method is remembered
+// for the Allow header, and the search goes on as from a dead end
+static bool accepts(const RouteNode *node, const char *method,
+                    size_t method_length, RouteMatch *match) {
+  const RouteHandler *handler = find_handler(node, method, method_length);
+  if (handler) {
+    match->data = handler->data;
+    return true;
+  }
+
+  if (match->allowed_count < HTTP_MAX_ROUTE_CANDIDATES)
+    match->allowed[match->allowed_count++] = node->handlers;
+  return false;
+}
+
+// static children win over params, params over wildcards; a dead end,
+// including a route without a handler for the method, backtracks to the
+// next candidate
+static const RouteNode *match_node(const RouteNode *node, const char *method,
+                                   size_t method_length, const char *path,
+                                   size_t position, size_t length,
+                                   RouteMatch *match) {
+  if (position == length && node->handlers &&
+      accepts(node, method, method_length, match))
+    return node;
+
+  if (position < length) {
+    const RouteNode *child = find_child(node, path[position]);
+    if (child && length - position >= child->prefix_length &&
+        memcmp(path + position, child->prefix, child->prefix_length) == 0) {
+      const RouteNode *found =
+          match_node(child, method, method_length, path,
+                     position + child->prefix_length, length, match);
+      if (found)
+        return found;
+    }
+  }
+
+  if (node->param_child && position < length &&
+      match->param_count < HTTP_MAX_ROUTE_PARAMS) {
+    size_t end = position;
+    while (end < length && path[end] != '/')
+      end++;
+
+    if (end > position) {
+      RouteParam *param = &match->params[match->param_count++];
+      param->name = node->param_child->param_name;
+      param->offset = position;
+      param->length = end - position;
+
+      const RouteNode *found = match_node(node->param_child, method,
+                                          method_length, path, end, length,
+                                          match);
+      if (found)
+        return found;
+      match->param_count--;
+    }
+  }
+
+  if (node->wildcard_child && node->wildcard_child->handlers &&
+      match->param_count < HTTP_MAX_ROUTE_PARAMS &&
+      accepts(node->wildcard_child, method, method_length, match)) {
+    RouteParam *param = &match->params[match->param_count++];
+    param->name = node->wildcard_child->param_name;
+    param->offset = position;
+    param->length = length - position;
+    return node->wildcard_child;
+  }
+
+  return NULL;
+}
+
+RouteResult router_match(const Router *router, const char *method,
+                         size_t method_length, const char *path,
+                         size_t path_length, RouteMatch *match) {
+  match->data = NULL;
+  match->param_count = 0;
+  match->allowed_count = 0;
+  if (!router->root)
+    return ROUTE_NOT_FOUND;
+
+  if (match_node(router->root, method, method_length, path, 0, path_length,
+                 match))
+    return ROUTE_FOUND;
+
+  match->param_count = 0;
+  return match->allowed_count > 0 ? ROUTE_METHOD_NOT_ALLOWED
+                                  : ROUTE_NOT_FOUND;
+}
+
+static void free_node(RouteNode *node,
+                      void (*release)(void *data, void *context),
+                      void *context) {
+  if (!node)
+    return;
+
+  for (size_t i = 0; i < node->child_count; i++)
+    free_node(node->children[i], release, context);
+  free_node(node->param_child, release, context);
+  free_node(node->wildcard_child, release, context);
+
+  RouteHandler *handler = node->handlers;
+  while (handler) {
+    RouteHandler *next = handler->next;
+    if (release)
+      release(handler->data, context);
+    free(handler->method);
+    free(handler);
+    handler = next;
+  }
+
+  free(node->children);
+  free(node->param_name);
+  free(node->prefix);
+  free(node);
+}
+
+void router_free(Router *router, void (*release)(void *data, void *context),
+                 void *context) {
+  free_node(router->root, release, context);
+  router->root = NULL;
+  router->route_count = 0;
+}
@@ -1,139 +1,3594 @@
 #include "api/http_api.h"
 
+#include "api/http_api/cache.h"
+#include "api/http_api/multipart.h"
+#include "api/http_api/parser.h"
+#include "api/http_api/router.h"
+#include "api/http_api/static.h"
+#include "api/http_api/websocket.h"
 #include "api/http_api_common.h"
+#include "api/streams_api.h"
 #include "constants.h"
+#include "core/cluster.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
+#include "core/socket_options.h"
+#include "core/timer_wheel.h"
+#include "core/workers.h"
+#include "pool.h"
 
 #include <JavaScriptCore/JSObjectRef.h>
 #include <JavaScriptCore/JavaScript.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
 #include <uv.h>
 
-static JSClassRef server_class = NULL;
+static THREAD_LOCAL JSClassRef server_class = NULL;
+static THREAD_LOCAL JSClassRef request_class = NULL;
+static THREAD_LOCAL JSClassRef response_class = NULL;
+static THREAD_LOCAL JSClassRef static_handler_class = NULL;
+static THREAD_LOCAL JSClassRef websocket_class = NULL;
+
+// connections and response writes come out of slabs, and a connection only
+// holds a read buffer while it has unhandled bytes, so idle keep-alive
+// connections cost little more than their TcpClientState
+static THREAD_LOCAL ObjectPool client_pool;
+static THREAD_LOCAL ObjectPool write_pool;
+static THREAD_LOCAL BufferPool read_buffer_pool;
+static THREAD_LOCAL bool pools_initialized = false;
 
 typedef struct {
   uv_tcp_t socket;
   JSContextRef ctx;
-  JSObjectRef callback;
+  JSObjectRef callback; // requests no route matched, NULL for a native 404
+  JSObjectRef upgrade_handler; // server.on("upgrade"), NULL to not upgrade
+  Router router;
+  ResponseCache *cache; // NULL unless createServer() was given { cache }
+  SocketOptions socket_options; // from listen(), applied to each client
+  bool reuse_port; // every thread binds the port, the kernel spreads accepts
+
+  // load shedding, the limits are 0 when unset. With threads each thread's
+  // server counts and limits its own share
+  int backlog;
+  size_t max_connections;
+  size_t max_pending_requests; // requests being handled at once
+  size_t connection_count;
+  size_t pending_requests;
+  uint64_t rejected_connections;
+  uint64_t rejected_requests;
 } HttpServerState;
 
-typedef struct {
-  uv_tcp_t *socket;
-  HttpServerState *server_state;
-  JSObjectRef req;
-  JSObjectRef res;
-} TcpClientState;
+// one piece of a response body, sent without another copy
+typedef struct {
+  char *data;       // owned copy of a string, NULL when borrowed
+  JSValueRef value; // protected Uint8Array/ArrayBuffer lending its bytes
+  uv_buf_t buf;
+} ResponsePart;
+
+// what writeHead()/setHeader()/write() have collected so far
+typedef struct {
+  int status_code;
+  char *headers; // "Name: value\r\n" lines
+  size_t headers_length;
+  size_t headers_capacity;
+  bool has_content_length;
+  bool headers_sent; // write() started streaming the body
+  bool chunked;
+  bool needs_drain;
+  JSObjectRef drain_handler;
+  JSObjectRef finish_handler;
+  ResponsePart *parts; // body not yet handed to the socket
+  size_t part_count;
+  size_t part_capacity;
+} HttpResponse;
+
+// keeps the bytes of one flush alive until libuv has written them
+typedef struct {
+  uv_write_t req;
+  struct TcpClientState *client_state;
+  JSContextRef ctx;
+  char *head; // status line, headers and/or chunk size line
+  SharedBuffer *shared; // a cached response's bytes
+  ResponsePart *parts;
+  size_t part_count;
+  JSObjectRef finish_handler; // the response's last write calls it
+  JSObjectRef res;
+} ResponseWrite;
+
+// a connection taken over by server.on("upgrade"), which carries frames
+// from then on. Messages reach JS whole, their fragments collect here
+typedef struct {
+  JSObjectRef ws; // protected until the connection closes
+  JSObjectRef message_handler;
+  JSObjectRef close_handler;
+  JSObjectRef pong_handler;
+  JSObjectRef drain_handler;
+
+  WebSocketFrame frame; // the frame being read, past its header
+  uint64_t frame_read;
+  bool in_frame;
+
+  char *message;
+  size_t message_length;
+  int message_opcode; // text or binary, 0 between messages
+
+  int close_code; // from the peer's close frame
+  char close_reason[WEBSOCKET_MAX_CONTROL_PAYLOAD];
+  bool close_sent;
+  bool needs_drain;
+} WebSocketState;
+
+typedef struct TcpClientState {
+  uv_tcp_t socket;
+  WheelTimer timeout; // for whichever wait `timeout_kind` says it's in
+  int timeout_kind;
+  int open_handles; // the socket and a static file transfer, freed at 0
+  HttpServerState *server_state;
+
+  // the request being handled, NULL between requests. Pipelined requests
+  // wait in the buffer until res.end(), so responses go out in order
+  JSObjectRef req;
+  JSObjectRef res;
+  unsigned req_fields; // lazy req properties already set on `req`
+  RouteMatch route; // params point into the url
+  HttpResponse response;
+
+  char *buffer; // bytes read but not yet handled, parsed in place
+  size_t buffer_length;
+  size_t buffer_capacity;
+  HttpParser parser;
+
+  // req's body, made when the handler first reads from req. Until then the
+  // body waits undecoded in the buffer
+  ReadableStreamState *body_stream;
+  struct MultipartUpload *multipart; // ... or req.multipart() saving it
+
+  WebSocketState *websocket; // set once the connection is upgraded
+
+  bool in_request;
+  bool dispatching;
+  bool cache_fill;    // the response is stored under the request's key
+  bool cache_refresh; // ... replacing a stale entry marked as refreshing
+  bool sendfile_pending; // the threadpool is writing to the socket's fd
+  bool close_deferred;   // close once it's done, the fd can't be reused yet
+  bool reading;
+  bool closing;
+} TcpClientState;
+
+// the one connection timeout that applies, by what it's waiting for
+enum {
+  TIMEOUT_NONE,       // the handler has the request and isn't reading it
+  TIMEOUT_KEEP_ALIVE, // the next request
+  TIMEOUT_HEADERS,    // the rest of the headers, from the request's first byte
+  TIMEOUT_BODY,       // more of the body, restarted as it arrives
+  TIMEOUT_CLOSING,    // the peer's answer to our WebSocket close frame
+};
+
+static void process_requests(TcpClientState *client_state);
+static void release_multipart(TcpClientState *client_state);
+static void release_websocket(TcpClientState *client_state);
+
+static void unprotect_route_handler(void *handler, void *ctx) {
+  JSValueUnprotect((JSContextRef)ctx, (JSObjectRef)handler);
+}
+
+static void http_server_finalize(JSObjectRef object) {
+  HttpServerState *server = (HttpServerState *)JSObjectGetPrivate(object);
+  if (server) {
+    if (server->callback) {
+      JSValueUnprotect(server->ctx, server->callback);
+    }
+    if (server->upgrade_handler) {
+      JSValueUnprotect(server->ctx, server->upgrade_handler);
+    }
+    router_free(&server->router, unprotect_route_handler, (void *)server->ctx);
+    response_cache_free(server->cache);
+    uv_close((uv_handle_t *)&server->socket, NULL);
+    free(server);
+  }
+}
+
+static void free_parts(JSContextRef ctx, ResponsePart *parts, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (parts[i].value) {
+      JSValueUnprotect(ctx, parts[i].value);
+    }
+    free(parts[i].data);
+  }
+  free(parts);
+}
+
+static void reset_response(TcpClientState *client_state) {
+  HttpResponse *response = &client_state->response;
+  JSContextRef ctx = client_state->server_state->ctx;
+  free_parts(ctx, response->parts, response->part_count);
+  free(response->headers);
+  if (response->drain_handler)
+    JSValueUnprotect(ctx, response->drain_handler);
+  if (response->finish_handler)
+    JSValueUnprotect(ctx, response->finish_handler);
+
+  memset(response, 0, sizeof(HttpResponse));
+  response->status_code = 200;
+}
+
+static void release_read_buffer(TcpClientState *client_state, bool force) {
+  // lazy req fields still point into the buffer while a request is handled
+  if (!client_state->buffer ||
+      (!force && (client_state->buffer_length > 0 || client_state->in_request))) {
+    return;
+  }
+
+  if (client_state->buffer_capacity == HTTP_READ_BUFFER_SIZE) {
+    buffer_pool_release(&read_buffer_pool, client_state->buffer);
+  } else {
+    free(client_state->buffer);
+  }
+
+  client_state->buffer = NULL;
+  client_state->buffer_length = 0;
+  client_state->buffer_capacity = 0;
+}
+
+static void release_client(TcpClientState *client_state) {
+  if (--client_state->open_handles > 0) {
+    return;
+  }
+
+  if (client_state->server_state) {
+    client_state->server_state->connection_count--;
+  }
+
+  release_read_buffer(client_state, true);
+  pool_free(&client_pool, client_state);
+}
+
+static void on_client_handle_close(uv_handle_t *handle) {
+  release_client(handle->data);
+}
+
+// detaches req/res from the connection, JS may still hold them
+static void release_request_objects(TcpClientState *client_state) {
+  JSContextRef ctx = client_state->server_state->ctx;
+
+  // what's left of the body is dropped as it arrives
+  ReadableStreamState *body_stream = client_state->body_stream;
+  if (body_stream) {
+    client_state->body_stream = NULL;
+    readable_stream_push_error(body_stream,
+                               "Request closed before its body ended");
+    JSValueUnprotect(ctx, body_stream->stream_obj);
+  }
+  release_multipart(client_state);
+
+  if (client_state->req) {
+    JSObjectSetPrivate(client_state->req, NULL);
+    JSValueUnprotect(ctx, client_state->req);
+    client_state->req = NULL;
+  }
+
+  if (client_state->res) {
+    JSObjectSetPrivate(client_state->res, NULL);
+    JSValueUnprotect(ctx, client_state->res);
+    client_state->res = NULL;
+  }
+}
+
+// "GET <url>" and the value of each vary header; HEAD shares GET's entries.
+// 0 when it doesn't fit `size`
+static size_t build_cache_key(TcpClientState *client_state, char *key,
+                              size_t size) {
+  const HttpParser *parser = &client_state->parser;
+  const ResponseCache *cache = client_state->server_state->cache;
+  const char *data = client_state->buffer;
+
+  size_t length = 4 + parser->url.length;
+  if (length > size) {
+    return 0;
+  }
+  memcpy(key, "GET ", 4);
+  memcpy(key + 4, data + parser->url.offset, parser->url.length);
+
+  for (size_t i = 0; i < cache->vary_count; i++) {
+    const HttpHeader *header =
+        http_parser_find_header(parser, data, cache->vary[i]);
+    size_t value_length = header ? header->value.length : 0;
+    if (length + 1 + value_length > size) {
+      return 0;
+    }
+
+    key[length++] = '\n';
+    if (header) {
+      memcpy(key + length, data + header->value.offset, value_length);
+      length += value_length;
+    }
+  }
+
+  return length;
+}
+
+// a refresh that ended without storing a response lets the next request
+// for the stale entry try again
+static void end_cache_fill(TcpClientState *client_state) {
+  if (client_state->cache_refresh) {
+    ResponseCache *cache = client_state->server_state->cache;
+    char key[HTTP_CACHE_KEY_SIZE];
+    size_t key_length = build_cache_key(client_state, key, sizeof(key));
+    CacheEntry *entry = response_cache_find(cache, key, key_length);
+    if (entry) {
+      entry->refreshing = false;
+    }
+  }
+
+  client_state->cache_fill = false;
+  client_state->cache_refresh = false;
+}
+
+static void close_client(TcpClientState *client_state) {
+  if (uv_is_closing((uv_handle_t *)&client_state->socket)) {
+    return;
+  }
+
+  client_state->closing = true;
+  wheel_timer_stop(&client_state->timeout);
+  if (client_state->sendfile_pending) {
+    client_state->close_deferred = true;
+    return;
+  }
+
+  if (client_state->in_request) {
+    client_state->in_request = false;
+    client_state->server_state->pending_requests--;
+  }
+
+  end_cache_fill(client_state);
+  release_request_objects(client_state);
+  release_websocket(client_state);
+  reset_response(client_state);
+  uv_close((uv_handle_t *)&client_state->socket, on_client_handle_close);
+}
+
+static void on_client_shutdown(uv_shutdown_t *req, int status) {
+  close_client(req->data);
+  free(req);
+}
+
+// closes after pending response writes have been flushed
+static void end_connection(TcpClientState *client_state) {
+  if (client_state->closing) {
+    return;
+  }
+
+  client_state->closing = true;
+  uv_read_stop((uv_stream_t *)&client_state->socket);
+  wheel_timer_stop(&client_state->timeout);
+
+  uv_shutdown_t *shutdown_req = malloc(sizeof(uv_shutdown_t));
+  shutdown_req->data = client_state;
+  if (uv_shutdown(shutdown_req, (uv_stream_t *)&client_state->socket,
+                  on_client_shutdown) < 0) {
+    free(shutdown_req);
+    close_client(client_state);
+  }
+}
+
+static void start_reading(TcpClientState *client_state);
+static void arm_timeout(TcpClientState *client_state);
+
+static void pause_reading(TcpClientState *client_state) {
+  if (client_state->reading) {
+    uv_read_stop((uv_stream_t *)&client_state->socket);
+    client_state->reading = false;
+  }
+}
+
+// drops the handled request, keeping any bytes of the next one
+static void consume_request(TcpClientState *client_state) {
+  size_t used = client_state->parser.position;
+  size_t remaining = client_state->buffer_length - used;
+
+  memmove(client_state->buffer, client_state->buffer + used, remaining);
+  client_state->buffer_length = remaining;
+  http_parser_init(&client_state->parser);
+}
+
+// called once the response has been queued, moves on to the next request
+static void finish_request(TcpClientState *client_state) {
+  end_cache_fill(client_state);
+  release_request_objects(client_state);
+  client_state->in_request = false;
+  client_state->server_state->pending_requests--;
+
+  if (!client_state->parser.keep_alive) {
+    end_connection(client_state);
+    return;
+  }
+
+  // the rest of an unread body is skipped first, see process_requests
+  if (!http_parser_in_body(&client_state->parser)) {
+    consume_request(client_state);
+  }
+  start_reading(client_state);
+
+  // otherwise on_client_read does both once the parse loop is done
+  if (!client_state->dispatching) {
+    process_requests(client_state);
+    release_read_buffer(client_state, false);
+    arm_timeout(client_state);
+  }
+}
+
+static bool append_header(JSContextRef ctx, HttpResponse *response,
+                          const char *name, const char *value,
+                          JSValueRef *js_err_str) {
+  if (strpbrk(name, "\r\n:") || strpbrk(value, "\r\n") || !*name) {
+    set_js_error(ctx, "Invalid response header", js_err_str);
+    return false;
+  }
+
+  size_t name_length = strlen(name);
+  size_t value_length = strlen(value);
+  size_t needed = response->headers_length + name_length + value_length + 4;
+
+  if (needed > response->headers_capacity) {
+    size_t capacity = response->headers_capacity ? response->headers_capacity
+                                                 : HTTP_RESPONSE_BUFFER_SIZE;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    char *headers = realloc(response->headers, capacity);
+    if (!headers) {
+      set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+      return false;
+    }
+    response->headers = headers;
+    response->headers_capacity = capacity;
+  }
+
+  char *cursor = response->headers + response->headers_length;
+  memcpy(cursor, name, name_length);
+  memcpy(cursor + name_length, ": ", 2);
+  memcpy(cursor + name_length + 2, value, value_length);
+  memcpy(cursor + name_length + 2 + value_length, "\r\n", 2);
+  response->headers_length = needed;
+
+  if (strcasecmp(name, "content-length") == 0) {
+    response->has_content_length = true;
+  }
+
+  return true;
+}
+
+// drops the lines already collected for `name`, case-insensitively
+static void remove_header(HttpResponse *response, const char *name) {
+  size_t name_length = strlen(name);
+  char *line = response->headers;
+  char *end = response->headers + response->headers_length;
+
+  while (line < end) {
+    char *line_end = (char *)memchr(line, '\n', end - line) + 1;
+    if ((size_t)(line_end - line) > name_length && line[name_length] == ':' &&
+        strncasecmp(line, name, name_length) == 0) {
+      memmove(line, line_end, end - line_end);
+      end -= line_end - line;
+    } else {
+      line = line_end;
+    }
+  }
+
+  response->headers_length = end - response->headers;
+  if (strcasecmp(name, "content-length") == 0) {
+    response->has_content_length = false;
+  }
+}
+
+// a header set again replaces its earlier value. Connection stays the
+// server's to send, "close" only asks for the connection to end after this
+// response
+static bool set_js_header(JSContextRef ctx, TcpClientState *client_state,
+                          JSValueRef name_value, JSValueRef value,
+                          JSValueRef *js_err_str) {
+  char *name = to_c_str(ctx, name_value, js_err_str);
+  if (*js_err_str) {
+    return false;
+  }
+
+  char *c_value = to_c_str(ctx, value, js_err_str);
+  if (*js_err_str) {
+    free(name);
+    return false;
+  }
+
+  bool set = true;
+  if (strcasecmp(name, "connection") == 0) {
+    if (strcasecmp(c_value, "close") == 0) {
+      client_state->parser.keep_alive = false;
+    }
+  } else {
+    remove_header(&client_state->response, name);
+    set = append_header(ctx, &client_state->response, name, c_value,
+                        js_err_str);
+  }
+
+  free(name);
+  free(c_value);
+  return set;
+}
+
+// Uint8Array/ArrayBuffer bodies are borrowed until written, strings are
+// converted to UTF-8 once
+static bool push_part(HttpResponse *response, ResponsePart part) {
+  if (response->part_count == response->part_capacity) {
+    size_t capacity = response->part_capacity ? response->part_capacity * 2 : 4;
+    ResponsePart *parts = realloc(response->parts, capacity * sizeof(*parts));
+    if (!parts) {
+      return false;
+    }
+    response->parts = parts;
+    response->part_capacity = capacity;
+  }
+
+  response->parts[response->part_count++] = part;
+  return true;
+}
+
+static bool append_part(JSContextRef ctx, HttpResponse *response,
+                        JSValueRef chunk, JSValueRef *js_err_str) {
+  ResponsePart part = {NULL, NULL, uv_buf_init(NULL, 0)};
+  char *bytes;
+  size_t length;
+
+  if (get_byte_span(ctx, chunk, &bytes, &length)) {
+    part.value = chunk;
+    part.buf = uv_buf_init(bytes, length);
+  } else {
+    part.data = to_bytes(ctx, chunk, &length, js_err_str);
+    if (*js_err_str) {
+      return false;
+    }
+    part.buf = uv_buf_init(part.data, length);
+  }
+
+  if (length == 0) {
+    free(part.data);
+    return true;
+  }
+
+  if (!push_part(response, part)) {
+    free(part.data);
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return false;
+  }
+
+  if (part.value) {
+    JSValueProtect(ctx, part.value);
+  }
+  return true;
+}
+
+// 1xx, 204 and 304 responses have no body, nor a header framing one
+static bool status_has_body(int status) {
+  return status >= 200 && status != 204 && status != 304;
+}
+
+// the last header of every response, the only one that depends on the request
+static const char *connection_header(TcpClientState *client_state) {
+  if (!client_state->parser.keep_alive) {
+    return "Connection: close\r\n";
+  }
+  if (client_state->parser.version_minor == 0) {
+    return "Connection: keep-alive\r\n";
+  }
+  return "";
+}
+
+// `body_length` is only used when neither chunked, a handler-set
+// Content-Length nor closing the connection delimits the body
+static char *build_response_head(TcpClientState *client_state,
+                                 size_t body_length, bool close_delimited,
+                                 size_t extra_capacity, size_t *length_out) {
+  HttpResponse *response = &client_state->response;
+  const char *connection = connection_header(client_state);
+
+  size_t capacity =
+      response->headers_length + HTTP_RESPONSE_BUFFER_SIZE + extra_capacity;
+  char *head = malloc(capacity);
+  if (!head) {
+    return NULL;
+  }
+
+  int status = response->status_code;
+  size_t length = snprintf(head, capacity, "HTTP/1.1 %d %s\r\n", status,
+                           http_status_text(status));
+
+  if (response->headers_length > 0) {
+    memcpy(head + length, response->headers, response->headers_length);
+    length += response->headers_length;
+  }
+
+  if (!status_has_body(status)) {
+    // nothing to frame
+  } else if (response->chunked) {
+    length += snprintf(head + length, capacity - length,
+                       "Transfer-Encoding: chunked\r\n");
+  } else if (!response->has_content_length && !close_delimited) {
+    length += snprintf(head + length, capacity - length,
+                       "Content-Length: %zu\r\n", body_length);
+  }
+
+  length += snprintf(head + length, capacity - length, "%s\r\n", connection);
+
+  *length_out = length;
+  return head;
+}
+
+static void emit_response_event(JSContextRef ctx, JSObjectRef handler,
+                                JSObjectRef res) {
+  JSValueRef exception = NULL;
+  JSObjectCallAsFunction(ctx, handler, res, 0, NULL, &exception);
+
+  if (exception) {
+    JSStringRef err_str = JSValueToStringCopy(ctx, exception, NULL);
+    char err_buffer[ERROR_MSG_BUFFER_SIZE];
+    JSStringGetUTF8CString(err_str, err_buffer, sizeof(err_buffer));
+    fprintf(stderr, "Response event handler error: %s\n", err_buffer);
+    JSStringRelease(err_str);
+  }
+}
+
+static void release_response_write(ResponseWrite *write, bool written) {
+  free_parts(write->ctx, write->parts, write->part_count);
+  free(write->head);
+  if (write->shared) {
+    shared_buffer_release(write->shared);
+  }
+
+  if (write->finish_handler) {
+    if (written) {
+      emit_response_event(write->ctx, write->finish_handler, write->res);
+    }
+    JSValueUnprotect(write->ctx, write->finish_handler);
+    JSValueUnprotect(write->ctx, write->res);
+  }
+}
+
+static bool below_watermark(TcpClientState *client_state) {
+  return client_state->socket.write_queue_size < HTTP_RESPONSE_HIGH_WATERMARK;
+}
+
+static void on_response_written(uv_write_t *req, int status) {
+  ResponseWrite *write = (ResponseWrite *)req;
+  TcpClientState *client_state = write->client_state;
+  release_response_write(write, status == 0);
+  pool_free(&write_pool, write);
+
+  WebSocketState *websocket = client_state->websocket;
+  if (status == 0 && websocket && websocket->needs_drain &&
+      below_watermark(client_state)) {
+    websocket->needs_drain = false;
+    if (websocket->drain_handler) {
+      emit_response_event(client_state->server_state->ctx,
+                          websocket->drain_handler, websocket->ws);
+    }
+  }
+
+  HttpResponse *response = &client_state->response;
+  if (status == 0 && response->needs_drain && below_watermark(client_state)) {
+    response->needs_drain = false;
+    if (response->drain_handler) {
+      emit_response_event(client_state->server_state->ctx,
+                          response->drain_handler, client_state->res);
+    }
+  }
+}
+
+// tries uv_try_write first, so a writable socket needs no write request, and
+// queues whatever it didn't take. `owned` keeps the bytes behind `bufs` alive
+static void send_buffers(TcpClientState *client_state, uv_buf_t *bufs,
+                         size_t buf_count, ResponseWrite *owned) {
+  uv_stream_t *stream = (uv_stream_t *)&client_state->socket;
+
+  int written = uv_try_write(stream, bufs, buf_count);
+  if (written < 0 && written != UV_EAGAIN) {
+    fprintf(stderr, "Response write error: %s\n", uv_strerror(written));
+    release_response_write(owned, false);
+    close_client(client_state);
+    return;
+  }
+
+  size_t skip = written > 0 ? (size_t)written : 0;
+  while (buf_count > 0 && skip >= bufs->len) {
+    skip -= bufs->len;
+    bufs++;
+    buf_count--;
+  }
+
+  if (buf_count == 0) {
+    release_response_write(owned, true);
+    return;
+  }
+
+  bufs->base += skip;
+  bufs->len -= skip;
+
+  ResponseWrite *write = pool_alloc(&write_pool);
+  if (!write) {
+    release_response_write(owned, false);
+    close_client(client_state);
+    return;
+  }
+  *write = *owned;
+
+  int write_result =
+      uv_write(&write->req, stream, bufs, buf_count, on_response_written);
+  if (write_result < 0) {
+    fprintf(stderr, "Response write error: %s\n", uv_strerror(write_result));
+    release_response_write(write, false);
+    pool_free(&write_pool, write);
+    close_client(client_state);
+  }
+}
+
+// keeps a copy of a complete 200 response, its head up to the Connection
+// header followed by the body, for requests with the same key
+static void store_cached_response(TcpClientState *client_state,
+                                  const char *head, size_t head_length,
+                                  size_t body_length) {
+  HttpResponse *response = &client_state->response;
+  ResponseCache *cache = client_state->server_state->cache;
+
+  if (response->status_code != 200 ||
+      !response_cache_storable(cache, response->headers,
+                               response->headers_length)) {
+    return;
+  }
+
+  char key[HTTP_CACHE_KEY_SIZE];
+  size_t key_length = build_cache_key(client_state, key, sizeof(key));
+  if (key_length == 0) {
+    return;
+  }
+
+  size_t cached_head_length =
+      head_length - strlen(connection_header(client_state)) - 2;
+  char *data = malloc(cached_head_length + body_length);
+  if (!data) {
+    return;
+  }
+
+  memcpy(data, head, cached_head_length);
+  size_t length = cached_head_length;
+  for (size_t i = 0; i < response->part_count; i++) {
+    memcpy(data + length, response->parts[i].buf.base,
+           response->parts[i].buf.len);
+    length += response->parts[i].buf.len;
+  }
+
+  SharedBuffer *shared = shared_buffer_create(data, length);
+  if (!shared) {
+    free(data);
+    return;
+  }
+
+  response_cache_put(cache, key, key_length, shared, cached_head_length,
+                     uv_now(loop));
+}
+
+// sends the headers if they haven't gone out yet, then the collected body
+// parts, framed as one chunk when the response is chunked
+static void flush_response(TcpClientState *client_state, bool ending) {
+  HttpResponse *response = &client_state->response;
+  JSContextRef ctx = client_state->server_state->ctx;
+
+  // HEAD responses describe the body without sending it
+  bool head_only =
+      http_span_equals(client_state->buffer, client_state->parser.method,
+                       "HEAD") ||
+      !status_has_body(response->status_code);
+
+  size_t body_length = 0;
+  for (size_t i = 0; i < response->part_count; i++) {
+    body_length += response->parts[i].buf.len;
+  }
+
+  char *head = NULL;
+  size_t head_length = 0;
+
+  if (!response->headers_sent) {
+    bool close_delimited = false;
+    if (!ending && !response->has_content_length &&
+        status_has_body(response->status_code)) {
+      if (client_state->parser.version_minor >= 1) {
+        response->chunked = true;
+      } else {
+        // HTTP/1.0 has no chunked encoding, the body ends with the connection
+        client_state->parser.keep_alive = false;
+        close_delimited = true;
+      }
+    }
+
+    head = build_response_head(client_state, body_length, close_delimited,
+                               HTTP_CHUNK_LINE_SIZE, &head_length);
+    response->headers_sent = true;
+
+    // only responses sent whole, by end() alone, are cached
+    if (head && ending && client_state->cache_fill && !response->chunked) {
+      store_cached_response(client_state, head, head_length, body_length);
+    }
+  }
+
+  bool frame = response->chunked && !head_only;
+  if (frame && body_length > 0) {
+    if (!head) {
+      head = malloc(HTTP_CHUNK_LINE_SIZE);
+    }
+    head_length += snprintf(head + head_length, HTTP_CHUNK_LINE_SIZE,
+                            "%zx\r\n", body_length);
+  }
+
+  const char *trailer = NULL;
+  if (frame) {
+    if (body_length > 0) {
+      trailer = ending ? "\r\n0\r\n\r\n" : "\r\n";
+    } else if (ending) {
+      trailer = "0\r\n\r\n";
+    }
+  }
+
+  uv_buf_t stack_bufs[HTTP_RESPONSE_STACK_BUFS];
+  size_t max_bufs = response->part_count + 2;
+  uv_buf_t *bufs = max_bufs <= HTTP_RESPONSE_STACK_BUFS
+                       ? stack_bufs
+                       : malloc(max_bufs * sizeof(uv_buf_t));
+  size_t buf_count = 0;
+
+  if (head) {
+    bufs[buf_count++] = uv_buf_init(head, head_length);
+  }
+  if (!head_only) {
+    for (size_t i = 0; i < response->part_count; i++) {
+      bufs[buf_count++] = response->parts[i].buf;
+    }
+  }
+  if (trailer) {
+    bufs[buf_count++] = uv_buf_init((char *)trailer, strlen(trailer));
+  }
+
+  // the write takes over the collected parts from here on
+  ResponseWrite owned = {.client_state = client_state,
+                         .ctx = ctx,
+                         .head = head,
+                         .parts = response->parts,
+                         .part_count = response->part_count};
+  response->parts = NULL;
+  response->part_count = 0;
+  response->part_capacity = 0;
+
+  if (ending && response->finish_handler) {
+    owned.finish_handler = response->finish_handler;
+    owned.res = client_state->res;
+    JSValueProtect(ctx, owned.res);
+    response->finish_handler = NULL;
+  }
+
+  if (buf_count > 0) {
+    send_buffers(client_state, bufs, buf_count, &owned);
+  } else {
+    release_response_write(&owned, true);
+  }
+
+  if (bufs != stack_bufs) {
+    free(bufs);
+  }
+}
+
+static JSValueRef res_write_head(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "res.writeHead", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (client_state->response.headers_sent) {
+    set_js_error(ctx, ERR_HEADERS_SENT, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  double status = JSValueToNumber(ctx, args[0], js_err_str);
+  if (*js_err_str || !(status >= 100 && status <= 999)) {
+    set_js_error(ctx, "Invalid status code", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  client_state->response.status_code = (int)status;
+
+  if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+    JSObjectRef headers = (JSObjectRef)args[1];
+    JSPropertyNameArrayRef names = JSObjectCopyPropertyNames(ctx, headers);
+    size_t count = JSPropertyNameArrayGetCount(names);
+
+    for (size_t i = 0; i < count; i++) {
+      JSStringRef name = JSPropertyNameArrayGetNameAtIndex(names, i);
+      JSValueRef value = JSObjectGetProperty(ctx, headers, name, NULL);
+      if (!set_js_header(ctx, client_state, JSValueMakeString(ctx, name),
+                         value, js_err_str)) {
+        break;
+      }
+    }
+
+    JSPropertyNameArrayRelease(names);
+  }
+
+  return this_obj;
+}
+
+static JSValueRef res_set_header(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "res.setHeader", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (client_state->response.headers_sent) {
+    set_js_error(ctx, ERR_HEADERS_SENT, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  set_js_header(ctx, client_state, args[0], args[1], js_err_str);
+  return this_obj;
+}
+
+// streams the chunk right away, chunked unless the handler set a
+// Content-Length. false means the socket is backed up: wait for 'drain'
+static JSValueRef res_write(JSContextRef ctx, JSObjectRef js_fn,
+                            JSObjectRef this_obj, size_t argc,
+                            const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "res.write", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!append_part(ctx, &client_state->response, args[0], js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  flush_response(client_state, false);
+  if (client_state->closing) {
+    return JSValueMakeBoolean(ctx, false);
+  }
+
+  bool can_continue = below_watermark(client_state);
+  if (!can_continue) {
+    client_state->response.needs_drain = true;
+  }
+
+  return JSValueMakeBoolean(ctx, can_continue);
+}
+
+static JSValueRef res_end(JSContextRef ctx, JSObjectRef js_fn,
+                          JSObjectRef this_obj, size_t argc,
+                          const JSValueRef args[], JSValueRef *js_err_str) {
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (argc > 0 && !JSValueIsUndefined(ctx, args[0]) &&
+      !append_part(ctx, &client_state->response, args[0], js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  flush_response(client_state, true);
+
+  if (!client_state->closing) {
+    reset_response(client_state);
+    finish_request(client_state);
+  }
+  return JSValueMakeUndefined(ctx);
+}
+
+static JSValueRef res_on(JSContextRef ctx, JSObjectRef js_fn,
+                         JSObjectRef this_obj, size_t argc,
+                         const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "res.on", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef handler;
+  if (!to_callback(ctx, args[1], &handler, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *event_name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  HttpResponse *response = &client_state->response;
+  JSObjectRef *slot = NULL;
+  if (strcmp(event_name, "drain") == 0) {
+    slot = &response->drain_handler;
+  } else if (strcmp(event_name, "finish") == 0) {
+    slot = &response->finish_handler;
+  }
+  free(event_name);
+
+  if (slot) {
+    if (*slot) {
+      JSValueUnprotect(ctx, *slot);
+    }
+    *slot = handler;
+    JSValueProtect(ctx, handler);
+  }
+
+  return this_obj;
+}
+
+#define ERROR_RESPONSE(status, text)                                          \
+  "HTTP/1.1 " #status " " text "\r\n"                                         \
+  "Content-Length: 0\r\n"                                                    \
+  "Connection: close\r\n"                                                    \
+  "\r\n"
+
+static const char *error_response(int status) {
+  switch (status) {
+  case 408:
+    return ERROR_RESPONSE(408, "Request Timeout");
+  case 413:
+    return ERROR_RESPONSE(413, "Content Too Large");
+  case 431:
+    return ERROR_RESPONSE(431, "Request Header Fields Too Large");
+  case 501:
+    return ERROR_RESPONSE(501, "Not Implemented");
+  case 503:
+    return "HTTP/1.1 503 Service Unavailable\r\n"
+           "Retry-After: " HTTP_RETRY_AFTER_SECONDS "\r\n"
+           "Content-Length: 0\r\n"
+           "Connection: close\r\n"
+           "\r\n";
+  case 505:
+    return ERROR_RESPONSE(505, "HTTP Version Not Supported");
+  default:
+    return ERROR_RESPONSE(400, "Bad Request");
+  }
+}
+
+static void write_literal(TcpClientState *client_state, const char *response) {
+  uv_buf_t buffer = uv_buf_init((char *)response, strlen(response));
+
+  uv_write_t *write_req = malloc(sizeof(uv_write_t));
+  write_req->data = NULL; // static response, nothing to free
+  if (uv_write(write_req, (uv_stream_t *)&client_state->socket, &buffer, 1,
+               http_write_complete) < 0) {
+    free(write_req);
+  }
+}
+
+// answers a request the parser rejected, then closes the connection
+static void send_error_response(TcpClientState *client_state, int status) {
+  write_literal(client_state, error_response(status));
+  end_connection(client_state);
+}
+
+static void on_connection_timeout(WheelTimer *timer) {
+  TcpClientState *client_state =
+      (TcpClientState *)((char *)timer - offsetof(TcpClientState, timeout));
+
+  // a handler's response may already be under way, so no 408 then
+  if (client_state->timeout_kind == TIMEOUT_KEEP_ALIVE ||
+      client_state->timeout_kind == TIMEOUT_CLOSING ||
+      client_state->in_request) {
+    close_client(client_state);
+  } else {
+    send_error_response(client_state, 408);
+  }
+}
+
+// a slow client can't stretch the headers out by trickling them, that
+// timeout runs from the request's first byte. The body's restarts on every
+// read, so only a stalled upload is cut off, and not while the handler
+// has yet to read it or has paused it
+static void arm_timeout(TcpClientState *client_state) {
+  if (client_state->closing) {
+    return;
+  }
+
+  int kind = TIMEOUT_KEEP_ALIVE;
+  uint64_t timeout_ms = HTTP_KEEP_ALIVE_TIMEOUT_MS;
+  if (client_state->websocket) {
+    // an open WebSocket may idle for as long as the application likes
+    kind = client_state->websocket->close_sent ? TIMEOUT_CLOSING
+                                                : TIMEOUT_NONE;
+    timeout_ms = WEBSOCKET_CLOSE_TIMEOUT_MS;
+  } else if (http_parser_in_body(&client_state->parser) &&
+      (!client_state->in_request ||
+       ((client_state->body_stream || client_state->multipart) &&
+        client_state->reading))) {
+    kind = TIMEOUT_BODY;
+    timeout_ms = HTTP_BODY_TIMEOUT_MS;
+  } else if (client_state->in_request) {
+    kind = TIMEOUT_NONE;
+  } else if (client_state->buffer_length > 0) {
+    kind = TIMEOUT_HEADERS;
+    timeout_ms = HTTP_HEADER_TIMEOUT_MS;
+  }
+
+  if (kind == client_state->timeout_kind && kind != TIMEOUT_BODY) {
+    return;
+  }
+
+  client_state->timeout_kind = kind;
+  if (kind == TIMEOUT_NONE) {
+    wheel_timer_stop(&client_state->timeout);
+    return;
+  }
+
+  wheel_timer_start(&client_state->timeout, timeout_ms, on_connection_timeout);
+}
+
+// `data` always has a spare byte past the span (see client_alloc_buffer), so
+// it is NUL-terminated in place rather than copied first
+static JSValueRef make_span_string(JSContextRef ctx, char *data, HttpSpan span) {
+  char *end = data + span.offset + span.length;
+  char saved = *end;
+  *end = '\0';
+
+  JSStringRef str = JSStringCreateWithUTF8CString(data + span.offset);
+  JSValueRef value = JSValueMakeString(ctx, str);
+  JSStringRelease(str);
+
+  *end = saved;
+  return value;
+}
+
+static JSValueRef req_get_header(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "req.getHeader", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  // headers point into the connection buffer, which only holds the request
+  // until res.end()
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  const HttpHeader *header = http_parser_find_header(
+      &client_state->parser, client_state->buffer, name);
+  free(name);
+
+  if (!header) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  return make_span_string(ctx, client_state->buffer, header->value);
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// form-urlencoded: '+' is a space and %XX a byte. `dest` needs `length` bytes
+static size_t decode_component(const char *src, size_t length, char *dest) {
+  size_t written = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    if (src[i] == '+') {
+      dest[written++] = ' ';
+    } else if (src[i] == '%' && i + 2 < length && hex_value(src[i + 1]) >= 0 &&
+               hex_value(src[i + 2]) >= 0) {
+      dest[written++] = (char)(hex_value(src[i + 1]) * 16 + hex_value(src[i + 2]));
+      i += 2;
+    } else {
+      dest[written++] = src[i];
+    }
+  }
+
+  return written;
+}
+
+static JSValueRef make_c_string_value(JSContextRef ctx, const char *data) {
+  JSStringRef str = JSStringCreateWithUTF8CString(data);
+  JSValueRef value = JSValueMakeString(ctx, str);
+  JSStringRelease(str);
+  return value;
+}
+
+static JSValueRef make_req_method(JSContextRef ctx,
+                                  TcpClientState *client_state) {
+  return make_span_string(ctx, client_state->buffer,
+                          client_state->parser.method);
+}
+
+static JSValueRef make_req_url(JSContextRef ctx, TcpClientState *client_state) {
+  return make_span_string(ctx, client_state->buffer, client_state->parser.url);
+}
+
+static bool same_header_name(const char *data, HttpSpan a, HttpSpan b) {
+  return a.length == b.length &&
+         strncasecmp(data + a.offset, data + b.offset, a.length) == 0;
+}
+
+// lowercased names; repeated headers are joined with ", "
+static JSValueRef make_req_headers(JSContextRef ctx,
+                                   TcpClientState *client_state) {
+  const HttpParser *parser = &client_state->parser;
+  const char *data = client_state->buffer;
+  JSObjectRef headers = JSObjectMake(ctx, NULL, NULL);
+
+  for (size_t i = 0; i < parser->header_count; i++) {
+    HttpSpan name = parser->headers[i].name;
+
+    bool seen = false;
+    size_t value_length = 0;
+    for (size_t j = 0; j < parser->header_count; j++) {
+      if (!same_header_name(data, name, parser->headers[j].name))
+        continue;
+      if (j < i) {
+        seen = true;
+        break;
+      }
+      value_length += parser->headers[j].value.length + 2;
+    }
+    if (seen)
+      continue;
+
+    char *name_str = malloc(name.length + 1);
+    for (size_t k = 0; k < name.length; k++) {
+      char c = data[name.offset + k];
+      name_str[k] = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+    name_str[name.length] = '\0';
+
+    char *value = malloc(value_length + 1);
+    size_t written = 0;
+    for (size_t j = i; j < parser->header_count; j++) {
+      if (!same_header_name(data, name, parser->headers[j].name))
+        continue;
+      if (written > 0) {
+        memcpy(value + written, ", ", 2);
+        written += 2;
+      }
+      HttpSpan span = parser->headers[j].value;
+      memcpy(value + written, data + span.offset, span.length);
+      written += span.length;
+    }
+    value[written] = '\0';
+
+    JSStringRef prop_name = JSStringCreateWithUTF8CString(name_str);
+    JSObjectSetProperty(ctx, headers, prop_name,
+                        make_c_string_value(ctx, value),
+                        kJSPropertyAttributeNone, NULL);
+    JSStringRelease(prop_name);
+    free(name_str);
+    free(value);
+  }
+
+  return headers;
+}
+
+// decoded query string parameters, the last of a repeated key wins
+static JSValueRef make_req_query(JSContextRef ctx,
+                                 TcpClientState *client_state) {
+  JSObjectRef query = JSObjectMake(ctx, NULL, NULL);
+
+  HttpSpan url = client_state->parser.url;
+  const char *cursor = client_state->buffer + url.offset;
+  const char *end = cursor + url.length;
+  cursor = memchr(cursor, '?', url.length);
+  if (!cursor) {
+    return query;
+  }
+  cursor++;
+
+  // big enough for any decoded key or value
+  char *decoded = malloc(end - cursor + 1);
+
+  while (cursor < end) {
+    const char *pair_end = memchr(cursor, '&', end - cursor);
+    if (!pair_end) {
+      pair_end = end;
+    }
+    const char *equals = memchr(cursor, '=', pair_end - cursor);
+    const char *key_end = equals ? equals : pair_end;
+
+    if (key_end > cursor) {
+      size_t length = decode_component(cursor, key_end - cursor, decoded);
+      decoded[length] = '\0';
+      JSStringRef key = JSStringCreateWithUTF8CString(decoded);
+
+      const char *value_start = equals ? equals + 1 : pair_end;
+      length = decode_component(value_start, pair_end - value_start, decoded);
+      decoded[length] = '\0';
+
+      JSObjectSetProperty(ctx, query, key, make_c_string_value(ctx, decoded),
+                          kJSPropertyAttributeNone, NULL);
+      JSStringRelease(key);
+    }
+
+    cursor = pair_end + 1;
+  }
+
+  free(decoded);
+  return query;
+}
+
+// route params, empty when no route matched
+static JSValueRef make_req_params(JSContextRef ctx,
+                                  TcpClientState *client_state) {
+  JSObjectRef params = JSObjectMake(ctx, NULL, NULL);
+  char *url = client_state->buffer + client_state->parser.url.offset;
+
+  for (size_t i = 0; i < client_state->route.param_count; i++) {
+    const RouteParam *param = &client_state->route.params[i];
+    HttpSpan span = {param->offset, param->length};
+
+    JSStringRef name = JSStringCreateWithUTF8CString(param->name);
+    JSObjectSetProperty(ctx, params, name, make_span_string(ctx, url, span),
+                        kJSPropertyAttributeNone, NULL);
+    JSStringRelease(name);
+  }
+
+  return params;
+}
+
+// req fields are built from the parsed request the first time a handler
+// reads them, most handlers only look at one or two
+typedef struct {
+  const char *name;
+  unsigned flag;
+  JSValueRef (*make)(JSContextRef ctx, TcpClientState *client_state);
+} RequestField;
+
+static const RequestField request_fields[] = {
+    {"method", 1 << 0, make_req_method},
+    {"url", 1 << 1, make_req_url},
+    {"headers", 1 << 2, make_req_headers},
+    {"query", 1 << 3, make_req_query},
+    {"params", 1 << 4, make_req_params},
+};
+
+#define REQUEST_FIELD_COUNT (sizeof(request_fields) / sizeof(request_fields[0]))
+
+static const RequestField *find_request_field(JSStringRef name) {
+  for (size_t i = 0; i < REQUEST_FIELD_COUNT; i++) {
+    if (JSStringIsEqualToUTF8CString(name, request_fields[i].name)) {
+      return &request_fields[i];
+    }
+  }
+
+  return NULL;
+}
+
+// once built, a field is stored as a plain property and this returns NULL so
+// JSC finds it there. That includes after res.end(), when the request's
+// bytes are gone and unread fields stay undefined
+static JSValueRef req_get_property(JSContextRef ctx, JSObjectRef object,
+                                   JSStringRef property_name,
+                                   JSValueRef *exception) {
+  TcpClientState *client_state = JSObjectGetPrivate(object);
+  if (!client_state) {
+    return NULL;
+  }
+
+  const RequestField *field = find_request_field(property_name);
+  if (!field || (client_state->req_fields & field->flag)) {
+    return NULL;
+  }
+
+  JSValueRef value = field->make(ctx, client_state);
+  client_state->req_fields |= field->flag;
+  JSObjectSetProperty(ctx, object, property_name, value,
+                      kJSPropertyAttributeNone, NULL);
+  return value;
+}
+
+// a handler assigning e.g. req.url replaces the lazy value for good
+static bool req_set_property(JSContextRef ctx, JSObjectRef object,
+                             JSStringRef property_name, JSValueRef value,
+                             JSValueRef *exception) {
+  TcpClientState *client_state = JSObjectGetPrivate(object);
+  const RequestField *field = find_request_field(property_name);
+  if (client_state && field) {
+    client_state->req_fields |= field->flag;
+  }
+
+  return false; // stored as a plain property
+}
+
+static void req_get_property_names(JSContextRef ctx, JSObjectRef object,
+                                   JSPropertyNameAccumulatorRef names) {
+  TcpClientState *client_state = JSObjectGetPrivate(object);
+  if (!client_state) {
+    return;
+  }
+
+  for (size_t i = 0; i < REQUEST_FIELD_COUNT; i++) {
+    if (client_state->req_fields & request_fields[i].flag) {
+      continue; // already a plain property
+    }
+    JSStringRef name = JSStringCreateWithUTF8CString(request_fields[i].name);
+    JSPropertyNameAccumulatorAddName(names, name);
+    JSStringRelease(name);
+  }
+}
+
+// the consumer of req's body sets the pace: once its stream is paused and
+// full, the socket stops being read and TCP pushes back on the client
+static void on_body_pull(void *data, bool more) {
+  TcpClientState *client_state = data;
+  bool was_reading = client_state->reading;
+
+  if (more) {
+    start_reading(client_state);
+  } else {
+    pause_reading(client_state);
+  }
+
+  if (client_state->reading != was_reading) {
+    arm_timeout(client_state);
+  }
+}
+
+// a client waiting to be told to send the body is told now it's wanted
+static void send_continue(TcpClientState *client_state) {
+  HttpParser *parser = &client_state->parser;
+  const HttpHeader *expect =
+      http_parser_find_header(parser, client_state->buffer, "expect");
+  if (expect && parser->version_minor >= 1 &&
+      !client_state->response.headers_sent &&
+      http_span_equals(client_state->buffer, expect->value, "100-continue")) {
+    write_literal(client_state, "HTTP/1.1 100 Continue\r\n\r\n");
+  }
+}
+
+// req reads like a stream, its first read makes one for the body and
+// decodes whatever of it has already arrived
+static JSObjectRef to_body_stream(JSContextRef ctx, JSObjectRef req,
+                                  JSValueRef *js_err_str) {
+  TcpClientState *client_state = JSObjectGetPrivate(req);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return NULL;
+  }
+
+  ReadableStreamState *body_stream = client_state->body_stream;
+  if (body_stream) {
+    return body_stream->stream_obj;
+  }
+
+  if (client_state->multipart) {
+    set_js_error(ctx, "Request body is already being read", js_err_str);
+    return NULL;
+  }
+
+  body_stream = create_pushed_stream(ctx, on_body_pull, client_state);
+  JSValueProtect(ctx, body_stream->stream_obj);
+  client_state->body_stream = body_stream;
+
+  HttpParser *parser = &client_state->parser;
+  if (!http_parser_in_body(parser)) {
+    readable_stream_push_end(body_stream);
+    return body_stream->stream_obj;
+  }
+
+  send_continue(client_state);
+  if (!client_state->dispatching) {
+    process_requests(client_state);
+    arm_timeout(client_state);
+  }
+
+  return body_stream->stream_obj;
+}
+
+static JSValueRef req_on(JSContextRef ctx, JSObjectRef js_fn,
+                         JSObjectRef this_obj, size_t argc,
+                         const JSValueRef args[], JSValueRef *js_err_str) {
+  JSObjectRef stream = to_body_stream(ctx, this_obj, js_err_str);
+  if (stream) {
+    readable_stream_on(ctx, js_fn, stream, argc, args, js_err_str);
+  }
+  return this_obj;
+}
+
+static JSValueRef req_pause(JSContextRef ctx, JSObjectRef js_fn,
+                            JSObjectRef this_obj, size_t argc,
+                            const JSValueRef args[], JSValueRef *js_err_str) {
+  JSObjectRef stream = to_body_stream(ctx, this_obj, js_err_str);
+  if (stream) {
+    readable_stream_pause(ctx, js_fn, stream, argc, args, js_err_str);
+  }
+  return this_obj;
+}
+
+static JSValueRef req_resume(JSContextRef ctx, JSObjectRef js_fn,
+                             JSObjectRef this_obj, size_t argc,
+                             const JSValueRef args[], JSValueRef *js_err_str) {
+  JSObjectRef stream = to_body_stream(ctx, this_obj, js_err_str);
+  if (stream) {
+    readable_stream_resume(ctx, js_fn, stream, argc, args, js_err_str);
+  }
+  return this_obj;
+}
+
+static JSValueRef req_pipe(JSContextRef ctx, JSObjectRef js_fn,
+                           JSObjectRef this_obj, size_t argc,
+                           const JSValueRef args[], JSValueRef *js_err_str) {
+  JSObjectRef stream = to_body_stream(ctx, this_obj, js_err_str);
+  if (!stream) {
+    return JSValueMakeUndefined(ctx);
+  }
+  return readable_stream_pipe(ctx, js_fn, stream, argc, args, js_err_str);
+}
+
+// chunks are Uint8Arrays unless set to "utf8"
+static JSValueRef req_set_encoding(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "req.setEncoding", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *encoding = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  bool binary = strcmp(encoding, "buffer") == 0;
+  bool known = binary || strcmp(encoding, "utf8") == 0;
+  free(encoding);
+  if (!known) {
+    set_js_error(ctx, "Unknown stream encoding", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef stream = to_body_stream(ctx, this_obj, js_err_str);
+  if (stream) {
+    ReadableStreamState *body_stream = JSObjectGetPrivate(stream);
+    body_stream->binary = binary;
+  }
+  return this_obj;
+}
+
+// a multipart/form-data body taken over by req.multipart(). File parts go
+// from the connection buffer into write streams, so JS only sees the field
+// values and what was saved, once the last file is closed
+typedef struct UploadFile {
+  struct MultipartUpload *upload;
+  WritableStreamState *stream; // NULL once closed
+  char *path;
+  bool created; // removed again if the upload fails
+  struct UploadFile *next;
+} UploadFile;
+
+typedef struct MultipartUpload {
+  TcpClientState *client_state; // NULL once the request is released
+  JSContextRef ctx;
+  JSObjectRef callback;
+  JSObjectRef fields;
+  JSObjectRef files;
+  MultipartParser parser;
+
+  char *dir;
+  double max_file_size; // 0 for no limit
+  size_t max_field_size;
+
+  UploadFile *saved; // newest first
+  UploadFile *current; // the file part being written
+  JSObjectRef current_info; // its entry in `files`
+  size_t file_count;
+  uint64_t current_size;
+  size_t pending_files; // not yet closed, or not yet removed after a failure
+
+  char *field_name; // the field part being read
+  char *field_value;
+  size_t field_length;
+
+  const char *error; // the first failure
+  bool body_done;
+  // inside the parser or a call into a file stream, which can close the
+  // file straight away. Settling waits until the caller is done
+  int busy;
+} MultipartUpload;
+
+static void set_number_property(JSContextRef ctx, JSObjectRef object,
+                                const char *name, double value) {
+  JSStringRef js_name = JSStringCreateWithUTF8CString(name);
+  JSObjectSetProperty(ctx, object, js_name, JSValueMakeNumber(ctx, value),
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(js_name);
+}
+
+static void set_string_property(JSContextRef ctx, JSObjectRef object,
+                                const char *name, const char *value) {
+  JSStringRef js_name = JSStringCreateWithUTF8CString(name);
+  JSValueRef js_value =
+      value ? make_c_string_value(ctx, value) : JSValueMakeNull(ctx);
+  JSObjectSetProperty(ctx, object, js_name, js_value, kJSPropertyAttributeNone,
+                      NULL);
+  JSStringRelease(js_name);
+}
+
+static void settle_upload(MultipartUpload *upload);
+
+static void on_upload_file_removed(uv_fs_t *req) {
+  MultipartUpload *upload = req->data;
+  uv_fs_req_cleanup(req);
+  free(req);
+
+  upload->pending_files--;
+  settle_upload(upload);
+}
+
+// a failed upload leaves nothing behind, its callback waits for this
+static void remove_upload_files(MultipartUpload *upload) {
+  for (UploadFile *file = upload->saved; file; file = file->next) {
+    if (!file->created) {
+      continue;
+    }
+    file->created = false;
+
+    uv_fs_t *req = malloc(sizeof(uv_fs_t));
+    if (!req) {
+      continue;
+    }
+    req->data = upload;
+    if (uv_fs_unlink(loop, req, file->path, on_upload_file_removed) < 0) {
+      free(req);
+      continue;
+    }
+    upload->pending_files++;
+  }
+}
+
+static void free_upload(MultipartUpload *upload) {
+  JSContextRef ctx = upload->ctx;
+
+  while (upload->saved) {
+    UploadFile *file = upload->saved;
+    upload->saved = file->next;
+    free(file->path);
+    free(file);
+  }
+
+  JSValueUnprotect(ctx, upload->callback);
+  JSValueUnprotect(ctx, upload->fields);
+  JSValueUnprotect(ctx, upload->files);
+  free(upload->dir);
+  free(upload->field_name);
+  free(upload->field_value);
+  free(upload);
+}
+
+// calls back once the body is in, or has failed, and every file is closed
+// (and removed, on failure)
+static void settle_upload(MultipartUpload *upload) {
+  if (upload->busy > 0 || upload->pending_files > 0 ||
+      (!upload->error && !upload->body_done)) {
+    return;
+  }
+
+  if (upload->error) {
+    remove_upload_files(upload);
+    if (upload->pending_files > 0) {
+      return;
+    }
+  }
+
+  // what's left of a failed body is skipped like an unread one
+  if (upload->client_state) {
+    upload->client_state->multipart = NULL;
+    upload->client_state = NULL;
+  }
+
+  // a failed upload still says what it got, its files are already gone
+  JSContextRef ctx = upload->ctx;
+  JSObjectRef form = JSObjectMake(ctx, NULL, NULL);
+  JSStringRef fields_name = JSStringCreateWithUTF8CString("fields");
+  JSStringRef files_name = JSStringCreateWithUTF8CString("files");
+  JSObjectSetProperty(ctx, form, fields_name, upload->fields,
+                      kJSPropertyAttributeNone, NULL);
+  JSObjectSetProperty(ctx, form, files_name, upload->files,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(fields_name);
+  JSStringRelease(files_name);
+
+  JSValueRef args[] = {upload->error ? make_c_string_value(ctx, upload->error)
+                                     : JSValueMakeNull(ctx),
+                       form};
+  JSObjectCallAsFunction(ctx, upload->callback, NULL, 2, args, NULL);
+
+  free_upload(upload);
+}
+
+static void end_upload_file(MultipartUpload *upload) {
+  UploadFile *file = upload->current;
+  upload->current = NULL;
+
+  upload->busy++;
+  writable_stream_finish(file->stream);
+  upload->busy--;
+}
+
+// stops saving, the file being written is closed and the rest of the body
+// is read and dropped. The caller settles
+static void fail_upload(MultipartUpload *upload, const char *error) {
+  if (upload->error) {
+    return;
+  }
+
+  upload->error = error;
+  upload->busy++;
+  if (upload->current) {
+    end_upload_file(upload);
+  }
+  if (upload->client_state) {
+    on_body_pull(upload->client_state, true);
+  }
+  upload->busy--;
+}
+
+static void on_upload_file_drain(void *data) {
+  UploadFile *file = data;
+  MultipartUpload *upload = file->upload;
+
+  if (upload->current == file && upload->client_state) {
+    on_body_pull(upload->client_state, true);
+  }
+}
+
+static void on_upload_file_closed(void *data) {
+  UploadFile *file = data;
+  MultipartUpload *upload = file->upload;
+  WritableStreamState *stream = file->stream;
+
+  bool failed = stream->failed;
+  file->created = stream->finished || stream->fd > 0;
+  file->stream = NULL;
+  JSValueUnprotect(upload->ctx, stream->stream_obj);
+
+  if (upload->current == file) {
+    upload->current = NULL;
+  }
+  upload->pending_files--;
+
+  if (failed) {
+    fail_upload(upload, "Could not save uploaded file");
+  }
+  settle_upload(upload);
+}
+
+static void start_upload_file(MultipartUpload *upload,
+                              const MultipartPart *part) {
+  JSContextRef ctx = upload->ctx;
+
+  uint64_t id;
+  uv_random(NULL, NULL, &id, sizeof(id), 0, NULL);
+
+  size_t path_size = strlen(upload->dir) + sizeof("/upload-") + 16;
+  UploadFile *file = calloc(1, sizeof(UploadFile));
+  char *path = malloc(path_size);
+  if (!file || !path) {
+    free(file);
+    free(path);
+    fail_upload(upload, ERR_MEMORY_ALLOCATION);
+    return;
+  }
+  snprintf(path, path_size, "%s/upload-%016" PRIx64, upload->dir, id);
+
+  file->upload = upload;
+  file->path = path;
+  file->next = upload->saved;
+  upload->saved = file;
+
+  // an existing file is never written over
+  file->stream = create_write_stream(
+      ctx, path, UV_FS_O_WRONLY | UV_FS_O_CREAT | UV_FS_O_EXCL,
+      STREAM_HIGH_WATERMARK);
+  file->stream->on_drain = on_upload_file_drain;
+  file->stream->on_drain_data = file;
+  file->stream->on_finish = on_upload_file_closed;
+  file->stream->on_finish_data = file;
+  upload->pending_files++;
+  upload->current = file;
+  upload->current_size = 0;
+
+  JSObjectRef info = JSObjectMake(ctx, NULL, NULL);
+  set_string_property(ctx, info, "field", part->name);
+  set_string_property(ctx, info, "filename", part->filename);
+  set_string_property(ctx, info, "contentType", part->content_type);
+  set_string_property(ctx, info, "path", path);
+  set_number_property(ctx, info, "size", 0);
+
+  JSObjectSetPropertyAtIndex(ctx, upload->files, upload->file_count++, info,
+                             NULL);
+  upload->current_info = info;
+}
+
+static void on_upload_part(void *data, const MultipartPart *part) {
+  MultipartUpload *upload = data;
+  if (upload->error) {
+    return;
+  }
+
+  if (part->filename) {
+    // a form's empty file input still sends a part, with no filename
+    if (*part->filename) {
+      start_upload_file(upload, part);
+    }
+    return;
+  }
+
+  // a value holds at most max_field_size, so its buffer is made once
+  if (!upload->field_value) {
+    upload->field_value = malloc(upload->max_field_size + 1);
+  }
+  upload->field_name = strdup(part->name);
+  upload->field_length = 0;
+  if (!upload->field_value || !upload->field_name) {
+    fail_upload(upload, ERR_MEMORY_ALLOCATION);
+  }
+}
+
+static void on_upload_data(void *data, const char *bytes, size_t length) {
+  MultipartUpload *upload = data;
+  if (upload->error) {
+    return;
+  }
+
+  if (upload->current) {
+    upload->current_size += length;
+    if (upload->max_file_size > 0 &&
+        upload->current_size > upload->max_file_size) {
+      fail_upload(upload, "Uploaded file too large");
+      return;
+    }
+
+    // `bytes` points into the connection buffer, which is reused once the
+    // parser returns, so the write stream gets its own copy
+    char *chunk = malloc(length);
+    if (!chunk) {
+      fail_upload(upload, ERR_MEMORY_ALLOCATION);
+      return;
+    }
+    memcpy(chunk, bytes, length);
+
+    // the connection waits while the disk catches up
+    if (!writable_stream_write_bytes(upload->current->stream, chunk, length)) {
+      on_body_pull(upload->client_state, false);
+    }
+    return;
+  }
+
+  if (!upload->field_name) {
+    return;
+  }
+
+  if (upload->field_length + length > upload->max_field_size) {
+    fail_upload(upload, "Form field too large");
+    return;
+  }
+
+  memcpy(upload->field_value + upload->field_length, bytes, length);
+  upload->field_length += length;
+}
+
+static void on_upload_part_end(void *data) {
+  MultipartUpload *upload = data;
+  JSContextRef ctx = upload->ctx;
+
+  if (upload->error) {
+    return;
+  }
+
+  if (upload->current) {
+    set_number_property(ctx, upload->current_info, "size",
+                        (double)upload->current_size);
+    end_upload_file(upload);
+    return;
+  }
+
+  // a repeated field keeps its last value
+  if (upload->field_name) {
+    upload->field_value[upload->field_length] = '\0';
+    set_string_property(ctx, upload->fields, upload->field_name,
+                        upload->field_value);
+    free(upload->field_name);
+    upload->field_name = NULL;
+  }
+}
+
+static const MultipartCallbacks upload_callbacks = {
+    on_upload_part,
+    on_upload_data,
+    on_upload_part_end,
+};
+
+static void feed_multipart(MultipartUpload *upload, const char *data,
+                           size_t length) {
+  if (upload->error) {
+    return;
+  }
+
+  upload->busy++;
+  MultipartResult result = multipart_parser_execute(
+      &upload->parser, data, length, &upload_callbacks, upload);
+  if (result == MULTIPART_ERROR) {
+    fail_upload(upload, "Malformed multipart body");
+  }
+  upload->busy--;
+  settle_upload(upload);
+}
+
+// the request body is all in; a form that didn't reach its closing
+// delimiter is cut short
+static void end_multipart(MultipartUpload *upload) {
+  upload->body_done = true;
+  if (!multipart_parser_done(&upload->parser)) {
+    fail_upload(upload, "Multipart body ended early");
+  }
+  settle_upload(upload);
+}
+
+// detaches the upload from a request being released. Files still being
+// written finish on their own; a body cut off fails the upload
+static void release_multipart(TcpClientState *client_state) {
+  MultipartUpload *upload = client_state->multipart;
+  if (!upload) {
+    return;
+  }
+
+  client_state->multipart = NULL;
+  upload->client_state = NULL;
+  if (!upload->body_done) {
+    fail_upload(upload, "Request closed before its body ended");
+  }
+  settle_upload(upload);
+}
+
+// req.multipart([options], callback) saves each file part to a new file in
+// `dir` (the OS temp dir by default) and calls back with
+// (err, { fields, files: [{ field, filename, contentType, path, size }] }).
+// On failure the files listed have been removed
+static JSValueRef req_multipart(JSContextRef ctx, JSObjectRef js_fn,
+                                JSObjectRef this_obj, size_t argc,
+                                const JSValueRef args[],
+                                JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "req.multipart", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSValueRef options = argc > 1 ? args[0] : NULL;
+  JSObjectRef callback;
+  if (!to_callback(ctx, args[argc > 1 ? 1 : 0], &callback, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (client_state->body_stream || client_state->multipart) {
+    set_js_error(ctx, "Request body is already being read", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  HttpParser *parser = &client_state->parser;
+  const HttpHeader *content_type =
+      http_parser_find_header(parser, client_state->buffer, "content-type");
+  const char *boundary;
+  size_t boundary_length;
+  if (!http_parser_in_body(parser) || !content_type ||
+      !multipart_boundary(client_state->buffer + content_type->value.offset,
+                          content_type->value.length, &boundary,
+                          &boundary_length)) {
+    set_js_error(ctx, "Request is not multipart/form-data", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  MultipartUpload *upload = calloc(1, sizeof(MultipartUpload));
+  if (!upload) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!multipart_parser_init(&upload->parser, boundary, boundary_length)) {
+    free(upload);
+    set_js_error(ctx, "Invalid multipart boundary", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  upload->dir = get_string_option(ctx, options, "dir");
+  if (!upload->dir) {
+    char tmpdir[PATH_MAX];
+    size_t tmpdir_length = sizeof(tmpdir);
+    if (uv_os_tmpdir(tmpdir, &tmpdir_length) == 0) {
+      upload->dir = strdup(tmpdir);
+    }
+  }
+  if (!upload->dir) {
+    free(upload);
+    set_js_error(ctx, "No directory to save uploads in", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  double max_file_size = 0;
+  double max_field_size = MULTIPART_DEFAULT_FIELD_SIZE;
+  get_number_option(ctx, options, "maxFileSize", &max_file_size);
+  get_number_option(ctx, options, "maxFieldSize", &max_field_size);
+  upload->max_file_size = max_file_size > 0 ? max_file_size : 0;
+  upload->max_field_size = max_field_size > 0 ? (size_t)max_field_size : 0;
+
+  upload->client_state = client_state;
+  upload->ctx = ctx;
+  upload->callback = callback;
+  upload->fields = JSObjectMake(ctx, NULL, NULL);
+  upload->files = JSObjectMakeArray(ctx, 0, NULL, NULL);
+  JSValueProtect(ctx, upload->callback);
+  JSValueProtect(ctx, upload->fields);
+  JSValueProtect(ctx, upload->files);
+  client_state->multipart = upload;
+
+  send_continue(client_state);
+  if (!client_state->dispatching) {
+    process_requests(client_state);
+    arm_timeout(client_state);
+  }
+
+  return JSValueMakeUndefined(ctx);
+}
+
+#define METHOD_ATTRIBUTES                                                      \
+  (kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontEnum |               \
+   kJSPropertyAttributeDontDelete)
+
+static const JSStaticFunction request_functions[] = {
+    {"getHeader", req_get_header, METHOD_ATTRIBUTES},
+    {"on", req_on, METHOD_ATTRIBUTES},
+    {"pause", req_pause, METHOD_ATTRIBUTES},
+    {"resume", req_resume, METHOD_ATTRIBUTES},
+    {"pipe", req_pipe, METHOD_ATTRIBUTES},
+    {"setEncoding", req_set_encoding, METHOD_ATTRIBUTES},
+    {"multipart", req_multipart, METHOD_ATTRIBUTES},
+    {NULL, NULL, 0},
+};
+
+static const JSStaticFunction response_functions[] = {
+    {"writeHead", res_write_head, METHOD_ATTRIBUTES},
+    {"setHeader", res_set_header, METHOD_ATTRIBUTES},
+    {"write", res_write, METHOD_ATTRIBUTES},
+    {"end", res_end, METHOD_ATTRIBUTES},
+    {"on", res_on, METHOD_ATTRIBUTES},
+    {NULL, NULL, 0},
+};
+
+// methods live on the classes, so a request costs two JSObjectMake calls
+static void create_request_objects(TcpClientState *client_state) {
+  JSContextRef ctx = client_state->server_state->ctx;
+
+  if (request_class == NULL) {
+    JSClassDefinition request_def = kJSClassDefinitionEmpty;
+    request_def.className = "IncomingMessage";
+    request_def.staticFunctions = request_functions;
+    request_def.getProperty = req_get_property;
+    request_def.setProperty = req_set_property;
+    request_def.getPropertyNames = req_get_property_names;
+    request_class = JSClassCreate(&request_def);
+
+    JSClassDefinition response_def = kJSClassDefinitionEmpty;
+    response_def.className = "ServerResponse";
+    response_def.staticFunctions = response_functions;
+    response_class = JSClassCreate(&response_def);
+  }
+
+  client_state->req_fields = 0;
+  client_state->req = JSObjectMake(ctx, request_class, client_state);
+  client_state->res = JSObjectMake(ctx, response_class, client_state);
+  JSValueProtect(ctx, client_state->req);
+  JSValueProtect(ctx, client_state->res);
+}
+
+// answers without entering JS. The body is a string literal, so the part
+// borrows it
+static void send_native_response(TcpClientState *client_state, int status,
+                                 const char *allow) {
+  HttpResponse *response = &client_state->response;
+  JSContextRef ctx = client_state->server_state->ctx;
+  JSValueRef error = NULL;
+
+  const char *body = http_status_text(status);
+  ResponsePart part = {NULL, NULL, uv_buf_init((char *)body, strlen(body))};
+
+  response->status_code = status;
+  append_header(ctx, response, "Content-Type", "text/plain", &error);
+  if (allow) {
+    append_header(ctx, response, "Allow", allow, &error);
+  }
+
+  if (!push_part(response, part)) {
+    close_client(client_state);
+    return;
+  }
+
+  flush_response(client_state, true);
+
+  if (!client_state->closing) {
+    reset_response(client_state);
+    finish_request(client_state);
+  }
+}
+
+// whether an earlier matching route already put `method` in the Allow list
+static bool is_allow_listed(const RouteMatch *route, size_t before,
+                            const char *method) {
+  for (size_t i = 0; i < before; i++) {
+    for (const RouteHandler *handler = route->allowed[i]; handler;
+         handler = handler->next) {
+      if (strcmp(handler->method, method) == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void send_method_not_allowed(TcpClientState *client_state) {
+  const RouteMatch *route = &client_state->route;
+  char allow[HTTP_RESPONSE_BUFFER_SIZE] = "";
+  size_t length = 0;
+
+  for (size_t i = 0; i < route->allowed_count && length < sizeof(allow); i++) {
+    for (const RouteHandler *handler = route->allowed[i]; handler;
+         handler = handler->next) {
+      if (is_allow_listed(route, i, handler->method)) {
+        continue;
+      }
+      length += snprintf(allow + length, sizeof(allow) - length, "%s%s",
+                         length > 0 ? ", " : "", handler->method);
+      if (length >= sizeof(allow)) {
+        break;
+      }
+    }
+  }
+
+  send_native_response(client_state, 405, allow);
+}
+
+// a file being sent for http.serveStatic(). It holds a reference on the
+// connection, so a client going away mid-transfer can't free it under us
+typedef struct {
+  uv_fs_t req;
+  uv_write_t write_req;
+  TcpClientState *client_state;
+  StaticRoot *root;
+  char path[HTTP_STATIC_PATH_SIZE];
+  StaticStat stat;
+  bool tried_index;
+  int status;
+  uv_file file;
+  uint64_t offset;
+  uint64_t remaining;
+  char *chunk; // copy buffer for when the socket can't take a sendfile
+  size_t chunk_length;
+} StaticTransfer;
+
+static void end_static_transfer(StaticTransfer *transfer) {
+  if (transfer->file >= 0) {
+    uv_fs_t close_req;
+    uv_fs_close(loop, &close_req, transfer->file, NULL);
+    uv_fs_req_cleanup(&close_req);
+  }
+
+  TcpClientState *client_state = transfer->client_state;
+  free(transfer->chunk);
+  free(transfer);
+  release_client(client_state);
+}
+
+static void complete_static_transfer(StaticTransfer *transfer) {
+  TcpClientState *client_state = transfer->client_state;
+  if (!client_state->closing) {
+    reset_response(client_state);
+    finish_request(client_state);
+  }
+  end_static_transfer(transfer);
+}
+
+static void abort_static_transfer(StaticTransfer *transfer) {
+  close_client(transfer->client_state);
+  end_static_transfer(transfer);
+}
+
+static void append_static_headers(StaticTransfer *transfer) {
+  TcpClientState *client_state = transfer->client_state;
+  JSContextRef ctx = client_state->server_state->ctx;
+  HttpResponse *response = &client_state->response;
+  JSValueRef error = NULL;
+
+  char cache_control[HTTP_RESPONSE_BUFFER_SIZE];
+  snprintf(cache_control, sizeof(cache_control), "public, max-age=%.0f",
+           transfer->root->max_age);
+
+  append_header(ctx, response, "ETag", transfer->stat.etag, &error);
+  append_header(ctx, response, "Last-Modified", transfer->stat.last_modified,
+                &error);
+  append_header(ctx, response, "Cache-Control", cache_control, &error);
+}
+
+static void pump_static_file(StaticTransfer *transfer);
+
+static void on_static_chunk_written(uv_write_t *req, int status) {
+  StaticTransfer *transfer = req->data;
+  if (status < 0 || transfer->client_state->closing) {
+    abort_static_transfer(transfer);
+    return;
+  }
+
+  transfer->offset += transfer->chunk_length;
+  transfer->remaining -= transfer->chunk_length;
+  pump_static_file(transfer);
+}
+
+static void on_static_chunk_read(uv_fs_t *req) {
+  StaticTransfer *transfer = req->data;
+  ssize_t result = req->result;
+  uv_fs_req_cleanup(req);
+
+  // a file that shrank since its stat can't fill the promised length
+  if (result <= 0 || transfer->client_state->closing) {
+    abort_static_transfer(transfer);
+    return;
+  }
+
+  transfer->chunk_length = result;
+  uv_buf_t buf = uv_buf_init(transfer->chunk, result);
+  transfer->write_req.data = transfer;
+  if (uv_write(&transfer->write_req,
+               (uv_stream_t *)&transfer->client_state->socket, &buf, 1,
+               on_static_chunk_written) < 0) {
+    abort_static_transfer(transfer);
+  }
+}
+
+// goes through the loop's write queue, which waits for the socket to drain
+static void copy_static_chunk(StaticTransfer *transfer, size_t length) {
+  if (!transfer->chunk) {
+    transfer->chunk = malloc(HTTP_STATIC_CHUNK_SIZE);
+    if (!transfer->chunk) {
+      abort_static_transfer(transfer);
+      return;
+    }
+  }
+
+  uv_buf_t buf = uv_buf_init(transfer->chunk, length);
+  uv_fs_read(loop, &transfer->req, transfer->file, &buf, 1, transfer->offset,
+             on_static_chunk_read);
+}
+
+static void on_static_sent(uv_fs_t *req) {
+  StaticTransfer *transfer = req->data;
+  TcpClientState *client_state = transfer->client_state;
+  ssize_t result = req->result;
+  uv_fs_req_cleanup(req);
+
+  client_state->sendfile_pending = false;
+  if (client_state->close_deferred) {
+    client_state->close_deferred = false;
+    client_state->closing = false; // so close_client does the closing now
+    abort_static_transfer(transfer);
+    return;
+  }
+
+  if (result == UV_EAGAIN) {
+    size_t length = transfer->remaining < HTTP_STATIC_CHUNK_SIZE
+                        ? transfer->remaining
+                        : HTTP_STATIC_CHUNK_SIZE;
+    copy_static_chunk(transfer, length);
+    return;
+  }
+
+  if (result <= 0) {
+    abort_static_transfer(transfer);
+    return;
+  }
+
+  transfer->offset += result;
+  transfer->remaining -= result;
+  pump_static_file(transfer);
+}
+
+// sendfile while the socket keeps up; once it's full the chunk is copied
+// through the loop, which also waits for it to drain
+static void pump_static_file(StaticTransfer *transfer) {
+  TcpClientState *client_state = transfer->client_state;
+  if (client_state->closing) {
+    end_static_transfer(transfer);
+    return;
+  }
+
+  if (transfer->remaining == 0) {
+    complete_static_transfer(transfer);
+    return;
+  }
+
+  size_t length = transfer->remaining < HTTP_STATIC_CHUNK_SIZE
+                      ? transfer->remaining
+                      : HTTP_STATIC_CHUNK_SIZE;
+
+  // sendfile would overtake bytes libuv still has queued, like the head
+  uv_os_fd_t socket_fd;
+  if (client_state->socket.write_queue_size > 0 ||
+      uv_fileno((uv_handle_t *)&client_state->socket, &socket_fd) < 0) {
+    copy_static_chunk(transfer, length);
+    return;
+  }
+
+  client_state->sendfile_pending = true;
+  uv_fs_sendfile(loop, &transfer->req, socket_fd, transfer->file,
+                 transfer->offset, length, on_static_sent);
+}
+
+static void on_static_open(uv_fs_t *req) {
+  StaticTransfer *transfer = req->data;
+  TcpClientState *client_state = transfer->client_state;
+  int result = req->result;
+  uv_fs_req_cleanup(req);
+
+  if (client_state->closing) {
+    if (result >= 0) {
+      transfer->file = result;
+    }
+    end_static_transfer(transfer);
+    return;
+  }
+
+  if (result < 0) {
+    send_native_response(client_state, 404, NULL);
+    end_static_transfer(transfer);
+    return;
+  }
+
+  transfer->file = result;
+
+  // only the head goes out here; its Content-Length keeps the body raw
+  client_state->response.status_code = transfer->status;
+  flush_response(client_state, false);
+  pump_static_file(transfer);
+}
+
+static void stat_static_file(StaticTransfer *transfer);
+
+// answers 304, 416 and HEAD from the stat alone, and opens the file for
+// everything else
+static void on_static_stat_ready(StaticTransfer *transfer) {
+  TcpClientState *client_state = transfer->client_state;
+  HttpParser *parser = &client_state->parser;
+  HttpResponse *response = &client_state->response;
+  JSContextRef ctx = client_state->server_state->ctx;
+  char *data = client_state->buffer;
+  JSValueRef error = NULL;
+  char value[HTTP_RESPONSE_BUFFER_SIZE];
+
+  // "/docs" serves "/docs/index.html"
+  if (transfer->stat.is_directory) {
+    size_t length = strlen(transfer->path);
+    const char *index = "/index.html";
+    if (transfer->tried_index ||
+        length + strlen(index) >= sizeof(transfer->path)) {
+      send_native_response(client_state, 404, NULL);
+      end_static_transfer(transfer);
+      return;
+    }
+    strcpy(transfer->path + length, index);
+    transfer->tried_index = true;
+    stat_static_file(transfer);
+    return;
+  }
+
+  const HttpHeader *if_none_match =
+      http_parser_find_header(parser, data, "if-none-match");
+  const HttpHeader *if_modified_since =
+      http_parser_find_header(parser, data, "if-modified-since");
+
+  if (static_is_not_modified(
+          &transfer->stat,
+          if_none_match ? data + if_none_match->value.offset : NULL,
+          if_none_match ? if_none_match->value.length : 0,
+          if_modified_since ? data + if_modified_since->value.offset : NULL,
+          if_modified_since ? if_modified_since->value.length : 0)) {
+    response->status_code = 304;
+    append_static_headers(transfer);
+    response->has_content_length = true; // a 304 has no body to describe
+    flush_response(client_state, true);
+    complete_static_transfer(transfer);
+    return;
+  }
+
+  uint64_t size = transfer->stat.size;
+  uint64_t start = 0;
+  uint64_t end = size > 0 ? size - 1 : 0;
+  transfer->status = 200;
+
+  const HttpHeader *range = http_parser_find_header(parser, data, "range");
+  if (range) {
+    switch (static_parse_range(data + range->value.offset,
+                               range->value.length, size, &start, &end)) {
+    case STATIC_RANGE_SATISFIABLE:
+      transfer->status = 206;
+      snprintf(value, sizeof(value), "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64,
+               start, end, size);
+      append_header(ctx, response, "Content-Range", value, &error);
+      break;
+    case STATIC_RANGE_UNSATISFIABLE:
+      response->status_code = 416;
+      snprintf(value, sizeof(value), "bytes */%" PRIu64, size);
+      append_header(ctx, response, "Content-Range", value, &error);
+      append_header(ctx, response, "Content-Length", "0", &error);
+      flush_response(client_state, true);
+      complete_static_transfer(transfer);
+      return;
+    case STATIC_RANGE_NONE:
+      break;
+    }
+  }
+
+  transfer->offset = start;
+  transfer->remaining = size > 0 ? end - start + 1 : 0;
+
+  snprintf(value, sizeof(value), "%" PRIu64, transfer->remaining);
+  append_header(ctx, response, "Content-Type",
+                static_mime_type(transfer->path), &error);
+  append_header(ctx, response, "Content-Length", value, &error);
+  append_header(ctx, response, "Accept-Ranges", "bytes", &error);
+  append_static_headers(transfer);
+
+  if (transfer->remaining == 0 ||
+      http_span_equals(data, parser->method, "HEAD")) {
+    response->status_code = transfer->status;
+    flush_response(client_state, true);
+    complete_static_transfer(transfer);
+    return;
+  }
+
+  uv_fs_open(loop, &transfer->req, transfer->path, O_RDONLY, 0,
+             on_static_open);
+}
+
+static void on_static_stat(uv_fs_t *req) {
+  StaticTransfer *transfer = req->data;
+  int result = req->result;
+  if (result == 0) {
+    static_cache_put(transfer->root, transfer->path, &req->statbuf,
+                     uv_now(loop), &transfer->stat);
+  }
+  uv_fs_req_cleanup(req);
+
+  if (transfer->client_state->closing) {
+    end_static_transfer(transfer);
+    return;
+  }
+
+  if (result < 0) {
+    send_native_response(transfer->client_state, 404, NULL);
+    end_static_transfer(transfer);
+    return;
+  }
+
+  on_static_stat_ready(transfer);
+}
+
+static void stat_static_file(StaticTransfer *transfer) {
+  const StaticStat *cached =
+      static_cache_get(transfer->root, transfer->path, uv_now(loop));
+  if (cached) {
+    transfer->stat = *cached;
+    on_static_stat_ready(transfer);
+    return;
+  }
+
+  uv_fs_stat(loop, &transfer->req, transfer->path, on_static_stat);
+}
+
+// the part a "/assets/*" route matched, or else the whole url path, is
+// looked up under the root
+static void serve_static(TcpClientState *client_state, StaticRoot *root) {
+  HttpParser *parser = &client_state->parser;
+  char *data = client_state->buffer;
+
+  // files have their own validators, they don't go through the cache
+  end_cache_fill(client_state);
+
+  if (!http_span_equals(data, parser->method, "GET") &&
+      !http_span_equals(data, parser->method, "HEAD")) {
+    send_native_response(client_state, 405, "GET, HEAD");
+    return;
+  }
+
+  const char *path = data + parser->url.offset;
+  const char *query = memchr(path, '?', parser->url.length);
+  size_t length = query ? (size_t)(query - path) : parser->url.length;
+
+  RouteMatch *route = &client_state->route;
+  if (route->param_count > 0 &&
+      strcmp(route->params[route->param_count - 1].name, "*") == 0) {
+    const RouteParam *rest = &route->params[route->param_count - 1];
+    path += rest->offset;
+    length = rest->length;
+  }
+
+  StaticTransfer *transfer = calloc(1, sizeof(StaticTransfer));
+  if (!transfer) {
+    close_client(client_state);
+    return;
+  }
+
+  if (!static_resolve_path(root, path, length, transfer->path,
+                           sizeof(transfer->path))) {
+    free(transfer);
+    send_native_response(client_state, 404, NULL);
+    return;
+  }
+
+  transfer->req.data = transfer;
+  transfer->client_state = client_state;
+  transfer->root = root;
+  transfer->file = -1;
+  client_state->open_handles++;
+
+  stat_static_file(transfer);
+}
+
+// answers GET and HEAD from the server's cache. A stale entry is refreshed
+// by the one request that finds it first, while the rest keep getting the
+// stale bytes until that response replaces it
+static bool serve_cached_response(TcpClientState *client_state) {
+  ResponseCache *cache = client_state->server_state->cache;
+  HttpParser *parser = &client_state->parser;
+  char *data = client_state->buffer;
+
+  bool head_only = http_span_equals(data, parser->method, "HEAD");
+  if (!head_only && !http_span_equals(data, parser->method, "GET")) {
+    return false;
+  }
+
+  char key[HTTP_CACHE_KEY_SIZE];
+  size_t key_length = build_cache_key(client_state, key, sizeof(key));
+  if (key_length == 0) {
+    return false;
+  }
+
+  uint64_t now = uv_now(loop);
+  CacheEntry *entry = response_cache_get(cache, key, key_length, now);
+  if (!entry || (now >= entry->fresh_until && !entry->refreshing)) {
+    if (!head_only) {
+      client_state->cache_fill = true;
+      if (entry) {
+        entry->refreshing = true;
+        client_state->cache_refresh = true;
+      }
+    }
+    return false;
+  }
+
+  // the entry's bytes are shared with the write, no copy is made
+  SharedBuffer *shared = entry->response;
+  const char *connection = connection_header(client_state);
+  uv_buf_t bufs[4];
+  size_t buf_count = 0;
+
+  bufs[buf_count++] = uv_buf_init(shared->data, entry->head_length);
+  if (*connection) {
+    bufs[buf_count++] = uv_buf_init((char *)connection, strlen(connection));
+  }
+  bufs[buf_count++] = uv_buf_init("\r\n", 2);
+  if (!head_only && shared->length > entry->head_length) {
+    bufs[buf_count++] = uv_buf_init(shared->data + entry->head_length,
+                                    shared->length - entry->head_length);
+  }
+
+  shared_buffer_retain(shared);
+  ResponseWrite owned = {.client_state = client_state,
+                         .ctx = client_state->server_state->ctx,
+                         .shared = shared};
+  send_buffers(client_state, bufs, buf_count, &owned);
+
+  if (!client_state->closing) {
+    finish_request(client_state);
+  }
+  return true;
+}
+
+// frames are built in one buffer, the payload at a fixed offset with the
+// header written right in front of it once its length is known
+static char *alloc_frame(size_t payload_length) {
+  return malloc(WEBSOCKET_MAX_HEADER_SIZE + payload_length);
+}
+
+// sends and takes over a frame from alloc_frame(), false once the socket
+// is backed up past the high watermark
+static bool send_frame(TcpClientState *client_state, int opcode, char *frame,
+                       size_t payload_length) {
+  uint8_t header[WEBSOCKET_MAX_HEADER_SIZE];
+  size_t header_length = websocket_frame_header(header, opcode, payload_length);
+  char *start = frame + WEBSOCKET_MAX_HEADER_SIZE - header_length;
+  memcpy(start, header, header_length);
+
+  ResponseWrite owned = {.client_state = client_state,
+                         .ctx = client_state->server_state->ctx,
+                         .head = frame};
+  uv_buf_t buf = uv_buf_init(start, header_length + payload_length);
+  send_buffers(client_state, &buf, 1, &owned);
+  return below_watermark(client_state);
+}
+
+static void send_control_frame(TcpClientState *client_state, int opcode,
+                               const char *payload, size_t length) {
+  char *frame = alloc_frame(length);
+  if (!frame) {
+    close_client(client_state);
+    return;
+  }
+  memcpy(frame + WEBSOCKET_MAX_HEADER_SIZE, payload, length);
+  send_frame(client_state, opcode, frame, length);
+}
+
+static void send_close_frame(TcpClientState *client_state, int code,
+                             const char *reason, size_t reason_length) {
+  char payload[WEBSOCKET_MAX_CONTROL_PAYLOAD];
+  size_t length = 0;
+
+  if (code != WEBSOCKET_CLOSE_NO_STATUS) {
+    if (reason_length > sizeof(payload) - 2) {
+      reason_length = sizeof(payload) - 2;
+    }
+    payload[0] = (char)(code >> 8);
+    payload[1] = (char)code;
+    memcpy(payload + 2, reason, reason_length);
+    length = reason_length + 2;
+  }
+
+  client_state->websocket->close_sent = true;
+  send_control_frame(client_state, WEBSOCKET_CLOSE, payload, length);
+}
+
+// the peer broke the protocol: it's told why and the connection ends
+static void fail_websocket(TcpClientState *client_state, int code) {
+  WebSocketState *websocket = client_state->websocket;
+  websocket->close_code = code;
+  if (!websocket->close_sent) {
+    send_close_frame(client_state, code, NULL, 0);
+  }
+  end_connection(client_state);
+}
+
+static void emit_websocket_event(JSContextRef ctx, JSObjectRef handler,
+                                 JSObjectRef ws, size_t argc,
+                                 const JSValueRef args[]) {
+  JSValueRef exception = NULL;
+  JSObjectCallAsFunction(ctx, handler, ws, argc, args, &exception);
+
+  if (exception) {
+    JSStringRef err_str = JSValueToStringCopy(ctx, exception, NULL);
+    char err_buffer[ERROR_MSG_BUFFER_SIZE];
+    JSStringGetUTF8CString(err_str, err_buffer, sizeof(err_buffer));
+    fprintf(stderr, "WebSocket event handler error: %s\n", err_buffer);
+    JSStringRelease(err_str);
+  }
+}
+
+// emits 'close' with the peer's code, 1006 when it just went away
+static void release_websocket(TcpClientState *client_state) {
+  WebSocketState *websocket = client_state->websocket;
+  if (!websocket) {
+    return;
+  }
+
+  client_state->websocket = NULL;
+  JSContextRef ctx = client_state->server_state->ctx;
+  JSObjectSetPrivate(websocket->ws, NULL);
+
+  if (websocket->close_handler) {
+    JSValueRef args[] = {JSValueMakeNumber(ctx, websocket->close_code),
+                         make_c_string_value(ctx, websocket->close_reason)};
+    emit_websocket_event(ctx, websocket->close_handler, websocket->ws, 2,
+                         args);
+  }
+
+  JSObjectRef handlers[] = {websocket->message_handler,
+                            websocket->close_handler, websocket->pong_handler,
+                            websocket->drain_handler};
+  for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+    if (handlers[i]) {
+      JSValueUnprotect(ctx, handlers[i]);
+    }
+  }
+
+  JSValueUnprotect(ctx, websocket->ws);
+  free(websocket->message);
+  free(websocket);
+}
+
+static bool valid_close_code(int code) {
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+         (code >= 3000 && code <= 4999);
+}
+
+// `payload` is already unmasked
+static void handle_control_frame(TcpClientState *client_state, int opcode,
+                                 const char *payload, size_t length) {
+  WebSocketState *websocket = client_state->websocket;
+  JSContextRef ctx = client_state->server_state->ctx;
+
+  if (opcode == WEBSOCKET_PING) {
+    send_control_frame(client_state, WEBSOCKET_PONG, payload, length);
+    return;
+  }
+
+  if (opcode == WEBSOCKET_PONG) {
+    if (websocket->pong_handler) {
+      emit_websocket_event(ctx, websocket->pong_handler, websocket->ws, 0,
+                           NULL);
+    }
+    return;
+  }
+
+  int code = WEBSOCKET_CLOSE_NO_STATUS;
+  if (length >= 2) {
+    code = (uint8_t)payload[0] << 8 | (uint8_t)payload[1];
+  }
+  if (length == 1 || (length >= 2 && !valid_close_code(code))) {
+    fail_websocket(client_state, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+    return;
+  }
+
+  size_t reason_length = length >= 2 ? length - 2 : 0;
+  if (!websocket_valid_utf8(payload + 2, reason_length)) {
+    fail_websocket(client_state, WEBSOCKET_CLOSE_INVALID_DATA);
+    return;
+  }
+
+  // the handshake's done once both sides have sent a close frame, and the
+  // server is the one to end the TCP connection
+  websocket->close_code = code;
+  memcpy(websocket->close_reason, payload + 2, reason_length);
+  websocket->close_reason[reason_length] = '\0';
+  if (!websocket->close_sent) {
+    send_close_frame(client_state, code, payload + 2, reason_length);
+  }
+  end_connection(client_state);
+}
+
+// checks a data frame against the message so far and makes room for it,
+// 0 or the close code to fail with
+static int start_data_frame(WebSocketState *websocket) {
+  WebSocketFrame *frame = &websocket->frame;
+
+  if (frame->opcode == WEBSOCKET_CONTINUATION) {
+    if (!websocket->message_opcode) {
+      return WEBSOCKET_CLOSE_PROTOCOL_ERROR;
+    }
+  } else if (websocket->message_opcode) {
+    return WEBSOCKET_CLOSE_PROTOCOL_ERROR; // the last message isn't done
+  } else {
+    websocket->message_opcode = frame->opcode;
+  }
+
+  uint64_t length = websocket->message_length + frame->payload_length;
+  if (length > WEBSOCKET_MAX_MESSAGE_SIZE) {
+    return WEBSOCKET_CLOSE_TOO_BIG;
+  }
+
+  // a spare byte so an empty message still gets a buffer
+  char *message = realloc(websocket->message, length + 1);
+  if (!message) {
+    return WEBSOCKET_CLOSE_TOO_BIG;
+  }
+  websocket->message = message;
+  return 0;
+}
+
+// hands a whole message to JS, text as a string and binary as a Uint8Array
+// that takes the buffer over
+static void deliver_message(TcpClientState *client_state) {
+  WebSocketState *websocket = client_state->websocket;
+  JSContextRef ctx = client_state->server_state->ctx;
+
+  char *message = websocket->message;
+  size_t length = websocket->message_length;
+  int opcode = websocket->message_opcode;
+  websocket->message = NULL;
+  websocket->message_length = 0;
+  websocket->message_opcode = 0;
+
+  JSValueRef value;
+  if (opcode == WEBSOCKET_TEXT) {
+    if (!websocket_valid_utf8(message, length)) {
+      free(message);
+      fail_websocket(client_state, WEBSOCKET_CLOSE_INVALID_DATA);
+      return;
+    }
+    // text may hold U+0000, so the string is built with its length
+    JSChar *units = malloc((length ? length : 1) * sizeof(JSChar));
+    if (!units) {
+      free(message);
+      fail_websocket(client_state, WEBSOCKET_CLOSE_TOO_BIG);
+      return;
+    }
+    size_t unit_count = websocket_utf8_to_utf16(units, message, length);
+    free(message);
+
+    JSStringRef text = JSStringCreateWithCharacters(units, unit_count);
+    value = JSValueMakeString(ctx, text);
+    JSStringRelease(text);
+    free(units);
+  } else {
+    value = make_byte_array(ctx, message, length);
+  }
+
+  if (websocket->message_handler) {
+    emit_websocket_event(ctx, websocket->message_handler, websocket->ws, 1,
+                         &value);
+  }
+}
+
+// reads frames out of the connection buffer as they arrive. Data frames
+// are unmasked straight into the message, so a large one never waits whole
+// in the buffer; control frames are short and handled once all in
+static void read_websocket(TcpClientState *client_state) {
+  size_t used = 0;
+
+  while (!client_state->closing) {
+    WebSocketState *websocket = client_state->websocket;
+    WebSocketFrame *frame = &websocket->frame;
+    char *data = client_state->buffer + used;
+    size_t available = client_state->buffer_length - used;
+
+    if (!websocket->in_frame) {
+      int header_length = websocket_parse_header(data, available, frame);
+      if (header_length == 0) {
+        break;
+      }
+
+      // clients must mask every frame
+      int code = header_length < 0 || !frame->masked
+                     ? WEBSOCKET_CLOSE_PROTOCOL_ERROR
+                     : 0;
+      if (!code && !(frame->opcode & 0x08)) {
+        code = start_data_frame(websocket);
+      }
+      if (code) {
+        fail_websocket(client_state, code);
+        break;
+      }
+
+      used += header_length;
+      websocket->in_frame = true;
+      websocket->frame_read = 0;
+      continue;
+    }
+
+    if (frame->opcode & 0x08) {
+      if (available < frame->payload_length) {
+        break;
+      }
+      websocket_unmask(data, data, frame->payload_length, frame->mask, 0);
+      used += frame->payload_length;
+      websocket->in_frame = false;
+      handle_control_frame(client_state, frame->opcode, data,
+                           frame->payload_length);
+      continue;
+    }
+
+    uint64_t wanted = frame->payload_length - websocket->frame_read;
+    size_t length = available < wanted ? available : (size_t)wanted;
+    websocket_unmask(websocket->message + websocket->message_length, data,
+                     length, frame->mask, websocket->frame_read);
+    websocket->message_length += length;
+    websocket->frame_read += length;
+    used += length;
+
+    if (websocket->frame_read < frame->payload_length) {
+      break;
+    }
+    websocket->in_frame = false;
+    if (frame->fin) {
+      deliver_message(client_state);
+    }
+  }
+
+  // a handler may have closed the connection, the buffer stays until the
+  // socket's close callback
+  memmove(client_state->buffer, client_state->buffer + used,
+          client_state->buffer_length - used);
+  client_state->buffer_length -= used;
+}
+
+static WebSocketState *to_open_websocket(JSContextRef ctx, JSObjectRef ws,
+                                         JSValueRef *js_err_str) {
+  TcpClientState *client_state = JSObjectGetPrivate(ws);
+  if (!client_state || client_state->closing) {
+    set_js_error(ctx, "WebSocket is closed", js_err_str);
+    return NULL;
+  }
+  return client_state->websocket;
+}
+
+// ws.send(data) sends a string as a text message and bytes as a binary
+// one, false once the socket is backed up until 'drain'
+static JSValueRef ws_send(JSContextRef ctx, JSObjectRef js_fn,
+                          JSObjectRef this_obj, size_t argc,
+                          const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "ws.send", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  WebSocketState *websocket = to_open_websocket(ctx, this_obj, js_err_str);
+  if (!websocket) {
+    return JSValueMakeUndefined(ctx);
+  }
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+
+  char *frame;
+  size_t length;
+  int opcode;
+  if (JSValueIsString(ctx, args[0])) {
+    JSStringRef string = JSValueToStringCopy(ctx, args[0], NULL);
+    size_t max_length = JSStringGetMaximumUTF8CStringSize(string);
+    frame = alloc_frame(max_length);
+    if (frame) {
+      length = JSStringGetUTF8CString(
+                   string, frame + WEBSOCKET_MAX_HEADER_SIZE, max_length) -
+               1;
+    }
+    JSStringRelease(string);
+    opcode = WEBSOCKET_TEXT;
+  } else {
+    char *bytes;
+    if (!get_byte_span(ctx, args[0], &bytes, &length)) {
+      set_js_error(ctx, "ws.send takes a string or bytes", js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+    frame = alloc_frame(length);
+    if (frame) {
+      memcpy(frame + WEBSOCKET_MAX_HEADER_SIZE, bytes, length);
+    }
+    opcode = WEBSOCKET_BINARY;
+  }
+
+  if (!frame) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  bool below = send_frame(client_state, opcode, frame, length);
+  if (!below && !client_state->closing) {
+    websocket->needs_drain = true;
+  }
+  return JSValueMakeBoolean(ctx, below);
+}
+
+// ws.ping([data]), answered by a 'pong'
+static JSValueRef ws_ping(JSContextRef ctx, JSObjectRef js_fn,
+                          JSObjectRef this_obj, size_t argc,
+                          const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!to_open_websocket(ctx, this_obj, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  size_t length = 0;
+  char *payload = NULL;
+  if (argc > 0) {
+    payload = to_bytes(ctx, args[0], &length, js_err_str);
+    if (*js_err_str) {
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  if (length > WEBSOCKET_MAX_CONTROL_PAYLOAD) {
+    free(payload);
+    set_js_error(ctx, "Ping payload too long", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  send_control_frame(JSObjectGetPrivate(this_obj), WEBSOCKET_PING, payload,
+                     length);
+  free(payload);
+  return JSValueMakeUndefined(ctx);
+}
+
+// ws.close([code[, reason]]) starts the closing handshake; the connection
+// ends when the peer answers, or after WEBSOCKET_CLOSE_TIMEOUT_MS
+static JSValueRef ws_close(JSContextRef ctx, JSObjectRef js_fn,
+                           JSObjectRef this_obj, size_t argc,
+                           const JSValueRef args[], JSValueRef *js_err_str) {
+  WebSocketState *websocket = to_open_websocket(ctx, this_obj, js_err_str);
+  if (!websocket || websocket->close_sent) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  int code = WEBSOCKET_CLOSE_NORMAL;
+  if (argc > 0 && !JSValueIsUndefined(ctx, args[0])) {
+    code = (int)JSValueToNumber(ctx, args[0], NULL);
+    if (!valid_close_code(code)) {
+      set_js_error(ctx, "Invalid WebSocket close code", js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  char *reason = NULL;
+  if (argc > 1) {
+    reason = to_c_str(ctx, args[1], js_err_str);
+    if (*js_err_str) {
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  send_close_frame(client_state, code, reason, reason ? strlen(reason) : 0);
+  free(reason);
+  arm_timeout(client_state);
+  return JSValueMakeUndefined(ctx);
+}
+
+// 'message' (data), 'close' (code, reason), 'pong' and 'drain'
+static JSValueRef ws_on(JSContextRef ctx, JSObjectRef js_fn,
+                        JSObjectRef this_obj, size_t argc,
+                        const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "ws.on", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  WebSocketState *websocket = to_open_websocket(ctx, this_obj, js_err_str);
+  if (!websocket) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef handler;
+  if (!to_callback(ctx, args[1], &handler, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *event_name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef *slot = NULL;
+  if (strcmp(event_name, "message") == 0) {
+    slot = &websocket->message_handler;
+  } else if (strcmp(event_name, "close") == 0) {
+    slot = &websocket->close_handler;
+  } else if (strcmp(event_name, "pong") == 0) {
+    slot = &websocket->pong_handler;
+  } else if (strcmp(event_name, "drain") == 0) {
+    slot = &websocket->drain_handler;
+  }
+  free(event_name);
+
+  if (slot) {
+    if (*slot) {
+      JSValueUnprotect(ctx, *slot);
+    }
+    *slot = handler;
+    JSValueProtect(ctx, handler);
+  }
+
+  return this_obj;
+}
+
+static const JSStaticFunction websocket_functions[] = {
+    {"send", ws_send, METHOD_ATTRIBUTES},
+    {"ping", ws_ping, METHOD_ATTRIBUTES},
+    {"close", ws_close, METHOD_ATTRIBUTES},
+    {"on", ws_on, METHOD_ATTRIBUTES},
+    {NULL, NULL, 0},
+};
+
+// whether `token` is in a comma separated header value, e.g. Connection's
+static bool header_has_token(const char *data, const HttpHeader *header,
+                             const char *token) {
+  size_t token_length = strlen(token);
+  const char *cursor = data + header->value.offset;
+  const char *end = cursor + header->value.length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ','))
+      cursor++;
+
+    const char *start = cursor;
+    while (cursor < end && *cursor != ',' && *cursor != ' ' && *cursor != '\t')
+      cursor++;
+
+    if ((size_t)(cursor - start) == token_length &&
+        strncasecmp(start, token, token_length) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+static bool wants_websocket(TcpClientState *client_state) {
+  HttpParser *parser = &client_state->parser;
+  const HttpHeader *upgrade =
+      http_parser_find_header(parser, client_state->buffer, "upgrade");
+  const HttpHeader *connection =
+      http_parser_find_header(parser, client_state->buffer, "connection");
+
+  return upgrade && connection &&
+         http_span_equals(client_state->buffer, upgrade->value, "websocket") &&
+         header_has_token(client_state->buffer, connection, "upgrade");
+}
+
+// answers the handshake natively and hands (req, ws) to the upgrade handler.
+// req is only readable inside the handler, the handshake's bytes are
+// dropped once it returns
+static void upgrade_websocket(TcpClientState *client_state) {
+  HttpServerState *server_state = client_state->server_state;
+  JSContextRef ctx = server_state->ctx;
+  HttpParser *parser = &client_state->parser;
+  char *data = client_state->buffer;
+
+  const HttpHeader *key = http_parser_find_header(parser, data,
+                                                  "sec-websocket-key");
+  const HttpHeader *version =
+      http_parser_find_header(parser, data, "sec-websocket-version");
+  if (!key || key->value.length != 24 || !version ||
+      !http_span_equals(data, version->value, "13") ||
+      !http_span_equals(data, parser->method, "GET") ||
+      http_parser_in_body(parser)) {
+    send_error_response(client_state, 400);
+    return;
+  }
+
+  WebSocketState *websocket = calloc(1, sizeof(WebSocketState));
+  char *head = malloc(HTTP_RESPONSE_BUFFER_SIZE);
+  if (!websocket || !head) {
+    free(websocket);
+    free(head);
+    close_client(client_state);
+    return;
+  }
+
+  char accept[WEBSOCKET_ACCEPT_KEY_SIZE];
+  websocket_accept_key(data + key->value.offset, key->value.length, accept);
+  int head_length = snprintf(head, HTTP_RESPONSE_BUFFER_SIZE,
+                             "HTTP/1.1 101 Switching Protocols\r\n"
+                             "Upgrade: websocket\r\n"
+                             "Connection: Upgrade\r\n"
+                             "Sec-WebSocket-Accept: %s\r\n"
+                             "\r\n",
+                             accept);
+
+  ResponseWrite owned = {.client_state = client_state, .ctx = ctx,
+                         .head = head};
+  uv_buf_t buf = uv_buf_init(head, head_length);
+  send_buffers(client_state, &buf, 1, &owned);
+  if (client_state->closing) {
+    free(websocket);
+    return;
+  }
 
-static void http_server_finalize(JSObjectRef object) {
-  HttpServerState *server = (HttpServerState *)JSObjectGetPrivate(object);
-  if (server) {
-    JSValueUnprotect(server->ctx, server->callback);
-    uv_close((uv_handle_t *)&server->socket, NULL);
-    free(server);
+  if (websocket_class == NULL) {
+    JSClassDefinition websocket_def = kJSClassDefinitionEmpty;
+    websocket_def.className = "WebSocket";
+    websocket_def.staticFunctions = websocket_functions;
+    websocket_class = JSClassCreate(&websocket_def);
   }
+
+  websocket->close_code = WEBSOCKET_CLOSE_ABNORMAL;
+  websocket->ws = JSObjectMake(ctx, websocket_class, client_state);
+  JSValueProtect(ctx, websocket->ws);
+  client_state->websocket = websocket;
+  arm_timeout(client_state);
+
+  create_request_objects(client_state);
+  JSValueRef args[] = {client_state->req, websocket->ws};
+  JSObjectCallAsFunction(ctx, server_state->upgrade_handler, NULL, 2, args,
+                         NULL);
+  release_request_objects(client_state);
+  consume_request(client_state);
 }
 
-static JSValueRef res_end(JSContextRef ctx, JSObjectRef js_fn,
-                          JSObjectRef this_obj, size_t argc,
-                          const JSValueRef args[], JSValueRef *js_err_str) {
-  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
-  if (!client_state) {
-    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
-    return JSValueMakeUndefined(ctx);
+// the broadcast payload framed as a WebSocket message or an HTTP chunk,
+// made once for all the subscribers that need it
+static SharedBuffer *frame_broadcast(Broadcast *broadcast, bool websocket) {
+  SharedBuffer *raw = broadcast->raw;
+  char prefix[WEBSOCKET_MAX_HEADER_SIZE + HTTP_CHUNK_LINE_SIZE];
+  size_t prefix_length;
+  const char *suffix = websocket ? "" : "\r\n";
+
+  if (websocket) {
+    int opcode = broadcast->binary ? WEBSOCKET_BINARY : WEBSOCKET_TEXT;
+    prefix_length =
+        websocket_frame_header((uint8_t *)prefix, opcode, raw->length);
+  } else {
+    prefix_length = snprintf(prefix, sizeof(prefix), "%zx\r\n", raw->length);
   }
 
-  const char *body = "Hello, world!";
-  char response[HTTP_RESPONSE_BUFFER_SIZE];
-  snprintf(response, sizeof(response),
-           "HTTP/1.1 200 OK\r\n"
-           "Content-Type: text/plain\r\n"
-           "Content-Length: %zu\r\n"
-           "\r\n%s",
-           strlen(body), body);
+  size_t suffix_length = strlen(suffix);
+  size_t length = prefix_length + raw->length + suffix_length;
+  char *data = malloc(length);
+  if (!data) {
+    return NULL;
+  }
+  memcpy(data, prefix, prefix_length);
+  memcpy(data + prefix_length, raw->data, raw->length);
+  memcpy(data + prefix_length + raw->length, suffix, suffix_length);
 
-  char *response_copy =
-      strdup(response); // write to heap until freed by http_write_complete
-  if (!response_copy) {
-    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
-    return JSValueMakeUndefined(ctx);
+  SharedBuffer *framed = shared_buffer_create(data, length);
+  if (!framed) {
+    free(data);
   }
+  return framed;
+}
 
-  uv_write_t *write_req = malloc(sizeof(uv_write_t));
-  if (!write_req) {
-    free(response_copy);
-    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
-    return JSValueMakeUndefined(ctx);
+BroadcastResult http_broadcast_to(JSContextRef ctx, JSValueRef target,
+                                  Broadcast *broadcast) {
+  bool websocket =
+      websocket_class && JSValueIsObjectOfClass(ctx, target, websocket_class);
+  if (!websocket && (!response_class ||
+                     !JSValueIsObjectOfClass(ctx, target, response_class))) {
+    return BROADCAST_UNKNOWN;
   }
 
-  uv_buf_t buffer = uv_buf_init(response_copy, strlen(response));
-  write_req->data = buffer.base;
+  TcpClientState *client_state = JSObjectGetPrivate((JSObjectRef)target);
+  if (!client_state || client_state->closing) {
+    return BROADCAST_CLOSED;
+  }
 
-  int write_result = uv_write(write_req, (uv_stream_t *)client_state->socket,
-                              &buffer, 1, http_write_complete);
-  if (write_result < 0) {
-    fprintf(stderr, "Response write error: %s\n", uv_strerror(write_result));
-    free(response_copy);
-    free(write_req);
+  // a response takes chunks once write() has started streaming it; an
+  // empty one would end its body
+  if (websocket ? client_state->websocket->close_sent
+                : !client_state->response.headers_sent ||
+                      !client_state->response.chunked ||
+                      http_span_equals(client_state->buffer,
+                                       client_state->parser.method, "HEAD")) {
+    return BROADCAST_CLOSED;
+  }
+  if (!websocket && broadcast->raw->length == 0) {
+    return BROADCAST_SENT;
   }
 
-  return JSValueMakeUndefined(ctx);
+  if (client_state->socket.write_queue_size >= broadcast->high_watermark) {
+    if (broadcast->drop_slow) {
+      close_client(client_state);
+      return BROADCAST_DROPPED;
+    }
+    return BROADCAST_SKIPPED;
+  }
+
+  SharedBuffer **framed =
+      websocket ? &broadcast->websocket_frame : &broadcast->http_chunk;
+  if (!*framed) {
+    *framed = frame_broadcast(broadcast, websocket);
+    if (!*framed) {
+      return BROADCAST_SKIPPED;
+    }
+  }
+
+  shared_buffer_retain(*framed);
+  ResponseWrite owned = {.client_state = client_state,
+                         .ctx = ctx,
+                         .shared = *framed};
+  uv_buf_t buf = uv_buf_init((*framed)->data, (*framed)->length);
+  send_buffers(client_state, &buf, 1, &owned);
+  return client_state->closing ? BROADCAST_CLOSED : BROADCAST_SENT;
 }
 
-static void on_client_read(uv_stream_t *client_socket, ssize_t bytes_read,
-                           const uv_buf_t *buffer) {
-  TcpClientState *client_state = client_socket->data;
+// routes are matched against the parsed url before any JS runs; requests no
+// route takes go to the createServer callback, or get a native 404
+static void dispatch_request(TcpClientState *client_state) {
+  HttpServerState *server_state = client_state->server_state;
+  JSContextRef ctx = server_state->ctx;
+  HttpParser *parser = &client_state->parser;
+  JSObjectRef handler = server_state->callback;
+
+  if (server_state->upgrade_handler && wants_websocket(client_state)) {
+    upgrade_websocket(client_state);
+    return;
+  }
 
-  if (bytes_read <= 0) {
-    free(buffer->base);
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_state);
+  client_state->in_request = true;
+  server_state->pending_requests++;
+  client_state->timeout_kind = TIMEOUT_NONE;
+  wheel_timer_stop(&client_state->timeout);
+  client_state->route.param_count = 0;
+
+  if (server_state->cache && serve_cached_response(client_state)) {
     return;
   }
 
-  if ((size_t)bytes_read >= buffer->len) {
-    free(buffer->base);
+  // over the limit, a request is turned away before any routing or JS and
+  // its connection closed, which is cheaper than queueing it behind the rest
+  if (server_state->max_pending_requests > 0 &&
+      server_state->pending_requests > server_state->max_pending_requests) {
+    JSValueRef error = NULL;
+    server_state->rejected_requests++;
+    client_state->parser.keep_alive = false;
+    append_header(ctx, &client_state->response, "Retry-After",
+                  HTTP_RETRY_AFTER_SECONDS, &error);
+    send_native_response(client_state, 503, NULL);
     return;
   }
 
-  buffer->base[bytes_read] = '\0';
+  if (server_state->router.route_count > 0) {
+    const char *url = client_state->buffer + parser->url.offset;
+    const char *query = memchr(url, '?', parser->url.length);
+    size_t path_length = query ? (size_t)(query - url) : parser->url.length;
 
-  char c_method[HTTP_METHOD_BUFFER_SIZE], c_url[HTTP_URL_BUFFER_SIZE];
-  char *first_line = strtok(buffer->base, "\r\n");
+    RouteResult result = router_match(
+        &server_state->router, client_state->buffer + parser->method.offset,
+        parser->method.length, url, path_length, &client_state->route);
 
-  if (!first_line || sscanf(first_line, "%15s %255s", c_method, c_url) != 2) {
-    fprintf(stderr, "Failed to parse HTTP request\n");
-    free(buffer->base);
-    return;
+    if (result == ROUTE_FOUND) {
+      handler = client_state->route.data;
+    } else if (!handler && result == ROUTE_METHOD_NOT_ALLOWED) {
+      send_method_not_allowed(client_state);
+      return;
+    }
   }
 
-  JSStringRef js_method = JSStringCreateWithUTF8CString(c_method);
-  JSStringRef method_name = JSStringCreateWithUTF8CString("method");
-  JSObjectSetProperty(
-      client_state->server_state->ctx, client_state->req, method_name,
-      JSValueMakeString(client_state->server_state->ctx, js_method),
-      kJSPropertyAttributeNone, NULL);
-  JSStringRelease(method_name);
-  JSStringRelease(js_method);
+  if (!handler) {
+    send_native_response(client_state, 404, NULL);
+    return;
+  }
 
-  JSStringRef js_url = JSStringCreateWithUTF8CString(c_url);
-  JSStringRef url_name = JSStringCreateWithUTF8CString("url");
-  JSObjectSetProperty(
-      client_state->server_state->ctx, client_state->req, url_name,
-      JSValueMakeString(client_state->server_state->ctx, js_url),
-      kJSPropertyAttributeNone, NULL);
-  JSStringRelease(url_name);
-  JSStringRelease(js_url);
+  if (static_handler_class &&
+      JSValueIsObjectOfClass(ctx, handler, static_handler_class)) {
+    serve_static(client_state, JSObjectGetPrivate(handler));
+    return;
+  }
 
-  printf("Received request %s %s\n", c_method, c_url);
+  create_request_objects(client_state);
 
   JSValueRef args[] = {client_state->req, client_state->res};
-  JSObjectCallAsFunction(client_state->server_state->ctx,
-                         client_state->server_state->callback, NULL, 2, args,
-                         NULL);
+  JSObjectCallAsFunction(ctx, handler, NULL, 2, args, NULL);
+}
+
+static void push_body_data(void *data, const char *bytes, size_t length) {
+  TcpClientState *client_state = data;
+
+  if (client_state->multipart) {
+    feed_multipart(client_state->multipart, bytes, length);
+    return;
+  }
+
+  // dropped once the response is done, or the handler stopped listening
+  if (!client_state->body_stream) {
+    return;
+  }
+
+  char *chunk = malloc(length + 1);
+  if (!chunk) {
+    return;
+  }
+  memcpy(chunk, bytes, length);
+  readable_stream_push(client_state->body_stream, chunk, length);
+}
+
+// decodes the body bytes in the buffer and drops them from it, so an upload
+// of any size only ever holds a read's worth here. false until it has all
+// been read
+static bool read_body(TcpClientState *client_state) {
+  HttpParser *parser = &client_state->parser;
+  size_t start = parser->position;
+
+  HttpParseResult result =
+      http_parser_execute_body(parser, client_state->buffer,
+                               client_state->buffer_length, push_body_data,
+                               client_state);
+
+  // a data handler may have closed the connection, the buffer stays until
+  // the socket's close callback
+  size_t used = parser->position - start;
+  if (used > 0) {
+    memmove(client_state->buffer + start,
+            client_state->buffer + parser->position,
+            client_state->buffer_length - parser->position);
+    client_state->buffer_length -= used;
+    parser->position = start;
+  }
+
+  if (result == HTTP_PARSE_ERROR) {
+    if (client_state->body_stream) {
+      readable_stream_push_error(client_state->body_stream,
+                                 "Malformed request body");
+    }
+    if (client_state->multipart) {
+      fail_upload(client_state->multipart, "Malformed request body");
+    }
+    close_client(client_state);
+    return false;
+  }
+
+  if (result == HTTP_PARSE_INCOMPLETE) {
+    return false;
+  }
+
+  if (client_state->body_stream) {
+    readable_stream_push_end(client_state->body_stream);
+  }
+  if (client_state->multipart) {
+    end_multipart(client_state->multipart);
+  }
+
+  // the response went out before the body was in, the next request follows
+  if (!client_state->in_request) {
+    consume_request(client_state);
+  }
+  return true;
+}
+
+static void process_requests(TcpClientState *client_state) {
+  // res.end() inside the handler lands back here through finish_request, the
+  // loop picks up the next pipelined request instead of recursing
+  client_state->dispatching = true;
+
+  while (!client_state->closing) {
+    if (client_state->websocket) {
+      read_websocket(client_state);
+      break;
+    }
+
+    if (http_parser_in_body(&client_state->parser)) {
+      // a handler that hasn't read from req yet leaves the body buffered
+      if ((client_state->in_request && !client_state->body_stream &&
+           !client_state->multipart) ||
+          !read_body(client_state)) {
+        break;
+      }
+      continue;
+    }
+
+    if (client_state->in_request) {
+      break;
+    }
+
+    HttpParseResult result = http_parser_execute(
+        &client_state->parser, client_state->buffer, client_state->buffer_length);
+
+    if (result == HTTP_PARSE_INCOMPLETE) {
+      break;
+    }
+
+    if (result == HTTP_PARSE_ERROR) {
+      send_error_response(client_state, client_state->parser.error_status);
+      break;
+    }
+
+    dispatch_request(client_state);
+  }
+
+  client_state->dispatching = false;
+}
+
+// reads land directly after the unparsed bytes of the connection buffer,
+// leaving one spare byte at the end for make_span_string
+static void client_alloc_buffer(uv_handle_t *handle, size_t suggested_size,
+                                uv_buf_t *buf) {
+  TcpClientState *client_state = handle->data;
+
+  if (!client_state->buffer) {
+    client_state->buffer = buffer_pool_acquire(&read_buffer_pool);
+    if (!client_state->buffer) {
+      *buf = uv_buf_init(NULL, 0);
+      return;
+    }
+    client_state->buffer_capacity = HTTP_READ_BUFFER_SIZE;
+  }
+
+  size_t free_space =
+      client_state->buffer_capacity - client_state->buffer_length;
+
+  // requests that outgrow a pooled buffer move to a private one
+  if (free_space <= HTTP_READ_BUFFER_SIZE / 2) {
+    size_t capacity = client_state->buffer_capacity * 2;
+    char *buffer = malloc(capacity);
+    if (!buffer) {
+      *buf = uv_buf_init(NULL, 0);
+      return;
+    }
+    memcpy(buffer, client_state->buffer, client_state->buffer_length);
+    size_t length = client_state->buffer_length;
+    release_read_buffer(client_state, true);
+    client_state->buffer = buffer;
+    client_state->buffer_length = length;
+    client_state->buffer_capacity = capacity;
+  }
 
-  free(buffer->base);
+  *buf = uv_buf_init(client_state->buffer + client_state->buffer_length,
+                     client_state->buffer_capacity -
+                         client_state->buffer_length - 1);
+}
+
+static void on_client_read(uv_stream_t *client_socket, ssize_t bytes_read,
+                           const uv_buf_t *buffer) {
+  TcpClientState *client_state = client_socket->data;
+
+  if (bytes_read < 0) {
+    close_client(client_state);
+    return;
+  }
+
+  client_state->buffer_length += bytes_read;
+  process_requests(client_state);
+  release_read_buffer(client_state, false);
+
+  // a client pipelining far ahead of its responses waits until they catch
+  // up, as does a body the handler hasn't started reading
+  if (client_state->in_request &&
+      client_state->buffer_length >= HTTP_MAX_PIPELINE_SIZE) {
+    pause_reading(client_state);
+  }
+
+  arm_timeout(client_state);
+}
+
+static void start_reading(TcpClientState *client_state) {
+  if (client_state->reading || client_state->closing) {
+    return;
+  }
+
+  int read_result = uv_read_start((uv_stream_t *)&client_state->socket,
+                                  client_alloc_buffer, on_client_read);
+  if (read_result < 0) {
+    fprintf(stderr, "Failed to start reading from client: %s\n",
+            uv_strerror(read_result));
+    close_client(client_state);
+    return;
+  }
+
+  client_state->reading = true;
 }
 
 void on_new_http_connection(uv_stream_t *server_socket, int uv_status) {
@@ -147,76 +3602,415 @@ void on_new_http_connection(uv_stream_t *server_socket, int uv_status) {
     return;
   }
 
-  uv_tcp_t *client_socket = malloc(sizeof(uv_tcp_t));
-  if (!client_socket) {
+  TcpClientState *client_state = pool_alloc(&client_pool);
+  if (!client_state) {
     fprintf(stderr, "Failed to allocate memory for client socket\n");
     return;
   }
 
-  uv_tcp_init(uv_default_loop(), client_socket);
+  uv_tcp_init(loop, &client_state->socket);
+  client_state->socket.data = client_state;
+  client_state->open_handles = 1;
 
-  if (uv_accept(server_socket, (uv_stream_t *)client_socket) != 0) {
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_socket);
+  if (uv_accept(server_socket, (uv_stream_t *)&client_state->socket) != 0) {
+    uv_close((uv_handle_t *)&client_state->socket, on_client_handle_close);
     return;
   }
 
-  TcpClientState *client_state = malloc(sizeof(TcpClientState));
-  if (!client_state) {
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_socket);
+  client_state->server_state = server_state;
+  client_state->response.status_code = 200;
+  http_parser_init(&client_state->parser);
+  server_state->connection_count++;
+
+  // a client left with default options still works, so failures are ignored
+  apply_socket_options(&client_state->socket, &server_state->socket_options);
+
+  // listen() can't be paused, so connections past the limit are accepted
+  // only to be answered with a 503 and closed
+  if (server_state->max_connections > 0 &&
+      server_state->connection_count > server_state->max_connections) {
+    server_state->rejected_connections++;
+    send_error_response(client_state, 503);
     return;
   }
 
-  client_state->socket = client_socket;
-  client_state->server_state = server_state;
+  arm_timeout(client_state);
+  start_reading(client_state);
+}
 
-  client_state->req = JSObjectMake(server_state->ctx, NULL, NULL);
-  client_state->res = JSObjectMake(server_state->ctx, NULL, NULL);
+static int set_reuse_port(uv_tcp_t *socket) {
+#ifdef SO_REUSEPORT
+  uv_os_fd_t fd;
+  int fileno_result = uv_fileno((uv_handle_t *)socket, &fd);
+  if (fileno_result < 0) {
+    return fileno_result;
+  }
 
-  JSStringRef end_name = JSStringCreateWithUTF8CString("end");
-  JSObjectRef end_fn =
-      JSObjectMakeFunctionWithCallback(server_state->ctx, end_name, res_end);
-  JSObjectSetProperty(server_state->ctx, client_state->res, end_name, end_fn,
-                      kJSPropertyAttributeNone, NULL);
-  JSStringRelease(end_name);
+  int enabled = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) < 0) {
+    return uv_translate_sys_error(errno);
+  }
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
 
-  JSObjectSetPrivate(client_state->res, client_state);
+// handlers are JS functions, or objects from http.serveStatic() which are
+// served without calling into JS
+static bool to_request_handler(JSContextRef ctx, JSValueRef value,
+                               JSObjectRef *handler, JSValueRef *js_err_str) {
+  if (static_handler_class &&
+      JSValueIsObjectOfClass(ctx, value, static_handler_class)) {
+    *handler = (JSObjectRef)value;
+    return true;
+  }
 
-  client_socket->data = client_state;
+  return to_callback(ctx, value, handler, js_err_str);
+}
 
-  int read_result = uv_read_start((uv_stream_t *)client_socket,
-                                  http_alloc_buffer, on_client_read);
-  if (read_result < 0) {
-    fprintf(stderr, "Failed to start reading from client: %s\n",
-            uv_strerror(read_result));
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_state);
-    free(client_socket);
+// server.route(method, pattern, handler), method "*" for any
+static JSValueRef http_server_route(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 3, "server.route", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  HttpServerState *server_state = JSObjectGetPrivate(this_obj);
+  if (!server_state) {
+    set_js_error(ctx, ERR_INVALID_SERVER_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef handler;
+  if (!to_request_handler(ctx, args[2], &handler, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *method = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+  char *pattern = to_c_str(ctx, args[1], js_err_str);
+  if (*js_err_str) {
+    free(method);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  for (char *c = method; *c; c++) {
+    if (*c >= 'a' && *c <= 'z') {
+      *c -= 'a' - 'A';
+    }
+  }
+
+  void *replaced;
+  if (router_add(&server_state->router, method, pattern, handler, &replaced)) {
+    JSValueProtect(ctx, handler);
+    if (replaced) {
+      JSValueUnprotect(ctx, (JSObjectRef)replaced);
+    }
+  } else {
+    set_js_error(ctx, "Invalid route pattern", js_err_str);
+  }
+
+  free(method);
+  free(pattern);
+  return this_obj;
+}
+
+static void static_handler_finalize(JSObjectRef object) {
+  static_root_free(JSObjectGetPrivate(object));
+}
+
+// http.serveStatic(root[, { maxAge }]), passed to createServer or a route
+JSValueRef http_serve_static(JSContextRef ctx, JSObjectRef js_fn,
+                             JSObjectRef this_obj, size_t argc,
+                             const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "http.serveStatic", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  double max_age = 0;
+  if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+    JSStringRef max_age_name = JSStringCreateWithUTF8CString("maxAge");
+    JSValueRef max_age_value =
+        JSObjectGetProperty(ctx, (JSObjectRef)args[1], max_age_name, NULL);
+    JSStringRelease(max_age_name);
+
+    if (!JSValueIsUndefined(ctx, max_age_value)) {
+      max_age = JSValueToNumber(ctx, max_age_value, NULL);
+      if (!(max_age >= 0)) {
+        set_js_error(ctx, "Invalid maxAge option", js_err_str);
+        return JSValueMakeUndefined(ctx);
+      }
+    }
+  }
+
+  char *root_path = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  StaticRoot *root = static_root_create(loop, root_path, max_age);
+  free(root_path);
+  if (!root) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (static_handler_class == NULL) {
+    JSClassDefinition class_def = kJSClassDefinitionEmpty;
+    class_def.className = "StaticHandler";
+    class_def.finalize = static_handler_finalize;
+    static_handler_class = JSClassCreate(&class_def);
+  }
+
+  return JSObjectMake(ctx, static_handler_class, root);
+}
+
+// { cache: true } or { cache: { maxBytes, ttl, staleWhileRevalidate, vary } }
+// with the times in milliseconds and vary naming request headers
+static bool create_response_cache(JSContextRef ctx, JSValueRef option,
+                                  ResponseCache **cache,
+                                  JSValueRef *js_err_str) {
+  *cache = NULL;
+  if (JSValueIsUndefined(ctx, option) || JSValueIsNull(ctx, option) ||
+      (JSValueIsBoolean(ctx, option) && !JSValueToBoolean(ctx, option))) {
+    return true;
+  }
+
+  double max_bytes = HTTP_CACHE_DEFAULT_BYTES;
+  double ttl = HTTP_CACHE_DEFAULT_TTL_MS;
+  double stale = 0;
+  JSObjectRef options = NULL;
+
+  if (JSValueIsObject(ctx, option)) {
+    options = (JSObjectRef)option;
+    get_number_option(ctx, options, "maxBytes", &max_bytes);
+    get_number_option(ctx, options, "ttl", &ttl);
+    get_number_option(ctx, options, "staleWhileRevalidate", &stale);
+    if (!(max_bytes >= 0 && ttl >= 0 && stale >= 0)) {
+      set_js_error(ctx, "Invalid cache option", js_err_str);
+      return false;
+    }
+  } else if (!JSValueIsBoolean(ctx, option)) {
+    set_js_error(ctx, "Invalid cache option", js_err_str);
+    return false;
+  }
+
+  *cache = response_cache_create((size_t)max_bytes, (uint64_t)ttl,
+                                 (uint64_t)stale);
+  if (!*cache) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return false;
+  }
+
+  JSValueRef vary = JSValueMakeUndefined(ctx);
+  if (options) {
+    JSStringRef vary_name = JSStringCreateWithUTF8CString("vary");
+    vary = JSObjectGetProperty(ctx, options, vary_name, NULL);
+    JSStringRelease(vary_name);
+  }
+
+  if (JSValueIsArray(ctx, vary)) {
+    JSStringRef length_name = JSStringCreateWithUTF8CString("length");
+    JSValueRef length_value =
+        JSObjectGetProperty(ctx, (JSObjectRef)vary, length_name, NULL);
+    JSStringRelease(length_name);
+    size_t length = (size_t)JSValueToNumber(ctx, length_value, NULL);
+
+    for (size_t i = 0; i < length; i++) {
+      JSValueRef name_value =
+          JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)vary, i, NULL);
+      char *name = to_c_str(ctx, name_value, js_err_str);
+      if (*js_err_str) {
+        response_cache_free(*cache);
+        return false;
+      }
+
+      bool added = response_cache_add_vary(*cache, name);
+      free(name);
+      if (!added) {
+        response_cache_free(*cache);
+        set_js_error(ctx, "Invalid cache option", js_err_str);
+        return false;
+      }
+    }
+  } else if (!JSValueIsUndefined(ctx, vary)) {
+    response_cache_free(*cache);
+    set_js_error(ctx, "Invalid cache option", js_err_str);
+    return false;
+  }
+
+  return true;
+}
+
+// server.stats(), this thread's counts
+static JSValueRef http_server_stats(JSContextRef ctx, JSObjectRef js_fn,
+                                    JSObjectRef this_obj, size_t argc,
+                                    const JSValueRef args[],
+                                    JSValueRef *js_err_str) {
+  HttpServerState *server_state = JSObjectGetPrivate(this_obj);
+  if (!server_state) {
+    set_js_error(ctx, ERR_INVALID_SERVER_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef stats = JSObjectMake(ctx, NULL, NULL);
+  set_number_property(ctx, stats, "connections",
+                      server_state->connection_count);
+  set_number_property(ctx, stats, "pendingRequests",
+                      server_state->pending_requests);
+  set_number_property(ctx, stats, "rejectedConnections",
+                      server_state->rejected_connections);
+  set_number_property(ctx, stats, "rejectedRequests",
+                      server_state->rejected_requests);
+  return stats;
+}
+
+// server.on("upgrade", (req, ws) => ...) takes WebSocket handshakes, which
+// are otherwise handled like any other request
+static JSValueRef http_server_on(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "server.on", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  HttpServerState *server_state = JSObjectGetPrivate(this_obj);
+  if (!server_state) {
+    set_js_error(ctx, ERR_INVALID_SERVER_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef handler;
+  if (!to_callback(ctx, args[1], &handler, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *event_name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  bool known = strcmp(event_name, "upgrade") == 0;
+  free(event_name);
+  if (!known) {
+    set_js_error(ctx, "Unknown server event", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (server_state->upgrade_handler) {
+    JSValueUnprotect(ctx, server_state->upgrade_handler);
   }
+  server_state->upgrade_handler = handler;
+  JSValueProtect(ctx, handler);
+  return this_obj;
 }
 
 JSValueRef http_create_server(JSContextRef ctx, JSObjectRef js_fn,
                               JSObjectRef this_obj, size_t argc,
                               const JSValueRef args[], JSValueRef *js_err_str) {
-  if (argc != 1 || !JSObjectIsFunction(ctx, (JSObjectRef)args[0])) {
+  // the callback is optional once routes are added with server.route()
+  JSObjectRef callback = NULL;
+  if (argc > 2 || (argc > 0 && !JSValueIsUndefined(ctx, args[0]) &&
+                   !JSValueIsNull(ctx, args[0]) &&
+                   !to_request_handler(ctx, args[0], &callback, js_err_str))) {
     set_js_error(ctx, ERR_CALLBACK_REQUIRED, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
+  // { threads: N } runs the script on N threads, each serving the port
+  int threads = 1;
+  double backlog = TCP_LISTEN_BACKLOG;
+  double max_connections = 0;
+  double max_pending_requests = 0;
+  JSValueRef cache_option = JSValueMakeUndefined(ctx);
+  if (argc > 1 && JSValueIsObject(ctx, args[1])) {
+    JSStringRef cache_name = JSStringCreateWithUTF8CString("cache");
+    cache_option =
+        JSObjectGetProperty(ctx, (JSObjectRef)args[1], cache_name, NULL);
+    JSStringRelease(cache_name);
+
+    JSStringRef threads_name = JSStringCreateWithUTF8CString("threads");
+    JSValueRef threads_value =
+        JSObjectGetProperty(ctx, (JSObjectRef)args[1], threads_name, NULL);
+    JSStringRelease(threads_name);
+
+    if (!JSValueIsUndefined(ctx, threads_value)) {
+      double value = JSValueToNumber(ctx, threads_value, NULL);
+      if (!(value >= 1 && value <= HTTP_MAX_THREADS)) {
+        set_js_error(ctx, "Invalid threads option", js_err_str);
+        return JSValueMakeUndefined(ctx);
+      }
+      threads = (int)value;
+    }
+
+    if ((get_number_option(ctx, args[1], "backlog", &backlog) &&
+         !(backlog >= 1 && backlog <= INT_MAX)) ||
+        (get_number_option(ctx, args[1], "maxConnections", &max_connections) &&
+         !(max_connections >= 0)) ||
+        (get_number_option(ctx, args[1], "maxPendingRequests",
+                           &max_pending_requests) &&
+         !(max_pending_requests >= 0))) {
+      set_js_error(ctx, "Invalid server option", js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  if (!pools_initialized) {
+    pool_init(&client_pool, sizeof(TcpClientState), HTTP_CLIENT_SLAB_SIZE);
+    pool_init(&write_pool, sizeof(ResponseWrite), HTTP_CLIENT_SLAB_SIZE);
+    buffer_pool_init(&read_buffer_pool, HTTP_READ_BUFFER_SIZE,
+                     HTTP_READ_BUFFER_POOL_SIZE);
+    pools_initialized = true;
+  }
+
+  ResponseCache *cache;
+  if (!create_response_cache(ctx, cache_option, &cache, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
   HttpServerState *server_state = malloc(sizeof(HttpServerState));
   if (!server_state) {
+    response_cache_free(cache);
     set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
   server_state->ctx = ctx;
-  server_state->callback = (JSObjectRef)args[0];
-  JSValueProtect(ctx, server_state->callback);
+  server_state->callback = callback;
+  if (callback) {
+    JSValueProtect(ctx, callback);
+  }
+  server_state->upgrade_handler = NULL;
+  router_init(&server_state->router);
+  server_state->cache = cache;
+  init_socket_options(&server_state->socket_options);
+  server_state->backlog = (int)backlog;
+  server_state->max_connections = (size_t)max_connections;
+  server_state->max_pending_requests = (size_t)max_pending_requests;
+  server_state->connection_count = 0;
+  server_state->pending_requests = 0;
+  server_state->rejected_connections = 0;
+  server_state->rejected_requests = 0;
+
+  // cluster workers are separate processes binding the same port
+  server_state->reuse_port = threads > 1 || is_cluster_worker();
 
-  uv_tcp_init(uv_default_loop(), &server_state->socket);
+  // SO_REUSEPORT has to be set before bind, so the socket is created now
+  uv_tcp_init_ex(loop, &server_state->socket, AF_INET);
   server_state->socket.data = server_state; // back pointer for later access
 
+  // workers run this same createServer call, with the main thread as the
+  // first of the N
+  if (threads > 1) {
+    start_workers(threads - 1);
+  }
+
   if (server_class == NULL) {
     JSClassDefinition class_def = kJSClassDefinitionEmpty;
     class_def.finalize = http_server_finalize;
@@ -231,13 +4025,34 @@ JSValueRef http_create_server(JSContextRef ctx, JSObjectRef js_fn,
                       kJSPropertyAttributeNone, NULL);
   JSStringRelease(listen_name);
 
+  JSStringRef route_name = JSStringCreateWithUTF8CString("route");
+  JSObjectRef route_fn =
+      JSObjectMakeFunctionWithCallback(ctx, route_name, http_server_route);
+  JSObjectSetProperty(ctx, server_obj, route_name, route_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(route_name);
+
+  JSStringRef on_name = JSStringCreateWithUTF8CString("on");
+  JSObjectRef on_fn =
+      JSObjectMakeFunctionWithCallback(ctx, on_name, http_server_on);
+  JSObjectSetProperty(ctx, server_obj, on_name, on_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(on_name);
+
+  JSStringRef stats_name = JSStringCreateWithUTF8CString("stats");
+  JSObjectRef stats_fn =
+      JSObjectMakeFunctionWithCallback(ctx, stats_name, http_server_stats);
+  JSObjectSetProperty(ctx, server_obj, stats_name, stats_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(stats_name);
+
   return server_obj;
 }
 
 JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef js_fn,
                               JSObjectRef this_obj, size_t argc,
                               const JSValueRef args[], JSValueRef *js_err_str) {
-  if (argc != 1 || !JSValueIsNumber(ctx, args[0])) {
+  if (argc < 1 || argc > 2 || !JSValueIsNumber(ctx, args[0])) {
     set_js_error(ctx, "Port required", js_err_str);
     return JSValueMakeUndefined(ctx);
   }
@@ -248,6 +4063,12 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
+  // listen(port[, socketOptions])
+  if (!get_socket_options(ctx, argc > 1 ? args[1] : JSValueMakeUndefined(ctx),
+                          &server_state->socket_options, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
   int port = JSValueToNumber(ctx, args[0], js_err_str);
   if (*js_err_str) {
     return JSValueMakeUndefined(ctx);
@@ -256,6 +4077,14 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef js_fn,
   struct sockaddr_in addr;
   uv_ip4_addr("0.0.0.0", port, &addr);
 
+  if (server_state->reuse_port) {
+    int fd_result = set_reuse_port(&server_state->socket);
+    if (fd_result < 0) {
+      fprintf(stderr, "Server SO_REUSEPORT error: %s\n", uv_strerror(fd_result));
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
   int bind_result =
       uv_tcp_bind(&server_state->socket, (const struct sockaddr *)&addr, 0);
   if (bind_result < 0) {
@@ -263,13 +4092,31 @@ JSValueRef http_server_listen(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
+  int options_result =
+      apply_listen_options(&server_state->socket, &server_state->socket_options);
+  if (options_result < 0) {
+    fprintf(stderr, "Server socket option error: %s\n",
+            uv_strerror(options_result));
+    return JSValueMakeUndefined(ctx);
+  }
+
   int listen_result = uv_listen((uv_stream_t *)&server_state->socket,
-                                TCP_LISTEN_BACKLOG, on_new_http_connection);
+                                server_state->backlog, on_new_http_connection);
   if (listen_result < 0) {
     fprintf(stderr, "Server listen error: %s\n", uv_strerror(listen_result));
     return JSValueMakeUndefined(ctx);
   }
 
-  printf("HTTP server listening on port %d\n", port);
+  if (is_worker_thread()) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (is_cluster_worker()) {
+    char message[CLUSTER_MESSAGE_SIZE];
+    snprintf(message, sizeof(message), "listening %d", port);
+    cluster_send(message); // the master reports it
+  } else {
+    printf("HTTP server listening on port %d\n", port);
+  }
   return JSValueMakeUndefined(ctx);
 }
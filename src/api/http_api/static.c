@@ -0,0 +1,348 @@
+#include "api/http_api/static.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static const struct {
+  const char *extension;
+  const char *type;
+} mime_types[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"wasm", "application/wasm"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"pdf", "application/pdf"},
+};
+
+static void clear_cache(StaticRoot *root) {
+  for (size_t i = 0; i < HTTP_STATIC_CACHE_SIZE; i++) {
+    free(root->cache[i].path);
+    root->cache[i].path = NULL;
+  }
+}
+
+static void on_root_changed(uv_fs_event_t *watcher, const char *filename,
+                            int events, int status) {
+  StaticRoot *root = watcher->data;
+  if (root) {
+    clear_cache(root);
+  }
+}
+
+static void on_watcher_close(uv_handle_t *handle) { free(handle); }
+
+StaticRoot *static_root_create(uv_loop_t *loop, const char *root_path,
+                               double max_age) {
+  StaticRoot *root = calloc(1, sizeof(StaticRoot));
+  if (!root)
+    return NULL;
+
+  // without a trailing slash, so joined paths have exactly one
+  size_t length = strlen(root_path);
+  while (length > 1 && root_path[length - 1] == '/')
+    length--;
+
+  root->root = malloc(length + 1);
+  if (!root->root) {
+    free(root);
+    return NULL;
+  }
+  memcpy(root->root, root_path, length);
+  root->root[length] = '\0';
+  root->max_age = max_age;
+
+  // recursive where the platform supports it; the stat TTL covers the rest
+  root->watcher = malloc(sizeof(uv_fs_event_t));
+  if (root->watcher) {
+    uv_fs_event_init(loop, root->watcher);
+    root->watcher->data = root;
+    if (uv_fs_event_start(root->watcher, on_root_changed, root->root,
+                          UV_FS_EVENT_RECURSIVE) < 0) {
+      uv_close((uv_handle_t *)root->watcher, on_watcher_close);
+      root->watcher = NULL;
+    } else {
+      uv_unref((uv_handle_t *)root->watcher);
+    }
+  }
+
+  return root;
+}
+
+void static_root_free(StaticRoot *root) {
+  if (!root)
+    return;
+
+  if (root->watcher) {
+    root->watcher->data = NULL;
+    uv_close((uv_handle_t *)root->watcher, on_watcher_close);
+  }
+
+  clear_cache(root);
+  free(root->root);
+  free(root);
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool static_resolve_path(const StaticRoot *root, const char *url_path,
+                         size_t length, char *out, size_t out_size) {
+  size_t root_length = strlen(root->root);
+  if (root_length + 1 >= out_size)
+    return false;
+
+  memcpy(out, root->root, root_length);
+  size_t written = root_length;
+  out[written++] = '/';
+
+  size_t segment_start = written;
+  for (size_t i = 0; i < length; i++) {
+    char c = url_path[i];
+
+    if (c == '%') {
+      int high = i + 2 < length ? hex_digit(url_path[i + 1]) : -1;
+      int low = i + 2 < length ? hex_digit(url_path[i + 2]) : -1;
+      if (high < 0 || low < 0)
+        return false;
+      c = (char)(high * 16 + low);
+      i += 2;
+    }
+
+    if (c == '\0' || c == '\\')
+      return false;
+
+    if (c == '/') {
+      // "..", or "." and empty segments, never walk the tree
+      size_t segment_length = written - segment_start;
+      if (segment_length == 0)
+        continue;
+      if (segment_length == 2 && out[segment_start] == '.' &&
+          out[segment_start + 1] == '.')
+        return false;
+      if (segment_length == 1 && out[segment_start] == '.') {
+        written = segment_start;
+        continue;
+      }
+      if (written + 1 >= out_size)
+        return false;
+      out[written++] = '/';
+      segment_start = written;
+      continue;
+    }
+
+    if (written + 1 >= out_size)
+      return false;
+    out[written++] = c;
+  }
+
+  size_t segment_length = written - segment_start;
+  if (segment_length == 2 && out[segment_start] == '.' &&
+      out[segment_start + 1] == '.')
+    return false;
+  if (segment_length == 1 && out[segment_start] == '.')
+    written = segment_start;
+
+  // a directory path serves its index
+  if (written == segment_start) {
+    const char *index = "index.html";
+    size_t index_length = strlen(index);
+    if (written + index_length >= out_size)
+      return false;
+    memcpy(out + written, index, index_length);
+    written += index_length;
+  }
+
+  out[written] = '\0';
+  return true;
+}
+
+static size_t cache_slot(const char *path) {
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (const char *c = path; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 16777619u;
+  }
+  return hash % HTTP_STATIC_CACHE_SIZE;
+}
+
+const StaticStat *static_cache_get(StaticRoot *root, const char *path,
+                                   uint64_t now) {
+  StaticCacheEntry *entry = &root->cache[cache_slot(path)];
+  if (!entry->path || strcmp(entry->path, path) != 0 ||
+      now - entry->checked_at > HTTP_STATIC_STAT_TTL_MS)
+    return NULL;
+
+  return &entry->stat;
+}
+
+void static_cache_put(StaticRoot *root, const char *path,
+                      const uv_stat_t *stat, uint64_t now, StaticStat *out) {
+  out->size = stat->st_size;
+  out->is_directory = (stat->st_mode & S_IFMT) == S_IFDIR;
+
+  uint64_t mtime_ns =
+      (uint64_t)stat->st_mtim.tv_sec * 1000000000 + stat->st_mtim.tv_nsec;
+  snprintf(out->etag, sizeof(out->etag), "\"%" PRIx64 "-%" PRIx64 "\"",
+           out->size, mtime_ns);
+
+  time_t mtime = (time_t)stat->st_mtim.tv_sec;
+  struct tm tm;
+  gmtime_r(&mtime, &tm);
+  strftime(out->last_modified, sizeof(out->last_modified),
+           "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+  // a colliding path just takes the slot over
+  StaticCacheEntry *entry = &root->cache[cache_slot(path)];
+  if (!entry->path || strcmp(entry->path, path) != 0) {
+    free(entry->path);
+    entry->path = strdup(path);
+  }
+  entry->stat = *out;
+  entry->checked_at = now;
+}
+
+const char *static_mime_type(const char *path) {
+  const char *slash = strrchr(path, '/');
+  const char *dot = strrchr(path, '.');
+  if (dot && (!slash || dot > slash)) {
+    size_t count = sizeof(mime_types) / sizeof(mime_types[0]);
+    for (size_t i = 0; i < count; i++) {
+      if (strcasecmp(dot + 1, mime_types[i].extension) == 0)
+        return mime_types[i].type;
+    }
+  }
+
+  return "application/octet-stream";
+}
+
+// weak comparison, so W/"x" matches "x"
+static bool etag_list_matches(const char *list, size_t length,
+                              const char *etag) {
+  size_t etag_length = strlen(etag);
+  const char *cursor = list;
+  const char *end = list + length;
+
+  while (cursor < end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == ','))
+      cursor++;
+
+    const char *start = cursor;
+    while (cursor < end && *cursor != ',')
+      cursor++;
+
+    const char *last = cursor;
+    while (last > start && last[-1] == ' ')
+      last--;
+    if (last - start > 2 && start[0] == 'W' && start[1] == '/')
+      start += 2;
+
+    if ((last - start == 1 && *start == '*') ||
+        ((size_t)(last - start) == etag_length &&
+         memcmp(start, etag, etag_length) == 0))
+      return true;
+  }
+
+  return false;
+}
+
+bool static_is_not_modified(const StaticStat *stat, const char *if_none_match,
+                            size_t if_none_match_length,
+                            const char *if_modified_since,
+                            size_t if_modified_since_length) {
+  if (if_none_match)
+    return etag_list_matches(if_none_match, if_none_match_length, stat->etag);
+
+  // clients echo Last-Modified back, so an exact match is what we look for
+  return if_modified_since &&
+         strlen(stat->last_modified) == if_modified_since_length &&
+         memcmp(if_modified_since, stat->last_modified,
+                if_modified_since_length) == 0;
+}
+
+static bool parse_offset(const char **cursor, const char *end,
+                         uint64_t *value) {
+  const char *start = *cursor;
+  uint64_t result = 0;
+
+  while (*cursor < end && **cursor >= '0' && **cursor <= '9') {
+    if (result > (UINT64_MAX - 9) / 10)
+      return false;
+    result = result * 10 + (uint64_t)(**cursor - '0');
+    (*cursor)++;
+  }
+
+  *value = result;
+  return *cursor > start;
+}
+
+// one "bytes=" range; anything else, multiple ranges included, is ignored
+// and the whole file is sent, as RFC 9110 allows
+StaticRangeResult static_parse_range(const char *value, size_t length,
+                                     uint64_t size, uint64_t *start,
+                                     uint64_t *end) {
+  const char *prefix = "bytes=";
+  size_t prefix_length = strlen(prefix);
+  if (length <= prefix_length || strncasecmp(value, prefix, prefix_length) ||
+      memchr(value, ',', length))
+    return STATIC_RANGE_NONE;
+
+  const char *cursor = value + prefix_length;
+  const char *limit = value + length;
+  uint64_t first = 0;
+  uint64_t last = 0;
+
+  if (*cursor == '-') {
+    cursor++;
+    if (!parse_offset(&cursor, limit, &last) || cursor != limit)
+      return STATIC_RANGE_NONE;
+    if (last == 0 || size == 0)
+      return STATIC_RANGE_UNSATISFIABLE;
+    *start = last >= size ? 0 : size - last;
+    *end = size - 1;
+    return STATIC_RANGE_SATISFIABLE;
+  }
+
+  if (!parse_offset(&cursor, limit, &first) || cursor == limit ||
+      *cursor++ != '-')
+    return STATIC_RANGE_NONE;
+
+  if (cursor == limit) {
+    last = size - 1;
+  } else if (!parse_offset(&cursor, limit, &last) || cursor != limit ||
+             last < first) {
+    return STATIC_RANGE_NONE;
+  }
+
+  if (first >= size)
+    return STATIC_RANGE_UNSATISFIABLE;
+
+  *start = first;
+  *end = last >= size ? size - 1 : last;
+  return STATIC_RANGE_SATISFIABLE;
+}
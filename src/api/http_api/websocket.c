@@ -0,0 +1,267 @@
+#include "api/http_api/websocket.h"
+
+#include "api/crypto_api/hash.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#define HAS_SSE2_UNMASK 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define HAS_NEON_UNMASK 1
+#endif
+
+int websocket_parse_header(const char *data, size_t length,
+                           WebSocketFrame *frame) {
+  if (length < 2) {
+    return 0;
+  }
+
+  const uint8_t *bytes = (const uint8_t *)data;
+  frame->fin = bytes[0] & 0x80;
+  frame->opcode = bytes[0] & 0x0f;
+  frame->masked = bytes[1] & 0x80;
+
+  // no extensions are negotiated, so the RSV bits stay clear
+  if (bytes[0] & 0x70) {
+    return -1;
+  }
+
+  bool control = frame->opcode & 0x08;
+  if ((frame->opcode > WEBSOCKET_BINARY && !control) ||
+      frame->opcode > WEBSOCKET_PONG) {
+    return -1;
+  }
+
+  size_t header_length = 2;
+  uint64_t payload_length = bytes[1] & 0x7f;
+  if (payload_length == 126) {
+    header_length += 2;
+  } else if (payload_length == 127) {
+    header_length += 8;
+  }
+  if (frame->masked) {
+    header_length += 4;
+  }
+  if (length < header_length) {
+    return 0;
+  }
+
+  size_t position = 2;
+  if (payload_length >= 126) {
+    size_t size_bytes = payload_length == 126 ? 2 : 8;
+    payload_length = 0;
+    for (size_t i = 0; i < size_bytes; i++) {
+      payload_length = payload_length << 8 | bytes[position++];
+    }
+    if (payload_length >> 63) {
+      return -1;
+    }
+  }
+
+  if (control &&
+      (!frame->fin || payload_length > WEBSOCKET_MAX_CONTROL_PAYLOAD)) {
+    return -1;
+  }
+
+  if (frame->masked) {
+    memcpy(frame->mask, bytes + position, 4);
+  }
+  frame->payload_length = payload_length;
+  return (int)header_length;
+}
+
+size_t websocket_frame_header(uint8_t *out, int opcode, uint64_t length) {
+  out[0] = 0x80 | (uint8_t)opcode;
+
+  if (length < 126) {
+    out[1] = (uint8_t)length;
+    return 2;
+  }
+
+  if (length <= 0xffff) {
+    out[1] = 126;
+    out[2] = (uint8_t)(length >> 8);
+    out[3] = (uint8_t)length;
+    return 4;
+  }
+
+  out[1] = 127;
+  for (int i = 0; i < 8; i++) {
+    out[2 + i] = (uint8_t)(length >> (56 - 8 * i));
+  }
+  return 10;
+}
+
+void websocket_unmask(char *dest, const char *src, size_t length,
+                      const uint8_t mask[4], uint64_t offset) {
+  // the mask repeated and rotated so its first byte lines up with `src`
+  uint8_t key[16];
+  for (int i = 0; i < 16; i++) {
+    key[i] = mask[(offset + i) & 3];
+  }
+
+  size_t i = 0;
+#if defined(HAS_SSE2_UNMASK)
+  __m128i key_vector = _mm_loadu_si128((const __m128i *)key);
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(block, key_vector));
+  }
+#elif defined(HAS_NEON_UNMASK)
+  uint8x16_t key_vector = vld1q_u8(key);
+  for (; i + 16 <= length; i += 16) {
+    uint8x16_t block = vld1q_u8((const uint8_t *)src + i);
+    vst1q_u8((uint8_t *)dest + i, veorq_u8(block, key_vector));
+  }
+#endif
+
+  // `i` is a multiple of 16 here, so the key still lines up
+  uint64_t key_word;
+  memcpy(&key_word, key, sizeof(key_word));
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, src + i, sizeof(word));
+    word ^= key_word;
+    memcpy(dest + i, &word, sizeof(word));
+  }
+
+  for (; i < length; i++) {
+    dest[i] = (char)(src[i] ^ key[i & 3]);
+  }
+}
+
+bool websocket_valid_utf8(const char *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t i = 0;
+
+  while (i < length) {
+    // ASCII runs are checked a word at a time
+    if (i + 8 <= length) {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      if ((word & 0x8080808080808080ull) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+
+    uint8_t lead = bytes[i];
+    if (lead < 0x80) {
+      i++;
+      continue;
+    }
+
+    size_t count;
+    uint32_t min;
+    uint32_t code;
+    if ((lead & 0xe0) == 0xc0) {
+      count = 1;
+      min = 0x80;
+      code = lead & 0x1f;
+    } else if ((lead & 0xf0) == 0xe0) {
+      count = 2;
+      min = 0x800;
+      code = lead & 0x0f;
+    } else if ((lead & 0xf8) == 0xf0) {
+      count = 3;
+      min = 0x10000;
+      code = lead & 0x07;
+    } else {
+      return false;
+    }
+
+    if (i + count >= length) {
+      return false;
+    }
+    for (size_t j = 1; j <= count; j++) {
+      if ((bytes[i + j] & 0xc0) != 0x80) {
+        return false;
+      }
+      code = code << 6 | (bytes[i + j] & 0x3f);
+    }
+
+    // overlong forms, surrogates and past U+10FFFF
+    if (code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) {
+      return false;
+    }
+    i += count + 1;
+  }
+
+  return true;
+}
+
+size_t websocket_utf8_to_utf16(uint16_t *dest, const char *data,
+                               size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t units = 0;
+  size_t i = 0;
+
+  while (i < length) {
+    uint8_t lead = bytes[i];
+    if (lead < 0x80) {
+      dest[units++] = lead;
+      i++;
+      continue;
+    }
+
+    size_t count = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : 1;
+    uint32_t code = lead & (0x3f >> count);
+    for (size_t j = 1; j <= count; j++) {
+      code = code << 6 | (bytes[i + j] & 0x3f);
+    }
+    i += count + 1;
+
+    if (code >= 0x10000) {
+      code -= 0x10000;
+      dest[units++] = (uint16_t)(0xd800 | code >> 10);
+      dest[units++] = (uint16_t)(0xdc00 | (code & 0x3ff));
+    } else {
+      dest[units++] = (uint16_t)code;
+    }
+  }
+
+  return units;
+}
+
+static void base64_encode(const uint8_t *data, size_t length, char *out) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    uint32_t group = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 |
+                     data[i + 2];
+    *out++ = alphabet[group >> 18];
+    *out++ = alphabet[(group >> 12) & 0x3f];
+    *out++ = alphabet[(group >> 6) & 0x3f];
+    *out++ = alphabet[group & 0x3f];
+  }
+
+  if (i < length) {
+    uint32_t group = (uint32_t)data[i] << 16;
+    if (i + 1 < length) {
+      group |= (uint32_t)data[i + 1] << 8;
+    }
+    *out++ = alphabet[group >> 18];
+    *out++ = alphabet[(group >> 12) & 0x3f];
+    *out++ = i + 1 < length ? alphabet[(group >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+  *out = '\0';
+}
+
+void websocket_accept_key(const char *key, size_t key_length,
+                          char out[WEBSOCKET_ACCEPT_KEY_SIZE]) {
+  static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+  Sha1Context sha1;
+  uint8_t digest[20];
+  sha1_init(&sha1);
+  sha1_update(&sha1, (const uint8_t *)key, key_length);
+  sha1_update(&sha1, (const uint8_t *)guid, sizeof(guid) - 1);
+  sha1_final(&sha1, digest);
+
+  base64_encode(digest, sizeof(digest), out);
+}
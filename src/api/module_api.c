@@ -1,6 +1,7 @@
 #include "api/module_api.h"
 #include "api/fs_api.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
 #include "hashtable.h"
 
 #include <JavaScriptCore/JavaScript.h>
@@ -9,8 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-static HashTable module_cache;
-static char *current_module_dir = NULL; // dir of currently executing script
+static THREAD_LOCAL HashTable module_cache;
+static THREAD_LOCAL char *current_module_dir = NULL; // dir of currently executing script
 
 void init_module_cache(void) { hashtable_init(&module_cache); }
 
@@ -1,31 +1,228 @@
 #include "api/net_api.h"
+#include "api/http_api.h"
+#include "api/streams_api.h"
 #include "constants.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
+#include "core/socket_options.h"
+#include "core/timer_wheel.h"
 
 #include <JavaScriptCore/JavaScript.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <uv.h>
 
-static JSClassRef server_class = NULL;
-static JSClassRef client_class = NULL;
+static THREAD_LOCAL JSClassRef server_class = NULL;
+static THREAD_LOCAL JSClassRef client_class = NULL;
+
+// reads land here and are copied out only for a 'data' handler
+static THREAD_LOCAL char read_buffer[NET_READ_BUFFER_SIZE];
 
 typedef struct {
   uv_tcp_t socket;
   JSContextRef ctx;
   JSObjectRef callback;
+  SocketOptions socket_options; // from listen(), applied to each client
 } TcpServerState;
 
 typedef struct {
-  uv_tcp_t *socket;
+  uv_tcp_t *socket; // NULL once the connection has closed
+  JSContextRef ctx;
+  JSObjectRef object;
+  JSObjectRef data_handler;
+  JSObjectRef close_handler;
+  bool binary; // chunks as Uint8Arrays rather than strings
+  // the start of a UTF-8 character split across two reads
+  char partial[3];
+  size_t partial_length;
 } TcpClientState;
 
+// the socket side, closed on EOF, an error or NET_IDLE_TIMEOUT_MS without
+// reads or writes. The JS client object may be collected before it closes
+typedef struct {
+  uv_tcp_t socket;
+  WheelTimer timeout;
+  TcpClientState *client_state; // NULL once the JS object is gone
+} TcpConnection;
+
+static void on_connection_close(uv_handle_t *handle) { free(handle->data); }
+
+static void emit_client_event(TcpClientState *client_state, JSObjectRef handler,
+                              size_t argc, const JSValueRef args[]) {
+  if (!handler) {
+    return;
+  }
+
+  JSValueRef exception = NULL;
+  JSObjectCallAsFunction(client_state->ctx, handler, client_state->object,
+                         argc, args, &exception);
+  if (exception) {
+    JSStringRef err_str =
+        JSValueToStringCopy(client_state->ctx, exception, NULL);
+    char err_buffer[ERROR_MSG_BUFFER_SIZE];
+    JSStringGetUTF8CString(err_str, err_buffer, sizeof(err_buffer));
+    fprintf(stderr, "Socket event handler error: %s\n", err_buffer);
+    JSStringRelease(err_str);
+  }
+}
+
+// an open socket with handlers is kept alive for them; they're let go once
+// it closes, as they usually close over the socket
+static void release_client_handlers(TcpClientState *client_state) {
+  if (client_state->data_handler || client_state->close_handler) {
+    JSValueUnprotect(client_state->ctx, client_state->object);
+  }
+  if (client_state->data_handler) {
+    JSValueUnprotect(client_state->ctx, client_state->data_handler);
+    client_state->data_handler = NULL;
+  }
+  if (client_state->close_handler) {
+    JSValueUnprotect(client_state->ctx, client_state->close_handler);
+    client_state->close_handler = NULL;
+  }
+}
+
+static void close_connection(TcpConnection *connection) {
+  if (uv_is_closing((uv_handle_t *)&connection->socket)) {
+    return;
+  }
+
+  wheel_timer_stop(&connection->timeout);
+  uv_close((uv_handle_t *)&connection->socket, on_connection_close);
+
+  TcpClientState *client_state = connection->client_state;
+  if (client_state) {
+    client_state->socket = NULL;
+    connection->client_state = NULL;
+    emit_client_event(client_state, client_state->close_handler, 0, NULL);
+    release_client_handlers(client_state);
+  }
+}
+
+static void on_idle_timeout(WheelTimer *timer) {
+  close_connection(
+      (TcpConnection *)((char *)timer - offsetof(TcpConnection, timeout)));
+}
+
+static void touch_connection(TcpConnection *connection) {
+  wheel_timer_start(&connection->timeout, NET_IDLE_TIMEOUT_MS,
+                    on_idle_timeout);
+}
+
+static void alloc_read_buffer(uv_handle_t *handle, size_t suggested_size,
+                              uv_buf_t *buf) {
+  *buf = uv_buf_init(read_buffer, sizeof(read_buffer));
+}
+
+static void on_connection_read(uv_stream_t *stream, ssize_t bytes_read,
+                               const uv_buf_t *buf) {
+  TcpConnection *connection = stream->data;
+  if (bytes_read < 0) {
+    close_connection(connection);
+    return;
+  }
+  if (bytes_read == 0) {
+    return;
+  }
+
+  touch_connection(connection);
+
+  TcpClientState *client_state = connection->client_state;
+  if (!client_state || !client_state->data_handler) {
+    return;
+  }
+
+  JSValueRef chunk;
+  if (client_state->binary) {
+    char *data = malloc(bytes_read);
+    if (!data) {
+      close_connection(connection);
+      return;
+    }
+    memcpy(data, buf->base, bytes_read);
+    chunk = make_byte_array(client_state->ctx, data, bytes_read);
+  } else {
+    // a character cut off by the read is finished by the next one
+    size_t carried = client_state->partial_length;
+    size_t length = carried + bytes_read;
+    char *data = malloc(length);
+    if (!data) {
+      close_connection(connection);
+      return;
+    }
+    memcpy(data, client_state->partial, carried);
+    memcpy(data + carried, buf->base, bytes_read);
+
+    size_t tail = incomplete_utf8_tail(data, length);
+    length -= tail;
+    memcpy(client_state->partial, data + length, tail);
+    client_state->partial_length = tail;
+
+    chunk = length > 0 ? make_utf8_string(client_state->ctx, data, length)
+                       : NULL;
+    free(data);
+    if (!chunk) {
+      return;
+    }
+  }
+  JSValueRef args[] = {chunk};
+  emit_client_event(client_state, client_state->data_handler, 1, args);
+}
+
 static void on_client_write(uv_write_t *write_req, int status) {
   free(write_req->data);
   free(write_req);
 }
 
+// a broadcast's remainder that the socket couldn't take straight away
+typedef struct {
+  uv_write_t req;
+  SharedBuffer *buffer;
+} SharedWrite;
+
+static void on_shared_write(uv_write_t *write_req, int status) {
+  SharedWrite *write = (SharedWrite *)write_req;
+  shared_buffer_release(write->buffer);
+  free(write);
+}
+
+// tries the socket first, so most subscribers need no write request at all,
+// and queues what's left holding a reference on the buffer
+static bool write_shared(uv_stream_t *stream, SharedBuffer *buffer) {
+  if (buffer->length == 0) {
+    return true;
+  }
+
+  uv_buf_t buf = uv_buf_init(buffer->data, buffer->length);
+  int written = uv_try_write(stream, &buf, 1);
+  if (written < 0 && written != UV_EAGAIN) {
+    return false;
+  }
+  if (written == (int)buffer->length) {
+    return true;
+  }
+
+  SharedWrite *write = malloc(sizeof(SharedWrite));
+  if (!write) {
+    return false;
+  }
+
+  size_t skip = written > 0 ? (size_t)written : 0;
+  buf.base += skip;
+  buf.len -= skip;
+  shared_buffer_retain(buffer);
+  write->buffer = buffer;
+  if (uv_write(&write->req, stream, &buf, 1, on_shared_write) < 0) {
+    shared_buffer_release(buffer);
+    free(write);
+    return false;
+  }
+  return true;
+}
+
 static void tcp_server_finalize(JSObjectRef object) {
   TcpServerState *state = (TcpServerState *)JSObjectGetPrivate(object);
   if (state) {
@@ -34,6 +231,119 @@ static void tcp_server_finalize(JSObjectRef object) {
   }
 }
 
+static void tcp_client_finalize(JSObjectRef object) {
+  TcpClientState *state = (TcpClientState *)JSObjectGetPrivate(object);
+  if (state) {
+    if (state->socket) {
+      ((TcpConnection *)state->socket->data)->client_state = NULL;
+    }
+    free(state); // handlers keep the object alive, so there are none left
+  }
+}
+
+static JSValueRef client_on(JSContextRef ctx, JSObjectRef js_fn,
+                            JSObjectRef this_obj, size_t argc,
+                            const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "socket.on", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef handler;
+  if (!to_callback(ctx, args[1], &handler, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (!client_state) {
+    set_js_error(ctx, ERR_INVALID_CLIENT_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *event_name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef *slot = NULL;
+  if (strcmp(event_name, "data") == 0) {
+    slot = &client_state->data_handler;
+  } else if (strcmp(event_name, "close") == 0) {
+    slot = &client_state->close_handler;
+  }
+  free(event_name);
+
+  // a closed socket won't emit anything again
+  if (slot && client_state->socket) {
+    if (!client_state->data_handler && !client_state->close_handler) {
+      JSValueProtect(ctx, this_obj);
+    }
+    if (*slot) {
+      JSValueUnprotect(ctx, *slot);
+    }
+    *slot = handler;
+    JSValueProtect(ctx, handler);
+  }
+
+  return this_obj;
+}
+
+static JSValueRef client_end(JSContextRef ctx, JSObjectRef js_fn,
+                             JSObjectRef this_obj, size_t argc,
+                             const JSValueRef args[], JSValueRef *js_err_str) {
+  TcpClientState *client_state = JSObjectGetPrivate(this_obj);
+  if (client_state && client_state->socket) {
+    close_connection(client_state->socket->data);
+  }
+  return JSValueMakeUndefined(ctx);
+}
+
+// the JS side of an accepted or connected socket
+static JSObjectRef make_client_object(JSContextRef ctx,
+                                      TcpConnection *connection, bool binary) {
+  TcpClientState *client_state = calloc(1, sizeof(TcpClientState));
+  if (!client_state) {
+    return NULL;
+  }
+
+  if (client_class == NULL) {
+    JSClassDefinition class_def = kJSClassDefinitionEmpty;
+    class_def.finalize = tcp_client_finalize;
+    client_class = JSClassCreate(&class_def);
+  }
+
+  JSObjectRef client_obj = JSObjectMake(ctx, client_class, client_state);
+  client_state->socket = &connection->socket;
+  client_state->ctx = ctx;
+  client_state->object = client_obj;
+  client_state->binary = binary;
+  connection->client_state = client_state;
+
+  static const struct {
+    const char *name;
+    JSObjectCallAsFunctionCallback callback;
+  } client_fns[] = {
+      {"write", client_write}, {"on", client_on}, {"end", client_end}};
+
+  const size_t fn_count = sizeof(client_fns) / sizeof(client_fns[0]);
+  for (size_t i = 0; i < fn_count; i++) {
+    JSStringRef fn_name = JSStringCreateWithUTF8CString(client_fns[i].name);
+    JSObjectRef fn =
+        JSObjectMakeFunctionWithCallback(ctx, fn_name, client_fns[i].callback);
+    JSObjectSetProperty(ctx, client_obj, fn_name, fn, kJSPropertyAttributeNone,
+                        NULL);
+    JSStringRelease(fn_name);
+  }
+
+  JSStringRef id_key = JSStringCreateWithUTF8CString("id");
+  JSValueRef id_value =
+      JSValueMakeNumber(ctx, (double)(uintptr_t)&connection->socket);
+  JSObjectSetProperty(ctx, client_obj, id_key, id_value,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(id_key);
+
+  return client_obj;
+}
+
 static void on_new_tcp_connection(uv_stream_t *server_socket, int uv_status) {
   if (uv_status < 0) {
     return;
@@ -44,52 +354,35 @@ static void on_new_tcp_connection(uv_stream_t *server_socket, int uv_status) {
     return;
   }
 
-  uv_tcp_t *client_socket = malloc(sizeof(uv_tcp_t));
-  if (!client_socket) {
+  TcpConnection *connection = calloc(1, sizeof(TcpConnection));
+  if (!connection) {
     fprintf(stderr, "Failed to allocate memory for client socket\n");
     return;
   }
 
-  uv_tcp_init(uv_default_loop(), client_socket);
+  uv_tcp_t *client_socket = &connection->socket;
+  uv_tcp_init(loop, client_socket);
+  client_socket->data = connection;
 
   if (uv_accept(server_socket, (uv_stream_t *)client_socket) != 0) {
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_socket);
+    uv_close((uv_handle_t *)client_socket, on_connection_close);
     return;
   }
 
-  TcpClientState *client_state = malloc(sizeof(TcpClientState));
-  if (!client_state) {
-    uv_close((uv_handle_t *)client_socket, NULL);
-    free(client_socket);
+  JSObjectRef client_obj =
+      make_client_object(server_state->ctx, connection, false);
+  if (!client_obj) {
+    uv_close((uv_handle_t *)client_socket, on_connection_close);
     return;
   }
 
-  client_state->socket = client_socket;
-
-  if (client_class == NULL) {
-    JSClassDefinition class_def = kJSClassDefinitionEmpty;
-    class_def.finalize = tcp_server_finalize;
-    client_class = JSClassCreate(&class_def);
+  apply_socket_options(client_socket, &server_state->socket_options);
+  touch_connection(connection);
+  if (uv_read_start((uv_stream_t *)client_socket, alloc_read_buffer,
+                    on_connection_read) < 0) {
+    close_connection(connection);
   }
 
-  JSObjectRef client_obj =
-      JSObjectMake(server_state->ctx, client_class, client_state);
-
-  JSStringRef write_name = JSStringCreateWithUTF8CString("write");
-  JSObjectRef write_fn = JSObjectMakeFunctionWithCallback(
-      server_state->ctx, write_name, client_write);
-  JSObjectSetProperty(server_state->ctx, client_obj, write_name, write_fn,
-                      kJSPropertyAttributeNone, NULL);
-  JSStringRelease(write_name);
-
-  JSStringRef id_key = JSStringCreateWithUTF8CString("id");
-  JSValueRef id_value =
-      JSValueMakeNumber(server_state->ctx, (double)(uintptr_t)client_socket);
-  JSObjectSetProperty(server_state->ctx, client_obj, id_key, id_value,
-                      kJSPropertyAttributeNone, NULL);
-  JSStringRelease(id_key);
-
   JSValueRef args[] = {client_obj};
   JSObjectCallAsFunction(server_state->ctx, server_state->callback, NULL, 1,
                          args, NULL);
@@ -112,8 +405,9 @@ JSValueRef net_create_server(JSContextRef ctx, JSObjectRef js_fn,
   server_state->ctx = ctx;
   server_state->callback = (JSObjectRef)args[0];
   JSValueProtect(ctx, server_state->callback);
+  init_socket_options(&server_state->socket_options);
 
-  uv_tcp_init(uv_default_loop(), &server_state->socket);
+  uv_tcp_init(loop, &server_state->socket);
   server_state->socket.data = server_state; // back pointer for later access
 
   if (server_class == NULL) {
@@ -136,7 +430,7 @@ JSValueRef net_create_server(JSContextRef ctx, JSObjectRef js_fn,
 JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef js_fn,
                              JSObjectRef this_obj, size_t argc,
                              const JSValueRef args[], JSValueRef *js_err_str) {
-  if (argc != 2 || !JSValueIsNumber(ctx, args[0]) ||
+  if (argc < 2 || argc > 3 || !JSValueIsNumber(ctx, args[0]) ||
       !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
     set_js_error(ctx, "Port and callback required", js_err_str);
     return JSValueMakeUndefined(ctx);
@@ -153,6 +447,12 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
+  // listen(port, callback[, socketOptions])
+  if (!get_socket_options(ctx, argc > 2 ? args[2] : JSValueMakeUndefined(ctx),
+                          &server_state->socket_options, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
   struct sockaddr_in addr;
   uv_ip4_addr("0.0.0.0", port, &addr);
 
@@ -163,6 +463,14 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
+  int options_result =
+      apply_listen_options(&server_state->socket, &server_state->socket_options);
+  if (options_result < 0) {
+    fprintf(stderr, "Server socket option error: %s\n",
+            uv_strerror(options_result));
+    return JSValueMakeUndefined(ctx);
+  }
+
   int uv_listen_result = uv_listen((uv_stream_t *)&server_state->socket,
                                    TCP_LISTEN_BACKLOG, on_new_tcp_connection);
   if (uv_listen_result < 0) {
@@ -175,8 +483,7 @@ JSValueRef net_server_listen(JSContextRef ctx, JSObjectRef js_fn,
 JSValueRef client_write(JSContextRef ctx, JSObjectRef js_fn,
                         JSObjectRef this_obj, size_t argc,
                         const JSValueRef args[], JSValueRef *js_err_str) {
-  if (argc != 1 || !JSValueIsString(ctx, args[0])) {
-    set_js_error(ctx, "String arg required", js_err_str);
+  if (!is_valid_argc(ctx, argc, 1, "socket.write", js_err_str)) {
     return JSValueMakeUndefined(ctx);
   }
 
@@ -186,36 +493,307 @@ JSValueRef client_write(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
-  JSStringRef js_data_to_write = JSValueToStringCopy(ctx, args[0], js_err_str);
-  if (!js_data_to_write || *js_err_str) {
+  // a string is sent as UTF-8, a Uint8Array as is
+  size_t length;
+  char *data = to_bytes(ctx, args[0], &length, js_err_str);
+  if (*js_err_str) {
     return JSValueMakeUndefined(ctx);
   }
 
-  size_t js_data_to_write_len =
-      JSStringGetMaximumUTF8CStringSize(js_data_to_write);
-  char *c_data_to_write = (char *)malloc(js_data_to_write_len);
-  if (!c_data_to_write) {
-    JSStringRelease(js_data_to_write);
+  uv_write_t *write_req = (uv_write_t *)malloc(sizeof(uv_write_t));
+  if (!write_req) {
+    free(data);
     set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
-  JSStringGetUTF8CString(js_data_to_write, c_data_to_write,
-                         js_data_to_write_len);
-  JSStringRelease(js_data_to_write);
+  uv_buf_t buffer = uv_buf_init(data, length);
+  write_req->data = data; // for cleanup tracking
 
-  uv_write_t *write_req = (uv_write_t *)malloc(sizeof(uv_write_t));
-  if (!write_req) {
-    free(c_data_to_write);
-    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+  if (uv_write(write_req, (uv_stream_t *)client_state->socket, &buffer, 1,
+               on_client_write) < 0) {
+    free(data);
+    free(write_req);
+    close_connection(client_state->socket->data);
+    return JSValueMakeUndefined(ctx);
+  }
+  touch_connection(client_state->socket->data);
+
+  return JSValueMakeUndefined(ctx);
+}
+
+typedef struct {
+  uv_getaddrinfo_t resolver;
+  uv_connect_t connect_req;
+  TcpConnection *connection;
+  JSContextRef ctx;
+  JSObjectRef callback;
+  bool binary;
+} ConnectState;
+
+static void finish_connect(ConnectState *state, const char *err_msg,
+                           JSValueRef socket) {
+  JSContextRef ctx = state->ctx;
+  JSValueRef args[2];
+  if (err_msg) {
+    JSStringRef err_str = JSStringCreateWithUTF8CString(err_msg);
+    args[0] = JSValueMakeString(ctx, err_str);
+    args[1] = JSValueMakeNull(ctx);
+    JSStringRelease(err_str);
+  } else {
+    args[0] = JSValueMakeNull(ctx);
+    args[1] = socket;
+  }
+
+  JSObjectRef callback = state->callback;
+  free(state);
+  JSObjectCallAsFunction(ctx, callback, NULL, 2, args, NULL);
+  JSValueUnprotect(ctx, callback);
+}
+
+static void on_net_connect(uv_connect_t *req, int uv_status) {
+  ConnectState *state = req->data;
+  TcpConnection *connection = state->connection;
+
+  if (uv_status < 0) {
+    uv_close((uv_handle_t *)&connection->socket, on_connection_close);
+    finish_connect(state, uv_strerror(uv_status), NULL);
+    return;
+  }
+
+  JSObjectRef client_obj =
+      make_client_object(state->ctx, connection, state->binary);
+  if (!client_obj) {
+    uv_close((uv_handle_t *)&connection->socket, on_connection_close);
+    finish_connect(state, ERR_MEMORY_ALLOCATION, NULL);
+    return;
+  }
+
+  touch_connection(connection);
+  if (uv_read_start((uv_stream_t *)&connection->socket, alloc_read_buffer,
+                    on_connection_read) < 0) {
+    close_connection(connection);
+  }
+  finish_connect(state, NULL, client_obj);
+}
+
+static void on_net_resolved(uv_getaddrinfo_t *resolver, int uv_status,
+                            struct addrinfo *res) {
+  ConnectState *state = resolver->data;
+
+  if (uv_status < 0) {
+    uv_freeaddrinfo(res);
+    finish_connect(state, uv_strerror(uv_status), NULL);
+    return;
+  }
+
+  TcpConnection *connection = calloc(1, sizeof(TcpConnection));
+  if (!connection) {
+    uv_freeaddrinfo(res);
+    finish_connect(state, ERR_MEMORY_ALLOCATION, NULL);
+    return;
+  }
+
+  uv_tcp_init(loop, &connection->socket);
+  connection->socket.data = connection;
+  state->connection = connection;
+  state->connect_req.data = state;
+
+  int connect_result = uv_tcp_connect(&state->connect_req, &connection->socket,
+                                      res->ai_addr, on_net_connect);
+  uv_freeaddrinfo(res);
+  if (connect_result < 0) {
+    uv_close((uv_handle_t *)&connection->socket, on_connection_close);
+    finish_connect(state, uv_strerror(connect_result), NULL);
+  }
+}
+
+// net.connect(port[, { host, encoding }], callback) calls back with
+// (err, socket). Chunks are strings unless encoding is "buffer"
+JSValueRef net_connect(JSContextRef ctx, JSObjectRef js_fn,
+                       JSObjectRef this_obj, size_t argc,
+                       const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "net.connect", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef callback;
+  if (!to_callback(ctx, args[argc - 1], &callback, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  double port = JSValueToNumber(ctx, args[0], NULL);
+  if (!(port >= 1 && port <= 65535)) {
+    set_js_error(ctx, "Invalid port", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSValueRef options = argc > 2 ? args[1] : NULL;
+  bool binary;
+  if (!to_stream_encoding(ctx, options, false, &binary, js_err_str)) {
     return JSValueMakeUndefined(ctx);
   }
 
-  uv_buf_t buffer = uv_buf_init(c_data_to_write, strlen(c_data_to_write));
-  write_req->data = c_data_to_write; // for cleanup tracking
+  char *host = get_string_option(ctx, options, "host");
+  char port_str[8];
+  snprintf(port_str, sizeof(port_str), "%d", (int)port);
+
+  ConnectState *state = calloc(1, sizeof(ConnectState));
+  if (!state) {
+    free(host);
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
 
-  uv_write(write_req, (uv_stream_t *)client_state->socket, &buffer, 1,
-           on_client_write);
+  state->ctx = ctx;
+  state->callback = callback;
+  state->binary = binary;
+  state->resolver.data = state;
+  JSValueProtect(ctx, callback);
+
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  int resolve_result =
+      uv_getaddrinfo(loop, &state->resolver, on_net_resolved,
+                     host ? host : "localhost", port_str, &hints);
+  free(host);
+  if (resolve_result < 0) {
+    JSValueUnprotect(ctx, callback);
+    free(state);
+    set_js_error(ctx, uv_strerror(resolve_result), js_err_str);
+  }
 
   return JSValueMakeUndefined(ctx);
 }
+
+static BroadcastResult broadcast_to_socket(JSContextRef ctx, JSValueRef value,
+                                           Broadcast *broadcast) {
+  if (!client_class || !JSValueIsObjectOfClass(ctx, value, client_class)) {
+    return BROADCAST_UNKNOWN;
+  }
+
+  TcpClientState *client_state = JSObjectGetPrivate((JSObjectRef)value);
+  if (!client_state || !client_state->socket) {
+    return BROADCAST_CLOSED;
+  }
+
+  TcpConnection *connection = client_state->socket->data;
+  uv_stream_t *stream = (uv_stream_t *)client_state->socket;
+  if (stream->write_queue_size >= broadcast->high_watermark) {
+    if (broadcast->drop_slow) {
+      close_connection(connection);
+      return BROADCAST_DROPPED;
+    }
+    return BROADCAST_SKIPPED;
+  }
+
+  if (!write_shared(stream, broadcast->raw)) {
+    close_connection(connection);
+    return BROADCAST_CLOSED;
+  }
+
+  touch_connection(connection);
+  return BROADCAST_SENT;
+}
+
+// net.broadcast(subscribers, data[, { highWaterMark, slow }]) sends one
+// string or byte payload to every net socket, WebSocket and streaming
+// response (SSE) in `subscribers`. Those with highWaterMark bytes already
+// queued are skipped, or closed with slow: "drop". Returns how many were
+// { sent, skipped, dropped, closed }
+JSValueRef net_broadcast(JSContextRef ctx, JSObjectRef js_fn,
+                         JSObjectRef this_obj, size_t argc,
+                         const JSValueRef args[], JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "net.broadcast", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!JSValueIsObject(ctx, args[0])) {
+    set_js_error(ctx, "Subscribers must be an array", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  JSObjectRef subscribers = (JSObjectRef)args[0];
+
+  JSValueRef options = argc > 2 ? args[2] : NULL;
+  double high_watermark = NET_BROADCAST_HIGH_WATERMARK;
+  get_number_option(ctx, options, "highWaterMark", &high_watermark);
+  if (!(high_watermark >= 1)) {
+    set_js_error(ctx, "Invalid broadcast options", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  bool drop_slow = false;
+  char *slow = get_string_option(ctx, options, "slow");
+  if (slow) {
+    drop_slow = strcmp(slow, "drop") == 0;
+    bool known = drop_slow || strcmp(slow, "skip") == 0;
+    free(slow);
+    if (!known) {
+      set_js_error(ctx, "slow must be \"skip\" or \"drop\"", js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  size_t length;
+  char *data = to_bytes(ctx, args[1], &length, js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  SharedBuffer *raw = shared_buffer_create(data, length);
+  if (!raw) {
+    free(data);
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  Broadcast broadcast = {
+      .raw = raw,
+      .binary = JSValueGetTypedArrayType(ctx, args[1], NULL) !=
+                kJSTypedArrayTypeNone,
+      .high_watermark = high_watermark < (double)SIZE_MAX
+                            ? (size_t)high_watermark
+                            : SIZE_MAX, // Infinity for no limit
+      .drop_slow = drop_slow,
+  };
+
+  JSStringRef length_name = JSStringCreateWithUTF8CString("length");
+  double count = JSValueToNumber(
+      ctx, JSObjectGetProperty(ctx, subscribers, length_name, NULL), NULL);
+  JSStringRelease(length_name);
+
+  double totals[BROADCAST_UNKNOWN] = {0};
+  for (unsigned i = 0; i < count; i++) {
+    JSValueRef subscriber =
+        JSObjectGetPropertyAtIndex(ctx, subscribers, i, NULL);
+
+    BroadcastResult result = broadcast_to_socket(ctx, subscriber, &broadcast);
+    if (result == BROADCAST_UNKNOWN) {
+      result = http_broadcast_to(ctx, subscriber, &broadcast);
+    }
+    // stale entries in a subscriber list are counted as closed
+    if (result == BROADCAST_UNKNOWN) {
+      result = BROADCAST_CLOSED;
+    }
+    totals[result]++;
+  }
+
+  // the writes still queued hold their own references
+  shared_buffer_release(broadcast.raw);
+  if (broadcast.websocket_frame) {
+    shared_buffer_release(broadcast.websocket_frame);
+  }
+  if (broadcast.http_chunk) {
+    shared_buffer_release(broadcast.http_chunk);
+  }
+
+  static const char *names[BROADCAST_UNKNOWN] = {"sent", "skipped", "dropped",
+                                                 "closed"};
+  JSObjectRef summary = JSObjectMake(ctx, NULL, NULL);
+  for (int i = 0; i < BROADCAST_UNKNOWN; i++) {
+    JSStringRef name = JSStringCreateWithUTF8CString(names[i]);
+    JSObjectSetProperty(ctx, summary, name, JSValueMakeNumber(ctx, totals[i]),
+                        kJSPropertyAttributeNone, NULL);
+    JSStringRelease(name);
+  }
+  return summary;
+}
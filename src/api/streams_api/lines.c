@@ -0,0 +1,102 @@
+#include "api/streams_api/lines.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void emit_line(char *line, size_t length, line_handler handler,
+                      void *user_data) {
+  if (length > 0 && line[length - 1] == '\r') {
+    length--;
+  }
+  line[length] = '\0';
+  handler(line, length, user_data);
+}
+
+static bool append_partial(LineSplitter *splitter, const char *data,
+                           size_t length) {
+  size_t needed = splitter->partial_length + length + 1;
+  if (needed > splitter->partial_capacity) {
+    size_t capacity = splitter->partial_capacity ? splitter->partial_capacity : 64;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+
+    char *grown = realloc(splitter->partial, capacity);
+    if (!grown) {
+      return false;
+    }
+    splitter->partial = grown;
+    splitter->partial_capacity = capacity;
+  }
+
+  memcpy(splitter->partial + splitter->partial_length, data, length);
+  splitter->partial_length += length;
+  return true;
+}
+
+void line_splitter_init(LineSplitter *splitter, size_t max_line_length) {
+  splitter->partial = NULL;
+  splitter->partial_length = 0;
+  splitter->partial_capacity = 0;
+  splitter->max_line_length = max_line_length;
+}
+
+// appends to the line carried over, without letting it outgrow the limit
+static bool carry_partial(LineSplitter *splitter, const char *data,
+                          size_t length) {
+  if (length > splitter->max_line_length - splitter->partial_length ||
+      !append_partial(splitter, data, length)) {
+    splitter->partial_length = 0;
+    return false;
+  }
+  return true;
+}
+
+bool line_splitter_feed(LineSplitter *splitter, char *data, size_t length,
+                        line_handler handler, void *user_data) {
+  char *cursor = data;
+  char *end = data + length;
+
+  // memchr is vectorized by libc, so scanning runs well above byte-at-a-time
+  char *newline = memchr(cursor, '\n', end - cursor);
+
+  if (newline && splitter->partial_length > 0) {
+    // first line straddles the previous chunk, so it is the only one copied
+    if (!carry_partial(splitter, cursor, newline - cursor)) {
+      return false;
+    }
+    emit_line(splitter->partial, splitter->partial_length, handler, user_data);
+    splitter->partial_length = 0;
+    cursor = newline + 1;
+    newline = memchr(cursor, '\n', end - cursor);
+  }
+
+  while (newline) {
+    if ((size_t)(newline - cursor) > splitter->max_line_length) {
+      return false;
+    }
+    emit_line(cursor, newline - cursor, handler, user_data);
+    cursor = newline + 1;
+    newline = memchr(cursor, '\n', end - cursor);
+  }
+
+  if (cursor < end) {
+    return carry_partial(splitter, cursor, end - cursor);
+  }
+  return true;
+}
+
+void line_splitter_flush(LineSplitter *splitter, line_handler handler,
+                         void *user_data) {
+  if (splitter->partial_length == 0) {
+    return;
+  }
+
+  emit_line(splitter->partial, splitter->partial_length, handler, user_data);
+  splitter->partial_length = 0;
+}
+
+void line_splitter_free(LineSplitter *splitter) {
+  free(splitter->partial);
+  line_splitter_init(splitter, splitter->max_line_length);
+}
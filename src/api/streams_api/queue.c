@@ -2,16 +2,35 @@
 #include <stdlib.h>
 #include <string.h>
 
+SharedBuffer *shared_buffer_create(char *data, size_t length) {
+  SharedBuffer *buffer = malloc(sizeof(SharedBuffer));
+  if (!buffer)
+    return NULL;
+
+  buffer->data = data;
+  buffer->length = length;
+  buffer->refs = 1;
+  return buffer;
+}
+
+void shared_buffer_retain(SharedBuffer *buffer) { buffer->refs++; }
+
+void shared_buffer_release(SharedBuffer *buffer) {
+  if (--buffer->refs > 0) {
+    return;
+  }
+
+  free(buffer->data);
+  free(buffer);
+}
+
 void stream_queue_init(StreamQueue *queue) {
   queue->head = NULL;
   queue->tail = NULL;
   queue->total_size = 0;
 }
 
-void stream_queue_enqueue(StreamQueue *queue, char *data, size_t length) {
-  StreamChunk *chunk = malloc(sizeof(StreamChunk));
-  chunk->data = data;
-  chunk->length = length;
+static void append_chunk(StreamQueue *queue, StreamChunk *chunk) {
   chunk->next = NULL;
 
   if (!queue->head) {
@@ -21,7 +40,24 @@ void stream_queue_enqueue(StreamQueue *queue, char *data, size_t length) {
     queue->tail = chunk;
   }
 
-  queue->total_size += length;
+  queue->total_size += chunk->length;
+}
+
+void stream_queue_enqueue(StreamQueue *queue, char *data, size_t length) {
+  StreamChunk *chunk = malloc(sizeof(StreamChunk));
+  chunk->data = data;
+  chunk->length = length;
+  chunk->shared = NULL;
+  append_chunk(queue, chunk);
+}
+
+void stream_queue_enqueue_shared(StreamQueue *queue, SharedBuffer *buffer) {
+  StreamChunk *chunk = malloc(sizeof(StreamChunk));
+  chunk->data = buffer->data;
+  chunk->length = buffer->length;
+  chunk->shared = buffer;
+  shared_buffer_retain(buffer);
+  append_chunk(queue, chunk);
 }
 
 StreamChunk *stream_queue_dequeue(StreamQueue *queue) {
@@ -40,12 +76,41 @@ StreamChunk *stream_queue_dequeue(StreamQueue *queue) {
   return chunk;
 }
 
+char *stream_queue_take_all(StreamQueue *queue, size_t *length_out) {
+  size_t length = queue->total_size;
+  char *data;
+
+  if (queue->head && queue->head == queue->tail) {
+    data = queue->head->data;
+    free(queue->head);
+  } else {
+    data = malloc(length + 1);
+    size_t offset = 0;
+    StreamChunk *chunk = queue->head;
+    while (chunk) {
+      StreamChunk *next = chunk->next;
+      memcpy(data + offset, chunk->data, chunk->length);
+      offset += chunk->length;
+      free(chunk->data);
+      free(chunk);
+      chunk = next;
+    }
+  }
+
+  data[length] = '\0';
+  queue->head = NULL;
+  queue->tail = NULL;
+  queue->total_size = 0;
+
+  *length_out = length;
+  return data;
+}
+
 void stream_queue_free(StreamQueue *queue) {
   StreamChunk *chunk = queue->head;
   while (chunk) {
     StreamChunk *next = chunk->next;
-    free(chunk->data);
-    free(chunk);
+    stream_chunk_free(chunk);
     chunk = next;
   }
   
@@ -56,4 +121,13 @@ void stream_queue_free(StreamQueue *queue) {
 
 int stream_queue_is_empty(StreamQueue *queue) {
   return queue->head == NULL;
+}
+
+void stream_chunk_free(StreamChunk *chunk) {
+  if (chunk->shared) {
+    shared_buffer_release(chunk->shared);
+  } else {
+    free(chunk->data);
+  }
+  free(chunk);
 }
\ No newline at end of file
@@ -1,19 +1,35 @@
 #include "api/streams_api.h"
+#include "api/crypto_api.h"
+#include "api/crypto_api/hash.h"
+#include "api/fs_api.h"
+#include "api/streams_api/lines.h"
 #include "api/streams_api/queue.h"
 #include "constants.h"
 #include "core/jsc_interop.h"
+#include "core/jsc_promise.h"
+#include "core/libuv.h"
 
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 
-static JSClassRef readable_stream_class = NULL;
+static THREAD_LOCAL JSClassRef readable_stream_class = NULL;
+static THREAD_LOCAL JSObjectRef make_async_iterable_fn = NULL;
 
 static void on_stream_read(uv_fs_t *req);
 static void on_stream_open_for_read(uv_fs_t *req);
 static void schedule_next_read(ReadableStreamState *state);
 static void drain_queue(ReadableStreamState *state);
 
+static void close_stream_fd(ReadableStreamState *state) {
+  if (state->fd > 0) {
+    uv_fs_t close_req;
+    uv_fs_close(loop, &close_req, state->fd, NULL);
+    uv_fs_req_cleanup(&close_req);
+    state->fd = 0;
+  }
+}
+
 static void readable_stream_finalize(JSObjectRef object) {
   ReadableStreamState *state = JSObjectGetPrivate(object);
   if (!state)
@@ -25,18 +41,30 @@ static void readable_stream_finalize(JSObjectRef object) {
     JSValueUnprotect(state->ctx, state->end_handler);
   if (state->error_handler)
     JSValueUnprotect(state->ctx, state->error_handler);
+  if (state->tap_obj)
+    JSValueUnprotect(state->ctx, state->tap_obj);
+  if (state->next_resolve)
+    JSValueUnprotect(state->ctx, state->next_resolve);
+  if (state->next_reject)
+    JSValueUnprotect(state->ctx, state->next_reject);
+  if (state->error)
+    JSValueUnprotect(state->ctx, state->error);
+  for (size_t i = 0; i < state->pipe_count; i++)
+    JSValueUnprotect(state->ctx, state->pipe_dests[i]->stream_obj);
+  free(state->pipe_dests);
 
   if (state->queue) {
     stream_queue_free(state->queue);
     free(state->queue);
   }
 
-  if (state->fd > 0) {
-    uv_fs_t close_req;
-    uv_fs_close(uv_default_loop(), &close_req, state->fd, NULL);
-    uv_fs_req_cleanup(&close_req);
+  if (state->line_splitter) {
+    line_splitter_free(state->line_splitter);
+    free(state->line_splitter);
   }
 
+  close_stream_fd(state);
+
   free(state->path);
   free(state);
 }
@@ -69,85 +97,416 @@ static void emit_stream_event(ReadableStreamState *state,
   }
 }
 
+typedef struct {
+  ReadableStreamState *state;
+  JSObjectRef items;
+  unsigned count;
+  size_t limit; // emit every `limit` lines, 0 = caller takes `items`
+} LineBatch;
+
+static void flush_batch(LineBatch *batch) {
+  if (batch->count == 0)
+    return;
+
+  emit_stream_event(batch->state, "data", batch->items);
+  batch->items = NULL;
+  batch->count = 0;
+}
+
+static bool is_blank(const char *line, size_t length) {
+  return strspn(line, " \t") == length;
+}
+
+static void append_line(char *line, size_t length, void *user_data) {
+  LineBatch *batch = user_data;
+  ReadableStreamState *state = batch->state;
+  state->lines_read++;
+
+  JSStringRef line_str = JSStringCreateWithUTF8CString(line);
+  JSValueRef item;
+
+  if (state->parse_json) {
+    item = is_blank(line, length)
+               ? NULL
+               : JSValueMakeFromJSONString(state->ctx, line_str);
+    if (!item && !is_blank(line, length)) {
+      // skip the record and keep going, one bad line shouldn't end ingestion
+      char err_msg[ERROR_MSG_BUFFER_SIZE];
+      snprintf(err_msg, sizeof(err_msg), "Invalid JSON on line %zu of '%s'",
+               state->lines_read, state->path);
+      JSStringRef err_str = JSStringCreateWithUTF8CString(err_msg);
+      emit_stream_event(state, "error", JSValueMakeString(state->ctx, err_str));
+      JSStringRelease(err_str);
+    }
+  } else {
+    item = JSValueMakeString(state->ctx, line_str);
+  }
+  JSStringRelease(line_str);
+
+  if (!item)
+    return;
+
+  if (!batch->items) {
+    batch->items = JSObjectMakeArray(state->ctx, 0, NULL, NULL);
+  }
+  JSObjectSetPropertyAtIndex(state->ctx, batch->items, batch->count++, item,
+                             NULL);
+
+  if (batch->limit > 0 && batch->count >= batch->limit)
+    flush_batch(batch);
+}
+
+static bool is_consuming(ReadableStreamState *state) {
+  return state->flowing && (state->data_handler || state->pipe_count > 0);
+}
+
+// queues one refcounted copy of the chunk on every pipeMany() destination,
+// it is freed once the slowest of them has written it
+static void fan_out(ReadableStreamState *state, char *data, size_t length) {
+  SharedBuffer *buffer = shared_buffer_create(data, length);
+  if (!buffer) {
+    free(data);
+    readable_stream_push_error(state, ERR_MEMORY_ALLOCATION);
+    return;
+  }
+
+  for (size_t i = 0; i < state->pipe_count; i++) {
+    if (!writable_stream_write_shared(state->pipe_dests[i], buffer)) {
+      state->flowing = false;
+    }
+  }
+
+  shared_buffer_release(buffer);
+}
+
+static void end_pipe_dests(ReadableStreamState *state) {
+  for (size_t i = 0; i < state->pipe_count; i++) {
+    writable_stream_finish(state->pipe_dests[i]);
+  }
+}
+
+// takes ownership of `data`, which must be NUL-terminated
+static JSValueRef make_chunk_value(ReadableStreamState *state, char *data,
+                                   size_t length) {
+  if (state->binary) {
+    return make_byte_array(state->ctx, data, length);
+  }
+
+  JSStringRef chunk_str = JSStringCreateWithUTF8CString(data);
+  JSValueRef value = JSValueMakeString(state->ctx, chunk_str);
+  JSStringRelease(chunk_str);
+  free(data);
+  return value;
+}
+
+static void fail_stream(ReadableStreamState *state, const char *message);
+
+static void fail_long_line(ReadableStreamState *state) {
+  char err_msg[ERROR_MSG_BUFFER_SIZE];
+  snprintf(err_msg, sizeof(err_msg), "Line %zu of '%s' exceeds maxLineLength",
+           state->lines_read + 1, state->path);
+  fail_stream(state, err_msg);
+}
+
+// takes ownership of `data`, which must be NUL-terminated (line mode splits
+// it in place)
+static void emit_chunk(ReadableStreamState *state, char *data, size_t length) {
+  // nothing more is handed out after 'error'
+  if (state->error) {
+    free(data);
+    return;
+  }
+
+  if (state->pipe_count > 0) {
+    fan_out(state, data, length);
+    return;
+  }
+
+  if (state->line_splitter) {
+    LineBatch batch = {state, NULL, 0, state->batch_size};
+    bool fits = line_splitter_feed(state->line_splitter, data, length,
+                                   append_line, &batch);
+    flush_batch(&batch);
+    free(data);
+    if (!fits) {
+      fail_long_line(state);
+    }
+    return;
+  }
+
+  emit_stream_event(state, "data", make_chunk_value(state, data, length));
+}
+
+static void emit_end_if_drained(ReadableStreamState *state) {
+  if (!state->ended || state->end_emitted ||
+      !stream_queue_is_empty(state->queue))
+    return;
+
+  state->end_emitted = true;
+  state->end_pending = !state->end_handler;
+
+  if (state->line_splitter) {
+    // a final line without trailing newline
+    LineBatch batch = {state, NULL, 0, state->batch_size};
+    line_splitter_flush(state->line_splitter, append_line, &batch);
+    flush_batch(&batch);
+  }
+
+  end_pipe_dests(state);
+  emit_stream_event(state, "end", JSValueMakeUndefined(state->ctx));
+}
+
 static void drain_queue(ReadableStreamState *state) {
-  while (!stream_queue_is_empty(state->queue) && state->flowing &&
-         state->data_handler) {
+  while (!stream_queue_is_empty(state->queue) && is_consuming(state)) {
     StreamChunk *chunk = stream_queue_dequeue(state->queue);
     if (chunk) {
-      JSStringRef chunk_str = JSStringCreateWithUTF8CString(chunk->data);
-      JSValueRef data = JSValueMakeString(state->ctx, chunk_str);
-      JSStringRelease(chunk_str);
-      emit_stream_event(state, "data", data);
+      emit_chunk(state, chunk->data, chunk->length);
+      free(chunk);
+    }
+  }
+
+  emit_end_if_drained(state);
+}
+
+// everything queued as one value: a single string or Uint8Array, or one
+// array of lines in line mode. NULL when there is nothing to hand out yet
+static JSValueRef take_queued(ReadableStreamState *state) {
+  if (state->line_splitter) {
+    LineBatch batch = {state, NULL, 0, 0};
+    StreamChunk *chunk;
+    while ((chunk = stream_queue_dequeue(state->queue))) {
+      bool fits = line_splitter_feed(state->line_splitter, chunk->data,
+                                     chunk->length, append_line, &batch);
       free(chunk->data);
       free(chunk);
+      if (!fits) {
+        fail_long_line(state); // rejects the pending next()
+        return NULL;
+      }
     }
+    if (state->ended) {
+      line_splitter_flush(state->line_splitter, append_line, &batch);
+    }
+    return batch.items;
+  }
+
+  if (stream_queue_is_empty(state->queue))
+    return NULL;
+
+  size_t length;
+  char *data = stream_queue_take_all(state->queue, &length);
+  return make_chunk_value(state, data, length);
+}
+
+static void release_next(ReadableStreamState *state) {
+  JSValueUnprotect(state->ctx, state->next_resolve);
+  JSValueUnprotect(state->ctx, state->next_reject);
+  state->next_resolve = NULL;
+  state->next_reject = NULL;
+}
+
+static JSObjectRef make_iter_result(JSContextRef ctx, JSValueRef value,
+                                    bool done) {
+  JSObjectRef result = JSObjectMake(ctx, NULL, NULL);
+
+  JSStringRef value_name = JSStringCreateWithUTF8CString("value");
+  JSObjectSetProperty(ctx, result, value_name,
+                      value ? value : JSValueMakeUndefined(ctx),
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(value_name);
+
+  JSStringRef done_name = JSStringCreateWithUTF8CString("done");
+  JSObjectSetProperty(ctx, result, done_name, JSValueMakeBoolean(ctx, done),
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(done_name);
+
+  return result;
+}
+
+// resolves a pending next() once there is data or the stream has ended
+static void settle_next(ReadableStreamState *state) {
+  if (!state->next_resolve)
+    return;
+
+  JSValueRef value = take_queued(state);
+  if (!state->next_resolve || (!value && !state->ended))
+    return; // rejected by take_queued, or nothing to hand out yet
+
+  JSObjectRef resolve = state->next_resolve;
+  JSValueProtect(state->ctx, resolve);
+  release_next(state);
+
+  if (!value) {
+    emit_end_if_drained(state);
+  }
+  promise_resolve(state->ctx, resolve, make_iter_result(state->ctx, value, !value));
+  JSValueUnprotect(state->ctx, resolve);
+}
+
+static void reject_next(ReadableStreamState *state, JSValueRef error) {
+  if (!state->next_reject)
+    return;
+
+  JSObjectRef reject = state->next_reject;
+  JSValueProtect(state->ctx, reject);
+  release_next(state);
+
+  promise_reject(state->ctx, reject, error);
+  JSValueUnprotect(state->ctx, reject);
+}
+
+static void mark_ended(ReadableStreamState *state) {
+  state->ended = true;
+
+  if (state->next_resolve) {
+    settle_next(state);
+  } else {
+    emit_end_if_drained(state);
   }
 }
 
 static void schedule_next_read(ReadableStreamState *state) {
-  if (!state->flowing || state->ended || state->reading)
+  if (state->ended || state->reading)
     return;
 
+  // while paused, read ahead only until the queue reaches the high watermark
+  bool wanted = is_consuming(state) ||
+                state->queue->total_size < state->high_watermark;
+
+  if (state->pull) {
+    state->pull(state->source, wanted);
+    return;
+  }
+
+  if (state->fd <= 0 || !wanted)
+    return;
+
+  size_t length = state->chunk_size;
+  if (state->end_position >= 0) {
+    off_t remaining = state->end_position - state->file_position + 1;
+    if (remaining <= 0) {
+      mark_ended(state);
+      return;
+    }
+    if ((off_t)length > remaining)
+      length = (size_t)remaining;
+  }
+
   state->reading = true;
 
-  state->read_buffer =
-      uv_buf_init(malloc(state->chunk_size), state->chunk_size);
+  // one spare byte so the chunk can be NUL-terminated without copying
+  state->read_buffer = uv_buf_init(malloc(length + 1), length);
   state->fs_req.data = state;
 
-  uv_fs_read(uv_default_loop(), &state->fs_req, state->fd, &state->read_buffer,
+  uv_fs_read(loop, &state->fs_req, state->fd, &state->read_buffer,
              1, state->file_position, on_stream_read);
 }
 
+// ends the stream for good, the error is kept so later next() calls reject
+// at once instead of waiting for a read that will never come
+static void fail_stream(ReadableStreamState *state, const char *message) {
+  if (state->error)
+    return;
+
+  JSStringRef err_str = JSStringCreateWithUTF8CString(message);
+  state->error = JSValueMakeString(state->ctx, err_str);
+  JSStringRelease(err_str);
+  JSValueProtect(state->ctx, state->error);
+
+  state->ended = true;
+  state->end_emitted = true; // no 'end' after 'error'
+  if (!state->reading) {
+    close_stream_fd(state); // otherwise on_stream_read closes it
+  }
+
+  emit_stream_event(state, "error", state->error);
+  reject_next(state, state->error);
+  end_pipe_dests(state);
+}
+
+// takes ownership of `data`, which must be NUL-terminated
+static void deliver_chunk(ReadableStreamState *state, char *data,
+                          size_t length) {
+  if (state->tap_hasher) {
+    // hashed straight from the read buffer, before it is handed on
+    hasher_update(state->tap_hasher, data, length);
+  }
+
+  if (is_consuming(state)) {
+    // emit when flowing
+    emit_chunk(state, data, length);
+  } else {
+    // enqueue when paused, the queue takes ownership of the read buffer
+    stream_queue_enqueue(state->queue, data, length);
+    settle_next(state);
+  }
+}
+
 static void on_stream_read(uv_fs_t *req) {
   ReadableStreamState *state = req->data;
   state->reading = false;
 
+  // return() or an error ended the stream while this read was in flight
+  if (state->ended) {
+    free(state->read_buffer.base);
+    uv_fs_req_cleanup(req);
+    close_stream_fd(state);
+    return;
+  }
+
   if (req->result < 0) {
     char err_msg[ERROR_MSG_BUFFER_SIZE];
     snprintf(err_msg, sizeof(err_msg), "Stream read error: %s",
              uv_strerror(req->result));
-    JSStringRef err_str = JSStringCreateWithUTF8CString(err_msg);
-    JSValueRef error = JSValueMakeString(state->ctx, err_str);
-    JSStringRelease(err_str);
-    emit_stream_event(state, "error", error);
-
-    free(req->bufs[0].base);
+    free(state->read_buffer.base);
     uv_fs_req_cleanup(req);
+    fail_stream(state, err_msg);
     return;
   }
 
   if (req->result == 0) {
-    state->ended = true;
-    emit_stream_event(state, "end", JSValueMakeUndefined(state->ctx));
+    mark_ended(state);
     free(state->read_buffer.base);
     uv_fs_req_cleanup(req);
     return;
   }
 
-  char *chunk_data = malloc(req->result + 1);
-  memcpy(chunk_data, state->read_buffer.base, req->result);
+  char *chunk_data = state->read_buffer.base;
   chunk_data[req->result] = '\0';
-
   state->file_position += req->result;
+  deliver_chunk(state, chunk_data, req->result);
 
-  if (state->flowing && state->data_handler) {
-    // emit when flowing
-    JSStringRef chunk_str = JSStringCreateWithUTF8CString(chunk_data);
-    JSValueRef data = JSValueMakeString(state->ctx, chunk_str);
-    JSStringRelease(chunk_str);
-    emit_stream_event(state, "data", data);
-    free(chunk_data);
-  } else {
-    // enqueue when paused
-    stream_queue_enqueue(state->queue, chunk_data, req->result);
-  }
-
-  free(state->read_buffer.base);
   uv_fs_req_cleanup(req);
 
   schedule_next_read(state);
 }
 
+void readable_stream_push(ReadableStreamState *state, char *data,
+                          size_t length) {
+  // a consumer that returned early leaves the rest to be dropped
+  if (state->ended) {
+    free(data);
+    return;
+  }
+
+  data[length] = '\0';
+  deliver_chunk(state, data, length);
+  schedule_next_read(state);
+}
+
+void readable_stream_push_end(ReadableStreamState *state) {
+  if (!state->ended) {
+    mark_ended(state);
+  }
+}
+
+void readable_stream_push_error(ReadableStreamState *state,
+                                const char *message) {
+  if (!state->ended) {
+    fail_stream(state, message);
+  }
+}
+
 static void on_stream_open_for_read(uv_fs_t *req) {
   ReadableStreamState *state = req->data;
 
@@ -155,47 +514,45 @@ static void on_stream_open_for_read(uv_fs_t *req) {
     char err_msg[ERROR_MSG_BUFFER_SIZE];
     snprintf(err_msg, sizeof(err_msg), "Cannot open file '%s': %s", state->path,
              uv_strerror(req->result));
-    JSStringRef err_str = JSStringCreateWithUTF8CString(err_msg);
-    JSValueRef error = JSValueMakeString(state->ctx, err_str);
-    JSStringRelease(err_str);
-    emit_stream_event(state, "error", error);
     uv_fs_req_cleanup(req);
+    fail_stream(state, err_msg);
     return;
   }
 
   state->fd = req->result;
   uv_fs_req_cleanup(req);
 
-  if (state->flowing && state->data_handler) {
+  // return() before the file opened
+  if (state->ended) {
+    close_stream_fd(state);
+    return;
+  }
+
+  if (is_consuming(state) || state->next_resolve) {
     schedule_next_read(state);
   }
 }
 
-JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
-                                 JSObjectRef this_obj, size_t argc,
-                                 const JSValueRef args[],
-                                 JSValueRef *js_err_str) {
-  if (!is_valid_argc(ctx, argc, 1, "fs.createReadStream", js_err_str)) {
-    return JSValueMakeUndefined(ctx);
+// the stream is its own async iterator, so `for await` drives next()/return()
+static void make_async_iterable(JSContextRef ctx, JSObjectRef stream) {
+  if (make_async_iterable_fn == NULL) {
+    JSStringRef code = JSStringCreateWithUTF8CString(
+        "(function(stream) {"
+        "  stream[Symbol.asyncIterator] = function() { return this; };"
+        "})");
+    JSValueRef fn = JSEvaluateScript(ctx, code, NULL, NULL, 1, NULL);
+    JSStringRelease(code);
+
+    make_async_iterable_fn = (JSObjectRef)fn;
+    JSValueProtect(ctx, make_async_iterable_fn);
   }
 
-  char *path = to_c_str(ctx, args[0], js_err_str);
-  if (*js_err_str) {
-    return JSValueMakeUndefined(ctx);
-  }
-
-  ReadableStreamState *state = calloc(1, sizeof(ReadableStreamState));
-  state->ctx = ctx;
-  state->path = strdup(path);
-  state->chunk_size = STREAM_CHUNK_SIZE;
-  state->high_watermark = STREAM_HIGH_WATERMARK;
-  state->flowing = false;
-  state->ended = false;
-  state->reading = false;
-  state->file_position = 0;
-  state->queue = malloc(sizeof(StreamQueue));
-  stream_queue_init(state->queue);
+  JSValueRef args[] = {stream};
+  JSObjectCallAsFunction(ctx, make_async_iterable_fn, NULL, 1, args, NULL);
+}
 
+static JSObjectRef make_stream_object(JSContextRef ctx,
+                                      ReadableStreamState *state) {
   if (readable_stream_class == NULL) {
     JSClassDefinition class_def = kJSClassDefinitionEmpty;
     class_def.finalize = readable_stream_finalize;
@@ -204,7 +561,6 @@ JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
 
   JSObjectRef stream = JSObjectMake(ctx, readable_stream_class, state);
   state->stream_obj = stream;
-  JSValueProtect(ctx, stream);
 
   JSStringRef on_name = JSStringCreateWithUTF8CString("on");
   JSObjectRef on_fn =
@@ -227,6 +583,13 @@ JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
                       kJSPropertyAttributeNone, NULL);
   JSStringRelease(resume_name);
 
+  JSStringRef tap_name = JSStringCreateWithUTF8CString("tap");
+  JSObjectRef tap_fn =
+      JSObjectMakeFunctionWithCallback(ctx, tap_name, readable_stream_tap);
+  JSObjectSetProperty(ctx, stream, tap_name, tap_fn, kJSPropertyAttributeNone,
+                      NULL);
+  JSStringRelease(tap_name);
+
   JSStringRef pipe_name = JSStringCreateWithUTF8CString("pipe");
   JSObjectRef pipe_fn =
       JSObjectMakeFunctionWithCallback(ctx, pipe_name, readable_stream_pipe);
@@ -234,12 +597,217 @@ JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
                       NULL);
   JSStringRelease(pipe_name);
 
+  JSStringRef pipe_many_name = JSStringCreateWithUTF8CString("pipeMany");
+  JSObjectRef pipe_many_fn = JSObjectMakeFunctionWithCallback(
+      ctx, pipe_many_name, readable_stream_pipe_many);
+  JSObjectSetProperty(ctx, stream, pipe_many_name, pipe_many_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(pipe_many_name);
+
+  JSStringRef next_name = JSStringCreateWithUTF8CString("next");
+  JSObjectRef next_fn =
+      JSObjectMakeFunctionWithCallback(ctx, next_name, readable_stream_next);
+  JSObjectSetProperty(ctx, stream, next_name, next_fn, kJSPropertyAttributeNone,
+                      NULL);
+  JSStringRelease(next_name);
+
+  JSStringRef return_name = JSStringCreateWithUTF8CString("return");
+  JSObjectRef return_fn = JSObjectMakeFunctionWithCallback(
+      ctx, return_name, readable_stream_return);
+  JSObjectSetProperty(ctx, stream, return_name, return_fn,
+                      kJSPropertyAttributeNone, NULL);
+  JSStringRelease(return_name);
+
+  make_async_iterable(ctx, stream);
+  return stream;
+}
+
+static bool is_file_offset(double value) {
+  return value >= 0 && value <= STREAM_MAX_OFFSET &&
+         value == (double)(int64_t)value;
+}
+
+static ReadableStreamState *create_read_stream(JSContextRef ctx, size_t argc,
+                                               const JSValueRef args[],
+                                               const char *fn_name,
+                                               size_t default_chunk_size,
+                                               JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, fn_name, js_err_str)) {
+    return NULL;
+  }
+
+  char *path = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return NULL;
+  }
+
+  JSValueRef options = argc > 1 ? args[1] : NULL;
+  double chunk_size = default_chunk_size;
+  double high_watermark = STREAM_HIGH_WATERMARK;
+  double start = 0;
+  double end = -1;
+  get_number_option(ctx, options, "chunkSize", &chunk_size);
+  get_number_option(ctx, options, "highWaterMark", &high_watermark);
+  get_number_option(ctx, options, "start", &start);
+  bool has_end = get_number_option(ctx, options, "end", &end);
+
+  // written so NaN fails too, start and end must be whole byte offsets
+  if (!(chunk_size >= 1 && chunk_size <= STREAM_MAX_CHUNK_SIZE) ||
+      !(high_watermark >= 0) || !is_file_offset(start) ||
+      (has_end && !(is_file_offset(end) && end >= start))) {
+    free(path);
+    set_js_error(ctx, "Invalid stream options", js_err_str);
+    return NULL;
+  }
+
+  char *flags = get_string_option(ctx, options, "flags");
+  int open_flags = to_open_flags(flags ? flags : "r");
+  free(flags);
+  // "w" and friends would truncate the file before the first read
+  if (open_flags < 0 || (open_flags & O_ACCMODE) == O_WRONLY ||
+      (open_flags & O_TRUNC)) {
+    free(path);
+    set_js_error(ctx, "Unknown file open flags", js_err_str);
+    return NULL;
+  }
+
+  bool binary;
+  if (!to_stream_encoding(ctx, options, false, &binary, js_err_str)) {
+    free(path);
+    return NULL;
+  }
+
+  ReadableStreamState *state = calloc(1, sizeof(ReadableStreamState));
+  state->ctx = ctx;
+  state->path = strdup(path);
+  state->chunk_size = (size_t)chunk_size;
+  state->high_watermark = high_watermark < (double)SIZE_MAX
+                              ? (size_t)high_watermark
+                              : SIZE_MAX; // Infinity for no limit
+  state->flowing = false;
+  state->ended = false;
+  state->end_emitted = false;
+  state->reading = false;
+  state->file_position = (off_t)start;
+  state->end_position = has_end ? (off_t)end : -1;
+  state->binary = binary;
+  state->queue = malloc(sizeof(StreamQueue));
+  stream_queue_init(state->queue);
+
+  JSObjectRef stream = make_stream_object(ctx, state);
+  JSValueProtect(ctx, stream);
+
   state->fs_req.data = state; // back pointer for later access
-  uv_fs_open(uv_default_loop(), &state->fs_req, path, O_RDONLY, 0,
-             on_stream_open_for_read);
+  uv_fs_open(loop, &state->fs_req, path, open_flags,
+             FILE_DEFAULT_PERMISSIONS, on_stream_open_for_read);
 
   free(path);
-  return stream;
+  return state;
+}
+
+ReadableStreamState *create_pushed_stream(JSContextRef ctx,
+                                          void (*pull)(void *source, bool more),
+                                          void *source) {
+  ReadableStreamState *state = calloc(1, sizeof(ReadableStreamState));
+  state->ctx = ctx;
+  state->high_watermark = STREAM_HIGH_WATERMARK;
+  state->end_position = -1;
+  state->binary = true;
+  state->pull = pull;
+  state->source = source;
+  state->queue = malloc(sizeof(StreamQueue));
+  stream_queue_init(state->queue);
+
+  // the source keeps the object alive for as long as it pushes
+  make_stream_object(ctx, state);
+  return state;
+}
+
+JSValueRef fs_create_read_stream(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  ReadableStreamState *state = create_read_stream(
+      ctx, argc, args, "fs.createReadStream", STREAM_CHUNK_SIZE, js_err_str);
+  if (!state) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  return state->stream_obj;
+}
+
+typedef struct {
+  size_t batch_size;
+  size_t max_line_length;
+} LineOptions;
+
+static bool to_line_options(JSContextRef ctx, size_t argc,
+                            const JSValueRef args[], LineOptions *out,
+                            JSValueRef *js_err_str) {
+  JSValueRef options = argc > 1 ? args[1] : NULL;
+  double batch_size = 0;
+  double max_line_length = LINE_READER_MAX_LINE_LENGTH;
+  get_number_option(ctx, options, "batchSize", &batch_size);
+  get_number_option(ctx, options, "maxLineLength", &max_line_length);
+  if (!(batch_size >= 0) || !(max_line_length >= 1)) { // NaN too
+    set_js_error(ctx, "Invalid stream options", js_err_str);
+    return false;
+  }
+
+  out->batch_size =
+      batch_size < (double)SIZE_MAX ? (size_t)batch_size : SIZE_MAX;
+  out->max_line_length = max_line_length < (double)SIZE_MAX
+                             ? (size_t)max_line_length
+                             : SIZE_MAX; // Infinity for no limit
+  return true;
+}
+
+static void enable_line_mode(ReadableStreamState *state,
+                             const LineOptions *options) {
+  state->batch_size = options->batch_size;
+  state->line_splitter = malloc(sizeof(LineSplitter));
+  line_splitter_init(state->line_splitter, options->max_line_length);
+}
+
+JSValueRef fs_create_line_reader(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  LineOptions line_options;
+  if (!to_line_options(ctx, argc, args, &line_options, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ReadableStreamState *state =
+      create_read_stream(ctx, argc, args, "fs.createLineReader",
+                         LINE_READER_CHUNK_SIZE, js_err_str);
+  if (!state) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  enable_line_mode(state, &line_options);
+  return state->stream_obj;
+}
+
+JSValueRef fs_create_ndjson_reader(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str) {
+  LineOptions line_options;
+  if (!to_line_options(ctx, argc, args, &line_options, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ReadableStreamState *state =
+      create_read_stream(ctx, argc, args, "fs.createNDJSONReader",
+                         LINE_READER_CHUNK_SIZE, js_err_str);
+  if (!state) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  enable_line_mode(state, &line_options);
+  state->parse_json = true;
+  return state->stream_obj;
 }
 
 JSValueRef readable_stream_on(JSContextRef ctx, JSObjectRef js_fn,
@@ -278,7 +846,7 @@ JSValueRef readable_stream_on(JSContextRef ctx, JSObjectRef js_fn,
     }
     state->data_handler = handler;
     state->flowing = true;
-    if (state->fd > 0) {
+    if (state->fd > 0 || state->pull) {
       drain_queue(state);
       schedule_next_read(state);
     }
@@ -287,6 +855,10 @@ JSValueRef readable_stream_on(JSContextRef ctx, JSObjectRef js_fn,
       JSValueUnprotect(ctx, state->end_handler);
     }
     state->end_handler = handler;
+    if (state->end_pending) {
+      state->end_pending = false;
+      emit_stream_event(state, "end", JSValueMakeUndefined(ctx));
+    }
   } else if (strcmp(event_name, "error") == 0) {
     if (state->error_handler) {
       JSValueUnprotect(ctx, state->error_handler);
@@ -328,27 +900,142 @@ JSValueRef readable_stream_resume(JSContextRef ctx, JSObjectRef js_fn,
   return this_obj;
 }
 
-JSValueRef readable_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
+JSValueRef readable_stream_next(JSContextRef ctx, JSObjectRef js_fn,
                                 JSObjectRef this_obj, size_t argc,
                                 const JSValueRef args[],
                                 JSValueRef *js_err_str) {
-  if (!is_valid_argc(ctx, argc, 1, "stream.pipe", js_err_str)) {
+  ReadableStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
-  if (!JSValueIsObject(ctx, args[0])) {
-    set_js_error(ctx, "Pipe destination must be a writable stream", js_err_str);
+  if (state->data_handler || state->pipe_count > 0) {
+    set_js_error(ctx, "Cannot iterate a stream that is already being consumed",
+                 js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
-  JSObjectRef dest = (JSObjectRef)args[0];
+  if (state->next_resolve) {
+    set_js_error(ctx, "stream.next() is already pending", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
 
-  ReadableStreamState *read_state = JSObjectGetPrivate(this_obj);
-  if (!read_state) {
+  JSObjectRef resolve, reject;
+  JSValueRef promise = create_promise(ctx, &resolve, &reject, js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (state->error) {
+    promise_reject(ctx, reject, state->error);
+    return promise;
+  }
+
+  JSValueProtect(ctx, resolve);
+  JSValueProtect(ctx, reject);
+  state->next_resolve = resolve;
+  state->next_reject = reject;
+
+  // resolves at once with whatever was read ahead, otherwise on the next read
+  settle_next(state);
+  schedule_next_read(state);
+
+  return promise;
+}
+
+JSValueRef readable_stream_return(JSContextRef ctx, JSObjectRef js_fn,
+                                  JSObjectRef this_obj, size_t argc,
+                                  const JSValueRef args[],
+                                  JSValueRef *js_err_str) {
+  ReadableStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef resolve, reject;
+  JSValueRef promise = create_promise(ctx, &resolve, &reject, js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  // the consumer broke out early, so stop reading and drop what is queued
+  bool was_ended = state->ended;
+  state->ended = true;
+  state->end_emitted = true;
+  stream_queue_free(state->queue);
+
+  // a pushed stream's source still has to get through the rest of its data
+  if (!was_ended && state->pull) {
+    state->pull(state->source, true);
+  }
+
+  // with a read in flight on_stream_read closes the file instead
+  if (!state->reading) {
+    close_stream_fd(state);
+  }
+
+  promise_resolve(ctx, resolve, make_iter_result(ctx, NULL, true));
+  return promise;
+}
+
+JSValueRef readable_stream_tap(JSContextRef ctx, JSObjectRef js_fn,
+                               JSObjectRef this_obj, size_t argc,
+                               const JSValueRef args[],
+                               JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "stream.tap", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ReadableStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
     set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
     return JSValueMakeUndefined(ctx);
   }
 
+  Hasher *hasher = to_hasher(ctx, args[0]);
+  if (!hasher) {
+    set_js_error(ctx, "Tap target must be a crypto.createHash() object",
+                 js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (state->tap_obj) {
+    JSValueUnprotect(ctx, state->tap_obj);
+  }
+  state->tap_hasher = hasher;
+  state->tap_obj = (JSObjectRef)args[0];
+  JSValueProtect(ctx, state->tap_obj);
+
+  return this_obj;
+}
+
+bool to_stream_encoding(JSContextRef ctx, JSValueRef options,
+                        bool default_binary, bool *binary_out,
+                        JSValueRef *js_err_str) {
+  char *encoding = get_string_option(ctx, options, "encoding");
+  if (!encoding) {
+    *binary_out = default_binary;
+    return true;
+  }
+
+  bool known = true;
+  if (strcmp(encoding, "buffer") == 0) {
+    *binary_out = true;
+  } else if (strcmp(encoding, "utf8") == 0) {
+    *binary_out = false;
+  } else {
+    known = false;
+    set_js_error(ctx, "Unknown stream encoding", js_err_str);
+  }
+
+  free(encoding);
+  return known;
+}
+
+JSValueRef pipe_streams(JSContextRef ctx, JSObjectRef source, JSObjectRef dest,
+                        JSValueRef *js_err_str) {
   const char *pipe_handler_code =
       "(function(readable, writable) {"
       "  readable.on('data', function(chunk) {"
@@ -386,7 +1073,7 @@ JSValueRef readable_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
-  JSValueRef pipe_args[] = {this_obj, dest};
+  JSValueRef pipe_args[] = {source, dest};
   JSObjectCallAsFunction(ctx, pipe_fn, NULL, 2, pipe_args, &exception);
 
   if (exception) {
@@ -396,3 +1083,151 @@ JSValueRef readable_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
 
   return dest;
 }
+
+JSValueRef readable_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
+                                JSObjectRef this_obj, size_t argc,
+                                const JSValueRef args[],
+                                JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "stream.pipe", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!JSValueIsObject(ctx, args[0])) {
+    set_js_error(ctx, "Pipe destination must be a writable stream", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ReadableStreamState *read_state = JSObjectGetPrivate(this_obj);
+  if (!read_state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  return pipe_streams(ctx, this_obj, (JSObjectRef)args[0], js_err_str);
+}
+
+static void on_pipe_dest_drain(void *data) {
+  ReadableStreamState *state = data;
+
+  // the slowest destination sets the pace
+  for (size_t i = 0; i < state->pipe_count; i++) {
+    if (state->pipe_dests[i]->needs_drain)
+      return;
+  }
+
+  state->flowing = true;
+  drain_queue(state);
+  schedule_next_read(state);
+}
+
+// a destination that failed takes no more writes, so it is dropped rather
+// than left holding back the rest
+static void on_pipe_dest_finish(void *data) {
+  ReadableStreamState *state = data;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < state->pipe_count; i++) {
+    WritableStreamState *dest = state->pipe_dests[i];
+    if (dest->failed) {
+      dest->on_drain = NULL;
+      dest->on_finish = NULL;
+      JSValueUnprotect(state->ctx, dest->stream_obj);
+    } else {
+      state->pipe_dests[kept++] = dest;
+    }
+  }
+
+  if (kept == state->pipe_count)
+    return; // finished normally
+  state->pipe_count = kept;
+
+  if (kept == 0) {
+    fail_stream(state, "Every pipeMany() destination failed");
+    return;
+  }
+  on_pipe_dest_drain(state);
+}
+
+JSValueRef readable_stream_pipe_many(JSContextRef ctx, JSObjectRef js_fn,
+                                     JSObjectRef this_obj, size_t argc,
+                                     const JSValueRef args[],
+                                     JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "stream.pipeMany", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ReadableStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (state->line_splitter || state->data_handler || state->pipe_count > 0) {
+    set_js_error(ctx, "stream.pipeMany() needs an unconsumed byte stream",
+                 js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef dests = JSValueToObject(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSStringRef length_name = JSStringCreateWithUTF8CString("length");
+  double length = JSValueToNumber(
+      ctx, JSObjectGetProperty(ctx, dests, length_name, NULL), NULL);
+  JSStringRelease(length_name);
+  if (!(length >= 1)) { // NaN too
+    set_js_error(ctx, "stream.pipeMany() needs at least one destination",
+                 js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  if (length > STREAM_MAX_PIPE_DESTS) {
+    set_js_error(ctx, "stream.pipeMany() has too many destinations",
+                 js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  size_t count = (size_t)length;
+
+  WritableStreamState **pipe_dests = calloc(count, sizeof(*pipe_dests));
+  if (!pipe_dests) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+  for (size_t i = 0; i < count; i++) {
+    JSValueRef dest = JSObjectGetPropertyAtIndex(ctx, dests, i, NULL);
+    pipe_dests[i] = to_writable_stream(ctx, dest);
+    if (!pipe_dests[i]) {
+      free(pipe_dests);
+      set_js_error(ctx, "stream.pipeMany() destinations must be file write "
+                        "streams",
+                   js_err_str);
+      return JSValueMakeUndefined(ctx);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    JSValueProtect(ctx, pipe_dests[i]->stream_obj);
+    pipe_dests[i]->on_drain = on_pipe_dest_drain;
+    pipe_dests[i]->on_drain_data = state;
+    pipe_dests[i]->on_finish = on_pipe_dest_finish;
+    pipe_dests[i]->on_finish_data = state;
+  }
+
+  state->pipe_dests = pipe_dests;
+  state->pipe_count = count;
+  state->flowing = true;
+
+  // one that already failed won't report it again
+  on_pipe_dest_finish(state);
+  if (state->error) {
+    return args[0];
+  }
+
+  if (state->fd > 0 || state->pull) {
+    drain_queue(state);
+    schedule_next_read(state);
+  }
+
+  return args[0];
+}
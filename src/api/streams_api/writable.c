@@ -1,18 +1,27 @@
 #include "api/streams_api.h"
+#include "api/fs_api.h"
 #include "api/streams_api/queue.h"
 #include "constants.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
 
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 
-static JSClassRef writable_stream_class = NULL;
+static THREAD_LOCAL JSClassRef writable_stream_class = NULL;
 
 static void on_stream_write(uv_fs_t *req);
 static void on_stream_open_for_write(uv_fs_t *req);
 static void process_write_queue(WritableStreamState *state);
 
+static void close_file(WritableStreamState *state) {
+  uv_fs_t close_req;
+  uv_fs_close(loop, &close_req, state->fd, NULL);
+  uv_fs_req_cleanup(&close_req);
+  state->fd = 0;
+}
+
 static void writable_stream_finalize(JSObjectRef object) {
   WritableStreamState *state = JSObjectGetPrivate(object);
   if (!state)
@@ -31,9 +40,7 @@ static void writable_stream_finalize(JSObjectRef object) {
   }
 
   if (state->fd > 0) {
-    uv_fs_t close_req;
-    uv_fs_close(uv_default_loop(), &close_req, state->fd, NULL);
-    uv_fs_req_cleanup(&close_req);
+    close_file(state);
   }
 
   free(state->path);
@@ -67,8 +74,39 @@ static void emit_writable_event(WritableStreamState *state,
   }
 }
 
+// 'finish' waits for the file to be open and every chunk written, and the
+// file is closed first so its fd isn't held until the stream is collected
+static void finish_if_flushed(WritableStreamState *state) {
+  if (!state->ended || state->finished || state->failed || state->fd <= 0 ||
+      !stream_queue_is_empty(state->queue)) {
+    return;
+  }
+
+  state->finished = true;
+  close_file(state);
+  emit_writable_event(state, "finish");
+  if (state->on_finish) {
+    state->on_finish(state->on_finish_data);
+  }
+}
+
+// nothing more is written once a write has failed
+static void fail_write_stream(WritableStreamState *state) {
+  if (state->failed) {
+    return;
+  }
+
+  state->failed = true;
+  stream_queue_free(state->queue); // no write is in flight here
+  emit_writable_event(state, "error");
+  if (state->on_finish) {
+    state->on_finish(state->on_finish_data);
+  }
+}
+
 static void process_write_queue(WritableStreamState *state) {
-  if (state->writing || stream_queue_is_empty(state->queue) || state->fd <= 0) {
+  if (state->writing || state->failed || stream_queue_is_empty(state->queue) ||
+      state->fd <= 0) {
     return;
   }
 
@@ -78,7 +116,7 @@ static void process_write_queue(WritableStreamState *state) {
   state->write_buffer = uv_buf_init(chunk->data, chunk->length);
   state->fs_req.data = state; // back pointer for later access
 
-  uv_fs_write(uv_default_loop(), &state->fs_req, state->fd,
+  uv_fs_write(loop, &state->fs_req, state->fd,
               &state->write_buffer, 1, -1, on_stream_write);
 }
 
@@ -92,13 +130,13 @@ static void on_stream_write(uv_fs_t *req) {
              uv_strerror(req->result));
     fprintf(stderr, "%s\n", err_msg);
     uv_fs_req_cleanup(req);
+    fail_write_stream(state);
     return;
   }
 
   StreamChunk *written = stream_queue_dequeue(state->queue);
   if (written) {
-    free(written->data);
-    free(written);
+    stream_chunk_free(written);
   }
 
   uv_fs_req_cleanup(req);
@@ -106,13 +144,13 @@ static void on_stream_write(uv_fs_t *req) {
   if (state->needs_drain && state->queue->total_size < state->high_watermark) {
     state->needs_drain = false;
     emit_writable_event(state, "drain");
+    if (state->on_drain) {
+      state->on_drain(state->on_drain_data);
+    }
   }
 
   process_write_queue(state);
-
-  if (state->ended && stream_queue_is_empty(state->queue)) {
-    emit_writable_event(state, "finish");
-  }
+  finish_if_flushed(state);
 }
 
 static void on_stream_open_for_write(uv_fs_t *req) {
@@ -124,6 +162,7 @@ static void on_stream_open_for_write(uv_fs_t *req) {
              state->path, uv_strerror(req->result));
     fprintf(stderr, "%s\n", err_msg);
     uv_fs_req_cleanup(req);
+    fail_write_stream(state);
     return;
   }
 
@@ -131,6 +170,7 @@ static void on_stream_open_for_write(uv_fs_t *req) {
   uv_fs_req_cleanup(req);
 
   process_write_queue(state);
+  finish_if_flushed(state);
 }
 
 JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef js_fn,
@@ -146,10 +186,39 @@ JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
+  JSValueRef options = argc > 1 ? args[1] : NULL;
+  double high_watermark = STREAM_HIGH_WATERMARK;
+  get_number_option(ctx, options, "highWaterMark", &high_watermark);
+  if (!(high_watermark >= 1)) { // NaN too
+    free(path);
+    set_js_error(ctx, "Invalid stream options", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *flags = get_string_option(ctx, options, "flags");
+  int open_flags = to_open_flags(flags ? flags : "w");
+  free(flags);
+  if (open_flags < 0) {
+    free(path);
+    set_js_error(ctx, "Unknown file open flags", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  WritableStreamState *state =
+      create_write_stream(ctx, path, open_flags,
+                          high_watermark < (double)SIZE_MAX
+                              ? (size_t)high_watermark
+                              : SIZE_MAX);
+  free(path);
+  return state->stream_obj;
+}
+
+WritableStreamState *create_write_stream(JSContextRef ctx, const char *path,
+                                         int open_flags, size_t high_watermark) {
   WritableStreamState *state = calloc(1, sizeof(WritableStreamState));
   state->ctx = ctx;
   state->path = strdup(path);
-  state->high_watermark = STREAM_HIGH_WATERMARK;
+  state->high_watermark = high_watermark;
   state->needs_drain = false;
   state->ended = false;
   state->writing = false;
@@ -189,12 +258,33 @@ JSValueRef fs_create_write_stream(JSContextRef ctx, JSObjectRef js_fn,
   JSStringRelease(on_name);
 
   state->fs_req.data = state;
-  uv_fs_open(uv_default_loop(), &state->fs_req, path,
-             O_WRONLY | O_CREAT | O_TRUNC, FILE_DEFAULT_PERMISSIONS,
-             on_stream_open_for_write);
+  uv_fs_open(loop, &state->fs_req, path, open_flags,
+             FILE_DEFAULT_PERMISSIONS, on_stream_open_for_write);
 
-  free(path);
-  return stream;
+  return state;
+}
+
+// starts writing what was just queued, false once past the high watermark
+static bool flush_queued(WritableStreamState *state) {
+  if (!state->writing) {
+    process_write_queue(state);
+  }
+
+  bool can_continue = state->queue->total_size < state->high_watermark;
+  if (!can_continue) {
+    state->needs_drain = true;
+  }
+
+  return can_continue;
+}
+
+WritableStreamState *to_writable_stream(JSContextRef ctx, JSValueRef value) {
+  if (!writable_stream_class || !JSValueIsObjectOfClass(ctx, value,
+                                                        writable_stream_class)) {
+    return NULL;
+  }
+
+  return JSObjectGetPrivate((JSObjectRef)value);
 }
 
 JSValueRef writable_stream_write(JSContextRef ctx, JSObjectRef js_fn,
@@ -205,7 +295,8 @@ JSValueRef writable_stream_write(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
-  char *data = to_c_str(ctx, args[0], js_err_str);
+  size_t length;
+  char *data = to_bytes(ctx, args[0], &length, js_err_str);
   if (*js_err_str) {
     return JSValueMakeUndefined(ctx);
   }
@@ -223,19 +314,30 @@ JSValueRef writable_stream_write(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
-  size_t length = strlen(data);
   stream_queue_enqueue(state->queue, data, length);
+  return JSValueMakeBoolean(ctx, flush_queued(state));
+}
 
-  if (!state->writing) {
-    process_write_queue(state);
+bool writable_stream_write_shared(WritableStreamState *state,
+                                  SharedBuffer *buffer) {
+  // a failed stream never writes again, so nothing is queued behind it
+  if (state->ended || state->failed) {
+    return true;
   }
 
-  bool can_continue = state->queue->total_size < state->high_watermark;
-  if (!can_continue) {
-    state->needs_drain = true;
+  stream_queue_enqueue_shared(state->queue, buffer);
+  return flush_queued(state);
+}
+
+bool writable_stream_write_bytes(WritableStreamState *state, char *data,
+                                 size_t length) {
+  if (state->ended || state->failed) {
+    free(data);
+    return true;
   }
 
-  return JSValueMakeBoolean(ctx, can_continue);
+  stream_queue_enqueue(state->queue, data, length);
+  return flush_queued(state);
 }
 
 JSValueRef writable_stream_end(JSContextRef ctx, JSObjectRef js_fn,
@@ -248,13 +350,17 @@ JSValueRef writable_stream_end(JSContextRef ctx, JSObjectRef js_fn,
     return JSValueMakeUndefined(ctx);
   }
 
-  state->ended = true;
+  writable_stream_finish(state);
+  return JSValueMakeUndefined(ctx);
+}
 
-  if (stream_queue_is_empty(state->queue)) {
-    emit_writable_event(state, "finish");
+void writable_stream_finish(WritableStreamState *state) {
+  if (state->ended) {
+    return;
   }
 
-  return JSValueMakeUndefined(ctx);
+  state->ended = true;
+  finish_if_flushed(state);
 }
 
 JSValueRef writable_stream_on(JSContextRef ctx, JSObjectRef js_fn,
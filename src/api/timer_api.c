@@ -11,8 +11,6 @@
 #include <stdlib.h>
 #include <uv.h>
 
-extern uv_loop_t *loop;
-
 typedef struct {
   uv_timer_t uv_handle;
   JSContextRef ctx;
@@ -20,8 +18,8 @@ typedef struct {
   uint32_t id;
 } TimerState;
 
-static TimerState *timer_states[MAX_TIMER_STATES];
-uint32_t next_timer_id = 0;
+static THREAD_LOCAL TimerState *timer_states[MAX_TIMER_STATES];
+THREAD_LOCAL uint32_t next_timer_id = 0;
 
 static void on_timer_close(uv_handle_t *uv_handle) {
   TimerState *state = (TimerState *)uv_handle->data;
@@ -0,0 +1,542 @@
+#include "api/zlib_api.h"
+
+#include "api/streams_api.h"
+#include "api/streams_api/queue.h"
+#include "constants.h"
+#include "core/jsc_interop.h"
+#include "core/libuv.h"
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <zlib.h>
+
+#define GZIP_WINDOW_BITS (MAX_WBITS + 16)
+#define AUTO_DETECT_WINDOW_BITS (MAX_WBITS + 32) // gzip or zlib header
+
+static THREAD_LOCAL JSClassRef zlib_stream_class = NULL;
+
+typedef struct {
+  uv_work_t work_req;
+  z_stream zs;
+  JSContextRef ctx;
+  JSObjectRef stream_obj;
+  JSObjectRef data_handler;
+  JSObjectRef end_handler;
+  JSObjectRef error_handler;
+  JSObjectRef drain_handler;
+  JSObjectRef finish_handler;
+
+  StreamQueue *queue; // input waiting for the threadpool
+  size_t high_watermark;
+
+  // owned by the threadpool while `working` is set
+  StreamChunk *input;
+  char *output;
+  size_t output_length;
+  int z_result;
+  // the start of a UTF-8 character split across two batches of output
+  char partial[3];
+  size_t partial_length;
+
+  bool deflating;
+  bool binary;
+  bool flowing;
+  bool working;
+  bool ended;      // end() called, no more input
+  bool finishing;  // final flush handed to the threadpool
+  bool stream_end; // zlib reported Z_STREAM_END
+  bool needs_drain;
+  bool done;
+  bool released; // zlib state ended, the object left to the collector
+} ZlibStreamState;
+
+static void process_zlib_queue(ZlibStreamState *state);
+
+static void zlib_stream_finalize(JSObjectRef object) {
+  ZlibStreamState *state = JSObjectGetPrivate(object);
+  if (!state)
+    return;
+
+  if (state->data_handler)
+    JSValueUnprotect(state->ctx, state->data_handler);
+  if (state->end_handler)
+    JSValueUnprotect(state->ctx, state->end_handler);
+  if (state->error_handler)
+    JSValueUnprotect(state->ctx, state->error_handler);
+  if (state->drain_handler)
+    JSValueUnprotect(state->ctx, state->drain_handler);
+  if (state->finish_handler)
+    JSValueUnprotect(state->ctx, state->finish_handler);
+
+  if (!state->released) {
+    if (state->deflating)
+      deflateEnd(&state->zs);
+    else
+      inflateEnd(&state->zs);
+  }
+
+  stream_queue_free(state->queue);
+  free(state->queue);
+  free(state);
+}
+
+static void emit_zlib_event(ZlibStreamState *state, JSObjectRef handler,
+                            size_t argc, const JSValueRef args[]) {
+  if (!handler)
+    return;
+
+  JSValueRef exception = NULL;
+  JSObjectCallAsFunction(state->ctx, handler, state->stream_obj, argc, args,
+                         &exception);
+
+  if (exception) {
+    JSStringRef err_str = JSValueToStringCopy(state->ctx, exception, NULL);
+    char err_buffer[ERROR_MSG_BUFFER_SIZE];
+    JSStringGetUTF8CString(err_str, err_buffer, sizeof(err_buffer));
+    fprintf(stderr, "Stream event handler error: %s\n", err_buffer);
+    JSStringRelease(err_str);
+  }
+}
+
+// once 'end' or 'error' has gone out nothing more can happen, so the zlib
+// state is freed right away and the object is left to the collector
+static void release_zlib_stream(ZlibStreamState *state) {
+  if (state->released)
+    return;
+  state->released = true;
+
+  if (state->deflating)
+    deflateEnd(&state->zs);
+  else
+    inflateEnd(&state->zs);
+  stream_queue_free(state->queue); // input left over after an error
+
+  JSObjectRef *handlers[] = {&state->data_handler, &state->end_handler,
+                             &state->error_handler, &state->drain_handler,
+                             &state->finish_handler};
+  for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+    if (*handlers[i]) {
+      JSValueUnprotect(state->ctx, *handlers[i]);
+      *handlers[i] = NULL;
+    }
+  }
+
+  JSValueUnprotect(state->ctx, state->stream_obj);
+}
+
+static void emit_zlib_error(ZlibStreamState *state, const char *message) {
+  char err_msg[ERROR_MSG_BUFFER_SIZE];
+  snprintf(err_msg, sizeof(err_msg), "zlib error: %s", message);
+  JSStringRef err_str = JSStringCreateWithUTF8CString(err_msg);
+  JSValueRef args[] = {JSValueMakeString(state->ctx, err_str)};
+  JSStringRelease(err_str);
+  emit_zlib_event(state, state->error_handler, 1, args);
+}
+
+// runs on the threadpool, must not touch JS
+static void zlib_work(uv_work_t *req) {
+  ZlibStreamState *state = req->data;
+  z_stream *zs = &state->zs;
+
+  zs->next_in = state->input ? (Bytef *)state->input->data : Z_NULL;
+  zs->avail_in = state->input ? (uInt)state->input->length : 0;
+  int flush = state->finishing && state->deflating ? Z_FINISH : Z_NO_FLUSH;
+
+  size_t capacity = ZLIB_OUTPUT_CHUNK_SIZE;
+  char *output = malloc(capacity);
+  size_t length = 0;
+  state->z_result = output ? Z_OK : Z_MEM_ERROR;
+
+  if (output && state->partial_length > 0) {
+    memcpy(output, state->partial, state->partial_length);
+    length = state->partial_length;
+    state->partial_length = 0;
+  }
+
+  // input after a finished member starts the next one, see below
+  if (!state->deflating && state->stream_end && zs->avail_in > 0) {
+    inflateReset(zs);
+    state->stream_end = false;
+  }
+
+  while (output && !state->stream_end) {
+    if (length == capacity) {
+      char *grown = realloc(output, capacity * 2);
+      if (!grown) {
+        state->z_result = Z_MEM_ERROR;
+        break;
+      }
+      output = grown;
+      capacity *= 2;
+    }
+
+    zs->next_out = (Bytef *)output + length;
+    zs->avail_out = (uInt)(capacity - length);
+
+    int result = state->deflating ? deflate(zs, flush) : inflate(zs, flush);
+    length = capacity - zs->avail_out;
+
+    if (result == Z_STREAM_END && !state->deflating && zs->avail_in > 0) {
+      // concatenated members, as `cat a.gz b.gz` makes, decode as one stream
+      inflateReset(zs);
+    } else if (result == Z_STREAM_END) {
+      state->stream_end = true;
+    } else if (result != Z_OK && result != Z_BUF_ERROR) {
+      state->z_result = result;
+      break;
+    } else if (zs->avail_out > 0 &&
+               (zs->avail_in == 0 || result == Z_BUF_ERROR)) {
+      break; // input consumed and output not full: nothing left to produce
+    }
+  }
+
+  // another member may still follow Z_STREAM_END, so only the final flush
+  // hands out what's left
+  if (output && !state->binary && !state->finishing) {
+    size_t tail = incomplete_utf8_tail(output, length);
+    length -= tail;
+    memcpy(state->partial, output + length, tail);
+    state->partial_length = tail;
+  }
+
+  state->output = output;
+  state->output_length = length;
+}
+
+static void on_zlib_work_done(uv_work_t *req, int uv_status) {
+  ZlibStreamState *state = req->data;
+  state->working = false;
+
+  if (state->input) {
+    stream_chunk_free(state->input);
+    state->input = NULL;
+  }
+
+  if (state->z_result != Z_OK) {
+    free(state->output);
+    state->done = true;
+    emit_zlib_error(state, state->zs.msg ? state->zs.msg
+                                         : zError(state->z_result));
+    release_zlib_stream(state);
+    return;
+  }
+
+  if (state->output_length > 0 && state->data_handler) {
+    JSValueRef chunk;
+    if (state->binary) {
+      chunk = make_byte_array(state->ctx, state->output, state->output_length);
+    } else {
+      chunk = make_utf8_string(state->ctx, state->output, state->output_length);
+      free(state->output);
+    }
+    JSValueRef args[] = {chunk};
+    emit_zlib_event(state, state->data_handler, 1, args);
+  } else {
+    free(state->output);
+  }
+  state->output = NULL;
+
+  if (state->needs_drain && state->queue->total_size < state->high_watermark) {
+    state->needs_drain = false;
+    emit_zlib_event(state, state->drain_handler, 0, NULL);
+  }
+
+  if (state->finishing) {
+    state->done = true;
+    if (!state->stream_end) {
+      emit_zlib_error(state, "unexpected end of compressed data");
+      release_zlib_stream(state);
+      return;
+    }
+    emit_zlib_event(state, state->end_handler, 0, NULL);
+    emit_zlib_event(state, state->finish_handler, 0, NULL);
+    release_zlib_stream(state);
+    return;
+  }
+
+  process_zlib_queue(state);
+}
+
+static void process_zlib_queue(ZlibStreamState *state) {
+  if (state->working || state->done || !state->flowing)
+    return;
+
+  if (!stream_queue_is_empty(state->queue)) {
+    state->input = stream_queue_dequeue(state->queue);
+  } else if (state->ended) {
+    state->finishing = true;
+  } else {
+    return;
+  }
+
+  state->working = true;
+  state->work_req.data = state;
+  uv_queue_work(loop, &state->work_req, zlib_work,
+                on_zlib_work_done);
+}
+
+static JSValueRef zlib_stream_write(JSContextRef ctx, JSObjectRef js_fn,
+                                    JSObjectRef this_obj, size_t argc,
+                                    const JSValueRef args[],
+                                    JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "stream.write", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ZlibStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (state->ended) {
+    set_js_error(ctx, "Cannot write after end", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  // an error ended it, there is nothing left to take the input
+  if (state->done) {
+    set_js_error(ctx, "Cannot write after the stream has failed", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  size_t length;
+  char *data = to_bytes(ctx, args[0], &length, js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  stream_queue_enqueue(state->queue, data, length);
+  process_zlib_queue(state);
+
+  bool can_continue = state->queue->total_size < state->high_watermark;
+  if (!can_continue) {
+    state->needs_drain = true;
+  }
+
+  return JSValueMakeBoolean(ctx, can_continue);
+}
+
+static JSValueRef zlib_stream_end(JSContextRef ctx, JSObjectRef js_fn,
+                                  JSObjectRef this_obj, size_t argc,
+                                  const JSValueRef args[],
+                                  JSValueRef *js_err_str) {
+  ZlibStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  state->ended = true;
+  process_zlib_queue(state);
+  return JSValueMakeUndefined(ctx);
+}
+
+static JSValueRef zlib_stream_on(JSContextRef ctx, JSObjectRef js_fn,
+                                 JSObjectRef this_obj, size_t argc,
+                                 const JSValueRef args[],
+                                 JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 2, "stream.on", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  char *event_name = to_c_str(ctx, args[0], js_err_str);
+  if (*js_err_str) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!JSValueIsObject(ctx, args[1]) ||
+      !JSObjectIsFunction(ctx, (JSObjectRef)args[1])) {
+    free(event_name);
+    set_js_error(ctx, ERR_CALLBACK_REQUIRED, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ZlibStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    free(event_name);
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  JSObjectRef *slot = NULL;
+  if (strcmp(event_name, "data") == 0)
+    slot = &state->data_handler;
+  else if (strcmp(event_name, "end") == 0)
+    slot = &state->end_handler;
+  else if (strcmp(event_name, "error") == 0)
+    slot = &state->error_handler;
+  else if (strcmp(event_name, "drain") == 0)
+    slot = &state->drain_handler;
+  else if (strcmp(event_name, "finish") == 0)
+    slot = &state->finish_handler;
+
+  if (slot) {
+    if (*slot) {
+      JSValueUnprotect(ctx, *slot);
+    }
+    *slot = (JSObjectRef)args[1];
+    JSValueProtect(ctx, *slot);
+  }
+
+  if (slot == &state->data_handler) {
+    state->flowing = true;
+    process_zlib_queue(state);
+  }
+
+  free(event_name);
+  return this_obj;
+}
+
+static JSValueRef zlib_stream_pause(JSContextRef ctx, JSObjectRef js_fn,
+                                    JSObjectRef this_obj, size_t argc,
+                                    const JSValueRef args[],
+                                    JSValueRef *js_err_str) {
+  ZlibStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  state->flowing = false;
+  return this_obj;
+}
+
+static JSValueRef zlib_stream_resume(JSContextRef ctx, JSObjectRef js_fn,
+                                     JSObjectRef this_obj, size_t argc,
+                                     const JSValueRef args[],
+                                     JSValueRef *js_err_str) {
+  ZlibStreamState *state = JSObjectGetPrivate(this_obj);
+  if (!state) {
+    set_js_error(ctx, ERR_INVALID_STREAM_STATE, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  state->flowing = true;
+  process_zlib_queue(state);
+  return this_obj;
+}
+
+static JSValueRef zlib_stream_pipe(JSContextRef ctx, JSObjectRef js_fn,
+                                   JSObjectRef this_obj, size_t argc,
+                                   const JSValueRef args[],
+                                   JSValueRef *js_err_str) {
+  if (!is_valid_argc(ctx, argc, 1, "stream.pipe", js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  if (!JSValueIsObject(ctx, args[0])) {
+    set_js_error(ctx, "Pipe destination must be a writable stream", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  return pipe_streams(ctx, this_obj, (JSObjectRef)args[0], js_err_str);
+}
+
+static JSValueRef create_zlib_stream(JSContextRef ctx, size_t argc,
+                                     const JSValueRef args[], bool deflating,
+                                     int window_bits, JSValueRef *js_err_str) {
+  JSValueRef options = argc > 0 ? args[0] : NULL;
+  double level = Z_DEFAULT_COMPRESSION;
+  double high_watermark = STREAM_HIGH_WATERMARK;
+  get_number_option(ctx, options, "level", &level);
+  get_number_option(ctx, options, "highWaterMark", &high_watermark);
+
+  // written so NaN fails too
+  if (!(level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION) ||
+      !(high_watermark >= 1)) {
+    set_js_error(ctx, "Invalid zlib options", js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  bool binary;
+  if (!to_stream_encoding(ctx, options, true, &binary, js_err_str)) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  ZlibStreamState *state = calloc(1, sizeof(ZlibStreamState));
+  if (!state) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  int init_result =
+      deflating ? deflateInit2(&state->zs, (int)level, Z_DEFLATED, window_bits,
+                               8, Z_DEFAULT_STRATEGY)
+                : inflateInit2(&state->zs, window_bits);
+  if (init_result != Z_OK) {
+    free(state);
+    set_js_error(ctx, zError(init_result), js_err_str);
+    return JSValueMakeUndefined(ctx);
+  }
+
+  state->ctx = ctx;
+  state->deflating = deflating;
+  state->binary = binary;
+  state->high_watermark = high_watermark < (double)SIZE_MAX
+                              ? (size_t)high_watermark
+                              : SIZE_MAX;
+  state->queue = malloc(sizeof(StreamQueue));
+  stream_queue_init(state->queue);
+
+  if (zlib_stream_class == NULL) {
+    JSClassDefinition class_def = kJSClassDefinitionEmpty;
+    class_def.finalize = zlib_stream_finalize;
+    zlib_stream_class = JSClassCreate(&class_def);
+  }
+
+  JSObjectRef stream = JSObjectMake(ctx, zlib_stream_class, state);
+  state->stream_obj = stream;
+  JSValueProtect(ctx, stream);
+
+  static const struct {
+    const char *name;
+    JSObjectCallAsFunctionCallback callback;
+  } stream_fns[] = {{"write", zlib_stream_write},   {"end", zlib_stream_end},
+                    {"on", zlib_stream_on},         {"pause", zlib_stream_pause},
+                    {"resume", zlib_stream_resume}, {"pipe", zlib_stream_pipe}};
+
+  const size_t fn_count = sizeof(stream_fns) / sizeof(stream_fns[0]);
+  for (size_t i = 0; i < fn_count; i++) {
+    JSStringRef fn_name = JSStringCreateWithUTF8CString(stream_fns[i].name);
+    JSObjectRef fn =
+        JSObjectMakeFunctionWithCallback(ctx, fn_name, stream_fns[i].callback);
+    JSObjectSetProperty(ctx, stream, fn_name, fn, kJSPropertyAttributeNone,
+                        NULL);
+    JSStringRelease(fn_name);
+  }
+
+  return stream;
+}
+
+JSValueRef zlib_create_gzip(JSContextRef ctx, JSObjectRef js_fn,
+                            JSObjectRef this_obj, size_t argc,
+                            const JSValueRef args[], JSValueRef *js_err_str) {
+  return create_zlib_stream(ctx, argc, args, true, GZIP_WINDOW_BITS,
+                            js_err_str);
+}
+
+JSValueRef zlib_create_gunzip(JSContextRef ctx, JSObjectRef js_fn,
+                              JSObjectRef this_obj, size_t argc,
+                              const JSValueRef args[], JSValueRef *js_err_str) {
+  return create_zlib_stream(ctx, argc, args, false, AUTO_DETECT_WINDOW_BITS,
+                            js_err_str);
+}
+
+JSValueRef zlib_create_deflate(JSContextRef ctx, JSObjectRef js_fn,
+                               JSObjectRef this_obj, size_t argc,
+                               const JSValueRef args[],
+                               JSValueRef *js_err_str) {
+  return create_zlib_stream(ctx, argc, args, true, MAX_WBITS, js_err_str);
+}
+
+JSValueRef zlib_create_inflate(JSContextRef ctx, JSObjectRef js_fn,
+                               JSObjectRef this_obj, size_t argc,
+                               const JSValueRef args[],
+                               JSValueRef *js_err_str) {
+  return create_zlib_stream(ctx, argc, args, false, AUTO_DETECT_WINDOW_BITS,
+                            js_err_str);
+}
@@ -1,11 +1,13 @@
 #include "cli.h"
 
+#include "constants.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 parse_result parse_args(int argc, char **argv) {
-  parse_result result = {CMD_NONE, NULL};
+  parse_result result = {CMD_NONE, NULL, 0, NULL};
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--version") == 0) {
@@ -18,9 +20,23 @@ parse_result parse_args(int argc, char **argv) {
       return result;
     }
 
+    if (strncmp(argv[i], "--cluster=", 10) == 0) {
+      char *end;
+      long workers = strtol(argv[i] + 10, &end, 10);
+      if (end == argv[i] + 10 || *end != '\0' || workers < 1 ||
+          workers > CLUSTER_MAX_WORKERS) {
+        result.cmd = CMD_ERROR;
+        result.error = "--cluster requires a worker count";
+        return result;
+      }
+      result.cluster_workers = (int)workers;
+      continue;
+    }
+
     if (strcmp(argv[i], "--eval") == 0) {
       if (i + 1 >= argc) {
         result.cmd = CMD_ERROR;
+        result.error = "--eval requires code arg";
         return result;
       }
       result.cmd = CMD_EVAL;
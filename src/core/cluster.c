@@ -0,0 +1,370 @@
+#include "core/cluster.h"
+#include "constants.h"
+#include "core/libuv.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+extern char **environ;
+
+typedef struct {
+  int id;
+  uv_process_t process;
+  uv_pipe_t pipe; // control messages, the worker's CLUSTER_IPC_FD
+  uv_timer_t restart_timer;
+  bool running;
+  char message[CLUSTER_MESSAGE_SIZE]; // partial line read from the worker
+  size_t message_length;
+} ClusterWorker;
+
+static ClusterWorker *workers = NULL;
+static int worker_count = 0;
+static int stopped_workers = 0;
+static bool shutting_down = false;
+
+static char exe_path[1024];
+static char **worker_args = NULL;
+static char **worker_env = NULL;
+static char worker_id_env[64]; // the one env entry that differs per worker
+
+static uv_signal_t sigint_handle;
+static uv_signal_t sigterm_handle;
+
+// worker side
+static int worker_id = -1;
+static uv_pipe_t control_pipe;
+static char control_message[CLUSTER_MESSAGE_SIZE];
+static size_t control_length = 0;
+
+static void on_control_write(uv_write_t *req, int status) {
+  free(req->data);
+  free(req);
+}
+
+static void send_line(uv_stream_t *stream, const char *message) {
+  size_t length = strlen(message);
+  char *line = malloc(length + 1);
+  uv_write_t *req = malloc(sizeof(uv_write_t));
+  if (!line || !req) {
+    free(line);
+    free(req);
+    return;
+  }
+
+  memcpy(line, message, length);
+  line[length] = '\n';
+  req->data = line;
+
+  uv_buf_t buf = uv_buf_init(line, length + 1);
+  if (uv_write(req, stream, &buf, 1, on_control_write) < 0) {
+    free(line);
+    free(req);
+  }
+}
+
+// splits what arrived into lines, calling `on_line` for each complete one
+static void read_lines(char *buffer, size_t *length, ssize_t bytes_read,
+                       void (*on_line)(void *data, char *line), void *data) {
+  *length += bytes_read;
+
+  char *start = buffer;
+  char *newline;
+  while ((newline = memchr(start, '\n', buffer + *length - start))) {
+    *newline = '\0';
+    on_line(data, start);
+    start = newline + 1;
+  }
+
+  size_t remaining = buffer + *length - start;
+  if (remaining == CLUSTER_MESSAGE_SIZE) {
+    remaining = 0; // no newline in a full buffer, drop the line
+  }
+  memmove(buffer, start, remaining);
+  *length = remaining;
+}
+
+static void stop_master(void) {
+  uv_close((uv_handle_t *)&sigint_handle, NULL);
+  uv_close((uv_handle_t *)&sigterm_handle, NULL);
+  for (int i = 0; i < worker_count; i++) {
+    uv_close((uv_handle_t *)&workers[i].restart_timer, NULL);
+  }
+}
+
+static void on_worker_stopped(void) {
+  if (++stopped_workers == worker_count) {
+    stop_master();
+  }
+}
+
+static void on_master_line(void *data, char *line) {
+  ClusterWorker *worker = data;
+
+  int port;
+  if (sscanf(line, "listening %d", &port) == 1) {
+    printf("Worker %d listening on port %d\n", worker->id, port);
+  }
+}
+
+static void master_alloc_buffer(uv_handle_t *handle, size_t suggested_size,
+                                uv_buf_t *buf) {
+  ClusterWorker *worker = handle->data;
+  *buf = uv_buf_init(worker->message + worker->message_length,
+                     CLUSTER_MESSAGE_SIZE - worker->message_length);
+}
+
+static void on_master_read(uv_stream_t *stream, ssize_t bytes_read,
+                           const uv_buf_t *buf) {
+  ClusterWorker *worker = stream->data;
+
+  if (bytes_read < 0) {
+    uv_read_stop(stream);
+    return;
+  }
+
+  read_lines(worker->message, &worker->message_length, bytes_read,
+             on_master_line, worker);
+}
+
+static void on_worker_exit(uv_process_t *process, int64_t exit_status,
+                           int term_signal);
+
+static int spawn_worker(ClusterWorker *worker) {
+  uv_pipe_init(loop, &worker->pipe, 1);
+  worker->pipe.data = worker;
+  worker->process.data = worker;
+  worker->message_length = 0;
+
+  uv_stdio_container_t stdio[CLUSTER_IPC_FD + 1];
+  for (int fd = 0; fd < CLUSTER_IPC_FD; fd++) {
+    stdio[fd].flags = UV_INHERIT_FD;
+    stdio[fd].data.fd = fd;
+  }
+  stdio[CLUSTER_IPC_FD].flags =
+      UV_CREATE_PIPE | UV_READABLE_PIPE | UV_WRITABLE_PIPE;
+  stdio[CLUSTER_IPC_FD].data.stream = (uv_stream_t *)&worker->pipe;
+
+  // uv_spawn copies the environment, so the shared array can be reused
+  snprintf(worker_id_env, sizeof(worker_id_env), "%s=%d", CLUSTER_WORKER_ENV,
+           worker->id);
+
+  uv_process_options_t options = {0};
+  options.file = exe_path;
+  options.args = worker_args;
+  options.env = worker_env;
+  options.stdio = stdio;
+  options.stdio_count = CLUSTER_IPC_FD + 1;
+  options.exit_cb = on_worker_exit;
+
+  int spawn_result = uv_spawn(loop, &worker->process, &options);
+  if (spawn_result < 0) {
+    fprintf(stderr, "Failed to start worker %d: %s\n", worker->id,
+            uv_strerror(spawn_result));
+    uv_close((uv_handle_t *)&worker->pipe, NULL);
+    return spawn_result;
+  }
+
+  worker->running = true;
+  uv_read_start((uv_stream_t *)&worker->pipe, master_alloc_buffer,
+                on_master_read);
+  return 0;
+}
+
+static void on_restart_timer(uv_timer_t *timer) {
+  ClusterWorker *worker = timer->data;
+  if (shutting_down || spawn_worker(worker) < 0) {
+    on_worker_stopped();
+  }
+}
+
+static void on_worker_exit(uv_process_t *process, int64_t exit_status,
+                           int term_signal) {
+  ClusterWorker *worker = process->data;
+  worker->running = false;
+  uv_close((uv_handle_t *)process, NULL);
+  uv_close((uv_handle_t *)&worker->pipe, NULL);
+
+  // a worker ended by ^C along with the master isn't a crash
+  bool crashed = exit_status != 0 ||
+                 (term_signal != 0 && term_signal != SIGINT &&
+                  term_signal != SIGTERM);
+  if (crashed && !shutting_down) {
+    if (term_signal != 0) {
+      fprintf(stderr, "Worker %d killed by signal %d, restarting\n",
+              worker->id, term_signal);
+    } else {
+      fprintf(stderr, "Worker %d exited with code %d, restarting\n",
+              worker->id, (int)exit_status);
+    }
+    // the delay keeps a worker that crashes on startup from spinning
+    uv_timer_start(&worker->restart_timer, on_restart_timer,
+                   CLUSTER_RESTART_DELAY_MS, 0);
+    return;
+  }
+
+  on_worker_stopped();
+}
+
+// first signal asks the workers to exit, a second one kills them
+static void on_master_signal(uv_signal_t *handle, int signum) {
+  for (int i = 0; i < worker_count; i++) {
+    ClusterWorker *worker = &workers[i];
+    if (!worker->running) {
+      continue;
+    }
+
+    if (shutting_down) {
+      uv_process_kill(&worker->process, SIGKILL);
+    } else {
+      send_line((uv_stream_t *)&worker->pipe, "shutdown");
+    }
+  }
+
+  shutting_down = true;
+}
+
+// same command line minus --cluster, same environment plus the worker id
+static int prepare_worker_command(int argc, char **argv) {
+  size_t exe_size = sizeof(exe_path);
+  int exe_result = uv_exepath(exe_path, &exe_size);
+  if (exe_result < 0) {
+    return exe_result;
+  }
+
+  worker_args = calloc(argc + 1, sizeof(char *));
+  if (!worker_args) {
+    return UV_ENOMEM;
+  }
+
+  int arg_count = 0;
+  worker_args[arg_count++] = exe_path;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--cluster=", 10) != 0) {
+      worker_args[arg_count++] = argv[i];
+    }
+  }
+
+  size_t env_count = 0;
+  while (environ[env_count]) {
+    env_count++;
+  }
+
+  worker_env = calloc(env_count + 2, sizeof(char *));
+  if (!worker_env) {
+    return UV_ENOMEM;
+  }
+
+  size_t env_index = 0;
+  size_t prefix_length = strlen(CLUSTER_WORKER_ENV);
+  for (size_t i = 0; i < env_count; i++) {
+    if (strncmp(environ[i], CLUSTER_WORKER_ENV, prefix_length) != 0 ||
+        environ[i][prefix_length] != '=') {
+      worker_env[env_index++] = environ[i];
+    }
+  }
+  worker_env[env_index] = worker_id_env;
+
+  return 0;
+}
+
+int run_cluster_master(int count, int argc, char **argv) {
+  init_event_loop();
+
+  int prepare_result = prepare_worker_command(argc, argv);
+  if (prepare_result < 0) {
+    fprintf(stderr, "Failed to start cluster: %s\n",
+            uv_strerror(prepare_result));
+    return EXIT_FAILURE;
+  }
+
+  workers = calloc(count, sizeof(ClusterWorker));
+  if (!workers) {
+    fprintf(stderr, "Failed to allocate memory for workers\n");
+    return EXIT_FAILURE;
+  }
+  worker_count = count;
+
+  uv_signal_init(loop, &sigint_handle);
+  uv_signal_start(&sigint_handle, on_master_signal, SIGINT);
+  uv_signal_init(loop, &sigterm_handle);
+  uv_signal_start(&sigterm_handle, on_master_signal, SIGTERM);
+
+  for (int i = 0; i < count; i++) {
+    ClusterWorker *worker = &workers[i];
+    worker->id = i;
+    uv_timer_init(loop, &worker->restart_timer);
+    worker->restart_timer.data = worker;
+
+    if (spawn_worker(worker) < 0) {
+      on_worker_stopped();
+    }
+  }
+
+  run_event_loop();
+
+  free(workers);
+  free(worker_args);
+  free(worker_env);
+  return EXIT_SUCCESS;
+}
+
+static void on_worker_line(void *data, char *line) {
+  if (strcmp(line, "shutdown") == 0) {
+    exit(EXIT_SUCCESS);
+  }
+}
+
+static void worker_alloc_buffer(uv_handle_t *handle, size_t suggested_size,
+                                uv_buf_t *buf) {
+  *buf = uv_buf_init(control_message + control_length,
+                     CLUSTER_MESSAGE_SIZE - control_length);
+}
+
+static void on_worker_read(uv_stream_t *stream, ssize_t bytes_read,
+                           const uv_buf_t *buf) {
+  // the master is gone, nothing would restart or stop this worker
+  if (bytes_read == UV_EOF) {
+    exit(EXIT_FAILURE);
+  }
+
+  if (bytes_read < 0) {
+    uv_read_stop(stream);
+    return;
+  }
+
+  read_lines(control_message, &control_length, bytes_read, on_worker_line,
+             NULL);
+}
+
+void init_cluster_worker(void) {
+  const char *id = getenv(CLUSTER_WORKER_ENV);
+  if (!id) {
+    return;
+  }
+
+  uv_pipe_init(loop, &control_pipe, 1);
+  if (uv_pipe_open(&control_pipe, CLUSTER_IPC_FD) < 0) {
+    uv_close((uv_handle_t *)&control_pipe, NULL);
+    return;
+  }
+
+  worker_id = atoi(id);
+  uv_read_start((uv_stream_t *)&control_pipe, worker_alloc_buffer,
+                on_worker_read);
+
+  // the pipe alone shouldn't keep a worker whose script is done alive
+  uv_unref((uv_handle_t *)&control_pipe);
+}
+
+bool is_cluster_worker(void) { return worker_id >= 0; }
+
+int cluster_worker_id(void) { return worker_id; }
+
+void cluster_send(const char *message) {
+  if (worker_id >= 0) {
+    send_line((uv_stream_t *)&control_pipe, message);
+  }
+}
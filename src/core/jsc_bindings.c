@@ -1,6 +1,7 @@
 #include "core/jsc.h"
 
 #include "api/console_api.h"
+#include "api/crypto_api.h"
 #include "api/fs_api.h"
 #include "api/http_api.h"
 #include "api/module_api.h"
@@ -8,6 +9,7 @@
 #include "api/process_api.h"
 #include "api/streams_api.h"
 #include "api/timer_api.h"
+#include "api/zlib_api.h"
 
 #include <JavaScriptCore/JavaScript.h>
 
@@ -23,6 +25,11 @@ extern JSValueRef http_create_server(JSContextRef ctx, JSObjectRef function,
                                      const JSValueRef args[],
                                      JSValueRef *exception);
 
+extern JSValueRef http_serve_static(JSContextRef ctx, JSObjectRef function,
+                                    JSObjectRef this_obj, size_t argc,
+                                    const JSValueRef args[],
+                                    JSValueRef *exception);
+
 static void bind_fn(JSContextRef ctx, JSObjectRef parent, const char *name,
                     JSObjectCallAsFunctionCallback callback) {
   JSStringRef jsName = JSStringCreateWithUTF8CString(name);
@@ -109,6 +116,9 @@ static void bind_fs_api(JSGlobalContextRef ctx, JSObjectRef global) {
                 {"exists", fs_exists},
                 {"readFileAsync", fs_read_file_async},
                 {"createReadStream", fs_create_read_stream},
+                {"createLineReader", fs_create_line_reader},
+                {"createNDJSONReader", fs_create_ndjson_reader},
+                {"hashFile", fs_hash_file},
                 {"createWriteStream", fs_create_write_stream}};
 
   JSObjectRef fs = create_and_bind_object(ctx, global, "fs");
@@ -124,7 +134,8 @@ static void bind_http_api(JSGlobalContextRef ctx, JSObjectRef global) {
     const char *name;
     JSObjectCallAsFunctionCallback callback;
   } http_functions[] = {{"get", http_get},
-                        {"createServer", http_create_server}};
+                        {"createServer", http_create_server},
+                        {"serveStatic", http_serve_static}};
 
   JSObjectRef http = create_and_bind_object(ctx, global, "http");
 
@@ -138,7 +149,9 @@ static void bind_net_api(JSGlobalContextRef ctx, JSObjectRef global) {
   static const struct {
     const char *name;
     JSObjectCallAsFunctionCallback callback;
-  } net_functions[] = {{"createServer", net_create_server}};
+  } net_functions[] = {{"createServer", net_create_server},
+                       {"connect", net_connect},
+                       {"broadcast", net_broadcast}};
 
   JSObjectRef net = create_and_bind_object(ctx, global, "net");
 
@@ -148,6 +161,28 @@ static void bind_net_api(JSGlobalContextRef ctx, JSObjectRef global) {
   }
 }
 
+static void bind_crypto_api(JSGlobalContextRef ctx, JSObjectRef global) {
+  JSObjectRef crypto = create_and_bind_object(ctx, global, "crypto");
+  bind_fn(ctx, crypto, "createHash", crypto_create_hash);
+}
+
+static void bind_zlib_api(JSGlobalContextRef ctx, JSObjectRef global) {
+  static const struct {
+    const char *name;
+    JSObjectCallAsFunctionCallback callback;
+  } zlib_fns[] = {{"createGzip", zlib_create_gzip},
+                  {"createGunzip", zlib_create_gunzip},
+                  {"createDeflate", zlib_create_deflate},
+                  {"createInflate", zlib_create_inflate}};
+
+  JSObjectRef zlib = create_and_bind_object(ctx, global, "zlib");
+
+  const size_t zlib_count = sizeof(zlib_fns) / sizeof(zlib_fns[0]);
+  for (size_t i = 0; i < zlib_count; i++) {
+    bind_fn(ctx, zlib, zlib_fns[i].name, zlib_fns[i].callback);
+  }
+}
+
 void bind_native_apis(JSGlobalContextRef ctx) {
   JSObjectRef global = JSContextGetGlobalObject(ctx);
 
@@ -157,6 +192,8 @@ void bind_native_apis(JSGlobalContextRef ctx) {
   bind_fs_api(ctx, global);
   bind_http_api(ctx, global);
   bind_net_api(ctx, global);
+  bind_zlib_api(ctx, global);
+  bind_crypto_api(ctx, global);
 
   bind_fn(ctx, global, "require", js_require);
 }
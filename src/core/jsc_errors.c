@@ -1,13 +1,14 @@
 #include "core/jsc_errors.h"
 #include "core/jsc_interop.h"
+#include "core/libuv.h"
 
 #include <JavaScriptCore/JavaScript.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static JSObjectRef global_error_handler = NULL;
-static JSContextRef error_ctx = NULL;
+static THREAD_LOCAL JSObjectRef global_error_handler = NULL;
+static THREAD_LOCAL JSContextRef error_ctx = NULL;
 
 static const char *error_code_names[] = {
     "None",         "MemoryError",     "InvalidArguments",
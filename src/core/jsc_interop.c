@@ -4,6 +4,7 @@
 #include "core/jsc_errors.h"
 
 #include <JavaScriptCore/JavaScript.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -72,6 +73,193 @@ char *to_c_str(JSContextRef ctx, JSValueRef js_value, JSValueRef *js_err_str) {
   return c_string;
 }
 
+bool get_number_option(JSContextRef ctx, JSValueRef options, const char *name,
+                       double *value_out) {
+  if (!options || !JSValueIsObject(ctx, options)) {
+    return false;
+  }
+
+  JSStringRef prop_name = JSStringCreateWithUTF8CString(name);
+  JSValueRef value =
+      JSObjectGetProperty(ctx, (JSObjectRef)options, prop_name, NULL);
+  JSStringRelease(prop_name);
+
+  if (!value || !JSValueIsNumber(ctx, value)) {
+    return false;
+  }
+
+  *value_out = JSValueToNumber(ctx, value, NULL);
+  return true;
+}
+
+char *get_string_option(JSContextRef ctx, JSValueRef options,
+                        const char *name) {
+  if (!options || !JSValueIsObject(ctx, options)) {
+    return NULL;
+  }
+
+  JSStringRef prop_name = JSStringCreateWithUTF8CString(name);
+  JSValueRef value =
+      JSObjectGetProperty(ctx, (JSObjectRef)options, prop_name, NULL);
+  JSStringRelease(prop_name);
+
+  if (!value || !JSValueIsString(ctx, value)) {
+    return NULL;
+  }
+
+  JSValueRef js_err_str = NULL;
+  return to_c_str(ctx, value, &js_err_str);
+}
+
+static void free_byte_array(void *bytes, void *deallocator_ctx) {
+  free(bytes);
+}
+
+JSObjectRef make_byte_array(JSContextRef ctx, char *data, size_t length) {
+  // JS takes ownership of `data`, it is freed when the array is collected
+  return JSObjectMakeTypedArrayWithBytesNoCopy(ctx, kJSTypedArrayTypeUint8Array,
+                                               data, length, free_byte_array,
+                                               NULL, NULL);
+}
+
+// the code point of the sequence at `bytes`, or -1 when it is malformed
+static int32_t decode_utf8(const uint8_t *bytes, size_t available,
+                           size_t *consumed) {
+  uint8_t lead = bytes[0];
+  size_t count = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+  static const int32_t min_code[] = {0, 0x80, 0x800, 0x10000};
+
+  *consumed = 1;
+  if (count == 0 || lead > 0xF4 || count >= available) {
+    return -1;
+  }
+
+  int32_t code = lead & (0x3F >> count);
+  for (size_t i = 1; i <= count; i++) {
+    if ((bytes[i] & 0xC0) != 0x80) {
+      return -1;
+    }
+    code = code << 6 | (bytes[i] & 0x3F);
+  }
+
+  // overlong forms, surrogates and anything past U+10FFFF
+  if (code < min_code[count] || (code >= 0xD800 && code <= 0xDFFF) ||
+      code > 0x10FFFF) {
+    return -1;
+  }
+  *consumed = count + 1;
+  return code;
+}
+
+JSValueRef make_utf8_string(JSContextRef ctx, const char *data, size_t length) {
+  // never more UTF-16 units than bytes
+  JSChar *units = malloc((length ? length : 1) * sizeof(JSChar));
+  if (!units) {
+    return JSValueMakeUndefined(ctx);
+  }
+
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t count = 0;
+  size_t i = 0;
+  while (i < length) {
+    if (bytes[i] < 0x80) {
+      units[count++] = bytes[i++];
+      continue;
+    }
+
+    size_t consumed;
+    int32_t code = decode_utf8(bytes + i, length - i, &consumed);
+    i += consumed;
+    if (code < 0) {
+      units[count++] = 0xFFFD;
+    } else if (code >= 0x10000) {
+      code -= 0x10000;
+      units[count++] = (JSChar)(0xD800 | code >> 10);
+      units[count++] = (JSChar)(0xDC00 | (code & 0x3FF));
+    } else {
+      units[count++] = (JSChar)code;
+    }
+  }
+
+  JSStringRef str = JSStringCreateWithCharacters(units, count);
+  free(units);
+  JSValueRef value = JSValueMakeString(ctx, str);
+  JSStringRelease(str);
+  return value;
+}
+
+size_t incomplete_utf8_tail(const char *data, size_t length) {
+  for (size_t back = 1; back <= 3 && back <= length; back++) {
+    unsigned char c = (unsigned char)data[length - back];
+    if ((c & 0xC0) == 0x80)
+      continue; // a continuation byte, keep looking for the lead
+    size_t needed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return needed > back ? back : 0;
+  }
+  return 0;
+}
+
+bool get_byte_span(JSContextRef ctx, JSValueRef value, char **data_out,
+                   size_t *length_out) {
+  if (!JSValueIsObject(ctx, value)) {
+    return false;
+  }
+
+  JSObjectRef obj = (JSObjectRef)value;
+  JSTypedArrayType type = JSValueGetTypedArrayType(ctx, value, NULL);
+
+  if (type == kJSTypedArrayTypeArrayBuffer) {
+    *data_out = JSObjectGetArrayBufferBytesPtr(ctx, obj, NULL);
+    *length_out = JSObjectGetArrayBufferByteLength(ctx, obj, NULL);
+    return true;
+  }
+
+  if (type == kJSTypedArrayTypeNone) {
+    return false;
+  }
+
+  // bytes ptr already accounts for the view's byte offset
+  *data_out = JSObjectGetTypedArrayBytesPtr(ctx, obj, NULL);
+  *length_out = JSObjectGetTypedArrayByteLength(ctx, obj, NULL);
+  return true;
+}
+
+char *to_bytes(JSContextRef ctx, JSValueRef js_value, size_t *length_out,
+               JSValueRef *js_err_str) {
+  char *bytes;
+  size_t length;
+  if (!get_byte_span(ctx, js_value, &bytes, &length)) {
+    JSStringRef js_str = JSValueToStringCopy(ctx, js_value, js_err_str);
+    if (*js_err_str) {
+      return NULL;
+    }
+
+    // measured by what was written rather than strlen, a string may hold
+    // U+0000
+    size_t capacity = JSStringGetMaximumUTF8CStringSize(js_str);
+    char *utf8 = malloc(capacity);
+    if (!utf8) {
+      JSStringRelease(js_str);
+      set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+      return NULL;
+    }
+    *length_out = JSStringGetUTF8CString(js_str, utf8, capacity) - 1;
+    JSStringRelease(js_str);
+    return utf8;
+  }
+
+  char *copy = malloc(length + 1);
+  if (!copy) {
+    set_js_error(ctx, ERR_MEMORY_ALLOCATION, js_err_str);
+    return NULL;
+  }
+
+  memcpy(copy, bytes, length);
+  copy[length] = '\0';
+  *length_out = length;
+  return copy;
+}
+
 void set_js_error(JSContextRef ctx, const char *message, JSValueRef *js_err_str) {
   JSStringRef msg = JSStringCreateWithUTF8CString(message);
   *js_err_str = JSValueMakeString(ctx, msg);
@@ -1,6 +1,6 @@
 #include "core/libuv.h"
 
-uv_loop_t *loop = NULL;
+THREAD_LOCAL uv_loop_t *loop = NULL;
 
 void init_event_loop(void) { loop = uv_default_loop(); }
 
@@ -0,0 +1,177 @@
+#include "core/socket_options.h"
+#include "constants.h"
+#include "core/jsc_interop.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+void init_socket_options(SocketOptions *options) {
+  options->no_delay = -1;
+  options->keep_alive = -1;
+  options->send_buffer_size = 0;
+  options->receive_buffer_size = 0;
+  options->defer_accept = 0;
+  options->fast_open = 0;
+}
+
+static JSValueRef get_option(JSContextRef ctx, JSObjectRef options,
+                             const char *name) {
+  JSStringRef js_name = JSStringCreateWithUTF8CString(name);
+  JSValueRef value = JSObjectGetProperty(ctx, options, js_name, NULL);
+  JSStringRelease(js_name);
+  return value;
+}
+
+// a whole number in [0, max], or false for a value that isn't one
+static bool get_int_option(JSContextRef ctx, JSObjectRef options,
+                           const char *name, int max, int *out) {
+  JSValueRef value = get_option(ctx, options, name);
+  if (JSValueIsUndefined(ctx, value)) {
+    return true;
+  }
+
+  double number = JSValueToNumber(ctx, value, NULL);
+  if (!(number >= 0 && number <= max) || number != (int)number) {
+    return false;
+  }
+
+  *out = (int)number;
+  return true;
+}
+
+bool get_socket_options(JSContextRef ctx, JSValueRef value,
+                        SocketOptions *options, JSValueRef *js_err_str) {
+  init_socket_options(options);
+  if (JSValueIsUndefined(ctx, value)) {
+    return true;
+  }
+
+  if (!JSValueIsObject(ctx, value)) {
+    set_js_error(ctx, "Invalid socket options", js_err_str);
+    return false;
+  }
+  JSObjectRef object = (JSObjectRef)value;
+
+  JSValueRef no_delay = get_option(ctx, object, "noDelay");
+  if (!JSValueIsUndefined(ctx, no_delay)) {
+    options->no_delay = JSValueToBoolean(ctx, no_delay);
+  }
+
+  int delay_ms = SOCKET_KEEPALIVE_DELAY_MS;
+  JSValueRef keep_alive = get_option(ctx, object, "keepAlive");
+  JSValueRef fast_open = get_option(ctx, object, "fastOpen");
+  if (!get_int_option(ctx, object, "keepAliveInitialDelay", INT32_MAX,
+                      &delay_ms) ||
+      !get_int_option(ctx, object, "sendBufferSize", INT32_MAX,
+                      &options->send_buffer_size) ||
+      !get_int_option(ctx, object, "receiveBufferSize", INT32_MAX,
+                      &options->receive_buffer_size) ||
+      !get_int_option(ctx, object, "deferAccept", INT32_MAX,
+                      &options->defer_accept) ||
+      (!JSValueIsBoolean(ctx, fast_open) &&
+       !get_int_option(ctx, object, "fastOpen", INT32_MAX,
+                       &options->fast_open))) {
+    set_js_error(ctx, "Invalid socket options", js_err_str);
+    return false;
+  }
+
+  if (!JSValueIsUndefined(ctx, keep_alive)) {
+    // the kernel counts in seconds
+    int delay = (int)(((long long)delay_ms + 999) / 1000);
+    options->keep_alive =
+        JSValueToBoolean(ctx, keep_alive) ? (delay > 0 ? delay : 1) : 0;
+  }
+
+  if (JSValueIsBoolean(ctx, fast_open)) {
+    options->fast_open =
+        JSValueToBoolean(ctx, fast_open) ? SOCKET_FASTOPEN_QUEUE : 0;
+  }
+
+  return true;
+}
+
+static int set_int_option(uv_tcp_t *socket, int level, int name, int value) {
+  uv_os_fd_t fd;
+  int fileno_result = uv_fileno((uv_handle_t *)socket, &fd);
+  if (fileno_result < 0) {
+    return fileno_result;
+  }
+
+  if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+    return uv_translate_sys_error(errno);
+  }
+  return 0;
+}
+
+static int apply_buffer_sizes(uv_tcp_t *socket, const SocketOptions *options) {
+  int result = 0;
+  if (options->send_buffer_size > 0) {
+    int value = options->send_buffer_size;
+    result = uv_send_buffer_size((uv_handle_t *)socket, &value);
+  }
+  if (result == 0 && options->receive_buffer_size > 0) {
+    int value = options->receive_buffer_size;
+    result = uv_recv_buffer_size((uv_handle_t *)socket, &value);
+  }
+  return result;
+}
+
+int apply_listen_options(uv_tcp_t *socket, const SocketOptions *options) {
+  int result = apply_buffer_sizes(socket, options);
+
+  // accept() only returns once the client has sent something, so a
+  // connection never sits idle in the server before its first read
+  if (result == 0 && options->defer_accept > 0) {
+#ifdef TCP_DEFER_ACCEPT
+    result = set_int_option(socket, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                            options->defer_accept);
+#else
+    result = UV_ENOTSUP;
+#endif
+  }
+
+  // data in the SYN from clients that have a cookie, saving a round trip
+  if (result == 0 && options->fast_open > 0) {
+#if defined(TCP_FASTOPEN) && defined(__APPLE__)
+    result = set_int_option(socket, IPPROTO_TCP, TCP_FASTOPEN, 1);
+#elif defined(TCP_FASTOPEN)
+    result = set_int_option(socket, IPPROTO_TCP, TCP_FASTOPEN,
+                            options->fast_open);
+#else
+    result = UV_ENOTSUP;
+#endif
+  }
+
+  return result;
+}
+
+int apply_socket_options(uv_tcp_t *socket, const SocketOptions *options) {
+  int result = 0;
+  if (options->no_delay >= 0) {
+    result = uv_tcp_nodelay(socket, options->no_delay);
+  }
+  if (result == 0 && options->keep_alive >= 0) {
+    result = uv_tcp_keepalive(socket, options->keep_alive > 0,
+                              options->keep_alive);
+  }
+  if (result == 0) {
+    result = apply_buffer_sizes(socket, options);
+  }
+  return result;
+}
+
+int apply_connect_options(uv_tcp_t *socket, const SocketOptions *options) {
+  int result = apply_socket_options(socket, options);
+
+  // sends the request with the SYN once the server has given this client a
+  // cookie. Only an optimization, so a kernel without it isn't an error
+  if (result == 0 && options->fast_open > 0) {
+#ifdef TCP_FASTOPEN_CONNECT
+    set_int_option(socket, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+  }
+
+  return result;
+}
@@ -0,0 +1,131 @@
+#include "core/timer_wheel.h"
+#include "constants.h"
+#include "core/libuv.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// slots are circular lists around a sentinel, so a timer can unlink itself
+// from whichever list holds it
+typedef struct {
+  uv_timer_t tick;
+  WheelTimer slots[TIMER_WHEEL_SLOTS];
+  uint64_t swept_tick; // every tick up to this one has been swept
+  size_t active_count;
+  bool initialized;
+  bool ticking;
+} TimerWheel;
+
+static THREAD_LOCAL TimerWheel wheel;
+
+static void link_timer(WheelTimer *list, WheelTimer *timer) {
+  timer->prev = list->prev;
+  timer->next = list;
+  list->prev->next = timer;
+  list->prev = timer;
+}
+
+static void unlink_timer(WheelTimer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+static void on_wheel_tick(uv_timer_t *handle) {
+  uint64_t now = uv_now(loop);
+  uint64_t now_tick = now / TIMER_WHEEL_TICK_MS;
+
+  // after a stall one turn covers every slot
+  uint64_t first = wheel.swept_tick + 1;
+  if (now_tick >= first + TIMER_WHEEL_SLOTS) {
+    first = now_tick - TIMER_WHEEL_SLOTS + 1;
+  }
+
+  // the expired timers are collected first, their callbacks may start or
+  // stop other timers in the same slot
+  WheelTimer expired = {&expired, &expired, 0, NULL};
+  for (uint64_t tick = first; tick <= now_tick; tick++) {
+    WheelTimer *slot = &wheel.slots[tick % TIMER_WHEEL_SLOTS];
+    WheelTimer *timer = slot->next;
+    while (timer != slot) {
+      WheelTimer *next = timer->next;
+      if (timer->expires <= now) {
+        unlink_timer(timer);
+        link_timer(&expired, timer);
+      }
+      timer = next;
+    }
+  }
+  wheel.swept_tick = now_tick;
+
+  while (expired.next != &expired) {
+    WheelTimer *timer = expired.next;
+    unlink_timer(timer);
+    wheel.active_count--;
+    timer->on_expire(timer);
+  }
+
+  if (wheel.active_count == 0 && wheel.ticking) {
+    uv_timer_stop(&wheel.tick);
+    wheel.ticking = false;
+  }
+}
+
+void wheel_timer_start(WheelTimer *timer, uint64_t timeout_ms,
+                       void (*on_expire)(WheelTimer *timer)) {
+  if (!wheel.initialized) {
+    for (size_t i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+      wheel.slots[i].next = &wheel.slots[i];
+      wheel.slots[i].prev = &wheel.slots[i];
+    }
+    uv_timer_init(loop, &wheel.tick);
+    // the connections keep the loop alive, not their timeouts
+    uv_unref((uv_handle_t *)&wheel.tick);
+    wheel.initialized = true;
+  }
+
+  if (timer->next) {
+    unlink_timer(timer);
+  } else {
+    wheel.active_count++;
+  }
+
+  uint64_t now = uv_now(loop);
+  if (!wheel.ticking) {
+    wheel.swept_tick = now / TIMER_WHEEL_TICK_MS;
+    uv_timer_start(&wheel.tick, on_wheel_tick, TIMER_WHEEL_TICK_MS,
+                   TIMER_WHEEL_TICK_MS);
+    wheel.ticking = true;
+  }
+
+  timer->expires = now + timeout_ms;
+  timer->on_expire = on_expire;
+
+  // the first tick at or after it expires, so sweeping that tick always
+  // fires it; never a slot already swept, it would wait a whole extra turn
+  uint64_t tick =
+      (timer->expires + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+  if (tick <= wheel.swept_tick) {
+    tick = wheel.swept_tick + 1;
+  }
+  link_timer(&wheel.slots[tick % TIMER_WHEEL_SLOTS], timer);
+}
+
+void wheel_timer_stop(WheelTimer *timer) {
+  if (!timer->next) {
+    return;
+  }
+
+  unlink_timer(timer);
+  wheel.active_count--;
+}
+
+void close_timer_wheel(void) {
+  if (wheel.initialized) {
+    uv_close((uv_handle_t *)&wheel.tick, NULL);
+    wheel.initialized = false;
+    wheel.ticking = false;
+    wheel.active_count = 0;
+  }
+}
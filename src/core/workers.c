@@ -0,0 +1,86 @@
+#include "core/workers.h"
+#include "api/events_api.h"
+#include "api/module_api.h"
+#include "core/jsc.h"
+#include "core/libuv.h"
+#include "core/timer_wheel.h"
+
+#include <JavaScriptCore/JavaScript.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <uv.h>
+
+void cleanup_js_context(JSGlobalContextRef ctx);
+
+static const char *script_path = NULL; // NULL for --eval
+static const char *script_source = NULL;
+
+static uv_thread_t *worker_threads = NULL;
+static int worker_count = 0;
+static THREAD_LOCAL bool worker_thread = false;
+
+void set_worker_script(const char *path, const char *source) {
+  script_path = path;
+  script_source = source;
+}
+
+bool is_worker_thread(void) { return worker_thread; }
+
+static void run_worker(void *arg) {
+  worker_thread = true;
+
+  uv_loop_t worker_loop;
+  int init_result = uv_loop_init(&worker_loop);
+  if (init_result < 0) {
+    fprintf(stderr, "Worker loop error: %s\n", uv_strerror(init_result));
+    return;
+  }
+  loop = &worker_loop;
+
+  init_module_cache();
+  JSGlobalContextRef ctx = create_js_context();
+  init_events_api(ctx);
+  if (script_path) {
+    set_current_module_dir(script_path);
+  }
+  execute_js(ctx, script_source);
+  run_event_loop();
+  clear_module_cache(ctx);
+  cleanup_js_context(ctx);
+
+  close_timer_wheel();
+  uv_run(&worker_loop, UV_RUN_DEFAULT); // lets the close callbacks run
+  uv_loop_close(&worker_loop);
+}
+
+void start_workers(int count) {
+  if (worker_thread || worker_threads || count <= 0 || !script_source) {
+    return;
+  }
+
+  worker_threads = malloc(count * sizeof(uv_thread_t));
+  if (!worker_threads) {
+    fprintf(stderr, "Failed to allocate memory for worker threads\n");
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    int create_result = uv_thread_create(&worker_threads[i], run_worker, NULL);
+    if (create_result < 0) {
+      fprintf(stderr, "Failed to start worker thread: %s\n",
+              uv_strerror(create_result));
+      break;
+    }
+    worker_count++;
+  }
+}
+
+void join_workers(void) {
+  for (int i = 0; i < worker_count; i++) {
+    uv_thread_join(&worker_threads[i]);
+  }
+
+  free(worker_threads);
+  worker_threads = NULL;
+  worker_count = 0;
+}
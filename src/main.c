@@ -3,8 +3,10 @@
 #include "api/module_api.h"
 #include "cli.h"
 #include "constants.h"
+#include "core/cluster.h"
 #include "core/jsc.h"
 #include "core/libuv.h"
+#include "core/workers.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +24,7 @@ void print_help() {
   printf("  --version   Print version\n");
   printf("  --help      Show help\n");
   printf("  --eval <code> Execute inline code\n");
+  printf("  --cluster=N Run the script in N worker processes\n");
 }
 
 int main(int argc, char **argv) {
@@ -30,6 +33,11 @@ int main(int argc, char **argv) {
 
   parse_result result = parse_args(argc, argv);
 
+  if (result.cluster_workers > 0 &&
+      (result.cmd == CMD_EVAL || result.cmd == CMD_RUN_FILE)) {
+    return run_cluster_master(result.cluster_workers, argc, argv);
+  }
+
   switch (result.cmd) {
   case CMD_VERSION:
     print_version();
@@ -40,7 +48,7 @@ int main(int argc, char **argv) {
     return EXIT_SUCCESS;
 
   case CMD_ERROR:
-    fprintf(stderr, "Error: --eval requires code arg\n");
+    fprintf(stderr, "Error: %s\n", result.error);
     return EXIT_FAILURE;
 
   case CMD_EVAL: {
@@ -48,8 +56,11 @@ int main(int argc, char **argv) {
     JSGlobalContextRef ctx = create_js_context();
     init_events_api(ctx);
     init_event_loop();
+    init_cluster_worker();
+    set_worker_script(NULL, result.arg);
     execute_js(ctx, result.arg);
     run_event_loop();
+    join_workers();
     clear_module_cache(ctx);
     cleanup_js_context(ctx);
     return EXIT_SUCCESS;
@@ -65,9 +76,12 @@ int main(int argc, char **argv) {
     JSGlobalContextRef ctx = create_js_context();
     init_events_api(ctx);
     init_event_loop();
+    init_cluster_worker();
     set_current_module_dir(result.arg);
+    set_worker_script(result.arg, script);
     execute_js(ctx, script);
     run_event_loop();
+    join_workers();
     clear_module_cache(ctx);
     cleanup_js_context(ctx);
     free(script);
@@ -0,0 +1,91 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_ALIGNMENT 16
+
+static size_t align_up(size_t size) {
+  return (size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+}
+
+void pool_init(ObjectPool *pool, size_t object_size, size_t objects_per_slab) {
+  // a free object holds the free list link
+  if (object_size < sizeof(void *)) {
+    object_size = sizeof(void *);
+  }
+
+  pool->object_size = align_up(object_size);
+  pool->objects_per_slab = objects_per_slab;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+}
+
+static int pool_grow(ObjectPool *pool) {
+  size_t header_size = align_up(sizeof(PoolSlab));
+  PoolSlab *slab =
+      malloc(header_size + pool->object_size * pool->objects_per_slab);
+  if (!slab) {
+    return 0;
+  }
+
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  // thread the new objects onto the free list, first one on top
+  char *objects = (char *)slab + header_size;
+  for (size_t i = pool->objects_per_slab; i > 0; i--) {
+    void *object = objects + (i - 1) * pool->object_size;
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+  }
+
+  return 1;
+}
+
+void *pool_alloc(ObjectPool *pool) {
+  if (!pool->free_list && !pool_grow(pool)) {
+    return NULL;
+  }
+
+  void *object = pool->free_list;
+  pool->free_list = *(void **)object;
+  memset(object, 0, pool->object_size);
+  return object;
+}
+
+void pool_free(ObjectPool *pool, void *object) {
+  if (!object) {
+    return;
+  }
+
+  *(void **)object = pool->free_list;
+  pool->free_list = object;
+}
+
+void buffer_pool_init(BufferPool *pool, size_t buffer_size, size_t max_idle) {
+  pool->buffer_size = buffer_size;
+  pool->idle_count = 0;
+  pool->idle = malloc(max_idle * sizeof(void *));
+  pool->max_idle = pool->idle ? max_idle : 0;
+}
+
+void *buffer_pool_acquire(BufferPool *pool) {
+  if (pool->idle_count > 0) {
+    return pool->idle[--pool->idle_count];
+  }
+
+  return malloc(pool->buffer_size);
+}
+
+void buffer_pool_release(BufferPool *pool, void *buffer) {
+  if (!buffer) {
+    return;
+  }
+
+  if (pool->idle_count < pool->max_idle) {
+    pool->idle[pool->idle_count++] = buffer;
+  } else {
+    free(buffer);
+  }
+}
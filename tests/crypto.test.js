@@ -0,0 +1,44 @@
+console.log("Starting crypto tests");
+
+function expectEqual(label, actual, expected) {
+  if (actual !== expected) {
+    console.error("FAIL:", label, "expected", expected, "got", actual);
+    process.exit(1);
+  }
+  console.log("PASS:", label);
+}
+
+// Test 1: Known digests
+console.log("\nTest 1: Known digests");
+expectEqual("sha256", crypto.createHash("sha256").update("abc").digest(),
+  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+expectEqual("crc32c", crypto.createHash("crc32c").update("1234").update("56789").digest("hex"),
+  "e3069283");
+expectEqual("xxh64", crypto.createHash("xxh64").update("abc").digest(),
+  "44bc2cf5ad770999");
+expectEqual("buffer digest length", crypto.createHash("sha256").digest("buffer").length, 32);
+
+// Test 2: fs.hashFile matches incremental hashing
+console.log("\nTest 2: fs.hashFile");
+var content = "";
+for (var i = 0; i < 500; i++) {
+  content += "record " + i + "\n";
+}
+var expected = crypto.createHash("sha256").update(content).digest();
+
+fs.writeFile("/tmp/crypto-test-input.txt", content, function(err) {
+  fs.hashFile("/tmp/crypto-test-input.txt", "sha256", function(err, digest) {
+    expectEqual("hashFile digest", digest, expected);
+
+    // Test 3: Hash tap on a pipe
+    console.log("\nTest 3: Hash tap on a pipe");
+    var hash = crypto.createHash("sha256");
+    var dest = fs.createWriteStream("/tmp/crypto-test-copy.txt");
+    fs.createReadStream("/tmp/crypto-test-input.txt").tap(hash).pipe(dest);
+
+    dest.on("finish", function() {
+      expectEqual("tapped digest", hash.digest(), expected);
+      console.log("\nAll tests passed");
+    });
+  });
+});
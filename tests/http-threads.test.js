@@ -0,0 +1,35 @@
+// Multi-threaded HTTP server tests
+// Every thread runs this whole file on its own context, so each one makes
+// its own request; the first to finish ends the process
+
+console.log("Running multi-threaded HTTP server tests...");
+
+// Test 1: threads must be a positive count
+try {
+	http.createServer(() => {}, { threads: 0 });
+	console.error("FAIL: threads: 0 should throw");
+	process.exit(1);
+} catch (e) {
+	console.log("PASS: Invalid threads option rejected");
+}
+
+// Test 2: every thread serves the same port
+const server = http.createServer((req, res) => {
+	res.end("served");
+}, { threads: 2 });
+server.listen(8086);
+
+http.get("http://localhost:8086/", (err, response) => {
+	if (err || response.statusCode !== 200 || response.body !== "served") {
+		console.error("FAIL: Threaded server request failed:", err);
+		process.exit(1);
+	}
+	console.log("PASS: Threaded server answered");
+	console.log("\nAll tests passed");
+	process.exit(0);
+});
+
+setTimeout(() => {
+	console.error("\nFAIL: Tests timed out");
+	process.exit(1);
+}, 8000);
@@ -4,7 +4,7 @@
 console.log("Running basic HTTP API tests...");
 
 let testsCompleted = 0;
-const totalTests = 3;
+const totalTests = 21;
 
 function testComplete() {
 	testsCompleted++;
@@ -48,8 +48,538 @@ http.get("http://httpbin.org/status/200", (err, response) => {
 	testComplete();
 });
 
+// Test 4: Local round trip, the client asks for Connection: close
+console.log("\nTest 4: Local request with headers");
+const localServer = http.createServer((req, res) => {
+	if (req.method !== "GET" || req.url !== "/local?x=1&name=a%20b+c" ||
+		req.getHeader("HOST") !== "localhost" || req.headers.host !== "localhost" ||
+		req.query.x !== "1" || req.query.name !== "a b c" ||
+		!Object.keys(req).includes("query")) {
+		console.error("FAIL: Unexpected request:", req.method, req.url, req.getHeader("host"));
+		process.exit(1);
+	}
+	res.writeHead(201, { "Content-Type": "text/plain", "X-Test": "yes" });
+	res.setHeader("Content-Length", 13); // streams as-is instead of chunked
+	res.write("Hello, ");
+	res.end(new Uint8Array([119, 111, 114, 108, 100, 33])); // "world!"
+});
+localServer.listen(8084);
+
+http.get("http://localhost:8084/local?x=1&name=a%20b+c", (err, response) => {
+	if (err || response.statusCode !== 201 || response.headers["X-Test"] !== "yes" ||
+		response.body !== "Hello, world!") {
+		console.error("FAIL: Local request failed:", err);
+		process.exit(1);
+	}
+	console.log("PASS: Local request served and connection closed");
+	testComplete();
+});
+
+// Test 5: write() without a Content-Length streams chunks
+console.log("\nTest 5: Chunked streaming response");
+let finished = false;
+const chunkedServer = http.createServer((req, res) => {
+	res.on("finish", () => {
+		finished = true;
+	});
+	const more = res.write("abc");
+	if (typeof more !== "boolean") {
+		console.error("FAIL: res.write should return a boolean:", more);
+		process.exit(1);
+	}
+	res.write("0123456789");
+	res.end();
+});
+chunkedServer.listen(8085);
+
+http.get("http://localhost:8085/", (err, response) => {
+	if (err || response.headers["Transfer-Encoding"] !== "chunked" ||
+		response.body !== "3\r\nabc\r\na\r\n0123456789\r\n0\r\n\r\n" || !finished) {
+		console.error("FAIL: Chunked response failed:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Chunked response framed and finish emitted");
+	testComplete();
+});
+
+// Test 6 & 7: native router, no createServer callback
+console.log("\nTest 6: Routed request with params");
+const router = http.createServer();
+router.route("GET", "/users/:id/posts/*", (req, res) => {
+	res.end(`${req.params.id}:${req.params["*"]}:${req.query.sort}`);
+});
+router.route("GET", "/users/me", (req, res) => res.end("me"));
+router.route("POST", "/teams/new", (req, res) => res.end("created"));
+router.route("GET", "/teams/:id", (req, res) => res.end(`team ${req.params.id}`));
+router.listen(8087);
+
+http.get("http://localhost:8087/users/42/posts/a/b?sort=new", (err, response) => {
+	if (err || response.statusCode !== 200 || response.body !== "42:a/b:new") {
+		console.error("FAIL: Routed request failed:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Route matched with params");
+	testComplete();
+});
+
+console.log("\nTest 7: Unmatched route gets a native 404");
+http.get("http://localhost:8087/users/42", (err, response) => {
+	if (err || response.statusCode !== 404) {
+		console.error("FAIL: Expected 404:", err, response && response.statusCode);
+		process.exit(1);
+	}
+	console.log("PASS: Unmatched route answered 404");
+	testComplete();
+});
+
+// Test 8 & 9: static files under a route
+console.log("\nTest 8: serveStatic sends a file");
+const assets = http.createServer();
+assets.route("GET", "/assets/*", http.serveStatic("/tmp", { maxAge: 60 }));
+assets.listen(8088);
+
+fs.writeFile("/tmp/http-static-test.txt", "static body", (err) => {
+	if (err) {
+		console.error("FAIL: Could not write static file:", err);
+		process.exit(1);
+	}
+
+	http.get("http://localhost:8088/assets/http-static-test.txt", (err, response) => {
+		if (err || response.statusCode !== 200 || response.body !== "static body" ||
+			response.headers["Cache-Control"] !== "public, max-age=60" ||
+			!response.headers["ETag"]) {
+			console.error("FAIL: Static file not served:", err, response);
+			process.exit(1);
+		}
+		console.log("PASS: Static file served with validators");
+		testComplete();
+	});
+});
+
+console.log("\nTest 9: serveStatic refuses to leave its root");
+http.get("http://localhost:8088/assets/%2e%2e/etc/passwd", (err, response) => {
+	if (err || response.statusCode !== 404) {
+		console.error("FAIL: Expected 404:", err, response && response.statusCode);
+		process.exit(1);
+	}
+	console.log("PASS: Traversal answered 404");
+	testComplete();
+});
+
+// Test 10: cached responses skip the handler
+console.log("\nTest 10: Response cache");
+let cachedCalls = 0;
+const cached = http.createServer((req, res) => {
+	cachedCalls++;
+	res.end(`call ${cachedCalls}`);
+}, { cache: { ttl: 5000 } });
+cached.listen(8089, { noDelay: true, keepAlive: true, sendBufferSize: 65536 });
+
+http.get("http://localhost:8089/hot", (err, first) => {
+	http.get("http://localhost:8089/hot", (err2, second) => {
+		if (err || err2 || first.body !== "call 1" || second.body !== "call 1" ||
+			cachedCalls !== 1) {
+			console.error("FAIL: Second request not served from cache:", first, second);
+			process.exit(1);
+		}
+		console.log("PASS: Second request served from cache");
+		testComplete();
+	});
+});
+
+// Test 11: requests past maxPendingRequests are shed natively
+console.log("\nTest 11: Load shedding");
+const limited = http.createServer((req, res) => {
+	setTimeout(() => res.end("slow"), 300);
+}, { maxPendingRequests: 1 });
+limited.listen(8090);
+
+let shedResponses = [];
+function checkShedding(err, response) {
+	shedResponses.push(err ? 0 : response.statusCode);
+	if (shedResponses.length < 2) return;
+
+	const stats = limited.stats();
+	shedResponses.sort();
+	if (shedResponses[0] !== 200 || shedResponses[1] !== 503 ||
+		stats.rejectedRequests !== 1 || stats.pendingRequests !== 0) {
+		console.error("FAIL: Expected one 200 and one 503:", shedResponses, stats);
+		process.exit(1);
+	}
+	console.log("PASS: Second concurrent request got a 503");
+	testComplete();
+}
+http.get("http://localhost:8090/a", checkShedding);
+http.get("http://localhost:8090/b", checkShedding);
+
+// Test 12: socket options are validated
+console.log("\nTest 12: Invalid socket options are rejected");
+try {
+	http.createServer(() => {}).listen(8091, { receiveBufferSize: -1 });
+	console.error("FAIL: Negative buffer size accepted");
+	process.exit(1);
+} catch (e) {
+	console.log("PASS: Invalid socket options threw");
+	testComplete();
+}
+
+// Test 13: req reads as a stream, a request without a body just ends
+console.log("\nTest 13: Request body stream");
+const uploads = http.createServer((req, res) => {
+	let received = 0;
+	req.on("data", (chunk) => { received += chunk.length; });
+	req.on("end", () => res.end(`received ${received}`));
+});
+uploads.listen(8092);
+
+http.get("http://localhost:8092/upload", (err, response) => {
+	if (err || response.statusCode !== 200 || response.body !== "received 0") {
+		console.error("FAIL: Body stream didn't end:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Body stream ended");
+	testComplete();
+});
+
+// Test 14: req.multipart() only takes a multipart/form-data body
+console.log("\nTest 14: Multipart needs a form body");
+const forms = http.createServer((req, res) => {
+	try {
+		req.multipart({ maxFileSize: 1024 }, () => res.end("parsed"));
+	} catch (e) {
+		res.writeHead(415);
+		res.end(String(e));
+	}
+});
+forms.listen(8093);
+
+http.get("http://localhost:8093/form", (err, response) => {
+	if (err || response.statusCode !== 415 ||
+		!response.body.includes("multipart/form-data")) {
+		console.error("FAIL: Multipart accepted a GET:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Multipart rejected a GET");
+	testComplete();
+});
+
+// Test 15: an upgrade handler leaves plain requests to the request handler
+console.log("\nTest 15: WebSocket upgrade handler");
+const sockets = http.createServer((req, res) => res.end("plain"));
+sockets.on("upgrade", (req, ws) => ws.send("hello"));
+try {
+	sockets.on("connect", () => {});
+	console.error("FAIL: Unknown server event accepted");
+	process.exit(1);
+} catch (e) {}
+sockets.listen(8094);
+
+http.get("http://localhost:8094/ws", (err, response) => {
+	if (err || response.statusCode !== 200 || response.body !== "plain") {
+		console.error("FAIL: Plain request not handled:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Plain request handled beside upgrades");
+	testComplete();
+});
+
+// Test 16: net.broadcast() adds one shared chunk to streaming responses
+console.log("\nTest 16: Broadcast to streaming responses");
+const events = http.createServer((req, res) => {
+	res.write("start\n");
+	try {
+		net.broadcast([res], "x", { highWaterMark: 0 });
+		console.error("FAIL: Broadcast accepted highWaterMark 0");
+		process.exit(1);
+	} catch (e) {}
+	const summary = net.broadcast([res, {}], "event\n");
+	if (summary.sent !== 1 || summary.closed !== 1) {
+		console.error("FAIL: Unexpected broadcast summary:", JSON.stringify(summary));
+		process.exit(1);
+	}
+	res.end("end\n");
+});
+events.listen(8095);
+
+http.get("http://localhost:8095/events", (err, response) => {
+	if (err || response.body !==
+		"6\r\nstart\n\r\n6\r\nevent\n\r\n4\r\nend\n\r\n0\r\n\r\n") {
+		console.error("FAIL: Broadcast chunk missing:", err, response && response.body);
+		process.exit(1);
+	}
+	console.log("PASS: Broadcast reached the streaming response");
+	testComplete();
+});
+
+// Test 17: pipelined requests on a kept-alive connection come back in order,
+// and the connection closes once it has idled for 5s
+console.log("\nTest 17: Keep-alive and pipelining");
+const pipelined = http.createServer((req, res) => {
+	try {
+		res.writeHead(NaN);
+		console.error("FAIL: writeHead accepted NaN");
+		process.exit(1);
+	} catch (e) {}
+	res.setHeader("X-Path", "unset");
+	const empty = req.url === "/empty";
+	res.writeHead(empty ? 204 : 200, { "x-path": req.url });
+	res.end(empty ? "" : "path " + req.url);
+});
+pipelined.listen(8096);
+
+net.connect(8096, { host: "127.0.0.1" }, (err, socket) => {
+	if (err) {
+		console.error("FAIL: Could not connect:", err);
+		process.exit(1);
+	}
+
+	let received = "";
+	let answeredAt = 0;
+	socket.on("data", (chunk) => {
+		received += chunk;
+		if (answeredAt || !received.endsWith("path /two")) return;
+
+		const first = received.indexOf("path /one");
+		const empty = received.indexOf("HTTP/1.1 204", first);
+		const second = received.indexOf("HTTP/1.1 200", empty);
+		if (received.indexOf("HTTP/1.1 200") !== 0 || first < 0 || empty < 0 ||
+			second < 0 || /content-length/i.test(received.slice(empty, second)) ||
+			received.includes("Connection: close") ||
+			received.split(/x-path:/i).length !== 4 || received.includes("unset")) {
+			console.error("FAIL: Pipelined responses out of order:", received);
+			process.exit(1);
+		}
+		answeredAt = Date.now();
+		console.log("PASS: Pipelined responses answered in order");
+	});
+	socket.on("close", () => {
+		if (!answeredAt || Date.now() - answeredAt < 4000) {
+			console.error("FAIL: Kept-alive connection closed early:", received);
+			process.exit(1);
+		}
+		console.log("PASS: Idle connection closed");
+		testComplete();
+	});
+
+	socket.write("GET /one HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+		"GET /empty HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+		"GET /two HTTP/1.1\r\nHost: localhost\r\n\r\n");
+});
+
+// Test 18: a multipart upload saves its fields and file, and a failed one
+// removes its files before calling back
+console.log("\nTest 18: Multipart upload over a raw connection");
+const saver = http.createServer((req, res) => {
+	req.multipart({ dir: "/tmp", maxFileSize: 64 }, (err, form) => {
+		const file = form.files[0];
+		if (err) {
+			fs.exists(file.path, (e, exists) => res.end(exists ? "kept" : "removed"));
+			return;
+		}
+		if (form.fields.note !== "hello" || file.field !== "doc" ||
+			file.filename !== "a.txt" || file.contentType !== "text/plain" ||
+			file.size !== 13) {
+			res.end("bad form " + JSON.stringify(form));
+			return;
+		}
+		fs.readFile(file.path, (e, data) => res.end(data === "file contents" ? "saved" : "bad file"));
+	});
+});
+saver.listen(8097);
+
+// with `split` the body goes out in two writes, cut inside a delimiter
+function postForm(fileContents, split, done) {
+	const body = "--XyZ\r\nContent-Disposition: form-data; name=\"note\"\r\n\r\nhello" +
+		"\r\n--XyZ\r\nContent-Disposition: form-data; name=\"doc\"; filename=\"a.txt\"\r\n" +
+		"Content-Type: text/plain\r\n\r\n" + fileContents + "\r\n--XyZ--\r\n";
+	const at = split ? body.indexOf("\r\n--XyZ") + 4 : body.length;
+
+	net.connect(8097, { host: "127.0.0.1" }, (err, socket) => {
+		if (err) {
+			console.error("FAIL: Could not connect:", err);
+			process.exit(1);
+		}
+		let response = "";
+		socket.on("data", (chunk) => { response += chunk; });
+		socket.on("close", () => done(response));
+		socket.write("POST /upload HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n" +
+			"Content-Type: multipart/form-data; boundary=XyZ\r\n" +
+			"Content-Length: " + body.length + "\r\n\r\n" + body.slice(0, at));
+		if (split) {
+			setTimeout(() => socket.write(body.slice(at)), 50);
+		}
+	});
+}
+
+postForm("file contents", true, (response) => {
+	if (!response.endsWith("\r\n\r\nsaved")) {
+		console.error("FAIL: Multipart upload not saved:", response);
+		process.exit(1);
+	}
+	console.log("PASS: Multipart fields and file saved");
+
+	postForm("x".repeat(100), false, (failed) => {
+		if (!failed.endsWith("\r\n\r\nremoved")) {
+			console.error("FAIL: Failed upload left its file:", failed);
+			process.exit(1);
+		}
+		console.log("PASS: Failed upload removed its file");
+		testComplete();
+	});
+});
+
+// Test 19: a WebSocket handshake, then a masked text message in two
+// fragments with a ping between them, echoed back whole
+console.log("\nTest 19: WebSocket echo over a raw connection");
+const echo = http.createServer((req, res) => res.end("plain"));
+echo.on("upgrade", (req, ws) => {
+	ws.on("message", (data) => ws.send(data));
+});
+echo.listen(8098);
+
+function utf8Bytes(text) {
+	const binary = unescape(encodeURIComponent(text));
+	const bytes = [];
+	for (let i = 0; i < binary.length; i++) bytes.push(binary.charCodeAt(i));
+	return bytes;
+}
+
+function maskedFrame(fin, opcode, payload) {
+	const mask = [0x37, 0xfa, 0x21, 0x3d];
+	const frame = [(fin ? 0x80 : 0) | opcode, 0x80 | payload.length].concat(mask);
+	payload.forEach((byte, i) => frame.push(byte ^ mask[i % 4]));
+	return frame;
+}
+
+// whole server frames from `offset` on, they're unmasked and short here
+function readFrames(bytes, offset) {
+	const frames = [];
+	while (offset + 2 <= bytes.length && offset + 2 + bytes[offset + 1] <= bytes.length) {
+		const length = bytes[offset + 1];
+		frames.push({ opcode: bytes[offset] & 0x0f, fin: bytes[offset] >= 0x80,
+			payload: bytes.slice(offset + 2, offset + 2 + length) });
+		offset += 2 + length;
+	}
+	return frames;
+}
+
+net.connect(8098, { host: "127.0.0.1", encoding: "buffer" }, (err, socket) => {
+	if (err) {
+		console.error("FAIL: Could not connect:", err);
+		process.exit(1);
+	}
+
+	const text = "h\u00e9llo\u0000 w\u00f6rld \u2713";
+	const message = utf8Bytes(text);
+	// cut inside the "\u00e9", the text only has to be whole per message
+	const first = maskedFrame(false, 0x1, message.slice(0, 2));
+	const second = maskedFrame(true, 0x0, message.slice(2));
+	const ping = maskedFrame(true, 0x9, utf8Bytes("hi"));
+
+	const received = [];
+	let bodyAt = -1;
+	let closing = false;
+	let closed = false;
+	socket.on("data", (chunk) => {
+		for (let i = 0; i < chunk.length; i++) received.push(chunk[i]);
+
+		if (bodyAt < 0) {
+			const head = String.fromCharCode.apply(null, received);
+			const end = head.indexOf("\r\n\r\n");
+			if (end < 0) return;
+			if (!head.startsWith("HTTP/1.1 101") ||
+				!head.includes("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")) {
+				console.error("FAIL: Bad handshake response:", head);
+				process.exit(1);
+			}
+			bodyAt = end + 4;
+
+			// the second fragment arrives in two reads, mid mask
+			const split = 2 + 4 + 3;
+			socket.write(new Uint8Array(first.concat(ping, second.slice(0, split))));
+			setTimeout(() => socket.write(new Uint8Array(second.slice(split))), 50);
+		}
+
+		const frames = readFrames(received, bodyAt);
+		if (frames.length < 2 || closed) return;
+
+		const pong = frames[0];
+		const reply = frames[1];
+		if (pong.opcode !== 0xa || String.fromCharCode.apply(null, pong.payload) !== "hi" ||
+			reply.opcode !== 0x1 || !reply.fin ||
+			reply.payload.join() !== message.join()) {
+			console.error("FAIL: Unexpected frames:", JSON.stringify(frames));
+			process.exit(1);
+		}
+		if (frames.length === 2) {
+			if (closing) return;
+			closing = true;
+			console.log("PASS: Handshake, pong and echoed message");
+			socket.write(new Uint8Array(maskedFrame(true, 0x8, [0x03, 0xe8])));
+			return;
+		}
+		if (frames[2].opcode !== 0x8) {
+			console.error("FAIL: Expected a close frame:", JSON.stringify(frames[2]));
+			process.exit(1);
+		}
+		closed = true;
+	});
+	socket.on("close", () => {
+		if (!closed) {
+			console.error("FAIL: Connection closed without a close frame");
+			process.exit(1);
+		}
+		console.log("PASS: Close handshake");
+		testComplete();
+	});
+
+	socket.write("GET /chat HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n" +
+		"Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n" +
+		"Sec-WebSocket-Version: 13\r\n\r\n");
+});
+
 // Safety timeout
 setTimeout(() => {
 	console.error("\nFAIL: Tests timed out");
 	process.exit(1);
-}, 8000);
+}, 12000);
+
+// Test 20: text-mode net sockets keep NULs and UTF-8 split across reads
+console.log("\nTest 20: Text chunks over net sockets");
+const textServer = net.createServer((socket) => {
+	let text = "";
+	socket.on("data", (chunk) => {
+		text += chunk;
+		if (text.length < 4) return;
+		if (text !== "h\u00e9\u0000x") {
+			console.error("FAIL: Text chunks garbled:", JSON.stringify(text));
+			process.exit(1);
+		}
+		console.log("PASS: Split character and NUL arrived intact");
+		socket.end();
+		testComplete();
+	});
+});
+textServer.listen(8099, () => {});
+
+net.connect(8099, { host: "127.0.0.1" }, (err, socket) => {
+	if (err) {
+		console.error("FAIL: Could not connect:", err);
+		process.exit(1);
+	}
+	// "é" is cut in two, the second half a separate read
+	socket.write(new Uint8Array([0x68, 0xc3]));
+	setTimeout(() => socket.write(new Uint8Array([0xa9, 0x00, 0x78])), 50);
+});
+
+// Test 21: a static route that doesn't take the method falls through to
+// a param route that does, rather than answering 405
+console.log("\nTest 21: Route method mismatch backtracks");
+http.get("http://localhost:8087/teams/new", (err, response) => {
+	if (err || response.statusCode !== 200 || response.body !== "team new") {
+		console.error("FAIL: Expected the param route:", err, response && response.statusCode);
+		process.exit(1);
+	}
+	console.log("PASS: GET /teams/new matched /teams/:id");
+	testComplete();
+});
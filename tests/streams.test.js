@@ -1,5 +1,57 @@
 console.log("Starting stream tests");
 
+async function iterateStreams() {
+  var text = "";
+  var batches = 0;
+  for await (const chunk of fs.createReadStream("/tmp/stream-test-input.txt", { chunkSize: 4 })) {
+    text += chunk;
+    batches++;
+  }
+  if (text !== "Hello, streams!\nThis is line 2.\nAnd here's line 3." || batches > 13) {
+    throw new Error("unexpected iteration result: " + batches + " batches");
+  }
+  console.log("PASS: Iterated", batches, "batches");
+
+  var lines = [];
+  for await (const batch of fs.createLineReader("/tmp/stream-test-input.txt", { chunkSize: 5 })) {
+    lines = lines.concat(batch);
+    break;
+  }
+  if (lines.length === 0 || lines[0] !== "Hello, streams!") {
+    throw new Error("unexpected lines: " + lines);
+  }
+  console.log("PASS: Broke out of line iteration");
+
+  var missing = fs.createReadStream("/tmp/stream-test-missing.txt");
+  missing.on("error", function() {});
+  var rejections = 0;
+  for (var i = 0; i < 2; i++) {
+    try {
+      await missing.next();
+    } catch (e) {
+      rejections++;
+    }
+  }
+  if (rejections !== 2) {
+    throw new Error("next() after a failed open settled " + rejections + " times");
+  }
+  console.log("PASS: next() keeps rejecting after a failed open");
+
+  var tooLong = null;
+  try {
+    for await (const batch of fs.createLineReader("/tmp/stream-test-input.txt", {
+      chunkSize: 4,
+      maxLineLength: 10
+    })) {}
+  } catch (e) {
+    tooLong = e;
+  }
+  if (!tooLong || String(tooLong).indexOf("maxLineLength") === -1) {
+    throw new Error("line over maxLineLength not rejected: " + tooLong);
+  }
+  console.log("PASS: Lines over maxLineLength end the stream");
+}
+
 // First create a test file
 fs.writeFile("/tmp/stream-test-input.txt", "Hello, streams!\nThis is line 2.\nAnd here's line 3.", function(err) {
   if (err) {
@@ -82,7 +134,161 @@ fs.writeFile("/tmp/stream-test-input.txt", "Hello, streams!\nThis is line 2.\nAn
           
           writeSimple.on("finish", function() {
             console.log("PASS: Simple write completed");
-            console.log("\nAll tests passed");
+
+            // Test 6: Byte range with custom chunk size
+            console.log("\nTest 6: Byte range with custom chunk size");
+            var rangeStream = fs.createReadStream("/tmp/stream-test-input.txt", {
+              start: 7,
+              end: 13,
+              chunkSize: 3
+            });
+            var rangeChunks = [];
+
+            rangeStream.on("data", function(chunk) {
+              rangeChunks.push(chunk);
+            });
+
+            rangeStream.on("end", function() {
+              if (rangeChunks.length !== 3 || rangeChunks.join("") !== "streams") {
+                console.error("FAIL: Unexpected range chunks:", rangeChunks);
+                return;
+              }
+              console.log("PASS: Byte range read");
+
+              var truncated = false;
+              try {
+                fs.createReadStream("/tmp/stream-test-input.txt", { flags: "w" });
+                truncated = true;
+              } catch (e) {}
+              if (truncated) {
+                console.error("FAIL: Read stream accepted truncating flags");
+                return;
+              }
+              console.log("PASS: Read stream rejects truncating flags");
+
+              var badOptions = [
+                { chunkSize: NaN },
+                { highWaterMark: NaN },
+                { start: NaN },
+                { start: 1.5 },
+                { start: 0, end: 2.5 },
+                { start: 1e300 }
+              ];
+              for (var i = 0; i < badOptions.length; i++) {
+                var accepted = false;
+                try {
+                  fs.createReadStream("/tmp/stream-test-input.txt", badOptions[i]);
+                  accepted = true;
+                } catch (e) {}
+                if (accepted) {
+                  console.error("FAIL: Read stream accepted", JSON.stringify(badOptions[i]));
+                  return;
+                }
+              }
+              console.log("PASS: Read stream rejects NaN and fractional options");
+
+              // Test 7: Append mode
+              console.log("\nTest 7: Append mode");
+              var appendStream = fs.createWriteStream("/tmp/stream-test-simple.txt", {
+                flags: "a"
+              });
+              appendStream.write("Line 4\n");
+              appendStream.end();
+
+              appendStream.on("finish", function() {
+                fs.readFile("/tmp/stream-test-simple.txt", function(err, data) {
+                  if (err || data !== "Line 1\nLine 2\nLine 3\nLine 4\n") {
+                    console.error("FAIL: Append mode truncated file:", data);
+                    return;
+                  }
+                  console.log("PASS: Append mode");
+
+                  // Test 8: Line reader
+                  console.log("\nTest 8: Line reader");
+                  var lineReader = fs.createLineReader("/tmp/stream-test-input.txt", {
+                    chunkSize: 5
+                  });
+                  var lines = [];
+
+                  lineReader.on("data", function(batch) {
+                    lines = lines.concat(batch);
+                  });
+
+                  lineReader.on("end", function() {
+                    if (lines.length !== 3 || lines[1] !== "This is line 2." ||
+                        lines[2] !== "And here's line 3.") {
+                      console.error("FAIL: Unexpected lines:", lines);
+                      return;
+                    }
+                    console.log("PASS: Line reader");
+
+                    // Test 9: NDJSON reader
+                    console.log("\nTest 9: NDJSON reader");
+                    var records = '{"id":1}\n{"id":2}\n\n{"id":3}\n{"id":4}\n{"id":5}';
+                    fs.writeFile("/tmp/stream-test-input.ndjson", records, function(err) {
+                      var ndjsonReader = fs.createNDJSONReader("/tmp/stream-test-input.ndjson", {
+                        batchSize: 2
+                      });
+                      var batchSizes = [];
+                      var ids = [];
+
+                      ndjsonReader.on("data", function(batch) {
+                        batchSizes.push(batch.length);
+                        for (var i = 0; i < batch.length; i++) {
+                          ids.push(batch[i].id);
+                        }
+                      });
+
+                      ndjsonReader.on("end", function() {
+                        if (ids.join(",") !== "1,2,3,4,5" || batchSizes.join(",") !== "2,2,1") {
+                          console.error("FAIL: Unexpected NDJSON batches:", batchSizes, ids);
+                          return;
+                        }
+                        console.log("PASS: NDJSON reader");
+
+                        // Test 10: Async iteration
+                        console.log("\nTest 10: Async iteration");
+                        iterateStreams().then(function() {
+                          // Test 11: Fan out to several writables
+                          console.log("\nTest 11: pipeMany");
+                          var fast = fs.createWriteStream("/tmp/stream-test-fanout-1.txt");
+                          var slow = fs.createWriteStream("/tmp/stream-test-fanout-2.txt", {
+                            highWaterMark: 8
+                          });
+                          // fails to open, and must not hold back the other two
+                          var broken = fs.createWriteStream("/tmp/stream-test-missing-dir/out.txt", {
+                            highWaterMark: 8
+                          });
+                          broken.on("error", function() {});
+                          var finished = 0;
+
+                          function checkFanOut() {
+                            if (++finished < 2) return;
+                            fs.readFile("/tmp/stream-test-fanout-1.txt", function(err, first) {
+                              fs.readFile("/tmp/stream-test-fanout-2.txt", function(err, second) {
+                                if (first !== second || first.indexOf("line 3.") === -1) {
+                                  console.error("FAIL: Fan-out copies differ");
+                                  return;
+                                }
+                                console.log("PASS: pipeMany");
+                                console.log("\nAll tests passed");
+                              });
+                            });
+                          }
+
+                          fast.on("finish", checkFanOut);
+                          slow.on("finish", checkFanOut);
+                          fs.createReadStream("/tmp/stream-test-input.txt", { chunkSize: 4 })
+                            .pipeMany([fast, broken, slow]);
+                        }, function(err) {
+                          console.error("FAIL: Async iteration:", err);
+                        });
+                      });
+                    });
+                  });
+                });
+              });
+            });
           });
         });
       });
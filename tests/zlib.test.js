@@ -0,0 +1,162 @@
+console.log("Starting zlib tests");
+
+var text = "";
+for (var i = 0; i < 200; i++) {
+  text += "line " + i + " of some very compressible text\n";
+}
+
+// Test 1: gzip round trip
+console.log("\nTest 1: gzip round trip");
+var gzip = zlib.createGzip();
+var compressed = [];
+var compressedSize = 0;
+
+gzip.on("data", function(chunk) {
+  compressed.push(chunk);
+  compressedSize += chunk.length;
+});
+
+gzip.on("end", function() {
+  if (!(compressed[0] instanceof Uint8Array) || compressedSize >= text.length) {
+    console.error("FAIL: Unexpected gzip output size:", compressedSize);
+    return;
+  }
+  console.log("PASS: Compressed", text.length, "bytes to", compressedSize);
+
+  var gunzip = zlib.createGunzip({ encoding: "utf8" });
+  var decompressed = "";
+
+  gunzip.on("data", function(chunk) {
+    decompressed += chunk;
+  });
+
+  gunzip.on("end", function() {
+    if (decompressed !== text) {
+      console.error("FAIL: Round trip mismatch");
+      return;
+    }
+    console.log("PASS: Decompressed output matches input");
+
+    // Test 2: Pipe file through gzip
+    console.log("\nTest 2: Pipe file through gzip");
+    fs.writeFile("/tmp/zlib-test-input.txt", text, function(err) {
+      var source = fs.createReadStream("/tmp/zlib-test-input.txt");
+      var dest = fs.createWriteStream("/tmp/zlib-test-input.txt.gz");
+      source.pipe(zlib.createGzip()).pipe(dest);
+
+      dest.on("finish", function() {
+        var gzipped = fs.createReadStream("/tmp/zlib-test-input.txt.gz", {
+          encoding: "buffer"
+        });
+        var unzipper = zlib.createGunzip({ encoding: "utf8" });
+        var roundTrip = "";
+
+        unzipper.on("data", function(chunk) {
+          roundTrip += chunk;
+        });
+
+        unzipper.on("end", function() {
+          if (roundTrip !== text) {
+            console.error("FAIL: Piped round trip mismatch");
+            return;
+          }
+          console.log("PASS: Piped gzip file round trip");
+
+          // Test 3: multibyte characters split across output batches, and NULs
+          console.log("\nTest 3: Non-ASCII round trip");
+          var unicode = "";
+          for (var k = 0; k < 300; k++) {
+            unicode += "h\u00e9llo w\u00f6rld \u2713 \ud83d\ude00 \u0000" + k + "\n";
+          }
+
+          var deflate = zlib.createDeflate();
+          var deflated = [];
+          deflate.on("data", function(chunk) {
+            deflated.push(chunk);
+          });
+
+          deflate.on("end", function() {
+            var inflate = zlib.createInflate({ encoding: "utf8" });
+            var inflated = "";
+
+            inflate.on("data", function(chunk) {
+              inflated += chunk;
+            });
+
+            inflate.on("end", function() {
+              if (inflated !== unicode) {
+                console.error("FAIL: Non-ASCII round trip mismatch");
+                return;
+              }
+              console.log("PASS: Non-ASCII round trip");
+
+              // Test 4: concatenated gzip members, as `cat a.gz b.gz` makes
+              console.log("\nTest 4: Multi-member gzip");
+              var multi = zlib.createGunzip({ encoding: "utf8" });
+              var members = "";
+              multi.on("data", function(chunk) {
+                members += chunk;
+              });
+
+              multi.on("end", function() {
+                if (members !== text + text) {
+                  console.error("FAIL: Second gzip member lost");
+                  return;
+                }
+                console.log("PASS: Both gzip members decoded");
+
+                // Test 5: writes after an error throw
+                console.log("\nTest 5: Write after error");
+                var broken = zlib.createInflate();
+                broken.on("data", function() {});
+                broken.on("error", function() {
+                  var threw = false;
+                  try {
+                    broken.write("more");
+                  } catch (e) {
+                    threw = true;
+                  }
+                  if (!threw) {
+                    console.error("FAIL: Write after error was accepted");
+                    return;
+                  }
+                  console.log("PASS: Write after error throws");
+                  console.log("\nAll tests passed");
+                });
+                broken.write("not compressed data");
+              });
+
+              for (var r = 0; r < 2; r++) {
+                for (var c = 0; c < compressed.length; c++) {
+                  multi.write(compressed[c]);
+                }
+              }
+              multi.end();
+            });
+
+            // a byte at a time, so the output batches end mid-character
+            for (var m = 0; m < deflated.length; m++) {
+              for (var n = 0; n < deflated[m].length; n++) {
+                inflate.write(deflated[m].subarray(n, n + 1));
+              }
+            }
+            inflate.end();
+          });
+
+          deflate.write(unicode);
+          deflate.end();
+        });
+
+        gzipped.pipe(unzipper);
+      });
+    });
+  });
+
+  for (var j = 0; j < compressed.length; j++) {
+    gunzip.write(compressed[j]);
+  }
+  gunzip.end();
+});
+
+gzip.write(text);
+gzip.end();